@@ -0,0 +1,104 @@
+/**
+ * Host stand-in for the Arduino core, covering what the firmware and the
+ * shield library use. See host.h for how time, the bus and the UART are
+ * modeled.
+ */
+
+#ifndef _host_arduino_h_
+#define _host_arduino_h_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "binary.h"
+#include "avr/pgmspace.h"
+#include "host.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t value);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+#define F_CPU 16000000L
+
+#define _BV(bit) (1 << (bit))
+
+// Status register and interrupt control. Interrupts are taken when the
+// virtual clock advances past them with the I bit set, never in between.
+extern volatile uint8_t SREG;
+#define cli() (SREG &= ~_BV(7))
+#define sei() hostSei()
+
+// Timer1, modeled in CTC mode with the compare A interrupt
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TIMSK1;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define OCIE1A 1
+
+// Timer2, likewise; CTC mode is selected in TCCR2A
+extern volatile uint8_t TCCR2A;
+extern volatile uint8_t TCCR2B;
+extern volatile uint8_t TIMSK2;
+extern volatile uint8_t TCNT2;
+extern volatile uint8_t OCR2A;
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define WGM21 1
+#define OCIE2A 1
+
+#define ISR(vector) extern "C" void vector()
+extern "C" void TIMER1_COMPA_vect();
+extern "C" void TIMER2_COMPA_vect();
+
+// Waits for the next interrupt
+void yield();
+
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 64
+#endif
+
+class HardwareSerial {
+public:
+	void begin(unsigned long baud);
+	void end();
+	int available();
+	int peek();
+	int read();
+	size_t write(uint8_t value);
+	void flush();
+	unsigned long baud();
+private:
+	unsigned long _baud;
+};
+
+extern HardwareSerial Serial;
+
+#endif /* _host_arduino_h_ */
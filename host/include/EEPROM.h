@@ -0,0 +1,41 @@
+/**
+ * Host stand-in for the Arduino EEPROM library. The contents start out
+ * erased (0xff) and live for the lifetime of the process.
+ */
+
+#ifndef _host_eeprom_h_
+#define _host_eeprom_h_
+
+#include <stdint.h>
+#include <string.h>
+
+#define HOST_EEPROM_SIZE 1024
+
+extern uint8_t hostEeprom[HOST_EEPROM_SIZE];
+
+struct EEPROMClass {
+	uint8_t read(int address) {
+		return hostEeprom[address];
+	}
+	void write(int address, uint8_t value) {
+		hostEeprom[address] = value;
+	}
+	void update(int address, uint8_t value) {
+		hostEeprom[address] = value;
+	}
+	uint16_t length() {
+		return HOST_EEPROM_SIZE;
+	}
+	template<typename T> T &get(int address, T &value) {
+		memcpy(&value, hostEeprom + address, sizeof(T));
+		return value;
+	}
+	template<typename T> const T &put(int address, const T &value) {
+		memcpy(hostEeprom + address, &value, sizeof(T));
+		return value;
+	}
+};
+
+extern EEPROMClass EEPROM;
+
+#endif /* _host_eeprom_h_ */
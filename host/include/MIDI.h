@@ -0,0 +1,320 @@
+/**
+ * Host stand-in for the Arduino MIDI Library (4.x API subset used by the
+ * firmware). Parsing follows the library's defaults: one byte is consumed
+ * per read(), running status is honored, Note On with velocity 0 is
+ * reported as Note Off, real-time bytes are dispatched immediately and
+ * SysEx messages longer than the buffer are dropped.
+ */
+
+#ifndef _host_midi_h_
+#define _host_midi_h_
+
+#include "Arduino.h"
+
+#define MIDI_CHANNEL_OMNI 0
+#define MIDI_CHANNEL_OFF 17
+
+#ifndef MIDI_SYSEX_ARRAY_SIZE
+#define MIDI_SYSEX_ARRAY_SIZE 128
+#endif
+
+namespace midi {
+
+enum MidiType {
+	InvalidType = 0x00,
+	NoteOff = 0x80,
+	NoteOn = 0x90,
+	AfterTouchPoly = 0xa0,
+	ControlChange = 0xb0,
+	ProgramChange = 0xc0,
+	AfterTouchChannel = 0xd0,
+	PitchBend = 0xe0,
+	SystemExclusive = 0xf0,
+	Clock = 0xf8,
+	Start = 0xfa,
+	Continue = 0xfb,
+	Stop = 0xfc,
+	ActiveSensing = 0xfe,
+	SystemReset = 0xff
+};
+
+class MidiInterface {
+public:
+	MidiInterface(HardwareSerial &serial) {
+		memset(this, 0, sizeof(*this));
+		mSerialPtr = &serial;
+	}
+
+	void begin(byte channel = 1) {
+		mSerialPtr->begin(31250);
+		mInputChannel = channel;
+		mRunningStatus = 0;
+		mPendingIndex = 0;
+		mPendingLength = 0;
+	}
+
+	void turnThruOff() {
+	}
+
+	byte getInputChannel() const {
+		return mInputChannel;
+	}
+
+	bool read() {
+		if (mInputChannel >= MIDI_CHANNEL_OFF || !mSerialPtr->available()) {
+			return false;
+		}
+		return parse((byte) mSerialPtr->read());
+	}
+
+	void sendNoteOn(byte note, byte velocity, byte channel) {
+		send(NoteOn, note, velocity, channel);
+	}
+
+	void sendNoteOff(byte note, byte velocity, byte channel) {
+		send(NoteOff, note, velocity, channel);
+	}
+
+	void sendControlChange(byte number, byte value, byte channel) {
+		send(ControlChange, number, value, channel);
+	}
+
+	void sendProgramChange(byte number, byte channel) {
+		mSerialPtr->write(ProgramChange | ((channel - 1) & 0x0f));
+		mSerialPtr->write(number & 0x7f);
+	}
+
+	void sendSysEx(unsigned length, const byte *array, bool containsBoundaries = false) {
+		if (!containsBoundaries) {
+			mSerialPtr->write(0xf0);
+		}
+		for (unsigned i = 0; i < length; i++) {
+			mSerialPtr->write(array[i]);
+		}
+		if (!containsBoundaries) {
+			mSerialPtr->write(0xf7);
+		}
+	}
+
+	void sendRealTime(MidiType type) {
+		mSerialPtr->write(type);
+	}
+
+	void setHandleNoteOff(void (*fptr)(byte, byte, byte)) {
+		mNoteOff = fptr;
+	}
+	void setHandleNoteOn(void (*fptr)(byte, byte, byte)) {
+		mNoteOn = fptr;
+	}
+	void setHandleAfterTouchPoly(void (*fptr)(byte, byte, byte)) {
+		mAfterTouchPoly = fptr;
+	}
+	void setHandleControlChange(void (*fptr)(byte, byte, byte)) {
+		mControlChange = fptr;
+	}
+	void setHandleProgramChange(void (*fptr)(byte, byte)) {
+		mProgramChange = fptr;
+	}
+	void setHandleAfterTouchChannel(void (*fptr)(byte, byte)) {
+		mAfterTouchChannel = fptr;
+	}
+	void setHandlePitchBend(void (*fptr)(byte, int)) {
+		mPitchBend = fptr;
+	}
+	void setHandleSystemExclusive(void (*fptr)(byte *, unsigned)) {
+		mSystemExclusive = fptr;
+	}
+	void setHandleClock(void (*fptr)(void)) {
+		mClock = fptr;
+	}
+	void setHandleStart(void (*fptr)(void)) {
+		mStart = fptr;
+	}
+	void setHandleContinue(void (*fptr)(void)) {
+		mContinue = fptr;
+	}
+	void setHandleStop(void (*fptr)(void)) {
+		mStop = fptr;
+	}
+
+private:
+	void send(MidiType type, byte data1, byte data2, byte channel) {
+		mSerialPtr->write(type | ((channel - 1) & 0x0f));
+		mSerialPtr->write(data1 & 0x7f);
+		mSerialPtr->write(data2 & 0x7f);
+	}
+
+	static byte dataLength(byte status) {
+		switch (status & 0xf0) {
+		case ProgramChange:
+		case AfterTouchChannel:
+			return 1;
+		default:
+			return 2;
+		}
+	}
+
+	bool parse(byte value) {
+		if (value >= 0xf8) {
+			return dispatchRealTime(value);
+		}
+
+		if (value & 0x80) {
+			if (mSysExLength && value != 0xf7) {
+				mSysExLength = 0; // aborted by a new status
+			}
+			if (value == 0xf0) {
+				mRunningStatus = 0;
+				mSysExOverflow = false;
+				mSysEx[0] = value;
+				mSysExLength = 1;
+				return false;
+			}
+			if (value == 0xf7) {
+				if (!mSysExLength) {
+					return false;
+				}
+				bool complete = !mSysExOverflow;
+				if (complete) {
+					mSysEx[mSysExLength++] = value;
+					if (mSystemExclusive) {
+						mSystemExclusive(mSysEx, mSysExLength);
+					}
+				}
+				mSysExLength = 0;
+				return complete;
+			}
+			if (value >= 0xf0) {
+				mRunningStatus = 0; // system common, not used
+				return false;
+			}
+			mRunningStatus = value;
+			mPendingIndex = 0;
+			mPendingLength = dataLength(value);
+			return false;
+		}
+
+		if (mSysExLength) {
+			if (mSysExLength < MIDI_SYSEX_ARRAY_SIZE - 1) {
+				mSysEx[mSysExLength++] = value;
+			} else {
+				mSysExOverflow = true;
+			}
+			return false;
+		}
+
+		if (!mRunningStatus) {
+			return false;
+		}
+		mPending[mPendingIndex++] = value;
+		if (mPendingIndex < mPendingLength) {
+			return false;
+		}
+		mPendingIndex = 0;
+		return dispatch(mRunningStatus, mPending[0], mPending[1]);
+	}
+
+	bool dispatch(byte status, byte data1, byte data2) {
+		byte channel = (status & 0x0f) + 1;
+		if (mInputChannel != MIDI_CHANNEL_OMNI && channel != mInputChannel) {
+			return false;
+		}
+		switch (status & 0xf0) {
+		case NoteOn:
+			if (data2 == 0) {
+				if (mNoteOff) {
+					mNoteOff(channel, data1, data2);
+				}
+			} else if (mNoteOn) {
+				mNoteOn(channel, data1, data2);
+			}
+			break;
+		case NoteOff:
+			if (mNoteOff) {
+				mNoteOff(channel, data1, data2);
+			}
+			break;
+		case AfterTouchPoly:
+			if (mAfterTouchPoly) {
+				mAfterTouchPoly(channel, data1, data2);
+			}
+			break;
+		case ControlChange:
+			if (mControlChange) {
+				mControlChange(channel, data1, data2);
+			}
+			break;
+		case ProgramChange:
+			if (mProgramChange) {
+				mProgramChange(channel, data1);
+			}
+			break;
+		case AfterTouchChannel:
+			if (mAfterTouchChannel) {
+				mAfterTouchChannel(channel, data1);
+			}
+			break;
+		case PitchBend:
+			if (mPitchBend) {
+				mPitchBend(channel, (int) ((data2 << 7) | data1) - 8192);
+			}
+			break;
+		}
+		return true;
+	}
+
+	bool dispatchRealTime(byte value) {
+		void (*fptr)(void) = 0;
+		switch (value) {
+		case Clock:
+			fptr = mClock;
+			break;
+		case Start:
+			fptr = mStart;
+			break;
+		case Continue:
+			fptr = mContinue;
+			break;
+		case Stop:
+			fptr = mStop;
+			break;
+		}
+		if (fptr) {
+			fptr();
+		}
+		return true;
+	}
+
+	HardwareSerial *mSerialPtr;
+	byte mInputChannel;
+	byte mRunningStatus;
+	byte mPending[2];
+	byte mPendingIndex;
+	byte mPendingLength;
+	byte mSysEx[MIDI_SYSEX_ARRAY_SIZE];
+	unsigned mSysExLength;
+	bool mSysExOverflow;
+
+	void (*mNoteOff)(byte, byte, byte);
+	void (*mNoteOn)(byte, byte, byte);
+	void (*mAfterTouchPoly)(byte, byte, byte);
+	void (*mControlChange)(byte, byte, byte);
+	void (*mProgramChange)(byte, byte);
+	void (*mAfterTouchChannel)(byte, byte);
+	void (*mPitchBend)(byte, int);
+	void (*mSystemExclusive)(byte *, unsigned);
+	void (*mClock)(void);
+	void (*mStart)(void);
+	void (*mContinue)(void);
+	void (*mStop)(void);
+};
+
+} // namespace midi
+
+#define MIDI_CREATE_INSTANCE(Type, SerialPort, Name) \
+	midi::MidiInterface Name((Type &) SerialPort);
+
+#define MIDI_CREATE_DEFAULT_INSTANCE() \
+	MIDI_CREATE_INSTANCE(HardwareSerial, Serial, MIDI)
+
+#endif /* _host_midi_h_ */
@@ -0,0 +1,4 @@
+/**
+ * Host stand-in for the Arduino MIDI Library's MIDI.hpp. Everything lives
+ * in MIDI.h on the host.
+ */
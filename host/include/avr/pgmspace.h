@@ -0,0 +1,19 @@
+/**
+ * Host stand-in for avr/pgmspace.h. Flash and RAM share one address space
+ * on the host, so program memory reads are plain loads.
+ */
+
+#ifndef _host_pgmspace_h_
+#define _host_pgmspace_h_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *) (addr))
+#define pgm_read_word(addr) (*(const uint16_t *) (addr))
+#define pgm_read_dword(addr) (*(const uint32_t *) (addr))
+#define memcpy_P memcpy
+
+#endif /* _host_pgmspace_h_ */
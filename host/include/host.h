@@ -0,0 +1,71 @@
+/**
+ * Host-side hooks for running the firmware off the board.
+ *
+ * The firmware sources are compiled unchanged with YMZ_HOST defined. Time
+ * is virtual: delay() advances the clock instantly and the host driver
+ * advances it between events. Timer1 and Timer2 interrupts fire as the
+ * clock passes them. The shield's bus primitives land here
+ * instead of on the AVR ports, and the UART is a ring buffer the driver
+ * pushes bytes into.
+ *
+ * Runs are reproducible: nothing reads the host's own clock, and events
+ * due at the same time always run in the same order. Compare matches due
+ * at or before a time are taken before the clock reaches it, so before
+ * anything the driver does at that time. When both timers match on the
+ * same cycle, Timer2 goes first, as the AVR's vector priority has it.
+ */
+
+#ifndef _host_h_
+#define _host_h_
+
+#include <stdint.h>
+
+/**
+ * Virtual clock, in microseconds since reset.
+ */
+uint64_t hostMicros();
+void hostAdvance(uint64_t us);
+void hostAdvanceTo(uint64_t us);
+
+/**
+ * Sets the I bit and takes any interrupt that came due while it was clear.
+ */
+void hostSei();
+
+/**
+ * Bus model for the shield's 74HC595 + YMZ284 interface. _busAddress() and
+ * _busData() drive SEL, _shiftOut() latches the shifter and the chip strobes
+ * clock the shifter into the selected chips. Complete register writes are
+ * reported to the sink with the chip index of the register file they belong
+ * to (0 = PSG0, 1 = PSG1).
+ */
+typedef void (*HostBusSink)(void *context, uint64_t time, uint8_t chip,
+		uint8_t reg, uint8_t value);
+
+void hostBusSetSink(HostBusSink sink, void *context);
+void hostBusSetCost(uint32_t shiftNs, uint32_t strobeNs);
+void hostBusSelect(bool data);
+void hostBusShift(uint8_t value);
+void hostBusStrobe(uint8_t chipMask);
+uint32_t hostBusWrites();
+
+/**
+ * Hardware UART receive side. Returns false if the byte was dropped
+ * because the ring buffer was full.
+ */
+bool hostSerialPush(uint8_t value);
+uint16_t hostSerialPending();
+uint32_t hostSerialDropped();
+
+/**
+ * Bytes the firmware transmitted, for tools that want to look at them.
+ */
+typedef void (*HostSerialSink)(void *context, uint8_t value);
+void hostSerialSetSink(HostSerialSink sink, void *context);
+
+/**
+ * Put every piece of host state back to power-on.
+ */
+void hostReset();
+
+#endif /* _host_h_ */
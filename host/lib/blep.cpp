@@ -0,0 +1,450 @@
+#include "blep.h"
+
+#include <math.h>
+#include <string.h>
+
+#define ENV_CONT 0x08
+#define ENV_ATT 0x04
+#define ENV_ALT 0x02
+#define ENV_HOLD 0x01
+
+#define BLEP_HALF (BLEP_TAPS / 2)
+#define BLEP_CUTOFF 0.45 // of the output rate
+#define DC_POLE 0.9995f
+#define LFSR_BITS 17
+
+// four lanes of the impulse at a time; the unaligned type is for the
+// delta buffers, which an impulse can start anywhere in
+typedef float v4f __attribute__((vector_size(16)));
+typedef float v4fu __attribute__((vector_size(16), aligned(4)));
+typedef float v2f __attribute__((vector_size(8)));
+
+/**
+ * Band-limited impulses, one per fraction of an output sample, each summing
+ * to 1 so a step integrates to exactly its height.
+ */
+struct BlepKernel {
+	alignas(16) float taps[BLEP_PHASES][BLEP_TAPS];
+
+	BlepKernel() {
+		for (int phase = 0; phase < BLEP_PHASES; phase++) {
+			double sum = 0;
+			double impulse[BLEP_TAPS];
+			for (int i = 0; i < BLEP_TAPS; i++) {
+				double x = i - (BLEP_HALF - 1) - (double) phase / BLEP_PHASES;
+				double window = 0.42 + 0.5 * cos(M_PI * x / BLEP_HALF)
+						+ 0.08 * cos(2 * M_PI * x / BLEP_HALF);
+				double arg = 2 * BLEP_CUTOFF * M_PI * x;
+				impulse[i] = window * ((x == 0) ? 1 : sin(arg) / arg);
+				sum += impulse[i];
+			}
+			for (int i = 0; i < BLEP_TAPS; i++) {
+				taps[phase][i] = impulse[i] / sum;
+			}
+		}
+	}
+};
+
+static const BlepKernel blepKernel;
+
+static inline uint32_t lfsrShift(uint32_t lfsr) {
+	return (lfsr >> 1) | (((lfsr ^ (lfsr >> 3)) & 1) << 16);
+}
+
+/**
+ * The noise LFSR is linear, so 2^n shifts are a fixed matrix over GF(2):
+ * column b of jumps[n] is where state bit b ends up. Any number of shifts
+ * is then at most LFSR_BITS matrix products.
+ */
+struct LfsrJumps {
+	uint32_t jumps[64][LFSR_BITS];
+
+	LfsrJumps() {
+		for (int b = 0; b < LFSR_BITS; b++) {
+			jumps[0][b] = lfsrShift(1 << b);
+		}
+		for (int n = 1; n < 64; n++) {
+			for (int b = 0; b < LFSR_BITS; b++) {
+				jumps[n][b] = apply(n - 1, jumps[n - 1][b]);
+			}
+		}
+	}
+
+	uint32_t apply(int n, uint32_t lfsr) const {
+		uint32_t out = 0;
+		for (int b = 0; lfsr; b++, lfsr >>= 1) {
+			if (lfsr & 1) {
+				out ^= jumps[n][b];
+			}
+		}
+		return out;
+	}
+
+	uint32_t advance(uint32_t lfsr, uint64_t shifts) const {
+		for (int n = 0; shifts; n++, shifts >>= 1) {
+			if (shifts & 1) {
+				lfsr = apply(n, lfsr);
+			}
+		}
+		return lfsr;
+	}
+};
+
+static const LfsrJumps lfsrJumps;
+
+/**
+ * One envelope step, with the shape rules at the end of each ramp, as in
+ * Ymz284.
+ */
+static void envelopeStep(uint8_t shape, uint8_t &pos, bool &attack, bool &holding) {
+	if (holding || ++pos < 32) {
+		return;
+	}
+	if (!(shape & ENV_CONT)) {
+		holding = true;
+		attack = false;
+		pos = 31;
+	} else if (shape & ENV_HOLD) {
+		holding = true;
+		pos = 31;
+		if (shape & ENV_ALT) {
+			attack = !attack;
+		}
+	} else {
+		pos = 0;
+		if (shape & ENV_ALT) {
+			attack = !attack;
+		}
+	}
+}
+
+BlepRenderer::BlepRenderer(uint32_t rate) :
+		_rate(rate), _done(0), _base(0) {
+	_step = ((uint64_t) rate << 32) / BLEP_HALF_TICK_RATE;
+	for (Chip &c : _chips) {
+		memset(c.regs, 0, sizeof(c.regs));
+		for (int i = 0; i < 3; i++) {
+			c.tonePeriod[i] = 2;
+			c.toneNext[i] = 2;
+		}
+		c.toneOut = 0;
+		c.noisePeriod = 8;
+		c.noiseNext = 8;
+		c.lfsr = 1;
+		c.envPeriod = 2;
+		c.envNext = 2;
+		c.envPos = 0;
+		c.envAttack = false;
+		c.envHolding = false;
+		c.toneAudible = 0;
+		c.toneFast = 0;
+		c.envChannels = 0;
+		for (int i = 0; i < 3; i++) {
+			c.scale[i] = 1;
+			c.fixed[i] = 0;
+		}
+		c.noiseAudible = false;
+		c.envAudible = false;
+		c.level = 0;
+	}
+	for (int i = 0; i < 2; i++) {
+		memset(_delta[i], 0, sizeof(_delta[i]));
+		_used[i] = 0;
+		_level[i] = 0;
+		_dcIn[i] = 0;
+		_dcOut[i] = 0;
+	}
+}
+
+uint32_t BlepRenderer::rate() const {
+	return _rate;
+}
+
+const std::vector<int16_t> &BlepRenderer::samples() const {
+	return _samples;
+}
+
+void BlepRenderer::busSink(void *context, uint64_t time, uint8_t chip, uint8_t reg, uint8_t value) {
+	((BlepRenderer *) context)->write(time, chip, reg, value);
+}
+
+/**
+ * Output level of a chip, 0 .. 3, from its generators and the channel
+ * levels write() worked out.
+ */
+float BlepRenderer::mix(const Chip &c) const {
+	uint8_t mixer = c.regs[0x07];
+	uint8_t tone = c.toneOut | c.toneFast | mixer;
+	uint8_t noise = ((c.lfsr & 1) ? 0x07 : 0) | (mixer >> 3);
+	uint8_t on = tone & noise & 0x07;
+	if (!on) {
+		return 0;
+	}
+	float env = Ymz284::dac[c.envAttack ? c.envPos : (31 - c.envPos)];
+	float out = 0;
+	for (int i = 0; i < 3; i++) {
+		if (on & (1 << i)) {
+			out += (c.envChannels & (1 << i)) ? env * c.scale[i] : c.fixed[i];
+		}
+	}
+	return out;
+}
+
+/**
+ * Add a step of delta at a time to one side's deltas as a band-limited
+ * impulse, BLEP_TAPS wide around it. _delta[x][i] is output sample
+ * _base + i - BLEP_HALF; the first BLEP_HALF are behind the output and only
+ * there so the impulses of the first edges have somewhere to start.
+ * renderTo() never runs further ahead than the block holds.
+ */
+void BlepRenderer::addStep(uint8_t side, uint64_t time, float delta) {
+	uint64_t pos = time * _step;
+	uint32_t phase = (uint32_t) pos / (uint32_t) ((1ULL << 32) / BLEP_PHASES);
+	uint32_t at = (pos >> 32) + 1 - _base;
+	const v4f *taps = (const v4f *) blepKernel.taps[phase];
+	v4fu *out = (v4fu *) &_delta[side][at];
+	v4f scale = { delta, delta, delta, delta };
+	for (int i = 0; i < BLEP_TAPS / 4; i++) {
+		out[i] += taps[i] * scale;
+	}
+	if (_used[side] < at + BLEP_TAPS) {
+		_used[side] = at + BLEP_TAPS;
+	}
+}
+
+/**
+ * Bring the generators nobody can hear up to now, in closed form. Those
+ * that can be heard have already been stepped there by run().
+ */
+void BlepRenderer::catchUp(Chip &c, uint64_t now) {
+	for (int i = 0; i < 3; i++) {
+		if (c.toneNext[i] <= now) {
+			uint64_t edges = (now - c.toneNext[i]) / c.tonePeriod[i] + 1;
+			if (edges & 1) {
+				c.toneOut ^= (1 << i);
+			}
+			c.toneNext[i] += edges * c.tonePeriod[i];
+		}
+	}
+	if (c.noiseNext <= now) {
+		uint64_t shifts = (now - c.noiseNext) / c.noisePeriod + 1;
+		c.noiseNext += shifts * c.noisePeriod;
+		c.lfsr = lfsrJumps.advance(c.lfsr, shifts);
+	}
+	if (c.envNext <= now) {
+		uint64_t steps = (now - c.envNext) / c.envPeriod + 1;
+		c.envNext += steps * c.envPeriod;
+		uint8_t shape = c.regs[0x0d];
+
+		// repeating shapes come back to the same state every two ramps
+		if ((shape & ENV_CONT) && !(shape & ENV_HOLD)) {
+			steps %= 64;
+		}
+		while (steps && !c.envHolding) {
+			uint8_t ramp = 32 - c.envPos;
+			if (steps < ramp) {
+				c.envPos += steps;
+				break;
+			}
+			steps -= ramp;
+			c.envPos = 31;
+			envelopeStep(shape, c.envPos, c.envAttack, c.envHolding);
+		}
+	}
+}
+
+/**
+ * Step a chip's audible generators through every edge up to and including
+ * until, adding a step wherever the output moves. A held envelope has no
+ * more edges; its next step time is left behind for catchUp().
+ */
+void BlepRenderer::run(uint8_t chip, uint64_t until) {
+	Chip &c = _chips[chip];
+	uint8_t side = chip ^ 1;
+	while (true) {
+		uint64_t time = UINT64_MAX;
+		for (int i = 0; i < 3; i++) {
+			if ((c.toneAudible & (1 << i)) && c.toneNext[i] < time) {
+				time = c.toneNext[i];
+			}
+		}
+		if (c.noiseAudible && c.noiseNext < time) {
+			time = c.noiseNext;
+		}
+		if (c.envAudible && !c.envHolding && c.envNext < time) {
+			time = c.envNext;
+		}
+		if (time > until) {
+			return;
+		}
+
+		for (int i = 0; i < 3; i++) {
+			if ((c.toneAudible & (1 << i)) && c.toneNext[i] == time) {
+				c.toneOut ^= (1 << i);
+				c.toneNext[i] += c.tonePeriod[i];
+			}
+		}
+		if (c.noiseAudible && c.noiseNext == time) {
+			c.lfsr = lfsrShift(c.lfsr);
+			c.noiseNext += c.noisePeriod;
+		}
+		if (c.envAudible && !c.envHolding && c.envNext == time) {
+			envelopeStep(c.regs[0x0d], c.envPos, c.envAttack, c.envHolding);
+			c.envNext += c.envPeriod;
+		}
+		float level = mix(c);
+		if (level != c.level) {
+			addStep(side, time, (level - c.level) / 3.0f);
+			c.level = level;
+		}
+	}
+}
+
+void BlepRenderer::write(uint64_t time, uint8_t chip, uint8_t reg, uint8_t value) {
+	if (reg > 0x0d) {
+		return;
+	}
+	renderTo(time);
+	uint64_t now = _done;
+	Chip &c = _chips[chip & 1];
+	catchUp(c, now);
+	c.regs[reg] = value;
+
+	// a new period counts from the last edge, as the chip's counters do
+	if (reg < 0x06) {
+		int i = reg >> 1;
+		uint16_t tp = c.regs[reg & ~1] | ((c.regs[reg | 1] & 0x0f) << 8);
+		uint32_t period = 2 * (tp ? tp : 1);
+		uint64_t next = c.toneNext[i] - c.tonePeriod[i] + period;
+		c.toneNext[i] = (next > now) ? next : now + 1;
+		c.tonePeriod[i] = period;
+	} else if (reg == 0x06) {
+		uint32_t period = 4 * ((value & 0x1f) ? (value & 0x1f) : 1);
+		uint64_t next = c.noiseNext - c.noisePeriod + period;
+		c.noiseNext = (next > now) ? next : now + 1;
+		c.noisePeriod = period;
+	} else if (reg == 0x0b || reg == 0x0c) {
+		uint32_t ep = c.regs[0x0b] | (c.regs[0x0c] << 8);
+		uint32_t period = 2 * (ep ? ep : 1);
+		uint64_t next = c.envNext - c.envPeriod + period;
+		c.envNext = (next > now) ? next : now + 1;
+		c.envPeriod = period;
+	} else if (reg == 0x0d) {
+		c.envNext = now + c.envPeriod;
+		c.envPos = 0;
+		c.envAttack = (value & ENV_ATT);
+		c.envHolding = false;
+	}
+
+	c.toneAudible = 0;
+	c.toneFast = 0;
+	c.envChannels = 0;
+	c.noiseAudible = false;
+	c.envAudible = false;
+	for (int i = 0; i < 3; i++) {
+		if ((uint64_t) c.tonePeriod[i] * _rate < BLEP_HALF_TICK_RATE) {
+			c.toneFast |= (1 << i);
+		}
+		uint8_t level = c.regs[0x08 + i];
+
+		// a tone above the output's Nyquist frequency would band-limit to
+		// its average, so it is mixed in at half its level, not stepped
+		c.scale[i] = ((c.toneFast & (1 << i)) && !(c.regs[0x07] & (1 << i))) ? 0.5f : 1.0f;
+		c.fixed[i] = c.scale[i] * Ymz284::dac[(level & 0x0f) * 2 + ((level & 0x0f) ? 1 : 0)];
+		if (level & 0x10) {
+			c.envChannels |= (1 << i);
+		}
+		if (!(level & 0x1f)) {
+			continue;
+		}
+		if (!(c.regs[0x07] & (1 << i)) && !(c.toneFast & (1 << i))) {
+			c.toneAudible |= (1 << i);
+		}
+		if (!(c.regs[0x07] & (8 << i))) {
+			c.noiseAudible = true;
+		}
+		if (level & 0x10) {
+			c.envAudible = true;
+		}
+	}
+	float level = mix(c);
+	if (level != c.level) {
+		addStep(chip ^ 1, now, (level - c.level) / 3.0f);
+		c.level = level;
+	}
+}
+
+/**
+ * Integrate the deltas of output samples _base .. end - 1 into levels, take
+ * out DC as StereoRenderer does and append them, both sides at once. The
+ * impulses still to come move down to the start of the block and what
+ * they leave behind is cleared for the next edges.
+ */
+void BlepRenderer::emit(uint64_t end) {
+	if (end <= _base) {
+		return;
+	}
+	uint32_t count = end - _base;
+	const float *left = _delta[0] + BLEP_HALF;
+	const float *right = _delta[1] + BLEP_HALF;
+	v2f level = { _level[0], _level[1] };
+	v2f dcIn = { _dcIn[0], _dcIn[1] };
+	v2f dcOut = { _dcOut[0], _dcOut[1] };
+	size_t first = _samples.size();
+	_samples.resize(first + 2 * count);
+	int16_t *out = &_samples[first];
+	for (size_t i = 0; i < count; i++) {
+		v2f delta = { left[i], right[i] };
+		level += delta;
+		v2f y = level - dcIn + DC_POLE * dcOut;
+		dcIn = level;
+		dcOut = y;
+		v2f scaled = y * 32767.0f;
+		for (int side = 0; side < 2; side++) {
+			float s = scaled[side];
+			out[2 * i + side] = (int16_t) (s > 32767.0f ? 32767 : (s < -32768.0f ? -32768 : s));
+		}
+	}
+	for (int i = 0; i < 2; i++) {
+		_level[i] = level[i];
+		_dcIn[i] = dcIn[i];
+		_dcOut[i] = dcOut[i];
+		uint32_t live = (_used[i] > count) ? _used[i] - count : 0;
+		memmove(_delta[i], _delta[i] + count, live * sizeof(float));
+		memset(_delta[i] + live, 0, (_used[i] - live) * sizeof(float));
+		_used[i] = live;
+	}
+	_base = end;
+}
+
+/**
+ * Step both chips to the given time (in microseconds) and append every
+ * output sample no later edge can still reach, a block at a time.
+ */
+void BlepRenderer::renderTo(uint64_t time) {
+	uint64_t now = time / 2;
+	do {
+		uint64_t until = ((_base + BLEP_BLOCK) << 32) / _step;
+		if (until > now) {
+			until = now;
+		}
+		if (until > _done) {
+			run(0, until);
+			run(1, until);
+			_done = until;
+		}
+		uint64_t last = (_done * _step) >> 32;
+		if (last + 1 > BLEP_HALF) {
+			emit(last + 1 - BLEP_HALF);
+		}
+	} while (_done < now);
+}
+
+/**
+ * Render to the end time and flush the samples still waiting on edges that
+ * will not come.
+ */
+void BlepRenderer::finish(uint64_t time) {
+	renderTo(time);
+	emit((_done * _step) >> 32);
+}
@@ -0,0 +1,86 @@
+/**
+ * Band-limited stereo renderer for the shield's two YMZ284s.
+ *
+ * StereoRenderer steps the chips at their 250 kHz tick and box-filters the
+ * result, which costs the same however little is playing. This one jumps
+ * from one output change to the next instead: every tone edge, noise bit,
+ * envelope step or register write that moves a chip's level drops a
+ * band-limited step (a windowed-sinc impulse, integrated on the way out)
+ * into the output at its exact time. Generators that cannot be heard are
+ * not stepped at all; they are caught up in closed form when a write might
+ * make them audible. The cost follows the number of edges, not the clock.
+ *
+ * Times inside are half ticks (2 us); every edge falls on a whole tick.
+ * The impulses are BLEP_TAPS output samples wide, so samples are only
+ * final BLEP_TAPS / 2 behind the last time rendered to; finish() flushes
+ * the rest.
+ */
+
+#ifndef _blep_h_
+#define _blep_h_
+
+#include <stdint.h>
+#include <vector>
+
+#include "ymz284.h"
+
+#define BLEP_TAPS 16
+#define BLEP_PHASES 64
+#define BLEP_BLOCK 2048 // output samples rendered ahead at most
+#define BLEP_HALF_TICK_RATE (YMZ284_TICK_RATE * 2)
+
+class BlepRenderer {
+public:
+	explicit BlepRenderer(uint32_t rate = 44100);
+	void write(uint64_t time, uint8_t chip, uint8_t reg, uint8_t value);
+	void renderTo(uint64_t time);
+	void finish(uint64_t time);
+	uint32_t rate() const;
+	const std::vector<int16_t> &samples() const;
+
+	static void busSink(void *context, uint64_t time, uint8_t chip, uint8_t reg, uint8_t value);
+
+private:
+	struct Chip {
+		uint8_t regs[16];
+		uint32_t tonePeriod[3];
+		uint64_t toneNext[3];
+		uint8_t toneOut;
+		uint32_t noisePeriod;
+		uint64_t noiseNext;
+		uint32_t lfsr;
+		uint32_t envPeriod;
+		uint64_t envNext;
+		uint8_t envPos;
+		bool envAttack;
+		bool envHolding;
+		uint8_t toneAudible;
+		uint8_t toneFast; // above the output's Nyquist frequency
+		uint8_t envChannels;
+		float scale[3];   // 0.5 for a channel with a fast tone
+		float fixed[3];   // scaled DAC output of the fixed levels
+		bool noiseAudible;
+		bool envAudible;
+		float level;
+	};
+
+	void run(uint8_t chip, uint64_t until);
+	void catchUp(Chip &c, uint64_t now);
+	float mix(const Chip &c) const;
+	void addStep(uint8_t side, uint64_t time, float delta);
+	void emit(uint64_t end);
+
+	Chip _chips[2];
+	uint32_t _rate;
+	uint64_t _step;  // output samples per half tick, 32.32 fixed point
+	uint64_t _done;  // half ticks rendered so far
+	uint64_t _base;  // next output sample to emit
+	float _delta[2][BLEP_BLOCK + 2 * BLEP_TAPS];
+	uint32_t _used[2]; // deltas past these are all zero
+	float _level[2];
+	float _dcIn[2];
+	float _dcOut[2];
+	std::vector<int16_t> _samples;
+};
+
+#endif /* _blep_h_ */
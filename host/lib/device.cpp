@@ -0,0 +1,73 @@
+#include "device.h"
+
+#include "host.h"
+
+extern "C" void setup();
+extern "C" void loop();
+
+uint64_t deviceBoot() {
+	hostReset();
+	setup();
+	return hostMicros();
+}
+
+uint64_t devicePlay(const std::vector<MidiEvent> &events, uint64_t start,
+		uint64_t tailUs, const DeviceOptions &options, DeviceStats *stats) {
+	// lay the bytes out on the wire
+	struct Arrival {
+		uint64_t time;
+		uint8_t value;
+		size_t event;
+	};
+	std::vector<Arrival> arrivals;
+	uint64_t wire = start;
+	for (size_t i = 0; i < events.size(); i++) {
+		uint64_t time = start + events[i].time;
+		for (uint8_t value : events[i].bytes) {
+			wire = (time > wire) ? time : wire;
+			wire += options.byteUs;
+			arrivals.push_back({ wire, value, i });
+		}
+	}
+	uint64_t end = ((arrivals.empty()) ? start : arrivals.back().time) + tailUs;
+
+	DeviceStats local;
+	DeviceStats &s = stats ? *stats : local;
+	s.dropped = 0;
+	s.firstDrop = 0;
+	s.firstDropEvent = 0;
+	s.maxPending = 0;
+	s.wireEnd = wire - start;
+
+	size_t next = 0;
+	while (next < arrivals.size() || hostMicros() < end) {
+		while (next < arrivals.size() && arrivals[next].time <= hostMicros()) {
+			if (!hostSerialPush(arrivals[next].value) && !s.dropped++) {
+				s.firstDrop = arrivals[next].time - start;
+				s.firstDropEvent = arrivals[next].event;
+			}
+			next++;
+		}
+		uint16_t pending = hostSerialPending();
+		if (pending > s.maxPending) {
+			s.maxPending = pending;
+		}
+
+		// idle: sleep until the next byte or the next idle pass
+		if (!pending && !options.spin) {
+			uint64_t step = hostMicros() + options.idleStepUs;
+			if (next < arrivals.size() && arrivals[next].time < step) {
+				step = arrivals[next].time;
+			} else if (next >= arrivals.size() && end < step) {
+				step = end;
+			}
+			hostAdvanceTo(step);
+			if (next < arrivals.size() && arrivals[next].time <= hostMicros()) {
+				continue;
+			}
+		}
+		loop();
+		hostAdvance(options.loopUs);
+	}
+	return hostMicros();
+}
@@ -0,0 +1,55 @@
+/**
+ * Runs the firmware (setup() and loop() from ymz_synth.cpp) on the host's
+ * virtual clock. MIDI messages reach the UART the way they would over a
+ * 31,250 baud cable, one byte every 320 us and never overlapping, and
+ * loop() runs until the receive buffer is drained. Between bytes the
+ * firmware still gets a loop() pass every idle step so its millis() driven
+ * work (LED decay, software envelopes) keeps time.
+ *
+ * Each loop() pass can be charged a fixed cost on top of whatever its bus
+ * writes cost (hostBusSetCost()). With spin set, loop() runs back to back
+ * even when there is nothing to read, as it does on the board, instead of
+ * waking exactly when a byte arrives. Bytes that arrive while the firmware
+ * is busy pile up in the 64-byte receive buffer exactly as they would on
+ * the board.
+ */
+
+#ifndef _device_h_
+#define _device_h_
+
+#include <stdint.h>
+#include <vector>
+
+#include "smf.h"
+
+#define MIDI_BYTE_US 320
+
+struct DeviceOptions {
+	uint32_t idleStepUs = 1000;
+	uint32_t byteUs = MIDI_BYTE_US;
+	uint32_t loopUs = 0;
+	bool spin = false; // idle passes too cost loopUs, so bytes land anywhere in a pass
+};
+
+struct DeviceStats {
+	uint32_t dropped;       // bytes lost to a full receive buffer
+	uint64_t firstDrop;     // time of the first loss, relative to start
+	size_t firstDropEvent;  // index of the event whose byte was lost first
+	uint16_t maxPending;    // deepest the receive buffer got
+	uint64_t wireEnd;       // when the last byte finished arriving, relative to start
+};
+
+/**
+ * Power on and run setup(). Returns the virtual time setup() finished at.
+ */
+uint64_t deviceBoot();
+
+/**
+ * Feed events (timestamps relative to start) and keep running for tailUs
+ * after the last one. Returns the virtual time at the end.
+ */
+uint64_t devicePlay(const std::vector<MidiEvent> &events, uint64_t start,
+		uint64_t tailUs, const DeviceOptions &options = DeviceOptions(),
+		DeviceStats *stats = 0);
+
+#endif /* _device_h_ */
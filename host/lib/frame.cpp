@@ -0,0 +1,87 @@
+#include "serial.h"
+
+#include <string.h>
+
+#include "regstream.h"
+
+FrameEncoder::FrameEncoder() {
+	memset(_shadow, 0, sizeof(_shadow));
+	memset(_pending, 0, sizeof(_pending));
+	memset(_dirty, 0, sizeof(_dirty));
+}
+
+void FrameEncoder::write(uint8_t chips, uint8_t reg, uint8_t value) {
+	if (reg >= PSG_REGISTERS) {
+		return;
+	}
+	for (uint8_t chip = 0; chip < 2; chip++) {
+		if (chips & (1 << chip)) {
+			_pending[chip][reg] = value;
+			_dirty[chip] |= (1 << reg);
+		}
+	}
+}
+
+void FrameEncoder::frame(uint8_t chips, uint16_t dirty, const uint8_t *values, bool more,
+		std::vector<uint8_t> &out) {
+	uint8_t header[3] = { (uint8_t) (chips | (more ? REGSTREAM_MORE : 0)),
+			(uint8_t) (dirty & 0xff), (uint8_t) (dirty >> 8) };
+	uint8_t crc = 0;
+	out.push_back(REGSTREAM_SYNC);
+	for (uint8_t value : header) {
+		out.push_back(value);
+		crc = regStreamCrc(crc, value);
+	}
+	for (uint8_t reg = 0; reg < PSG_REGISTERS; reg++) {
+		if (dirty & (1 << reg)) {
+			out.push_back(values[reg]);
+			crc = regStreamCrc(crc, values[reg]);
+		}
+	}
+	out.push_back(crc);
+}
+
+unsigned FrameEncoder::flush(std::vector<uint8_t> &out) {
+	// only what changes goes out
+	for (uint8_t chip = 0; chip < 2; chip++) {
+		for (uint8_t reg = 0; reg < PSG_REGISTERS; reg++) {
+			uint16_t bit = (1 << reg);
+			if ((_dirty[chip] & bit) && reg != 0x0d && _pending[chip][reg] == _shadow[chip][reg]) {
+				_dirty[chip] &= ~bit;
+			}
+		}
+	}
+
+	// registers going to both chips alike share a frame
+	uint16_t both = _dirty[0] & _dirty[1];
+	for (uint8_t reg = 0; reg < PSG_REGISTERS; reg++) {
+		if ((both & (1 << reg)) && _pending[0][reg] != _pending[1][reg]) {
+			both &= ~(1 << reg);
+		}
+	}
+	uint16_t dirty[3] = { both, (uint16_t) (_dirty[0] & ~both), (uint16_t) (_dirty[1] & ~both) };
+	const uint8_t chips[3] = { 3, 1, 2 };
+	const uint8_t *values[3] = { _pending[0], _pending[0], _pending[1] };
+
+	unsigned count = 0;
+	int last = -1;
+	for (int i = 0; i < 3; i++) {
+		if (dirty[i]) {
+			last = i;
+		}
+	}
+	for (int i = 0; i <= last; i++) {
+		if (dirty[i]) {
+			frame(chips[i], dirty[i], values[i], i != last, out);
+			count++;
+		}
+	}
+
+	memcpy(_shadow, _pending, sizeof(_shadow));
+	memset(_dirty, 0, sizeof(_dirty));
+	return count;
+}
+
+void FrameEncoder::end(std::vector<uint8_t> &out) {
+	frame(0, 0, 0, false, out);
+}
@@ -0,0 +1,415 @@
+#include "import.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define AY_REGISTERS 14
+#define YM_CLOCK 2000000
+#define ZX_CLOCK 1773400
+#define VGM_RATE 44100
+#define VGM_DUAL_CHIP 0x40000000
+#define VGM_HALF_CLOCK 0x10
+#define TONE_MAX 0x0fff
+#define NOISE_MAX 0x1f
+#define ENVELOPE_MAX 0xffff
+#define LEVEL_ENVELOPE 0x10
+#define SHAPE_NONE 0xff
+
+struct SourceWrite {
+	uint64_t time;
+	uint8_t chip;
+	uint8_t reg;
+	uint8_t value;
+};
+
+struct Source {
+	std::string format;
+	uint32_t clock;
+	uint8_t chips;
+	std::vector<SourceWrite> writes;
+};
+
+// bits an AY register holds; YM5/YM6 keep effect flags in the rest
+static const uint8_t registerMasks[AY_REGISTERS] = {
+	0xff, 0x0f, 0xff, 0x0f, 0xff, 0x0f, 0x1f, 0x3f, 0x1f, 0x1f, 0x1f, 0xff, 0xff, 0x0f
+};
+
+static uint32_t be32(const uint8_t *p) {
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const uint8_t *p) {
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t le32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data, std::string &error) {
+	FILE *in = fopen(path.c_str(), "rb");
+	if (!in) {
+		error = "cannot open";
+		return false;
+	}
+	uint8_t buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+		data.insert(data.end(), buffer, buffer + n);
+	}
+	bool ok = !ferror(in);
+	fclose(in);
+	if (!ok) {
+		error = "read error";
+	}
+	return ok;
+}
+
+/**
+ * Frames of 14 or 16 registers, stored frame by frame or register by
+ * register. Register 13 reads 0xff in frames that leave the envelope alone.
+ */
+static void readFrames(const uint8_t *p, uint32_t frames, uint8_t registers, bool interleaved,
+		uint32_t hz, Source &source) {
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		uint64_t time = (uint64_t) frame * 1000000 / hz;
+		for (uint8_t reg = 0; reg < AY_REGISTERS; reg++) {
+			uint8_t value = interleaved ? p[reg * frames + frame] : p[frame * registers + reg];
+			if (reg == 13 && value == SHAPE_NONE) {
+				continue;
+			}
+			source.writes.push_back({ time, 0, reg, (uint8_t) (value & registerMasks[reg]) });
+		}
+	}
+}
+
+static bool parseYm(const uint8_t *data, size_t size, Source &source, std::string &error) {
+	source.clock = YM_CLOCK;
+	source.chips = 1;
+	if (!memcmp(data, "YM2!", 4) || !memcmp(data, "YM3!", 4) || !memcmp(data, "YM3b", 4)) {
+		source.format = std::string((const char *) data, 4);
+		size_t tail = memcmp(data, "YM3b", 4) ? 0 : 4;
+		uint32_t frames = (size - 4 - tail) / AY_REGISTERS;
+		readFrames(data + 4, frames, AY_REGISTERS, true, 50, source);
+		return true;
+	}
+
+	// YM5! and YM6!: big-endian header, digidrums and three strings
+	source.format = std::string((const char *) data, 4);
+	if (size < 34 || memcmp(data + 4, "LeOnArD!", 8)) {
+		error = "bad " + source.format + " header";
+		return false;
+	}
+	uint32_t frames = be32(data + 12);
+	bool interleaved = be32(data + 16) & 1;
+	uint16_t digidrums = be16(data + 20);
+	source.clock = be32(data + 22);
+	uint16_t hz = be16(data + 26);
+	size_t at = 34 + be16(data + 32);
+	for (uint16_t i = 0; i < digidrums && at + 4 <= size; i++) {
+		at += 4 + be32(data + at);
+	}
+	for (int i = 0; i < 3 && at < size; i++) {
+		at += strnlen((const char *) data + at, size - at) + 1;
+	}
+	if (!hz || at > size || (size - at) / 16 < frames) {
+		error = "truncated " + source.format + " file";
+		return false;
+	}
+	readFrames(data + at, frames, 16, interleaved, hz, source);
+	return true;
+}
+
+static bool parseVgm(const uint8_t *data, size_t size, Source &source, std::string &error) {
+	source.format = "VGM";
+	uint32_t version = (size >= 0x0c) ? le32(data + 0x08) : 0;
+	if (version < 0x151 || size < 0x80) {
+		error = "VGM before 1.51 has no AY-8910 clock";
+		return false;
+	}
+	uint32_t clock = le32(data + 0x74);
+	if (!(clock & 0x3fffffff)) {
+		error = "no AY-8910 data";
+		return false;
+	}
+	source.chips = (clock & VGM_DUAL_CHIP) ? 2 : 1;
+	source.clock = clock & 0x3fffffff;
+	if (data[0x79] & VGM_HALF_CLOCK) {
+		source.clock /= 2;
+	}
+
+	uint64_t samples = 0;
+	size_t at = 0x34 + le32(data + 0x34);
+	while (at < size) {
+		uint8_t command = data[at];
+		size_t length;
+		uint32_t wait = 0;
+		if (command == 0x66) {
+			break;
+		} else if (command == 0xa0) {
+			length = 3;
+			if (at + 2 < size) {
+				uint8_t reg = data[at + 1];
+				uint8_t chip = (reg & 0x80) ? 1 : 0;
+				reg &= 0x7f;
+				if (reg < AY_REGISTERS && chip < source.chips) {
+					uint64_t time = samples * 1000000 / VGM_RATE;
+					source.writes.push_back({ time, chip, reg, (uint8_t) (data[at + 2] & registerMasks[reg]) });
+				}
+			}
+		} else if (command == 0x61) {
+			length = 3;
+			wait = (at + 2 < size) ? data[at + 1] | (data[at + 2] << 8) : 0;
+		} else if (command == 0x62 || command == 0x63) {
+			length = 1;
+			wait = (command == 0x62) ? 735 : 882;
+		} else if ((command & 0xf0) == 0x70) {
+			length = 1;
+			wait = (command & 0x0f) + 1;
+		} else if ((command & 0xf0) == 0x80) {
+			length = 1;
+			wait = command & 0x0f;
+		} else if (command == 0x67) {
+			length = (at + 6 < size) ? 7 + le32(data + at + 3) : size - at;
+		} else if (command == 0x68) {
+			length = 12;
+		} else if (command >= 0x90 && command <= 0x95) {
+			static const uint8_t streamLengths[] = { 5, 5, 6, 11, 2, 5 };
+			length = streamLengths[command - 0x90];
+		} else if (command >= 0x30 && command <= 0x3f) {
+			length = 2;
+		} else if (command == 0x4f || command == 0x50) {
+			length = 2;
+		} else if ((command >= 0x40 && command <= 0x5f) || (command >= 0xa1 && command <= 0xbf)) {
+			length = 3;
+		} else if (command >= 0xc0 && command <= 0xdf) {
+			length = 4;
+		} else if (command >= 0xe0) {
+			length = 5;
+		} else {
+			char message[32];
+			snprintf(message, sizeof(message), "unknown VGM command 0x%02x", command);
+			error = message;
+			return false;
+		}
+		samples += wait;
+		at += length;
+	}
+	return true;
+}
+
+static bool parsePsg(const uint8_t *data, size_t size, Source &source) {
+	source.format = "PSG";
+	source.clock = ZX_CLOCK;
+	source.chips = 1;
+	uint64_t frame = 0;
+	for (size_t at = 16; at < size;) {
+		uint8_t command = data[at++];
+		if (command == 0xfd) {
+			break;
+		} else if (command == 0xff) {
+			frame++;
+		} else if (command == 0xfe) {
+			frame += (at < size) ? 4 * data[at++] : 0;
+		} else if (at < size) {
+			uint8_t value = data[at++];
+			if (command < AY_REGISTERS) {
+				source.writes.push_back({ frame * 20000, 0, command, (uint8_t) (value & registerMasks[command]) });
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Scale a period by ratio to the integer nearest in pitch: of the two
+ * integers around the exact value, the one whose ratio to it is closer
+ * to 1.
+ */
+static uint32_t scalePeriod(uint32_t period, double ratio) {
+	if (!period) {
+		return 0;
+	}
+	double exact = period * ratio;
+	uint32_t below = (uint32_t) exact;
+	if (!below) {
+		return 1;
+	}
+	return (exact * exact < (double) below * (below + 1)) ? below : below + 1;
+}
+
+/**
+ * Walks the source writes one instant at a time, keeping each source chip's
+ * registers, and writes whatever the rescaled image of the chip changes.
+ */
+class Rescaler {
+public:
+	Rescaler(const Source &source, ImportResult &result) :
+			_ratio((double) IMPORT_SHIELD_CLOCK / source.clock), _chips(source.chips), _result(result) {
+		memset(_source, 0, sizeof(_source));
+		memset(_shadow, 0xff, sizeof(_shadow));
+		memset(_tones, 0xff, sizeof(_tones));
+		memset(_envelopes, 0xff, sizeof(_envelopes));
+		memset(_noises, 0xff, sizeof(_noises));
+	}
+
+	void run(const std::vector<SourceWrite> &writes) {
+		for (size_t i = 0; i < writes.size();) {
+			uint64_t time = writes[i].time;
+			bool shape[2] = { false, false };
+			for (; i < writes.size() && writes[i].time == time; i++) {
+				const SourceWrite &write = writes[i];
+				_source[write.chip][write.reg] = write.value;
+				shape[write.chip] |= (write.reg == 13);
+			}
+			for (uint8_t chip = 0; chip < _chips; chip++) {
+				emit(time, chip, shape[chip]);
+			}
+		}
+	}
+
+private:
+	uint32_t scale(uint32_t period, uint32_t max) {
+		uint32_t scaled = scalePeriod(period, _ratio);
+		return (scaled > max) ? max : scaled;
+	}
+
+	void emit(uint64_t time, uint8_t chip, bool shape) {
+		const uint8_t *in = _source[chip];
+		uint8_t out[AY_REGISTERS];
+		uint32_t tones[3];
+		for (int voice = 0; voice < 3; voice++) {
+			tones[voice] = in[voice * 2] | ((in[voice * 2 + 1] & 0x0f) << 8);
+		}
+		uint32_t envelope = in[11] | (in[12] << 8);
+		uint32_t noise = in[6];
+		uint32_t scaledTones[3];
+		for (int voice = 0; voice < 3; voice++) {
+			scaledTones[voice] = scale(tones[voice], TONE_MAX);
+		}
+		uint32_t scaledEnvelope = scale(envelope, ENVELOPE_MAX);
+
+		// a voice playing the envelope against its tone keeps their ratio
+		for (int voice = 0; voice < 3 && envelope && tones[voice]; voice++) {
+			if (!(in[8 + voice] & LEVEL_ENVELOPE) || (in[7] & (1 << voice))) {
+				continue;
+			}
+			if (tones[voice] % envelope == 0 && scaledEnvelope * (tones[voice] / envelope) <= TONE_MAX) {
+				scaledTones[voice] = scaledEnvelope * (tones[voice] / envelope);
+				break;
+			}
+			if (envelope % tones[voice] == 0 && scaledTones[voice] * (envelope / tones[voice]) <= ENVELOPE_MAX) {
+				scaledEnvelope = scaledTones[voice] * (envelope / tones[voice]);
+				break;
+			}
+		}
+
+		for (int voice = 0; voice < 3; voice++) {
+			out[voice * 2] = scaledTones[voice] & 0xff;
+			out[voice * 2 + 1] = scaledTones[voice] >> 8;
+			account(_tones[chip][voice], tones[voice], scaledTones[voice], TONE_MAX, true);
+		}
+		out[6] = scale(noise, NOISE_MAX);
+		account(_noises[chip], noise, out[6], NOISE_MAX, false);
+		out[7] = in[7];
+		out[8] = in[8];
+		out[9] = in[9];
+		out[10] = in[10];
+		out[11] = scaledEnvelope & 0xff;
+		out[12] = scaledEnvelope >> 8;
+		account(_envelopes[chip], envelope, scaledEnvelope, ENVELOPE_MAX, false);
+		out[13] = in[13];
+
+		uint8_t chips = (_chips == 1) ? 3 : 1 << chip;
+		for (uint8_t reg = 0; reg < AY_REGISTERS; reg++) {
+			if ((reg == 13) ? shape : (_shadow[chip][reg] != out[reg])) {
+				_shadow[chip][reg] = out[reg];
+				_result.writes.push_back({ time, chips, reg, out[reg] });
+			}
+		}
+	}
+
+	/**
+	 * Count each new source period once: clamped, or how far off pitch.
+	 */
+	void account(uint32_t &last, uint32_t period, uint32_t scaled, uint32_t max, bool tone) {
+		if (period == last) {
+			return;
+		}
+		last = period;
+		if (!period) {
+			return;
+		}
+		if (scaled == max && period * _ratio > max + 0.5) {
+			_result.clamped++;
+		} else if (tone) {
+			double cents = fabs(1200 * log2(scaled / (period * _ratio)));
+			_result.maxCents = (cents > _result.maxCents) ? cents : _result.maxCents;
+		}
+	}
+
+	double _ratio;
+	uint8_t _chips;
+	ImportResult &_result;
+	uint8_t _source[2][AY_REGISTERS];
+	uint16_t _shadow[2][AY_REGISTERS];
+	uint32_t _tones[2][3];
+	uint32_t _envelopes[2];
+	uint32_t _noises[2];
+};
+
+bool importRegisterLog(const std::string &path, uint32_t clockOverride, ImportResult &result,
+		std::string &error) {
+	std::vector<uint8_t> data;
+	if (!readFile(path, data, error)) {
+		return false;
+	}
+	if (data.size() < 16) {
+		error = "too short for a register log";
+		return false;
+	}
+
+	Source source;
+	const uint8_t *p = data.data();
+	bool ok;
+	if (!memcmp(p + 2, "-lh5-", 5)) {
+		error = "LHA-packed YM file; unpack it first";
+		return false;
+	} else if (p[0] == 0x1f && p[1] == 0x8b) {
+		error = "gzipped VGM file; gunzip it first";
+		return false;
+	} else if (!memcmp(p, "YM", 2)) {
+		ok = parseYm(p, data.size(), source, error);
+	} else if (!memcmp(p, "Vgm ", 4)) {
+		ok = parseVgm(p, data.size(), source, error);
+	} else if (!memcmp(p, "PSG\x1a", 4)) {
+		ok = parsePsg(p, data.size(), source);
+	} else if (!memcmp(p, "ZXAYEMUL", 8)) {
+		error = "ZXAYEMUL files hold Z80 players; record them to PSG or VGM first";
+		return false;
+	} else {
+		error = "not a YM, VGM or PSG file";
+		return false;
+	}
+	if (!ok) {
+		return false;
+	}
+	if (clockOverride) {
+		source.clock = clockOverride;
+	}
+	if (!source.clock) {
+		error = "no chip clock";
+		return false;
+	}
+
+	result.format = source.format;
+	result.sourceClock = source.clock;
+	result.sourceChips = source.chips;
+	result.writes.clear();
+	result.clamped = 0;
+	result.maxCents = 0;
+	Rescaler rescaler(source, result);
+	rescaler.run(source.writes);
+	return true;
+}
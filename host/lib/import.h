@@ -0,0 +1,49 @@
+/**
+ * Register logs from AY-3-8910/YM2149 players, rescaled to the YMZ284.
+ *
+ * The shield's chips run at 4 MHz and divide tone and noise by 32 where an
+ * AY divides its clock by 16, so a source period p at clock c sounds the
+ * same on the YMZ284 as p * 2 MHz / c. The envelope generator steps at the
+ * same relative rate, so one ratio serves all three. Periods are rounded to
+ * the nearest pitch rather than the nearest integer and, where a channel
+ * plays the envelope as a waveform against its own tone, the two stay in
+ * the integer ratio the source had so they do not beat.
+ *
+ * Formats read: YM2!, YM3!, YM3b, YM5! and YM6! (unpacked), VGM 1.51 and
+ * later with AY-8910 data, and PSG. ZXAYEMUL .ay files hold Z80 code and
+ * need a CPU emulator to produce register writes, so they are not read.
+ */
+
+#ifndef _import_h_
+#define _import_h_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define IMPORT_SHIELD_CLOCK 2000000 // AY clock with the YMZ284's periods
+
+struct RegisterWrite {
+	uint64_t time;  // microseconds from the start of the log
+	uint8_t chips;  // 1 = PSG0, 2 = PSG1, 3 = both, as in trace.h
+	uint8_t reg;
+	uint8_t value;
+};
+
+struct ImportResult {
+	std::string format;
+	uint32_t sourceClock;
+	uint8_t sourceChips;
+	std::vector<RegisterWrite> writes; // rescaled, in time order
+	uint32_t clamped;                  // periods that did not fit the register
+	double maxCents;                   // worst tone error of the rest
+};
+
+/**
+ * Read a register log and rescale it. clockOverride replaces the clock the
+ * file states, or the format's default where it has none (0 keeps it).
+ */
+bool importRegisterLog(const std::string &path, uint32_t clockOverride, ImportResult &result,
+		std::string &error);
+
+#endif /* _import_h_ */
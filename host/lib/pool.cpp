@@ -0,0 +1,59 @@
+#include "pool.h"
+
+#include <algorithm>
+#include <thread>
+
+WorkPool::WorkPool(unsigned workers) :
+		_workers(workers ? workers : std::max(1u, std::thread::hardware_concurrency())),
+		_queues(_workers) {
+}
+
+unsigned WorkPool::workers() const {
+	return _workers;
+}
+
+/**
+ * Pop from the back of our own deque, or steal from the front of another.
+ */
+bool WorkPool::take(unsigned worker, size_t &job) {
+	for (unsigned i = 0; i < _workers; i++) {
+		Queue &queue = _queues[(worker + i) % _workers];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (queue.jobs.empty()) {
+			continue;
+		}
+		if (i == 0) {
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+		} else {
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Run fn for every job in [0, jobs) and wait for all of them. Jobs never
+ * add work, so a worker that finds every deque empty is done.
+ */
+void WorkPool::run(size_t jobs, const std::function<void(size_t job, unsigned worker)> &fn) {
+	for (size_t job = 0; job < jobs; job++) {
+		_queues[job % _workers].jobs.push_front(job);
+	}
+
+	std::vector<std::thread> threads;
+	unsigned count = (unsigned) std::min<size_t>(_workers, jobs);
+	for (unsigned worker = 0; worker < count; worker++) {
+		threads.emplace_back([this, worker, &fn]() {
+			size_t job;
+			while (take(worker, job)) {
+				fn(job, worker);
+			}
+		});
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+}
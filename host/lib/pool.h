@@ -0,0 +1,35 @@
+/**
+ * Work-stealing pool for batch host tools. Jobs are dealt round-robin onto
+ * per-worker deques; a worker takes from the back of its own deque and,
+ * once that runs dry, steals from the front of the others, so a few long
+ * jobs do not leave the remaining cores idle.
+ */
+
+#ifndef _pool_h_
+#define _pool_h_
+
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class WorkPool {
+public:
+	explicit WorkPool(unsigned workers = 0);
+	unsigned workers() const;
+	void run(size_t jobs, const std::function<void(size_t job, unsigned worker)> &fn);
+
+private:
+	struct Queue {
+		std::mutex lock;
+		std::deque<size_t> jobs;
+	};
+
+	bool take(unsigned worker, size_t &job);
+
+	unsigned _workers;
+	std::vector<Queue> _queues;
+};
+
+#endif /* _pool_h_ */
@@ -0,0 +1,57 @@
+#include "render.h"
+
+#define US_PER_TICK (1000000 / YMZ284_TICK_RATE)
+#define DC_POLE 0.9995f
+
+StereoRenderer::StereoRenderer(uint32_t rate) :
+		_rate(rate), _tick(0), _sample(0), _count(0) {
+	_boundary = (uint64_t) YMZ284_TICK_RATE / _rate;
+	_sum[0] = _sum[1] = 0;
+	_dcIn[0] = _dcIn[1] = 0;
+	_dcOut[0] = _dcOut[1] = 0;
+}
+
+uint32_t StereoRenderer::rate() const {
+	return _rate;
+}
+
+const std::vector<int16_t> &StereoRenderer::samples() const {
+	return _samples;
+}
+
+void StereoRenderer::write(uint64_t time, uint8_t chip, uint8_t reg, uint8_t value) {
+	renderTo(time);
+	_chips[chip & 1].write(reg, value);
+}
+
+void StereoRenderer::busSink(void *context, uint64_t time, uint8_t chip, uint8_t reg, uint8_t value) {
+	((StereoRenderer *) context)->write(time, chip, reg, value);
+}
+
+/**
+ * Step both chips to the given time, emitting every output sample whose
+ * window closes on the way.
+ */
+void StereoRenderer::renderTo(uint64_t time) {
+	uint64_t target = time / US_PER_TICK;
+	while (_tick < target) {
+		_sum[0] += _chips[1].tick();
+		_sum[1] += _chips[0].tick();
+		_count++;
+		if (++_tick < _boundary) {
+			continue;
+		}
+		for (int i = 0; i < 2; i++) {
+			float x = _sum[i] / (3.0f * _count);
+			float y = x - _dcIn[i] + DC_POLE * _dcOut[i];
+			_dcIn[i] = x;
+			_dcOut[i] = y;
+			float scaled = y * 32767.0f;
+			_samples.push_back((int16_t) (scaled > 32767.0f ? 32767 : (scaled < -32768.0f ? -32768 : scaled)));
+			_sum[i] = 0;
+		}
+		_count = 0;
+		_sample++;
+		_boundary = (_sample + 1) * YMZ284_TICK_RATE / _rate;
+	}
+}
@@ -0,0 +1,39 @@
+/**
+ * Stereo renderer for the shield's two YMZ284s. Register writes arrive
+ * with their bus timestamps; the chips are stepped up to each write and
+ * box-filtered down to the output rate. PSG1 is the left channel and PSG0
+ * the right, matching the firmware's CHANNEL_LEFT / CHANNEL_RIGHT.
+ */
+
+#ifndef _render_h_
+#define _render_h_
+
+#include <stdint.h>
+#include <vector>
+
+#include "ymz284.h"
+
+class StereoRenderer {
+public:
+	explicit StereoRenderer(uint32_t rate = 44100);
+	void write(uint64_t time, uint8_t chip, uint8_t reg, uint8_t value);
+	void renderTo(uint64_t time);
+	uint32_t rate() const;
+	const std::vector<int16_t> &samples() const;
+
+	static void busSink(void *context, uint64_t time, uint8_t chip, uint8_t reg, uint8_t value);
+
+private:
+	Ymz284 _chips[2];
+	uint32_t _rate;
+	uint64_t _tick;
+	uint64_t _sample;
+	uint64_t _boundary;
+	float _sum[2];
+	uint32_t _count;
+	float _dcIn[2];
+	float _dcOut[2];
+	std::vector<int16_t> _samples;
+};
+
+#endif /* _render_h_ */
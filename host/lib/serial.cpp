@@ -0,0 +1,140 @@
+#include "serial.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <asm/termbits.h>
+#else
+#include <termios.h>
+#endif
+
+/**
+ * Serial port
+ */
+SerialPort::SerialPort() :
+		_fd(-1), _tty(false) {
+}
+
+SerialPort::~SerialPort() {
+	if (_fd >= 0) {
+		close(_fd);
+	}
+}
+
+bool SerialPort::open(const std::string &path, std::string &error) {
+	_fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_CREAT, 0644);
+	if (_fd < 0) {
+		error = strerror(errno);
+		return false;
+	}
+	_tty = isatty(_fd);
+	return setBaud(MIDI_BAUD, error);
+}
+
+bool SerialPort::isTty() const {
+	return _tty;
+}
+
+bool SerialPort::setBaud(uint32_t baud, std::string &error) {
+	if (!_tty) {
+		return true;
+	}
+#ifdef __linux__
+	struct termios2 tio;
+	if (ioctl(_fd, TCGETS2, &tio) < 0) {
+		error = strerror(errno);
+		return false;
+	}
+	tio.c_iflag = 0;
+	tio.c_oflag = 0;
+	tio.c_lflag = 0;
+	tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER;
+	tio.c_ispeed = tio.c_ospeed = baud;
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	if (ioctl(_fd, TCSETS2, &tio) < 0) {
+		error = strerror(errno);
+		return false;
+	}
+#else
+	struct termios tio;
+	if (tcgetattr(_fd, &tio) < 0) {
+		error = strerror(errno);
+		return false;
+	}
+	cfmakeraw(&tio);
+	tio.c_cflag |= CREAD | CLOCAL;
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	cfsetspeed(&tio, baud);
+	if (tcsetattr(_fd, TCSANOW, &tio) < 0) {
+		error = strerror(errno);
+		return false;
+	}
+#endif
+	return true;
+}
+
+bool SerialPort::write(const std::vector<uint8_t> &bytes) {
+	size_t done = 0;
+	while (done < bytes.size()) {
+		ssize_t n = ::write(_fd, bytes.data() + done, bytes.size() - done);
+		if (n < 0 && errno != EINTR && errno != EAGAIN) {
+			return false;
+		}
+		if (n > 0) {
+			done += n;
+		}
+	}
+	return true;
+}
+
+void SerialPort::drain() {
+	if (!_tty) {
+		return;
+	}
+#ifdef __linux__
+	ioctl(_fd, TCSBRK, 1);
+#else
+	tcdrain(_fd);
+#endif
+}
+
+bool SerialPort::readSysEx(uint8_t command, std::vector<uint8_t> &message, int timeoutMs) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t deadline = now.tv_sec * 1000LL + now.tv_nsec / 1000000 + timeoutMs;
+	message.clear();
+	while (true) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int wait = (int) (deadline - (now.tv_sec * 1000LL + now.tv_nsec / 1000000));
+		if (wait < 0) {
+			return false;
+		}
+		struct pollfd fds = { _fd, POLLIN, 0 };
+		if (poll(&fds, 1, wait) <= 0) {
+			continue;
+		}
+		uint8_t value;
+		if (read(_fd, &value, 1) != 1) {
+			continue;
+		}
+		if (value == 0xf0) {
+			message.assign(1, value);
+		} else if (!message.empty()) {
+			message.push_back(value);
+		}
+		if (value == 0xf7 && message.size() >= 4) {
+			if (message[1] == 0x7d && message[2] == command) {
+				return true;
+			}
+			message.clear();
+		}
+	}
+}
@@ -0,0 +1,73 @@
+/**
+ * Host side of the firmware's register frame transport (src/regstream.h):
+ * an encoder that turns register writes into frames, and a serial port
+ * that can be switched between MIDI's 31,250 baud and the frame rates.
+ */
+
+#ifndef _serial_h_
+#define _serial_h_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define MIDI_BAUD 31250
+
+/**
+ * Collects register writes for both chips and turns each batch into the
+ * fewest frames that carry it. Writes that leave a register unchanged are
+ * dropped, except to the envelope shape, which restarts the envelope.
+ */
+class FrameEncoder {
+public:
+	FrameEncoder();
+	void write(uint8_t chips, uint8_t reg, uint8_t value);
+
+	/**
+	 * Append the frames for everything written since the last flush, all
+	 * but the last marked to wait for the next, so the batch lands as one
+	 * commit. Returns the number of frames.
+	 */
+	unsigned flush(std::vector<uint8_t> &out);
+
+	/**
+	 * Append the empty frame that hands the UART back to MIDI.
+	 */
+	static void end(std::vector<uint8_t> &out);
+
+private:
+	static void frame(uint8_t chips, uint16_t dirty, const uint8_t *values, bool more,
+			std::vector<uint8_t> &out);
+
+	uint8_t _shadow[2][16];
+	uint8_t _pending[2][16];
+	uint16_t _dirty[2];
+};
+
+/**
+ * A tty opened raw. Baud rates outside the POSIX table are set with
+ * termios2 where the platform has it. For anything that is not a tty (a
+ * pty still is) the rate is ignored, so frames can be written to a file.
+ */
+class SerialPort {
+public:
+	SerialPort();
+	~SerialPort();
+	bool open(const std::string &path, std::string &error);
+	bool setBaud(uint32_t baud, std::string &error);
+	bool isTty() const;
+	bool write(const std::vector<uint8_t> &bytes);
+	void drain();
+
+	/**
+	 * Wait up to timeoutMs for a SysEx message from the firmware (F0 7D
+	 * ... F7, boundaries included) whose command byte is command.
+	 */
+	bool readSysEx(uint8_t command, std::vector<uint8_t> &message, int timeoutMs);
+
+private:
+	int _fd;
+	bool _tty;
+};
+
+#endif /* _serial_h_ */
@@ -0,0 +1,287 @@
+#include "smf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+struct TempoChange {
+	uint64_t tick;
+	uint32_t usPerQuarter;
+};
+
+struct TickEvent {
+	uint64_t tick;
+	uint16_t track;
+	uint32_t order;
+	std::vector<uint8_t> bytes;
+};
+
+static uint32_t be32(const uint8_t *p) {
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const uint8_t *p) {
+	return (p[0] << 8) | p[1];
+}
+
+/**
+ * Read a variable-length quantity, returning false on truncation.
+ */
+static bool readVlq(const uint8_t *&p, const uint8_t *end, uint32_t &value) {
+	value = 0;
+	for (int i = 0; i < 4; i++) {
+		if (p >= end) {
+			return false;
+		}
+		uint8_t b = *p++;
+		value = (value << 7) | (b & 0x7f);
+		if (!(b & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parseTrack(const uint8_t *p, const uint8_t *end, uint16_t track,
+		std::vector<TickEvent> &events, std::vector<TempoChange> &tempos,
+		std::string &error) {
+	uint64_t tick = 0;
+	uint8_t status = 0;
+	uint32_t order = 0;
+	while (p < end) {
+		uint32_t delta;
+		if (!readVlq(p, end, delta)) {
+			error = "truncated delta time";
+			return false;
+		}
+		tick += delta;
+		if (p >= end) {
+			error = "truncated event";
+			return false;
+		}
+
+		uint8_t b = *p;
+		if (b == 0xff) {
+			// meta event; only tempo and end of track matter
+			if (end - p < 2) {
+				error = "truncated meta event";
+				return false;
+			}
+			uint8_t type = p[1];
+			p += 2;
+			uint32_t length;
+			if (!readVlq(p, end, length) || (uint32_t) (end - p) < length) {
+				error = "truncated meta event";
+				return false;
+			}
+			if (type == 0x51 && length == 3) {
+				tempos.push_back({ tick, (uint32_t) ((p[0] << 16) | (p[1] << 8) | p[2]) });
+			}
+			p += length;
+			if (type == 0x2f) {
+				return true;
+			}
+			continue;
+		}
+
+		if (b == 0xf0 || b == 0xf7) {
+			p++;
+			uint32_t length;
+			if (!readVlq(p, end, length) || (uint32_t) (end - p) < length) {
+				error = "truncated SysEx event";
+				return false;
+			}
+			TickEvent event = { tick, track, order++, { } };
+			if (b == 0xf0) {
+				event.bytes.push_back(0xf0);
+			}
+			event.bytes.insert(event.bytes.end(), p, p + length);
+			events.push_back(event);
+			p += length;
+			status = 0;
+			continue;
+		}
+
+		if (b & 0x80) {
+			status = b;
+			p++;
+		} else if (!status) {
+			error = "data byte without running status";
+			return false;
+		}
+		uint8_t length = ((status & 0xf0) == 0xc0 || (status & 0xf0) == 0xd0) ? 1 : 2;
+		if (status >= 0xf0) {
+			error = "unexpected system message";
+			return false;
+		}
+		if (end - p < length) {
+			error = "truncated channel event";
+			return false;
+		}
+		TickEvent event = { tick, track, order++, { status } };
+		event.bytes.insert(event.bytes.end(), p, p + length);
+		events.push_back(event);
+		p += length;
+	}
+	return true;
+}
+
+bool parseSmf(const uint8_t *data, size_t size, std::vector<MidiEvent> &events, std::string &error) {
+	const uint8_t *p = data;
+	const uint8_t *end = data + size;
+	if (size < 14 || memcmp(p, "MThd", 4) || be32(p + 4) < 6) {
+		error = "not a standard MIDI file";
+		return false;
+	}
+	uint16_t tracks = be16(p + 10);
+	uint16_t division = be16(p + 12);
+	p += 8 + be32(p + 4);
+
+	std::vector<TickEvent> tickEvents;
+	std::vector<TempoChange> tempos;
+	for (uint16_t track = 0; track < tracks && p + 8 <= end; track++) {
+		uint32_t length = be32(p + 4);
+		const uint8_t *body = p + 8;
+		if ((size_t) (end - body) < length) {
+			error = "truncated track";
+			return false;
+		}
+		if (!memcmp(p, "MTrk", 4)
+				&& !parseTrack(body, body + length, track, tickEvents, tempos, error)) {
+			return false;
+		}
+		p = body + length;
+	}
+
+	std::stable_sort(tickEvents.begin(), tickEvents.end(),
+			[](const TickEvent &a, const TickEvent &b) {
+				return (a.tick != b.tick) ? (a.tick < b.tick) : (a.track < b.track);
+			});
+	std::stable_sort(tempos.begin(), tempos.end(),
+			[](const TempoChange &a, const TempoChange &b) {
+				return a.tick < b.tick;
+			});
+
+	// SMPTE divisions give a fixed tick length; otherwise walk the tempo map
+	double usPerTick;
+	bool smpte = (division & 0x8000);
+	if (smpte) {
+		int fps = -(int8_t) (division >> 8);
+		usPerTick = 1000000.0 / (fps * (division & 0xff));
+	} else if (!division) {
+		error = "zero time division";
+		return false;
+	}
+
+	size_t tempo = 0;
+	uint64_t tempoTick = 0;
+	double tempoTime = 0;
+	uint32_t usPerQuarter = 500000;
+	events.clear();
+	events.reserve(tickEvents.size());
+	for (const TickEvent &event : tickEvents) {
+		double time;
+		if (smpte) {
+			time = event.tick * usPerTick;
+		} else {
+			while (tempo < tempos.size() && tempos[tempo].tick <= event.tick) {
+				tempoTime += (double) (tempos[tempo].tick - tempoTick) * usPerQuarter / division;
+				tempoTick = tempos[tempo].tick;
+				usPerQuarter = tempos[tempo].usPerQuarter;
+				tempo++;
+			}
+			time = tempoTime + (double) (event.tick - tempoTick) * usPerQuarter / division;
+		}
+		events.push_back({ (uint64_t) (time + 0.5), event.track, event.bytes });
+	}
+	return true;
+}
+
+bool readSmf(const std::string &path, std::vector<MidiEvent> &events, std::string &error) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) {
+		error = "cannot open " + path;
+		return false;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[65536];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + count);
+	}
+	fclose(file);
+	return parseSmf(data.data(), data.size(), events, error);
+}
+
+static void putVlq(std::vector<uint8_t> &out, uint32_t value) {
+	uint8_t bytes[5];
+	int count = 0;
+	do {
+		bytes[count++] = value & 0x7f;
+		value >>= 7;
+	} while (value);
+	while (count--) {
+		out.push_back(bytes[count] | (count ? 0x80 : 0));
+	}
+}
+
+static void putBe(std::vector<uint8_t> &out, uint32_t value, int bytes) {
+	while (bytes--) {
+		out.push_back(value >> (8 * bytes));
+	}
+}
+
+/**
+ * Write events (in time order) as a format 0 file, one tick per
+ * millisecond, with running status for channel messages.
+ */
+bool writeSmf(const std::string &path, const std::vector<MidiEvent> &events, std::string &error) {
+	std::vector<uint8_t> track;
+	putVlq(track, 0);
+	track.insert(track.end(), { 0xff, 0x51, 0x03 });
+	putBe(track, 1000000, 3);
+
+	uint64_t tick = 0;
+	uint8_t status = 0;
+	for (const MidiEvent &event : events) {
+		if (event.bytes.empty()) {
+			continue;
+		}
+		uint64_t at = (event.time + 500) / 1000;
+		putVlq(track, (uint32_t) ((at > tick) ? at - tick : 0));
+		tick = (at > tick) ? at : tick;
+		if (event.bytes[0] == 0xf0) {
+			track.push_back(0xf0);
+			putVlq(track, event.bytes.size() - 1);
+			track.insert(track.end(), event.bytes.begin() + 1, event.bytes.end());
+			status = 0;
+			continue;
+		}
+		size_t first = (event.bytes[0] == status) ? 1 : 0;
+		status = event.bytes[0];
+		track.insert(track.end(), event.bytes.begin() + first, event.bytes.end());
+	}
+	putVlq(track, 0);
+	track.insert(track.end(), { 0xff, 0x2f, 0x00 });
+
+	std::vector<uint8_t> file = { 'M', 'T', 'h', 'd' };
+	putBe(file, 6, 4);
+	putBe(file, 0, 2);
+	putBe(file, 1, 2);
+	putBe(file, 1000, 2);
+	file.insert(file.end(), { 'M', 'T', 'r', 'k' });
+	putBe(file, track.size(), 4);
+	file.insert(file.end(), track.begin(), track.end());
+
+	FILE *out = fopen(path.c_str(), "wb");
+	if (!out) {
+		error = "cannot write " + path;
+		return false;
+	}
+	bool ok = fwrite(file.data(), 1, file.size(), out) == file.size();
+	ok &= fclose(out) == 0;
+	if (!ok) {
+		error = "cannot write " + path;
+	}
+	return ok;
+}
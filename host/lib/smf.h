@@ -0,0 +1,24 @@
+/**
+ * Standard MIDI File reader. Tracks are merged into one list of channel and
+ * SysEx messages timestamped in microseconds through the file's tempo map.
+ * The writer does the reverse for a single track at millisecond ticks.
+ */
+
+#ifndef _smf_h_
+#define _smf_h_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct MidiEvent {
+	uint64_t time;              // microseconds from the start of the file
+	uint16_t track;
+	std::vector<uint8_t> bytes; // complete message, status byte first
+};
+
+bool readSmf(const std::string &path, std::vector<MidiEvent> &events, std::string &error);
+bool parseSmf(const uint8_t *data, size_t size, std::vector<MidiEvent> &events, std::string &error);
+bool writeSmf(const std::string &path, const std::vector<MidiEvent> &events, std::string &error);
+
+#endif /* _smf_h_ */
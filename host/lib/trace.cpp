@@ -0,0 +1,162 @@
+#include "trace.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hcYmzShield.h"
+#include "host.h"
+
+#define TRACE_BUFFER 4096
+
+static TraceWriter *attached;
+
+static void traceHook(uint8_t chips, uint8_t reg, uint8_t value) {
+	attached->write(hostMicros(), chips, reg, value);
+}
+
+TraceWriter::TraceWriter() :
+		_file(0), _ok(false), _start(0) {
+}
+
+TraceWriter::~TraceWriter() {
+	close();
+}
+
+bool TraceWriter::open(const std::string &path) {
+	close();
+	_file = fopen(path.c_str(), "wb");
+	if (!_file) {
+		return false;
+	}
+	TraceHeader header;
+	memcpy(header.magic, TRACE_MAGIC, 4);
+	header.version = TRACE_VERSION;
+	header.recordSize = sizeof(TraceRecord);
+	header.reserved = 0;
+	_ok = fwrite(&header, sizeof(header), 1, _file) == 1;
+	_buffer.reserve(TRACE_BUFFER);
+	return _ok;
+}
+
+void TraceWriter::write(uint64_t time, uint8_t chips, uint8_t reg, uint8_t value) {
+	_buffer.push_back({ (uint32_t) (time - _start), chips, reg, value, 0 });
+	if (_buffer.size() >= TRACE_BUFFER) {
+		flush();
+	}
+}
+
+void TraceWriter::flush() {
+	if (_file && !_buffer.empty()) {
+		_ok &= fwrite(_buffer.data(), sizeof(TraceRecord), _buffer.size(), _file) == _buffer.size();
+	}
+	_buffer.clear();
+}
+
+bool TraceWriter::close() {
+	detach();
+	if (!_file) {
+		return _ok;
+	}
+	flush();
+	_ok &= (fclose(_file) == 0);
+	_file = 0;
+	return _ok;
+}
+
+void TraceWriter::attach(uint64_t start) {
+	_start = start;
+	attached = this;
+	YMZ.setTrace(traceHook);
+}
+
+void TraceWriter::detach() {
+	if (attached == this) {
+		YMZ.setTrace();
+		attached = 0;
+	}
+}
+
+TraceFile::TraceFile() :
+		_map(MAP_FAILED), _length(0), _records(0), _count(0) {
+}
+
+TraceFile::~TraceFile() {
+	if (_map != MAP_FAILED) {
+		munmap(_map, _length);
+	}
+}
+
+bool TraceFile::open(const std::string &path, std::string &error) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		error = "cannot open " + path;
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) || (size_t) info.st_size < sizeof(TraceHeader)) {
+		::close(fd);
+		error = path + ": not a trace";
+		return false;
+	}
+	_length = info.st_size;
+	_map = mmap(0, _length, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (_map == MAP_FAILED) {
+		error = "cannot map " + path;
+		return false;
+	}
+	const TraceHeader *header = (const TraceHeader *) _map;
+	if (memcmp(header->magic, TRACE_MAGIC, 4) || header->version != TRACE_VERSION
+			|| header->recordSize != sizeof(TraceRecord)) {
+		error = path + ": not a version 1 trace";
+		return false;
+	}
+	madvise(_map, _length, MADV_SEQUENTIAL);
+	_records = (const TraceRecord *) (header + 1);
+	_count = (_length - sizeof(TraceHeader)) / sizeof(TraceRecord);
+	return true;
+}
+
+size_t TraceFile::size() const {
+	return _count;
+}
+
+const TraceRecord &TraceFile::operator[](size_t i) const {
+	return _records[i];
+}
+
+const TraceRecord *TraceFile::begin() const {
+	return _records;
+}
+
+const TraceRecord *TraceFile::end() const {
+	return _records + _count;
+}
+
+uint32_t decodeTraceFrames(const uint8_t *data, size_t size, std::vector<TraceRecord> &records) {
+	uint32_t dropped = 0;
+	uint64_t time = 0;
+	for (size_t i = 0; i + 5 <= size; i++) {
+		if (data[i] != 0xf0 || data[i + 1] != 0x7d || data[i + 2] != 0x03) {
+			continue;
+		}
+		dropped += data[i + 4];
+		size_t p = i + 5;
+		for (; p + 4 <= size && !(data[p] & 0x80); p += 4) {
+			const uint8_t *r = data + p;
+			uint8_t chips = (r[0] >> 4) & 0x03;
+			if (!chips) {
+				time += ((uint64_t) ((r[1] << 14) | (r[2] << 7) | r[3])) << 2;
+				continue;
+			}
+			time += (uint64_t) ((r[2] << 7) | r[3]) << 2;
+			records.push_back({ (uint32_t) time, chips, (uint8_t) (r[0] & 0x0f),
+					(uint8_t) ((r[1] & 0x7f) | ((r[0] & 0x40) << 1)), 0 });
+		}
+		i = p - 1;
+	}
+	return dropped;
+}
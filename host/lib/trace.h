@@ -0,0 +1,95 @@
+/**
+ * Register trace files.
+ *
+ * A trace is a 16-byte header followed by fixed 8-byte records, one per
+ * shield register transaction, so a file can be mapped and indexed
+ * directly. Times are microseconds from the start of the trace.
+ *
+ *   header: "YMZT" / u16 version / u16 record size / u64 reserved
+ *   record: u32 time / u8 chips (1 = PSG0, 2 = PSG1, 3 = both) / u8 reg /
+ *           u8 value / u8 reserved
+ *
+ * All fields are little-endian.
+ */
+
+#ifndef _trace_h_
+#define _trace_h_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define TRACE_MAGIC "YMZT"
+#define TRACE_VERSION 1
+
+struct TraceHeader {
+	char magic[4];
+	uint16_t version;
+	uint16_t recordSize;
+	uint64_t reserved;
+};
+
+struct TraceRecord {
+	uint32_t time;
+	uint8_t chips;
+	uint8_t reg;
+	uint8_t value;
+	uint8_t reserved;
+};
+
+/**
+ * Buffered trace file writer.
+ */
+class TraceWriter {
+public:
+	TraceWriter();
+	~TraceWriter();
+	bool open(const std::string &path);
+	void write(uint64_t time, uint8_t chips, uint8_t reg, uint8_t value);
+	bool close();
+
+	/**
+	 * Route the shield's transaction hook into this writer, with times
+	 * relative to start on the host clock.
+	 */
+	void attach(uint64_t start);
+	void detach();
+
+private:
+	void flush();
+
+	FILE *_file;
+	bool _ok;
+	uint64_t _start;
+	std::vector<TraceRecord> _buffer;
+};
+
+/**
+ * Read-only memory-mapped trace.
+ */
+class TraceFile {
+public:
+	TraceFile();
+	~TraceFile();
+	bool open(const std::string &path, std::string &error);
+	size_t size() const;
+	const TraceRecord &operator[](size_t i) const;
+	const TraceRecord *begin() const;
+	const TraceRecord *end() const;
+
+private:
+	void *_map;
+	size_t _length;
+	const TraceRecord *_records;
+	size_t _count;
+};
+
+/**
+ * Decode the firmware's SysEx trace frames (F0 7D 03 ... F7) from a raw
+ * MIDI capture into trace records. Returns the number of writes the device
+ * reported dropping.
+ */
+uint32_t decodeTraceFrames(const uint8_t *data, size_t size, std::vector<TraceRecord> &records);
+
+#endif /* _trace_h_ */
@@ -0,0 +1,44 @@
+#include "wav.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void put16(uint8_t *p, uint16_t value) {
+	p[0] = value & 0xff;
+	p[1] = value >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t value) {
+	put16(p, value & 0xffff);
+	put16(p + 2, value >> 16);
+}
+
+bool writeWav(const std::string &path, const std::vector<int16_t> &samples,
+		uint32_t rate, uint16_t channels) {
+	uint32_t bytes = samples.size() * 2;
+	uint8_t header[44];
+	memcpy(header, "RIFF", 4);
+	put32(header + 4, 36 + bytes);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	put32(header + 16, 16);
+	put16(header + 20, 1);
+	put16(header + 22, channels);
+	put32(header + 24, rate);
+	put32(header + 28, rate * channels * 2);
+	put16(header + 32, channels * 2);
+	put16(header + 34, 16);
+	memcpy(header + 36, "data", 4);
+	put32(header + 40, bytes);
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	std::vector<uint8_t> data(bytes);
+	for (size_t i = 0; i < samples.size(); i++) {
+		put16(&data[i * 2], (uint16_t) samples[i]);
+	}
+	bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+			&& fwrite(data.data(), 1, bytes, file) == bytes;
+	return (fclose(file) == 0) && ok;
+}
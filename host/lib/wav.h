@@ -0,0 +1,15 @@
+/**
+ * Minimal 16-bit PCM WAV writer.
+ */
+
+#ifndef _wav_h_
+#define _wav_h_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+bool writeWav(const std::string &path, const std::vector<int16_t> &samples,
+		uint32_t rate, uint16_t channels);
+
+#endif /* _wav_h_ */
@@ -0,0 +1,167 @@
+#include "ymz284.h"
+
+#include <math.h>
+#include <string.h>
+
+#define ENV_CONT 0x08
+#define ENV_ATT 0x04
+#define ENV_ALT 0x02
+#define ENV_HOLD 0x01
+
+/**
+ * 1.5 dB per step; fixed levels use every other entry.
+ */
+static float dacLevel(int i) {
+	return i ? powf(10.0f, (i - 31) * 1.5f / 20.0f) : 0.0f;
+}
+
+const float Ymz284::dac[32] = {
+	dacLevel(0), dacLevel(1), dacLevel(2), dacLevel(3), dacLevel(4), dacLevel(5),
+	dacLevel(6), dacLevel(7), dacLevel(8), dacLevel(9), dacLevel(10), dacLevel(11),
+	dacLevel(12), dacLevel(13), dacLevel(14), dacLevel(15), dacLevel(16), dacLevel(17),
+	dacLevel(18), dacLevel(19), dacLevel(20), dacLevel(21), dacLevel(22), dacLevel(23),
+	dacLevel(24), dacLevel(25), dacLevel(26), dacLevel(27), dacLevel(28), dacLevel(29),
+	dacLevel(30), dacLevel(31)
+};
+
+Ymz284::Ymz284() {
+	reset();
+}
+
+void Ymz284::reset() {
+	memset(_regs, 0, sizeof(_regs));
+	memset(_toneCount, 0, sizeof(_toneCount));
+	_tonePeriod[0] = _tonePeriod[1] = _tonePeriod[2] = 1;
+	_noisePeriod = 2;
+	_envPeriod = 1;
+	_toneAudible = 0;
+	_noiseAudible = false;
+	_envAudible = false;
+	_out = 0;
+	_toneOut = 0;
+	_noiseCount = 0;
+	_lfsr = 1;
+	_envCount = 0;
+	_envPos = 0;
+	_envAttack = false;
+	_envHolding = false;
+}
+
+void Ymz284::write(uint8_t reg, uint8_t value) {
+	if (reg > 0x0d) {
+		return;
+	}
+	_regs[reg] = value;
+	if (reg < 0x06) {
+		uint16_t tp = _regs[reg & ~1] | ((_regs[reg | 1] & 0x0f) << 8);
+		_tonePeriod[reg >> 1] = tp ? tp : 1;
+	} else if (reg == 0x06) {
+		_noisePeriod = 2 * ((value & 0x1f) ? (value & 0x1f) : 1);
+	} else if (reg == 0x0b || reg == 0x0c) {
+		uint32_t ep = _regs[0x0b] | (_regs[0x0c] << 8);
+		_envPeriod = ep ? ep : 1;
+	} else if (reg == 0x0d) {
+		_envCount = 0;
+		_envPos = 0;
+		_envAttack = (value & ENV_ATT);
+		_envHolding = false;
+	}
+
+	// only state changes that can reach the output need a new mix
+	_toneAudible = 0;
+	_noiseAudible = false;
+	_envAudible = false;
+	for (int i = 0; i < 3; i++) {
+		uint8_t level = _regs[0x08 + i];
+		if (!(level & 0x1f)) {
+			continue;
+		}
+		if (!(_regs[0x07] & (1 << i))) {
+			_toneAudible |= (1 << i);
+		}
+		if (!(_regs[0x07] & (8 << i))) {
+			_noiseAudible = true;
+		}
+		if (level & 0x10) {
+			_envAudible = true;
+		}
+	}
+	mix();
+}
+
+uint8_t Ymz284::read(uint8_t reg) const {
+	return _regs[reg & 0x0f];
+}
+
+/**
+ * Advance the envelope by one of its 32 steps, applying the shape rules at
+ * the end of each ramp.
+ */
+void Ymz284::envelopeStep() {
+	if (_envHolding || ++_envPos < 32) {
+		return;
+	}
+	uint8_t shape = _regs[0x0d];
+	if (!(shape & ENV_CONT)) {
+		_envHolding = true;
+		_envAttack = false;
+		_envPos = 31;
+	} else if (shape & ENV_HOLD) {
+		_envHolding = true;
+		_envPos = 31;
+		if (shape & ENV_ALT) {
+			_envAttack = !_envAttack;
+		}
+	} else {
+		_envPos = 0;
+		if (shape & ENV_ALT) {
+			_envAttack = !_envAttack;
+		}
+	}
+}
+
+/**
+ * Recompute the output level after anything that feeds it changed.
+ */
+void Ymz284::mix() {
+	uint8_t envLevel = _envAttack ? _envPos : (31 - _envPos);
+	uint8_t mixer = _regs[0x07];
+	uint8_t noise = (_lfsr & 1) ? 0x07 : 0;
+	_out = 0;
+	for (int i = 0; i < 3; i++) {
+		bool tone = (_toneOut & (1 << i)) || (mixer & (1 << i));
+		bool noisy = (noise & (1 << i)) || (mixer & (8 << i));
+		if (!(tone && noisy)) {
+			continue;
+		}
+		uint8_t level = _regs[0x08 + i];
+		_out += dac[(level & 0x10) ? envLevel : ((level & 0x0f) * 2 + ((level & 0x0f) ? 1 : 0))];
+	}
+}
+
+float Ymz284::tick() {
+	bool changed = false;
+	for (int i = 0; i < 3; i++) {
+		if (++_toneCount[i] >= _tonePeriod[i]) {
+			_toneCount[i] = 0;
+			_toneOut ^= (1 << i);
+			changed |= (_toneAudible & (1 << i)) != 0;
+		}
+	}
+
+	if (++_noiseCount >= _noisePeriod) {
+		_noiseCount = 0;
+		_lfsr = (_lfsr >> 1) | (((_lfsr ^ (_lfsr >> 3)) & 1) << 16);
+		changed |= _noiseAudible;
+	}
+
+	for (_envCount++; _envCount >= _envPeriod; _envCount -= _envPeriod) {
+		envelopeStep();
+		changed |= _envAudible;
+	}
+
+	if (changed) {
+		mix();
+	}
+	return _out;
+}
@@ -0,0 +1,51 @@
+/**
+ * YMZ284 emulator for host builds.
+ *
+ * Steps the chip at its internal 250 kHz rate (4 MHz / 16): tone counters
+ * toggle every TP ticks, the 17-bit noise LFSR shifts every 2 * NP ticks
+ * and the 32-step envelope advances every EP ticks, so a sawtooth repeats
+ * at fM / (512 * EP) as setEnvelopeFrequency() has it. Output is the sum
+ * of the three channels through the 32-level logarithmic DAC, 0 .. 3.
+ */
+
+#ifndef _ymz284_h_
+#define _ymz284_h_
+
+#include <stdint.h>
+
+#define YMZ284_CLOCK 4000000
+#define YMZ284_TICK_RATE (YMZ284_CLOCK / 16)
+
+class Ymz284 {
+public:
+	Ymz284();
+	void reset();
+	void write(uint8_t reg, uint8_t value);
+	uint8_t read(uint8_t reg) const;
+	float tick();
+
+	static const float dac[32];
+
+private:
+	void envelopeStep();
+	void mix();
+
+	uint8_t _regs[16];
+	uint16_t _tonePeriod[3];
+	uint16_t _noisePeriod;
+	uint32_t _envPeriod;
+	uint8_t _toneAudible;
+	bool _noiseAudible;
+	bool _envAudible;
+	float _out;
+	uint16_t _toneCount[3];
+	uint8_t _toneOut;
+	uint16_t _noiseCount;
+	uint32_t _lfsr;
+	uint32_t _envCount;
+	uint8_t _envPos;
+	bool _envAttack;
+	bool _envHolding;
+};
+
+#endif /* _ymz284_h_ */
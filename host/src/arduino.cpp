@@ -0,0 +1,355 @@
+/**
+ * Host implementation of the Arduino core stand-in and the hooks in host.h.
+ *
+ * Everything here is plain zero-initialized data so that the shield's
+ * static constructor, which writes to the bus, is safe to run before any
+ * other static initializer.
+ */
+
+#include "Arduino.h"
+#include "EEPROM.h"
+
+#define HOST_PIN_COUNT 70
+#define HOST_CYCLES_PER_US (F_CPU / 1000000)
+
+static uint64_t clockMicros;
+
+static const uint16_t timer1Prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+static const uint16_t timer2Prescale[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+struct HostTimer {
+	bool armed;
+	uint64_t due; // CPU cycles
+};
+static HostTimer timers[2];
+static bool inInterrupt;
+
+static uint8_t pins[HOST_PIN_COUNT];
+
+static HostBusSink busSink;
+static void *busContext;
+static uint32_t busShiftNs;
+static uint32_t busStrobeNs;
+static uint32_t busRemainderNs;
+static uint32_t busWrites;
+static bool busData;
+static uint8_t busShifter;
+static uint8_t busAddress[2];
+
+static uint8_t serialRx[SERIAL_RX_BUFFER_SIZE];
+static uint16_t serialHead;
+static uint16_t serialTail;
+static uint32_t serialDropped;
+static HostSerialSink serialSink;
+static void *serialContext;
+
+volatile uint8_t SREG;
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint8_t TIMSK1;
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint8_t TCCR2A;
+volatile uint8_t TCCR2B;
+volatile uint8_t TIMSK2;
+volatile uint8_t TCNT2;
+volatile uint8_t OCR2A;
+uint8_t hostEeprom[HOST_EEPROM_SIZE];
+EEPROMClass EEPROM;
+HardwareSerial Serial;
+
+/**
+ * Timer1, Timer2 and interrupts
+ */
+extern "C" __attribute__((weak)) void TIMER1_COMPA_vect() {
+}
+
+extern "C" __attribute__((weak)) void TIMER2_COMPA_vect() {
+}
+
+/**
+ * Prescaler of a timer running in CTC mode with its compare A interrupt
+ * enabled, or 0.
+ */
+static uint16_t timerPrescale(uint8_t timer) {
+	if (timer == 0) {
+		if (!(TIMSK1 & _BV(OCIE1A)) || !(TCCR1B & _BV(WGM12))) {
+			return 0;
+		}
+		return timer1Prescale[TCCR1B & 7];
+	}
+	if (!(TIMSK2 & _BV(OCIE2A)) || !(TCCR2A & _BV(WGM21))) {
+		return 0;
+	}
+	return timer2Prescale[TCCR2B & 7];
+}
+
+static uint32_t timerTop(uint8_t timer) {
+	return (timer == 0) ? OCR1A : OCR2A;
+}
+
+/**
+ * Arm or disarm each timer to match its registers. Returns the armed timer
+ * due first, or -1. Timer2's compare vector comes before Timer1's on the
+ * AVR, so it wins when both are due on the same cycle.
+ */
+static int nextTimer() {
+	int next = -1;
+	for (int8_t timer = 1; timer >= 0; timer--) {
+		HostTimer &t = timers[timer];
+		uint16_t prescale = timerPrescale(timer);
+		if (!prescale) {
+			t.armed = false;
+			continue;
+		}
+		if (!t.armed) {
+			uint32_t count = (timer == 0) ? TCNT1 : TCNT2;
+			uint32_t counts = (count < timerTop(timer)) ? timerTop(timer) - count : 0;
+			t.due = clockMicros * HOST_CYCLES_PER_US + (uint64_t) (counts + 1) * prescale;
+			t.armed = true;
+		}
+		if (next < 0 || t.due < timers[next].due) {
+			next = timer;
+		}
+	}
+	return next;
+}
+
+/**
+ * Take every compare match up to the given time in order, with the clock
+ * set to each one while its handler runs.
+ */
+static void runTimers(uint64_t us) {
+	if (inInterrupt) {
+		return;
+	}
+	int timer;
+	while ((SREG & _BV(7)) && (timer = nextTimer()) >= 0
+			&& timers[timer].due <= us * HOST_CYCLES_PER_US) {
+		HostTimer &t = timers[timer];
+		if (t.due / HOST_CYCLES_PER_US > clockMicros) {
+			clockMicros = t.due / HOST_CYCLES_PER_US;
+		}
+		inInterrupt = true;
+		SREG &= ~_BV(7);
+		if (timer == 0) {
+			TIMER1_COMPA_vect();
+		} else {
+			TIMER2_COMPA_vect();
+		}
+		SREG |= _BV(7);
+		inInterrupt = false;
+
+		uint16_t prescale = timerPrescale(timer);
+		if (!prescale) {
+			t.armed = false;
+			continue;
+		}
+		t.due += (uint64_t) (timerTop(timer) + 1) * prescale;
+	}
+}
+
+void hostSei() {
+	SREG |= _BV(7);
+	runTimers(clockMicros);
+}
+
+void yield() {
+	runTimers(clockMicros);
+	int timer = nextTimer();
+	if (timer >= 0 && (SREG & _BV(7))) {
+		hostAdvanceTo((timers[timer].due + HOST_CYCLES_PER_US - 1) / HOST_CYCLES_PER_US);
+	} else {
+		hostAdvance(1);
+	}
+}
+
+/**
+ * Clock
+ */
+uint64_t hostMicros() {
+	return clockMicros;
+}
+
+void hostAdvance(uint64_t us) {
+	hostAdvanceTo(clockMicros + us);
+}
+
+void hostAdvanceTo(uint64_t us) {
+	runTimers(us);
+	if (us > clockMicros) {
+		clockMicros = us;
+	}
+}
+
+unsigned long millis() {
+	return (unsigned long) (clockMicros / 1000);
+}
+
+unsigned long micros() {
+	return (unsigned long) clockMicros;
+}
+
+void delay(unsigned long ms) {
+	hostAdvance((uint64_t) ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+	hostAdvance(us);
+}
+
+/**
+ * Pins
+ */
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+	if (pin < HOST_PIN_COUNT) {
+		pins[pin] = value;
+	}
+}
+
+int digitalRead(uint8_t pin) {
+	return (pin < HOST_PIN_COUNT) ? pins[pin] : LOW;
+}
+
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t value) {
+}
+
+/**
+ * Bus
+ */
+static void busCost(uint32_t ns) {
+	busRemainderNs += ns;
+	hostAdvance(busRemainderNs / 1000);
+	busRemainderNs %= 1000;
+}
+
+void hostBusSetSink(HostBusSink sink, void *context) {
+	busSink = sink;
+	busContext = context;
+}
+
+void hostBusSetCost(uint32_t shiftNs, uint32_t strobeNs) {
+	busShiftNs = shiftNs;
+	busStrobeNs = strobeNs;
+}
+
+void hostBusSelect(bool data) {
+	busData = data;
+}
+
+void hostBusShift(uint8_t value) {
+	busShifter = value;
+	busCost(busShiftNs);
+}
+
+void hostBusStrobe(uint8_t chipMask) {
+	busCost(busStrobeNs);
+	for (uint8_t chip = 0; chip < 2; chip++) {
+		if (!(chipMask & (1 << chip))) {
+			continue;
+		}
+		if (!busData) {
+			busAddress[chip] = busShifter;
+			continue;
+		}
+		busWrites++;
+		if (busSink) {
+			busSink(busContext, clockMicros, chip, busAddress[chip], busShifter);
+		}
+	}
+}
+
+uint32_t hostBusWrites() {
+	return busWrites;
+}
+
+/**
+ * Serial
+ */
+bool hostSerialPush(uint8_t value) {
+	uint16_t next = (serialHead + 1) % SERIAL_RX_BUFFER_SIZE;
+	if (next == serialTail) {
+		serialDropped++;
+		return false;
+	}
+	serialRx[serialHead] = value;
+	serialHead = next;
+	return true;
+}
+
+uint16_t hostSerialPending() {
+	return (SERIAL_RX_BUFFER_SIZE + serialHead - serialTail) % SERIAL_RX_BUFFER_SIZE;
+}
+
+uint32_t hostSerialDropped() {
+	return serialDropped;
+}
+
+void hostSerialSetSink(HostSerialSink sink, void *context) {
+	serialSink = sink;
+	serialContext = context;
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+	_baud = baud;
+}
+
+void HardwareSerial::end() {
+}
+
+int HardwareSerial::available() {
+	return hostSerialPending();
+}
+
+int HardwareSerial::peek() {
+	return (serialHead == serialTail) ? -1 : serialRx[serialTail];
+}
+
+int HardwareSerial::read() {
+	if (serialHead == serialTail) {
+		return -1;
+	}
+	uint8_t value = serialRx[serialTail];
+	serialTail = (serialTail + 1) % SERIAL_RX_BUFFER_SIZE;
+	return value;
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+	if (serialSink) {
+		serialSink(serialContext, value);
+	}
+	return 1;
+}
+
+void HardwareSerial::flush() {
+}
+
+unsigned long HardwareSerial::baud() {
+	return _baud;
+}
+
+/**
+ * Reset
+ */
+void hostReset() {
+	clockMicros = 0;
+	SREG = _BV(7);
+	TCCR1A = TCCR1B = TIMSK1 = 0;
+	TCNT1 = OCR1A = 0;
+	TCCR2A = TCCR2B = TIMSK2 = 0;
+	TCNT2 = OCR2A = 0;
+	memset(timers, 0, sizeof(timers));
+	inInterrupt = false;
+	memset(pins, 0, sizeof(pins));
+	busRemainderNs = 0;
+	busWrites = 0;
+	busData = false;
+	busShifter = 0;
+	memset(busAddress, 0, sizeof(busAddress));
+	serialHead = serialTail = 0;
+	serialDropped = 0;
+	memset(hostEeprom, 0xff, sizeof(hostEeprom));
+}
@@ -0,0 +1,675 @@
+/**
+ * ymzalloc: compile a multi-track MIDI file for the shield, choosing the
+ * YMZ channel for each note with the whole song in view.
+ *
+ *   ymzalloc [-j jobs] [-t ymzt|hc] [-o out] song.mid
+ *
+ * The firmware has to give a note a channel the moment it arrives, and
+ * when all six are busy it cuts one short without knowing which will be
+ * needed longest. Here every note's end is known up front, so:
+ *
+ *   - when a note finds no channel, whichever of it and the notes it could
+ *     displace ends last is the one left out, which keeps the most notes
+ *     whole; a new note that loses is dropped rather than cutting another
+ *   - among the free channels, a note takes the one whose registers
+ *     already hold the most of what it needs (period, level, mixer bits),
+ *     then the one idle longest
+ *   - drums (MIDI channel 10) play on noise, and each chip has one noise
+ *     generator: drums that need it set differently never share a chip. In
+ *     a trace each kit sound also decays on its chip's envelope, so the
+ *     envelope goes with the noise period
+ *
+ * The result is a register trace (-t ymzt, the default) for ymzsend, which
+ * streams it as register frames, or for ymztrace render; or a Hardchord
+ * Music block (-t hc) for hcYmzPlayer. A block's noise period is shared by
+ * both chips, as setNoisePeriod() writes it, and its drums hold a fixed
+ * level rather than use the envelope, which setEnvelope() only switches on
+ * the first channel of each chip. Either way only registers that change
+ * are written.
+ *
+ * Only notes and their velocities are used; controllers, program changes
+ * and pitch bend are ignored. Pitched notes sound until their note off,
+ * drums for their kit sound's decay.
+ *
+ * A song falls into sections wherever nothing sounds. No choice reaches
+ * across one, so the sections are allocated in parallel on -j workers
+ * (default one per core). The song is also allocated the way the firmware
+ * does it, first free channel and oldest note cut, and both are reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hcYmzShield.h"
+#include "pool.h"
+#include "smf.h"
+#include "trace.h"
+
+#define YMZ_CHANNELS 6
+#define DRUM_CHANNEL 9 // MIDI channel 10
+#define ENVELOPE_DECAY 0x00 // \___: one fall, then silence
+#define ENVELOPE_STEP_US 4 // per unit of EP: 32 steps of EP ticks each
+#define ENVELOPE_STEPS 32
+#define LEVEL_ENVELOPE 0x10
+#define DELAY_MAX 0xffff // ms in one 0xa1
+
+struct Options {
+	unsigned jobs = 0;
+	bool block = false;
+	std::string out;
+};
+
+static void usage() {
+	fprintf(stderr, "usage: ymzalloc [-j jobs] [-t ymzt|hc] [-o out] song.mid\n");
+	exit(2);
+}
+
+static std::string baseName(const std::string &path) {
+	size_t slash = path.find_last_of('/');
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+/**
+ * Notes
+ */
+struct DrumSound {
+	uint8_t noise;  // noise period
+	uint16_t decay; // ms
+};
+
+static const DrumSound DRUM_SOUNDS[] = {
+	{ 31, 150 }, // bass drum
+	{ 12, 180 }, // snare, clap
+	{ 18, 200 }, // toms
+	{ 1, 50 },   // closed and pedal hi-hat
+	{ 1, 300 },  // open hi-hat
+	{ 3, 800 },  // crash, splash, china
+	{ 2, 400 },  // ride
+	{ 6, 150 },  // the rest of the kit
+};
+
+static int8_t drumSound(uint8_t key) {
+	switch (key) {
+	case 35: case 36:
+		return 0;
+	case 37: case 38: case 39: case 40:
+		return 1;
+	case 41: case 43: case 45: case 47: case 48: case 50:
+		return 2;
+	case 42: case 44:
+		return 3;
+	case 46:
+		return 4;
+	case 49: case 52: case 55: case 57:
+		return 5;
+	case 51: case 53: case 59:
+		return 6;
+	}
+	return 7;
+}
+
+struct Note {
+	uint64_t start; // us
+	uint64_t end;   // us, moved up if the note is cut short
+	uint8_t key;
+	uint8_t level;  // 1..15, from the velocity
+	int8_t drum;    // DRUM_SOUNDS index, -1 for a pitched note
+	int8_t channel; // YMZ channel, -1 until given one or if dropped
+};
+
+/**
+ * Pair note ons with their note offs, by track, channel and key. A note
+ * struck again while it sounds ends there; one still on at the end of the
+ * file ends with its last event. Returned in start order.
+ */
+static void collectNotes(const std::vector<MidiEvent> &events, std::vector<Note> &notes) {
+	std::map<uint32_t, size_t> sounding;
+	uint64_t last = 0;
+	for (const MidiEvent &event : events) {
+		last = std::max(last, event.time);
+		uint8_t type = event.bytes.empty() ? 0 : event.bytes[0] & 0xf0;
+		if ((type != 0x80 && type != 0x90) || event.bytes.size() < 3) {
+			continue;
+		}
+		uint8_t channel = event.bytes[0] & 0x0f;
+		uint8_t key = event.bytes[1];
+		uint32_t id = ((uint32_t) event.track << 16) | (channel << 8) | key;
+		auto on = sounding.find(id);
+		if (on != sounding.end()) {
+			notes[on->second].end = event.time;
+			sounding.erase(on);
+		}
+		if (type == 0x90 && event.bytes[2]) {
+			int8_t drum = (channel == DRUM_CHANNEL) ? drumSound(key) : -1;
+			uint8_t level = std::min(15, (event.bytes[2] + 8) / 9);
+			sounding[id] = notes.size();
+			notes.push_back({ event.time, event.time, key, level, drum, -1 });
+		}
+	}
+	for (auto &on : sounding) {
+		notes[on.second].end = last;
+	}
+	for (Note &note : notes) {
+		if (note.drum >= 0) {
+			note.end = note.start + DRUM_SOUNDS[note.drum].decay * 1000ULL;
+		}
+	}
+	notes.erase(std::remove_if(notes.begin(), notes.end(),
+			[](const Note &note) { return note.end <= note.start; }), notes.end());
+	std::stable_sort(notes.begin(), notes.end(),
+			[](const Note &a, const Note &b) { return a.start < b.start; });
+}
+
+/**
+ * Runs of notes [first, second) that no note outside them overlaps.
+ */
+static std::vector<std::pair<size_t, size_t>> findSections(const std::vector<Note> &notes) {
+	std::vector<std::pair<size_t, size_t>> sections;
+	uint64_t reach = 0;
+	size_t begin = 0;
+	for (size_t i = 0; i < notes.size(); i++) {
+		if (i > begin && notes[i].start >= reach) {
+			sections.push_back({ begin, i });
+			begin = i;
+		}
+		reach = std::max(reach, notes[i].end);
+	}
+	if (begin < notes.size()) {
+		sections.push_back({ begin, notes.size() });
+	}
+	return sections;
+}
+
+// What a drum needs its chip's noise generator (and in a trace, envelope)
+// set to, or -1 for a pitched note
+static int noiseUse(const Note &note, bool block) {
+	if (note.drum < 0) {
+		return -1;
+	}
+	return block ? DRUM_SOUNDS[note.drum].noise : note.drum;
+}
+
+static uint8_t noteLevel(const Note &note, bool block) {
+	return (note.drum >= 0 && !block) ? LEVEL_ENVELOPE : note.level;
+}
+
+/**
+ * Allocation
+ */
+struct Tally {
+	unsigned stolen = 0;
+	unsigned dropped = 0;
+};
+
+class Allocator {
+public:
+	Allocator(std::vector<Note> &notes, bool lookahead, bool block)
+			: _notes(notes), _lookahead(lookahead), _block(block) {
+		for (Voice &voice : _voices) {
+			voice = { -1, -1, -1, -2, 0 };
+		}
+	}
+
+	/**
+	 * Give channels to notes [begin, end), cutting or dropping notes where
+	 * there are not enough.
+	 */
+	void run(size_t begin, size_t end, Tally &tally) {
+		for (size_t i = begin; i < end; i++) {
+			Note &note = _notes[i];
+			release(note.start);
+			int channel = pickFree(note);
+			if (channel < 0) {
+				channel = steal(note, tally);
+			}
+			if (channel < 0) {
+				tally.dropped++;
+				continue;
+			}
+			note.channel = channel;
+			_voices[channel] = { (long) i, note.key, noteLevel(note, _block), note.drum, 0 };
+		}
+	}
+
+private:
+	struct Voice {
+		long note;     // sounding, or -1
+		int key;       // what the registers were last set up for
+		int level;
+		int drum;      // -1 pitched, -2 never used
+		uint64_t idle; // when the last note ended
+	};
+
+	void release(uint64_t now) {
+		for (Voice &voice : _voices) {
+			if (voice.note >= 0 && _notes[voice.note].end <= now) {
+				voice.idle = _notes[voice.note].end;
+				voice.note = -1;
+			}
+		}
+	}
+
+	/**
+	 * Whether the note can sound on a channel next to what else is
+	 * sounding, leaving out ignore, a channel about to be freed. Only a
+	 * drum can clash, with a drum that shares its noise generator: one on
+	 * the same chip, or any in a block.
+	 */
+	bool fits(int channel, const Note &note, int ignore) const {
+		int use = noiseUse(note, _block);
+		if (use < 0) {
+			return true;
+		}
+		for (int other = 0; other < YMZ_CHANNELS; other++) {
+			if (other == channel || other == ignore || _voices[other].note < 0
+					|| (!_block && other / 3 != channel / 3)) {
+				continue;
+			}
+			int held = noiseUse(_notes[_voices[other].note], _block);
+			if (held >= 0 && held != use) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Registers of the channel's own the note has to change
+	int cost(int channel, const Note &note) const {
+		const Voice &voice = _voices[channel];
+		int writes = 0;
+		if (voice.drum == -2 || (voice.drum >= 0) != (note.drum >= 0)) {
+			writes++; // mixer
+		}
+		if (note.drum < 0 && voice.key != note.key) {
+			writes += 2;
+		}
+		if (voice.level != noteLevel(note, _block)) {
+			writes++;
+		}
+		return writes;
+	}
+
+	int pickFree(const Note &note) const {
+		int best = -1;
+		for (int channel = 0; channel < YMZ_CHANNELS; channel++) {
+			if (_voices[channel].note >= 0 || !fits(channel, note, -1)) {
+				continue;
+			}
+			if (!_lookahead) {
+				return channel;
+			}
+			if (best < 0) {
+				best = channel;
+				continue;
+			}
+			int difference = cost(channel, note) - cost(best, note);
+			if (difference < 0 || (!difference && _voices[channel].idle < _voices[best].idle)) {
+				best = channel;
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * Make room for the note on a channel whose note it could replace.
+	 * Looking ahead, whichever of them ends last loses, the new note
+	 * included; otherwise the oldest is cut. A note cut the instant it
+	 * started counts as dropped.
+	 */
+	int steal(const Note &note, Tally &tally) {
+		int victim = -1;
+		for (int channel = 0; channel < YMZ_CHANNELS; channel++) {
+			if (_voices[channel].note < 0 || !fits(channel, note, channel)) {
+				continue;
+			}
+			if (victim < 0 || (_lookahead ? endsAfter(_voices[channel].note, _voices[victim].note)
+					: _notes[_voices[channel].note].start < _notes[_voices[victim].note].start)) {
+				victim = channel;
+			}
+		}
+		if (victim < 0) {
+			return -1;
+		}
+		Note &held = _notes[_voices[victim].note];
+		if (_lookahead && (note.end > held.end || (note.end == held.end && note.level <= held.level))) {
+			return -1;
+		}
+		if (held.start == note.start) {
+			held.channel = -1;
+			tally.dropped++;
+		} else {
+			held.end = note.start;
+			tally.stolen++;
+		}
+		return victim;
+	}
+
+	bool endsAfter(long a, long b) const {
+		const Note &x = _notes[a];
+		const Note &y = _notes[b];
+		return x.end > y.end || (x.end == y.end && x.level < y.level);
+	}
+
+	std::vector<Note> &_notes;
+	bool _lookahead;
+	bool _block;
+	Voice _voices[YMZ_CHANNELS];
+};
+
+/**
+ * Emission
+ *
+ * The chips' registers are followed an instant at a time: every note that
+ * ends there and then every note that starts sets what it needs, and only
+ * the registers that end up different are written.
+ */
+class Emitter {
+public:
+	explicit Emitter(bool block) : _block(block) {
+		memset(_want, 0, sizeof(_want));
+		memset(_have, 0, sizeof(_have));
+		memset(_known, 0, sizeof(_known));
+		memset(_set, 0, sizeof(_set));
+		memset(_restart, 0, sizeof(_restart));
+		_want[0][0x07] = _want[1][0x07] = 0x3f;
+		_ms = 0;
+		writes = 0;
+		if (_block) {
+			data = { 'H', 'C', 1, 0x50, 0 };
+			for (uint8_t chip = 0; chip < 2; chip++) {
+				_known[chip] = 7 << 8;
+			}
+			writes += YMZ_CHANNELS;
+		} else {
+			for (uint8_t voice = 0; voice < 3; voice++) {
+				_known[0] |= 1 << (8 + voice);
+				_known[1] |= 1 << (8 + voice);
+				trace.push_back({ 0, 3, (uint8_t) (8 + voice), 0, 0 });
+				writes++;
+			}
+		}
+	}
+
+	void run(const std::vector<Note> &notes) {
+		struct Change {
+			uint64_t time;
+			bool start;
+			size_t note;
+		};
+		std::vector<Change> changes;
+		for (size_t i = 0; i < notes.size(); i++) {
+			if (notes[i].channel >= 0) {
+				changes.push_back({ notes[i].start, true, i });
+				changes.push_back({ notes[i].end, false, i });
+			}
+		}
+		std::sort(changes.begin(), changes.end(), [](const Change &a, const Change &b) {
+			return (a.time != b.time) ? a.time < b.time
+					: (a.start != b.start) ? !a.start : a.note < b.note;
+		});
+		for (size_t i = 0; i < changes.size();) {
+			uint64_t time = changes[i].time;
+			for (; i < changes.size() && changes[i].time == time; i++) {
+				const Note &note = notes[changes[i].note];
+				if (changes[i].start) {
+					start(note);
+				} else {
+					set(note.channel / 3, 8 + note.channel % 3, 0);
+				}
+			}
+			flush(time);
+		}
+		if (_block) {
+			data.push_back(0);
+		}
+	}
+
+	unsigned writes;
+	std::vector<TraceRecord> trace;
+	std::vector<uint8_t> data;
+
+private:
+	void set(uint8_t chip, uint8_t reg, uint8_t value) {
+		_want[chip][reg] = value;
+		_set[chip] |= 1 << reg;
+	}
+
+	void start(const Note &note) {
+		uint8_t chip = note.channel / 3;
+		uint8_t voice = note.channel % 3;
+		uint8_t mixer = _want[chip][0x07];
+		if (note.drum < 0) {
+			uint16_t tp = YMZ.getTonePeriodMidi(note.key);
+			set(chip, voice * 2, tp & 0xff);
+			set(chip, voice * 2 + 1, tp >> 8);
+			mixer = (mixer & ~(1 << voice)) | (8 << voice);
+		} else {
+			const DrumSound &sound = DRUM_SOUNDS[note.drum];
+			if (_block) {
+				set(0, 0x06, sound.noise);
+				set(1, 0x06, sound.noise);
+			} else {
+				uint16_t ep = sound.decay * 1000 / (ENVELOPE_STEPS * ENVELOPE_STEP_US);
+				set(chip, 0x06, sound.noise);
+				set(chip, 0x0b, ep & 0xff);
+				set(chip, 0x0c, ep >> 8);
+				set(chip, 0x0d, ENVELOPE_DECAY);
+				_restart[chip] = true;
+			}
+			mixer = (mixer | (1 << voice)) & ~(8 << voice);
+		}
+		set(chip, 0x07, mixer);
+		set(chip, 8 + voice, noteLevel(note, _block));
+	}
+
+	// Registers to write: those first given a value, those that differ from
+	// what was last written and the envelope shape when it restarts
+	uint16_t changed(uint8_t chip) const {
+		uint16_t dirty = _set[chip] & ~_known[chip];
+		if (_restart[chip]) {
+			dirty |= 1 << 0x0d;
+		}
+		for (uint8_t reg = 0; reg < PSG_REGISTERS; reg++) {
+			if (_want[chip][reg] != _have[chip][reg] && (_known[chip] & (1 << reg))) {
+				dirty |= 1 << reg;
+			}
+		}
+		return dirty;
+	}
+
+	void flush(uint64_t time) {
+		uint16_t dirty[2] = { changed(0), changed(1) };
+		if (_block) {
+			encodeBlock(time, dirty);
+		} else {
+			encodeTrace(time, dirty);
+		}
+		for (uint8_t chip = 0; chip < 2; chip++) {
+			memcpy(_have[chip], _want[chip], PSG_REGISTERS);
+			_known[chip] |= dirty[chip];
+			_restart[chip] = false;
+		}
+	}
+
+	void encodeTrace(uint64_t time, const uint16_t *dirty) {
+		for (uint8_t reg = 0; reg < PSG_REGISTERS; reg++) {
+			uint16_t bit = 1 << reg;
+			if ((dirty[0] & bit) && (dirty[1] & bit) && _want[0][reg] == _want[1][reg]) {
+				trace.push_back({ (uint32_t) time, 3, reg, _want[0][reg], 0 });
+				writes++;
+				continue;
+			}
+			for (uint8_t chip = 0; chip < 2; chip++) {
+				if (dirty[chip] & bit) {
+					trace.push_back({ (uint32_t) time, (uint8_t) (1 << chip), reg, _want[chip][reg], 0 });
+					writes++;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Say what changed in player commands, after a delay up to this
+	 * instant's millisecond. Periods go out before the mixer and the mixer
+	 * before the levels.
+	 */
+	void encodeBlock(uint64_t time, const uint16_t *dirty) {
+		if (!dirty[0] && !dirty[1]) {
+			return;
+		}
+		uint64_t ms = (time + 500) / 1000;
+		while (ms > _ms) {
+			uint16_t span = (uint16_t) std::min<uint64_t>(ms - _ms, DELAY_MAX);
+			data.insert(data.end(), { 0xa1, (uint8_t) (span >> 8), (uint8_t) span });
+			_ms += span;
+		}
+		if ((dirty[0] | dirty[1]) & (1 << 0x06)) {
+			data.insert(data.end(), { 0x90, _want[0][0x06] });
+			writes++;
+		}
+		for (uint8_t channel = 0; channel < YMZ_CHANNELS; channel++) {
+			uint8_t chip = channel / 3;
+			uint8_t voice = channel % 3;
+			if (dirty[chip] & (3 << (voice * 2))) {
+				data.insert(data.end(), { 0x80, channel, _want[chip][voice * 2 + 1],
+						_want[chip][voice * 2] });
+				writes += 2;
+			}
+		}
+		for (uint8_t channel = 0; channel < YMZ_CHANNELS; channel++) {
+			uint8_t chip = channel / 3;
+			uint8_t voice = channel % 3;
+			uint8_t want = _want[chip][0x07];
+			uint8_t have = _have[chip][0x07];
+			bool known = _known[chip] & (1 << 0x07);
+			if ((dirty[chip] & (1 << 0x07)) && (!known || ((want ^ have) & (1 << voice)))) {
+				data.insert(data.end(), { 0x61, channel, (uint8_t) !(want & (1 << voice)) });
+				writes++;
+			}
+			if ((dirty[chip] & (1 << 0x07)) && (!known || ((want ^ have) & (8 << voice)))) {
+				data.insert(data.end(), { 0x62, channel, (uint8_t) !(want & (8 << voice)) });
+				writes++;
+			}
+		}
+		for (uint8_t channel = 0; channel < YMZ_CHANNELS; channel++) {
+			uint8_t chip = channel / 3;
+			uint8_t voice = channel % 3;
+			if (dirty[chip] & (1 << (8 + voice))) {
+				data.insert(data.end(), { 0x51, channel, _want[chip][8 + voice] });
+				writes++;
+			}
+		}
+	}
+
+	bool _block;
+	uint8_t _want[2][PSG_REGISTERS];
+	uint8_t _have[2][PSG_REGISTERS];
+	uint16_t _known[2]; // written, so _have is what the chip holds
+	uint16_t _set[2];   // given a value by a note
+	bool _restart[2];
+	uint64_t _ms; // where the block's delays have got to
+};
+
+static bool writeFile(const std::string &path, const void *data, size_t size) {
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	bool ok = fwrite(data, 1, size, file) == size;
+	return (fclose(file) == 0) && ok;
+}
+
+static bool writeTrace(const std::string &path, const std::vector<TraceRecord> &records) {
+	TraceWriter trace;
+	if (!trace.open(path)) {
+		return false;
+	}
+	for (const TraceRecord &record : records) {
+		trace.write(record.time, record.chips, record.reg, record.value);
+	}
+	return trace.close();
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:t:o:")) != -1) {
+		switch (opt) {
+		case 'j':
+			options.jobs = atoi(optarg);
+			break;
+		case 't':
+			if (strcmp(optarg, "ymzt") && strcmp(optarg, "hc")) {
+				usage();
+			}
+			options.block = !strcmp(optarg, "hc");
+			break;
+		case 'o':
+			options.out = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 1) {
+		usage();
+	}
+	std::string in = argv[optind];
+	std::vector<MidiEvent> events;
+	std::string error;
+	if (!readSmf(in, events, error)) {
+		fprintf(stderr, "%s: %s\n", in.c_str(), error.c_str());
+		return 1;
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<Note> notes;
+	collectNotes(events, notes);
+	std::vector<std::pair<size_t, size_t>> sections = findSections(notes);
+	std::vector<Note> online = notes;
+	std::vector<Tally> tallies(sections.size() * 2);
+	WorkPool pool(options.jobs);
+	pool.run(sections.size() * 2, [&](size_t job, unsigned worker) {
+		bool lookahead = !(job & 1);
+		Allocator allocator(lookahead ? notes : online, lookahead, options.block);
+		allocator.run(sections[job / 2].first, sections[job / 2].second, tallies[job]);
+	});
+	Tally ahead, naive;
+	for (size_t i = 0; i < tallies.size(); i++) {
+		Tally &sum = (i & 1) ? naive : ahead;
+		sum.stolen += tallies[i].stolen;
+		sum.dropped += tallies[i].dropped;
+	}
+	Emitter emitter(options.block);
+	emitter.run(notes);
+	Emitter baseline(options.block);
+	baseline.run(online);
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	std::string out = options.out.empty() ? baseName(in) + (options.block ? ".hc" : ".ymzt")
+			: options.out;
+	if (!(options.block ? writeFile(out, emitter.data.data(), emitter.data.size())
+			: writeTrace(out, emitter.trace))) {
+		fprintf(stderr, "cannot write %s\n", out.c_str());
+		return 1;
+	}
+	printf("%s: %zu notes in %zu sections, %u cut short, %u dropped, %u writes", in.c_str(),
+			notes.size(), sections.size(), ahead.stolen, ahead.dropped, emitter.writes);
+	if (options.block) {
+		printf(", %zu-byte block", emitter.data.size());
+	}
+	printf("\n  as the firmware would: %u cut short, %u dropped, %u writes\n", naive.stolen,
+			naive.dropped, baseline.writes);
+	printf("%.3f s on %u workers\n", elapsed, pool.workers());
+	return 0;
+}
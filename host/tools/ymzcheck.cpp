@@ -0,0 +1,1024 @@
+/**
+ * ymzcheck: regression checks of the firmware on the host.
+ *
+ *   ymzcheck
+ *
+ * Each check runs in a child process, on a firmware that has not run
+ * before, feeds its UART byte by byte and looks at the register writes
+ * that come out of the bus. The name of each
+ * check is printed with ok or what went wrong, and the exit status is 1
+ * if any failed. Checks of features the build leaves out (see feature.h)
+ * are skipped. 'make host-check' builds and runs it.
+ *
+ *   frames-commit  register frames chained with REGSTREAM_MORE land as one
+ *                  commit, however many loop() passes come between them
+ *   burst-order    a raw CC and a music note read in the same loop() pass
+ *                  reach the chips in the order they arrived
+ *   sample-step    drum samples play at their kit step, for steps whose
+ *                  rate scaling overflows 16 bits
+ *   buzzer-pitch   envelope periods for MIDI notes agree with
+ *                  setEnvelopeFrequency(), and a synced buzzer's tone and
+ *                  envelope play the same note
+ *   envelope-rate  both renderers repeat a sawtooth envelope at the
+ *                  frequency setEnvelopeFrequency() was given
+ *   player-delay   Hardchord Music delays (0xa1) last their milliseconds
+ *                  at any tempo, and with the external clock stopped
+ *   player-beat    beats (0xa0) end between ticks when their length does
+ *   chord-range    chord notes above MIDI note 127 are left silent rather
+ *                  than wrapping to the bottom of the range
+ *   arp-shared     a note on one chip leaves an arpeggio on the other
+ *                  running
+ *   tuning-bulk    an MTS bulk dump, longer than the MIDI library's SysEx
+ *                  buffer, retunes the notes it lists
+ *   sysex-order    a SysEx message that mutes voices, read in the same
+ *                  loop() pass after a raw CC, reaches the chips after it
+ *   clock-order    so does an arpeggio step played by a MIDI clock byte
+ *   slew-steps     slewed raw levels climb a step at a time over the time
+ *                  CC_LEVEL_SLEW gives, and a tick of the smoothing never
+ *                  writes more than SMOOTH_WRITES registers
+ *   route-table    SysEx routes are stored in EEPROM, sent back, and send
+ *                  a channel's notes to the chips they name
+ *   dynamics-level velocity, pressure and volume set music levels through
+ *                  the attenuation table, writing only levels that change
+ *   program-patch  program changes pick factory and stored patches, and a
+ *                  repeated note-on writes only the patch registers that
+ *                  differ
+ *   portamento     six voices glide at once over the time CC5 gives, in
+ *                  steps of no more than GLIDE_WRITES tone bytes a tick
+ *   schedule-latency  with a 10 ms offset, notes landing anywhere in a slow
+ *                  loop() pass play 10 ms after their last byte, to within
+ *                  a millisecond, and the statistics sent back agree
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "blep.h"
+#include "device.h"
+#include "feature.h"
+#include "hcYmzPlayer.h"
+#include "hcYmzShield.h"
+#include "host.h"
+#include "route.h"
+#include "serial.h"
+#include "ymz284.h"
+
+#define CHANNEL_MUSIC_STEREO 1
+#define CHANNEL_MUSIC_PSG1 2
+#define CHANNEL_MUSIC_PSG0 3
+#define CHANNEL_RAW_STEREO 7
+#define CHANNEL_RAW_PSG0 9
+#define CHANNEL_SAMPLES 10
+#define CHANNEL_UNROUTED 12
+#define CC_PORTAMENTO_TIME 5
+#define CC_VOLUME 7
+#define CC_CHORD 14
+#define CC_ARP_PATTERN 15
+#define CC_ARP_RATE 16
+#define CC_CHANNEL_A_FREQ_MSB 20
+#define CC_CHANNEL_A_LEVEL 25
+#define CC_FREQ_SLEW 81
+#define CC_LEVEL_SLEW 83
+#define CC_PORTAMENTO 65
+#define CHORD_POWER 13
+#define ARP_UP 1
+#define ARP_RATE_TICK 7
+#define PROGRAM_SNARE 3
+#define PROGRAM_SYNC_TRIANGLE 9
+#define PROGRAM_USER 10
+#define YMZ284_HZ 4000000.0
+#define SYSEX_ID 0x7d
+#define SYSEX_PATCH_STORE 0x01
+#define SYSEX_SERIAL 0x07
+#define SYSEX_ROUTE 0x08
+#define SYSEX_SCHEDULE 0x09
+#define REGSTREAM_RATE 3
+#define SLEW_UNIT_MS 8
+#define SMOOTH_WRITES 4
+#define GLIDE_WRITES 4
+
+extern "C" void loop();
+
+struct Write {
+	uint64_t time;
+	uint32_t pass; // loop() pass it was made in
+	uint8_t chip;
+	uint8_t reg;
+	uint8_t value;
+};
+
+struct Log {
+	std::vector<Write> writes;
+	uint32_t pass = 0;
+};
+
+static void logWrite(void *context, uint64_t time, uint8_t chip, uint8_t reg, uint8_t value) {
+	Log &log = *(Log *) context;
+	log.writes.push_back({ time, log.pass, chip, reg, value });
+}
+
+static Log *boot() {
+	static Log log;
+	log = Log();
+	deviceBoot();
+	hostBusSetSink(logWrite, &log);
+	return &log;
+}
+
+static void pass(Log &log, unsigned count) {
+	for (unsigned i = 0; i < count; i++) {
+		log.pass++;
+		loop();
+		hostAdvance(100);
+	}
+}
+
+static void push(const std::vector<uint8_t> &bytes) {
+	for (uint8_t value : bytes) {
+		hostSerialPush(value);
+	}
+}
+
+static void logTransmit(void *context, uint8_t value) {
+	((std::vector<uint8_t> *) context)->push_back(value);
+}
+
+static const Write *find(const Log &log, size_t from, uint8_t chip, uint8_t reg, uint8_t value) {
+	for (size_t i = from; i < log.writes.size(); i++) {
+		const Write &w = log.writes[i];
+		if (w.chip == chip && w.reg == reg && w.value == value) {
+			return &w;
+		}
+	}
+	return 0;
+}
+
+/**
+ * A write to each chip, encoded as a PSG0 frame marked REGSTREAM_MORE and
+ * a PSG1 frame, with loop() passes between the two frames' arrival.
+ */
+static bool checkFramesCommit(std::string &error) {
+	Log &log = *boot();
+	uint8_t request[] = { 0xf0, SYSEX_ID, SYSEX_SERIAL, REGSTREAM_RATE, 0xf7 };
+	devicePlay({ { 0, 0, std::vector<uint8_t>(request, request + sizeof(request)) } },
+			hostMicros(), 10000);
+
+	FrameEncoder encoder;
+	std::vector<uint8_t> frames;
+	encoder.write(1, 0x00, 0x11);
+	encoder.write(2, 0x00, 0x22);
+	if (encoder.flush(frames) != 2) {
+		error = "encoder did not split the batch in two";
+		return false;
+	}
+	size_t split = frames.size() / 2;
+	size_t start = log.writes.size();
+	push(std::vector<uint8_t>(frames.begin(), frames.begin() + split));
+	pass(log, 5);
+	if (find(log, start, 0, 0x00, 0x11)) {
+		error = "first frame was written before the one chained to it arrived";
+		return false;
+	}
+	push(std::vector<uint8_t>(frames.begin() + split, frames.end()));
+	pass(log, 5);
+	const Write *first = find(log, start, 0, 0x00, 0x11);
+	const Write *second = find(log, start, 1, 0x00, 0x22);
+	if (!first || !second) {
+		error = "frames were not applied";
+		return false;
+	}
+	if (first->pass != second->pass) {
+		error = "frames landed in loop() passes " + std::to_string(first->pass) + " and "
+				+ std::to_string(second->pass);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * The first write of a loop() pass that reads the given bytes, which
+ * have to be a raw level of 8 on PSG0 channel A.
+ */
+static bool rawLevelFirst(Log &log, const std::vector<uint8_t> &bytes, std::string &error) {
+	size_t start = log.writes.size();
+	push(bytes);
+	log.pass++;
+	loop();
+	if (log.writes.size() == start) {
+		error = "nothing was written";
+		return false;
+	}
+	const Write &w = log.writes[start];
+	if (w.chip != 0 || w.reg != 0x08 || w.value != 8) {
+		error = "first write was " + std::to_string(w.reg) + "=" + std::to_string(w.value)
+				+ ", not the raw level";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * A raw level CC followed by a music note-on on the same chips, both in
+ * the receive buffer when loop() runs: the level goes out before any of
+ * the note's writes.
+ */
+static bool checkBurstOrder(std::string &error) {
+	Log &log = *boot();
+	pass(log, 5);
+	return rawLevelFirst(log, { 0xb0 | (CHANNEL_RAW_PSG0 - 1), CC_CHANNEL_A_LEVEL, 8 << 2,
+			0x90 | (CHANNEL_MUSIC_STEREO - 1), 60, 127 }, error);
+}
+
+/**
+ * How long a sample hit plays for: from its note-on until the sample
+ * interrupt is switched off again.
+ */
+static uint64_t sampleSpan(uint8_t note) {
+	Log &log = *boot();
+	push({ 0x90 | (CHANNEL_SAMPLES - 1), note, 127 });
+	pass(log, 1);
+	uint64_t start = hostMicros();
+	while ((TIMSK2 & _BV(OCIE2A)) && hostMicros() - start < 1000000) {
+		pass(log, 1);
+	}
+	return (TIMSK2 & _BV(OCIE2A)) ? 0 : hostMicros() - start;
+}
+
+/**
+ * The kick at kit steps 16 (note 36) and 30 (note 45). 30 times the sample
+ * rate does not fit in 16 bits, which the AVR's int is: done in int there,
+ * the step wraps to 5 and the hit plays six times too long. The host's int
+ * is wider, so this only catches the scaling going wrong in some other way.
+ */
+static bool checkSampleStep(std::string &error) {
+	uint64_t unity = sampleSpan(36);
+	uint64_t fast = sampleSpan(45);
+	if (!unity || !fast) {
+		error = "kick did not play";
+		return false;
+	}
+	// spans go as 1 / step, to within a loop() pass
+	uint64_t expected = unity * 16 / 30;
+	if (fast + 500 < expected || fast > expected + 500) {
+		error = "step 30 played for " + std::to_string(fast) + " us, not about "
+				+ std::to_string(expected);
+		return false;
+	}
+	return true;
+}
+
+#if HCYMZ_FLOAT
+static double noteHz(uint8_t note) {
+	return 440.0 * pow(2.0, (note - 69) / 12.0);
+}
+#endif
+
+static bool near(double value, double expected, double tolerance) {
+	return fabs(value - expected) <= expected * tolerance;
+}
+
+/**
+ * The sawtooth envelope period for each MIDI note against the one
+ * setEnvelopeFrequency() works out for the note's frequency, then the
+ * synced triangle patch playing A4: the tone is locked to the envelope,
+ * and both have to sound at 440 Hz.
+ */
+static bool checkBuzzerPitch(std::string &error) {
+#if HCYMZ_FLOAT
+	boot();
+	for (uint8_t note = 24; note <= 108; note++) {
+		YMZ.setEnvelopeFrequency(noteHz(note));
+		uint16_t expected = YMZ.getRegisterPsg0(0x0b) | (YMZ.getRegisterPsg0(0x0c) << 8);
+		uint16_t ep = YMZ.getEnvelopePeriodMidi(note);
+		if (abs(ep - expected) > 1 && !near(ep, expected, 0.02)) {
+			error = "note " + std::to_string(note) + " has envelope period "
+					+ std::to_string(ep) + ", not " + std::to_string(expected);
+			return false;
+		}
+	}
+#endif
+
+	Log &log = *boot();
+	push({ 0xc0 | (CHANNEL_MUSIC_STEREO - 1), PROGRAM_SYNC_TRIANGLE,
+			0x90 | (CHANNEL_MUSIC_STEREO - 1), 69, 127 });
+	pass(log, 5);
+	for (uint8_t channel = 0; channel < 3; channel++) {
+		if (YMZ.getRegisterPsg0(0x08 + channel) != 0x10) {
+			continue;
+		}
+		uint16_t tp = YMZ.getRegisterPsg0(channel * 2)
+				| ((YMZ.getRegisterPsg0(channel * 2 + 1) & 0x0f) << 8);
+		uint16_t ep = YMZ.getRegisterPsg0(0x0b) | (YMZ.getRegisterPsg0(0x0c) << 8);
+		// fM / (32 * TP) and, a triangle being two sawtooth ramps, fM / (1024 * EP)
+		double tone = YMZ284_HZ / 32.0 / tp;
+		double envelope = YMZ284_HZ / 1024.0 / ep;
+		if (!near(tone, 440, 0.03) || !near(envelope, 440, 0.03)) {
+			error = "A4 played its tone at " + std::to_string(tone) + " Hz and its envelope at "
+					+ std::to_string(envelope) + " Hz";
+			return false;
+		}
+		return true;
+	}
+	error = "no channel plays the envelope";
+	return false;
+}
+
+#if HCYMZ_FLOAT
+/**
+ * Cycles of a falling sawtooth: it crosses its middle going up once a
+ * cycle, at the jump. Ringing around the jump stays near the top and
+ * bottom, and a crossing only counts after the signal has gone well below
+ * the middle again.
+ */
+static unsigned sawtoothCycles(const std::vector<float> &signal) {
+	float low = signal[0], high = signal[0];
+	for (float value : signal) {
+		low = (value < low) ? value : low;
+		high = (value > high) ? value : high;
+	}
+	float middle = (low + high) / 2, margin = (high - low) / 4;
+	unsigned cycles = 0;
+	bool armed = false;
+	for (float value : signal) {
+		if (value < middle - margin) {
+			armed = true;
+		} else if (armed && value > middle) {
+			cycles++;
+			armed = false;
+		}
+	}
+	return cycles;
+}
+#endif
+
+/**
+ * A falling sawtooth on channel A, with the period setEnvelopeFrequency()
+ * picks, played for a second on the emulated chip and through the
+ * band-limited renderer. The period is whole, so the frequency to match is
+ * that of the period, fM / (512 * EP).
+ */
+static bool checkEnvelopeRate(std::string &error) {
+#if HCYMZ_FLOAT
+	const unsigned rates[] = { 55, 110, 220, 440 };
+	const uint8_t regs[][2] = { { 0x07, 0x3f }, { 0x08, 0x10 }, { 0x0b, 0 }, { 0x0c, 0 }, { 0x0d, 0x08 } };
+	for (unsigned hz : rates) {
+		boot();
+		YMZ.setEnvelopeFrequency(hz);
+		uint16_t ep = YMZ.getRegisterPsg0(0x0b) | (YMZ.getRegisterPsg0(0x0c) << 8);
+		double expected = YMZ284_HZ / 512 / ep;
+		if (!near(hz, expected, 0.05)) {
+			error = std::to_string(hz) + " Hz was given period " + std::to_string(ep);
+			return false;
+		}
+
+		Ymz284 chip;
+		BlepRenderer blep;
+		for (const uint8_t *reg : regs) {
+			uint8_t value = (reg[0] == 0x0b) ? (ep & 0xff) : (reg[0] == 0x0c) ? (ep >> 8) : reg[1];
+			chip.write(reg[0], value);
+			blep.write(0, 0, reg[0], value);
+		}
+		std::vector<float> ticks(YMZ284_TICK_RATE);
+		for (float &out : ticks) {
+			out = chip.tick();
+		}
+		blep.finish(1000000);
+		std::vector<float> samples;
+		for (size_t i = 0; i < blep.samples().size(); i += 2) {
+			samples.push_back(blep.samples()[i] + blep.samples()[i + 1]);
+		}
+
+		unsigned cycles[] = { sawtoothCycles(ticks), sawtoothCycles(samples) };
+		const char *names[] = { "emulator", "band-limited renderer" };
+		for (int i = 0; i < 2; i++) {
+			if (!near(cycles[i], expected, 0.01)) {
+				error = std::to_string(hz) + " Hz (period " + std::to_string(ep) + ") played at "
+						+ std::to_string(cycles[i]) + " Hz on the " + names[i];
+				return false;
+			}
+		}
+	}
+#endif
+	return true;
+}
+
+/**
+ * Play a block through hcYmzPlayer, polling it every 100 us for at most a
+ * second of virtual time.
+ */
+static bool playBlock(Log &log, const std::vector<uint8_t> &block) {
+	hcYmzProgmemSource source(block.data());
+	hcYmzPlayer player;
+	player.play(source);
+	uint64_t start = hostMicros();
+	while (player.poll()) {
+		if (hostMicros() - start > 1000000) {
+			return false;
+		}
+		pass(log, 1);
+	}
+	return true;
+}
+
+/**
+ * Three notes 5 and 7 ms apart at 40 BPM, where a tick is 62.5 ms, first
+ * on the internal clock and then on an external one that never starts.
+ */
+static bool checkPlayerDelay(std::string &error) {
+	const std::vector<uint8_t> block = { 'H', 'C', 0, 0x81, 0, 60, 0xa1, 0, 5, 0x81, 0, 62,
+			0xa1, 0, 7, 0x81, 0, 64, 0 };
+	for (uint8_t source : { CLOCK_INTERNAL, CLOCK_EXTERNAL }) {
+		Log &log = *boot();
+		YMZ.setTempo(40);
+		YMZ.setClockSource(source);
+		size_t from = log.writes.size();
+		if (!playBlock(log, block)) {
+			error = "block did not end within a second";
+			return false;
+		}
+		const Write *notes[3];
+		for (int i = 0; i < 3; i++) {
+			uint16_t tp = YMZ.getTonePeriodMidi(60 + 2 * i);
+			notes[i] = find(log, from, 0, 0x00, tp & 0xff);
+			if (!notes[i]) {
+				error = "note " + std::to_string(i) + " was not written";
+				return false;
+			}
+		}
+		uint64_t gaps[] = { notes[1]->time - notes[0]->time, notes[2]->time - notes[1]->time };
+		if (gaps[0] < 5000 || gaps[0] > 5200 || gaps[1] < 7000 || gaps[1] > 7200) {
+			error = "delays of 5 and 7 ms took " + std::to_string(gaps[0]) + " and "
+					+ std::to_string(gaps[1]) + " us";
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Notes a 1/64 beat apart at 20 BPM: 1.5 ticks of 125 ms, so every other
+ * one ends halfway through a tick.
+ */
+static bool checkPlayerBeat(std::string &error) {
+	const std::vector<uint8_t> block = { 'H', 'C', 0, 0x81, 0, 60, 0xa0, 64, 8, 0x81, 0, 62,
+			0xa0, 64, 8, 0x81, 0, 64, 0xa0, 64, 8, 0x81, 0, 65, 0 };
+	Log &log = *boot();
+	YMZ.setTempo(20);
+	// the tick under way when the tempo changed keeps its old length
+	uint32_t settled = YMZ.getClock() + 2;
+	while (YMZ.getClock() < settled) {
+		pass(log, 1);
+	}
+	size_t from = log.writes.size();
+	if (!playBlock(log, block)) {
+		error = "block did not end within a second";
+		return false;
+	}
+	const uint8_t notes[] = { 60, 62, 64, 65 };
+	const Write *previous = 0;
+	for (uint8_t note : notes) {
+		const Write *w = find(log, from, 0, 0x00, YMZ.getTonePeriodMidi(note) & 0xff);
+		if (!w) {
+			error = "note " + std::to_string(note) + " was not written";
+			return false;
+		}
+		if (previous && (w->time - previous->time < 187000 || w->time - previous->time > 188500)) {
+			error = "note " + std::to_string(note) + " came "
+					+ std::to_string(w->time - previous->time) + " us after the last, not 187500";
+			return false;
+		}
+		previous = w;
+	}
+	return true;
+}
+
+/**
+ * A power chord (root, fifth, octave) on note 120 over both chips: the
+ * octave, note 132, is not a MIDI note, so channel C of each chip has to
+ * stay closed in the mixer.
+ */
+static bool checkChordRange(std::string &error) {
+	Log &log = *boot();
+	push({ 0xb0 | (CHANNEL_MUSIC_STEREO - 1), CC_CHORD, CHORD_POWER,
+			0x90 | (CHANNEL_MUSIC_STEREO - 1), 120, 127 });
+	pass(log, 5);
+	uint8_t mixers[] = { YMZ.getRegisterPsg0(0x07), YMZ.getRegisterPsg1(0x07) };
+	for (int chip = 0; chip < 2; chip++) {
+		// tone and noise closed on channel C, tone open on the root
+		if ((mixers[chip] & 0x25) != 0x24) {
+			error = "chip " + std::to_string(chip) + " has mixer " + std::to_string(mixers[chip]);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * An arpeggio stepping every tick on PSG1, then a plain note on PSG0:
+ * the arpeggio goes on stepping through the next ten ticks.
+ */
+static bool checkArpShared(std::string &error) {
+	Log &log = *boot();
+	push({ 0xb0 | (CHANNEL_MUSIC_PSG1 - 1), CC_ARP_PATTERN, ARP_UP,
+			0xb0 | (CHANNEL_MUSIC_PSG1 - 1), CC_ARP_RATE, ARP_RATE_TICK,
+			0x90 | (CHANNEL_MUSIC_PSG1 - 1), 60, 127 });
+	pass(log, 5);
+	push({ 0x90 | (CHANNEL_MUSIC_PSG0 - 1), 72, 127 });
+	pass(log, 5);
+	size_t from = log.writes.size();
+	uint32_t end = YMZ.getClock() + 10;
+	while (YMZ.getClock() < end) {
+		pass(log, 1);
+	}
+	unsigned steps = 0;
+	for (size_t i = from; i < log.writes.size(); i++) {
+		steps += (log.writes[i].chip == 1 && log.writes[i].reg == 0x00);
+	}
+	if (steps < 8) {
+		error = "the arpeggio stepped " + std::to_string(steps) + " times in ten ticks";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * A bulk dump that moves A4 (69) up a semitone and a half and leaves every
+ * other note as it is, sent with a clock byte in the middle as a sequencer
+ * would.
+ */
+static bool checkTuningBulk(std::string &error) {
+#if HCYMZ_TUNING
+	Log &log = *boot();
+	uint16_t a4 = YMZ.getTonePeriodMidi(69);
+	uint16_t bb4 = YMZ.getTonePeriodMidi(70);
+	uint16_t b4 = YMZ.getTonePeriodMidi(71);
+
+	std::vector<uint8_t> dump = { 0xf0, 0x7e, 0x7f, 0x08, 0x01, 0x00 };
+	dump.resize(dump.size() + 16, ' ');
+	for (uint8_t note = 0; note < 128; note++) {
+		if (note == 69) {
+			dump.insert(dump.end(), { 70, 0x40, 0x00 });
+		} else {
+			dump.insert(dump.end(), { 0x7f, 0x7f, 0x7f });
+		}
+	}
+	dump.insert(dump.end(), { 0x00, 0xf7 });
+	dump.insert(dump.begin() + 200, 0xf8);
+	// in pieces the receive buffer holds, as the UART would deliver them
+	for (size_t i = 0; i < dump.size(); i += 32) {
+		push(std::vector<uint8_t>(dump.begin() + i, dump.begin() + std::min(i + 32, dump.size())));
+		pass(log, 1);
+	}
+	pass(log, 5);
+
+	uint16_t tp = YMZ.getTonePeriodMidi(69);
+	if (tp >= bb4 || tp <= b4) {
+		error = "A4 has period " + std::to_string(tp) + ", not between " + std::to_string(bb4)
+				+ " and " + std::to_string(b4) + " (it was " + std::to_string(a4) + ")";
+		return false;
+	}
+	if (YMZ.getTonePeriodMidi(70) != bb4) {
+		error = "note 70 was retuned too";
+		return false;
+	}
+#endif
+	return true;
+}
+
+/**
+ * A note on the stereo music channel, then a raw level CC followed by a
+ * route SysEx turning that channel off, which mutes its voices.
+ */
+static bool checkSysexOrder(std::string &error) {
+	Log &log = *boot();
+	push({ 0x90 | (CHANNEL_MUSIC_STEREO - 1), 60, 127 });
+	pass(log, 5);
+	return rawLevelFirst(log, { 0xb0 | (CHANNEL_RAW_PSG0 - 1), CC_CHANNEL_A_LEVEL, 8 << 2,
+			0xf0, SYSEX_ID, SYSEX_ROUTE, CHANNEL_MUSIC_STEREO - 1, 0, 0, 0xf7 }, error);
+}
+
+/**
+ * An arpeggio stepping every tick of an external clock on PSG0, then a
+ * raw level CC followed by a clock byte.
+ */
+static bool checkClockOrder(std::string &error) {
+	Log &log = *boot();
+	push({ 0xfa, 0xb0 | (CHANNEL_MUSIC_PSG0 - 1), CC_ARP_PATTERN, ARP_UP,
+			0xb0 | (CHANNEL_MUSIC_PSG0 - 1), CC_ARP_RATE, ARP_RATE_TICK,
+			0x90 | (CHANNEL_MUSIC_PSG0 - 1), 60, 127 });
+	pass(log, 5);
+	return rawLevelFirst(log, { 0xb0 | (CHANNEL_RAW_PSG0 - 1), CC_CHANNEL_A_LEVEL, 8 << 2,
+			0xf8 }, error);
+}
+
+/**
+ * Raw level A on PSG0 from 0 to 15 with a 10-unit level slew, then every
+ * level and tone period of both chips moved at once, which is more than
+ * a tick's writes.
+ */
+static bool checkSlewSteps(std::string &error) {
+	const uint8_t raw = 0xb0 | (CHANNEL_RAW_STEREO - 1);
+	Log &log = *boot();
+	push({ raw, CC_CHANNEL_A_LEVEL, 0, raw, CC_LEVEL_SLEW, 10, raw, CC_FREQ_SLEW, 10 });
+	pass(log, 5);
+	size_t from = log.writes.size();
+	push({ 0xb0 | (CHANNEL_RAW_PSG0 - 1), CC_CHANNEL_A_LEVEL, 15 << 2 });
+	pass(log, 2000);
+
+	bool ok = true;
+	uint8_t level = 0;
+	uint64_t start = 0, end = 0;
+	for (size_t i = from; i < log.writes.size() && ok; i++) {
+		const Write &w = log.writes[i];
+		if (w.chip == 0 && w.reg == 0x08) {
+			ok = (w.value == level + 1);
+			level = w.value;
+			start = start ? start : w.time;
+			end = w.time;
+		}
+	}
+	uint64_t full = 10 * SLEW_UNIT_MS * 1000;
+	if (!ok || level != 15) {
+		error = "level went to " + std::to_string(level) + " after "
+				+ std::to_string(end - start) + " us, not a step at a time to 15";
+	} else if (end - start < full * 8 / 10 || end - start > full * 12 / 10) {
+		error = "level took " + std::to_string(end - start) + " us to climb, not about "
+				+ std::to_string(full);
+		ok = false;
+	}
+
+	if (ok) {
+		from = log.writes.size();
+		for (uint8_t channel = 0; channel < 3; channel++) {
+			push({ raw, (uint8_t) (CC_CHANNEL_A_LEVEL + channel), 8 << 2,
+					raw, (uint8_t) (CC_CHANNEL_A_FREQ_MSB + channel), 0x7f });
+		}
+		pass(log, 2000);
+		for (size_t i = from; i < log.writes.size() && ok; i++) {
+			size_t j = i;
+			while (j < log.writes.size() && log.writes[j].pass == log.writes[i].pass) {
+				j++;
+			}
+			if (j - i > SMOOTH_WRITES) {
+				error = std::to_string(j - i) + " writes in one loop() pass";
+				ok = false;
+			}
+			i = j - 1;
+		}
+		for (uint8_t chip = 0; chip < 2 && ok; chip++) {
+			uint8_t c = (chip ? YMZ.getRegisterPsg1(0x09) : YMZ.getRegisterPsg0(0x09));
+			uint8_t high = (chip ? YMZ.getRegisterPsg1(0x05) : YMZ.getRegisterPsg0(0x05));
+			if (c != 8 || high != 0x0f) {
+				error = "chip " + std::to_string(chip) + " ended on level " + std::to_string(c)
+						+ " and period high " + std::to_string(high);
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+struct Check {
+	const char *name;
+	bool enabled;
+	bool (*run)(std::string &error);
+};
+
+/**
+ * Run a check in a child process. deviceBoot() only resets the host side,
+ * so this is what gives each check a firmware and shield in their
+ * power-on state rather than whatever the last check left.
+ */
+static bool runIsolated(const Check &check, std::string &error) {
+	int pipes[2];
+	if (pipe(pipes)) {
+		error = "no pipe for the check";
+		return false;
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(pipes[0]);
+		std::string message;
+		bool ok = check.run(message);
+		ssize_t written = write(pipes[1], message.data(), message.size());
+		_exit(ok && written == (ssize_t) message.size() ? 0 : 1);
+	}
+	close(pipes[1]);
+	char buffer[256];
+	ssize_t got;
+	while (pid > 0 && (got = read(pipes[0], buffer, sizeof(buffer))) > 0) {
+		error.append(buffer, got);
+	}
+	close(pipes[0]);
+	int status = 0;
+	if (pid > 0) {
+		waitpid(pid, &status, 0);
+	}
+	if (!WIFEXITED(status)) {
+		error = "check did not finish";
+		return false;
+	}
+	return WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Channel 12, unrouted by default, routed to music on PSG1 and channel 1
+ * routed off, plus a route with no such kind that has to be refused.
+ */
+static bool checkRouteTable(std::string &error) {
+	Log &log = *boot();
+	std::vector<uint8_t> sent;
+	hostSerialSetSink(logTransmit, &sent);
+	push({ 0xf0, SYSEX_ID, SYSEX_ROUTE, CHANNEL_UNROUTED - 1, ROUTE_MUSIC, ROUTE_PSG1, 0xf7,
+			0xf0, SYSEX_ID, SYSEX_ROUTE, CHANNEL_MUSIC_STEREO - 1, ROUTE_OFF, 0, 0xf7,
+			0xf0, SYSEX_ID, SYSEX_ROUTE, 0, ROUTE_KIND_COUNT, ROUTE_BOTH, 0xf7 });
+	pass(log, 5);
+
+	// three replies, the last one the table as it stands
+	uint8_t expected[ROUTE_CHANNELS];
+	loadRoutes(expected);
+	if (expected[CHANNEL_UNROUTED - 1] != ROUTE(ROUTE_MUSIC, ROUTE_PSG1)
+			|| expected[CHANNEL_MUSIC_STEREO - 1] != ROUTE_OFF) {
+		error = "routes were not stored in EEPROM";
+		return false;
+	}
+	size_t reply = 3 + ROUTE_CHANNELS + 1;
+	if (sent.size() != 3 * reply || sent[2 * reply + 1] != SYSEX_ID
+			|| sent[2 * reply + 2] != SYSEX_ROUTE
+			|| !std::equal(expected, expected + ROUTE_CHANNELS, sent.begin() + 2 * reply + 3)) {
+		error = "the table sent back was not the stored one";
+		return false;
+	}
+
+	size_t from = log.writes.size();
+	push({ 0x90 | (CHANNEL_MUSIC_STEREO - 1), 60, 127 });
+	pass(log, 5);
+	if (log.writes.size() != from) {
+		error = "a note on the channel routed off was played";
+		return false;
+	}
+	push({ 0x90 | (CHANNEL_UNROUTED - 1), 60, 127 });
+	pass(log, 5);
+	uint16_t tp = YMZ.getTonePeriodMidi(60);
+	if (!find(log, from, 1, 0x00, tp & 0xff)) {
+		error = "the newly routed channel did not play on PSG1";
+		return false;
+	}
+	for (size_t i = from; i < log.writes.size(); i++) {
+		if (log.writes[i].chip != 1) {
+			error = "the newly routed channel wrote PSG0";
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * The square patch (level 10) on PSG0 as velocity, channel pressure and
+ * volume change. Attenuations are in half steps: 8 for 32, 4 for 64 and
+ * none for 120 and up.
+ */
+static bool checkDynamicsLevel(std::string &error) {
+	const uint8_t channel = CHANNEL_MUSIC_PSG0 - 1;
+	struct Step {
+		std::vector<uint8_t> bytes;
+		uint8_t level; // of channel A after the bytes
+		bool writes;   // whether they may write the levels
+		const char *what;
+	};
+	const Step steps[] = {
+		{ { 0x90 | channel, 60, 127 }, 10, true, "velocity 127" },
+		{ { 0x80 | channel, 60, 0, 0x90 | channel, 60, 32 }, 6, true, "velocity 32" },
+		{ { 0xd0 | channel, 127 }, 10, true, "pressure 127" },
+		{ { 0xd0 | channel, 127 }, 10, false, "pressure 127 again" },
+		{ { 0xd0 | channel, 10 }, 6, true, "pressure below velocity" },
+		{ { 0xb0 | channel, CC_VOLUME, 64 }, 4, true, "volume 64" },
+		{ { 0xd0 | channel, 127 }, 8, true, "pressure 127 at volume 64" },
+		{ { 0xd0 | channel, 121, 0xd0 | channel, 124, 0xd0 | channel, 126 }, 8, false,
+				"a pressure stream within a level" },
+	};
+	Log &log = *boot();
+	for (const Step &step : steps) {
+		size_t from = log.writes.size();
+		push(step.bytes);
+		pass(log, 5);
+		bool wrote = false;
+		for (size_t i = from; i < log.writes.size(); i++) {
+			wrote |= (log.writes[i].reg >= 0x08 && log.writes[i].reg <= 0x0a);
+		}
+		if (YMZ.getRegisterPsg0(0x08) != step.level || (wrote && !step.writes)) {
+			error = std::string(step.what) + " left level " + std::to_string(YMZ.getRegisterPsg0(0x08))
+					+ (wrote ? " and wrote" : "") + ", expected " + std::to_string(step.level);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * The snare (noise only, level 13, noise period 8), then a tone patch at
+ * level 7 stored over SysEx as program 10, played twice, then program 11,
+ * which was never stored and has to leave program 10 in place.
+ */
+static bool checkProgramPatch(std::string &error) {
+	const uint8_t channel = CHANNEL_MUSIC_PSG0 - 1;
+	Log &log = *boot();
+	size_t from = log.writes.size();
+	push({ 0xc0 | channel, PROGRAM_SNARE, 0x90 | channel, 60, 127 });
+	pass(log, 1);
+	if (!find(log, from, 0, 0x07, 0x07) || !find(log, from, 0, 0x06, 8)
+			|| !find(log, from, 0, 0x08, 13)) {
+		error = "the snare did not set noise, its period and its level";
+		return false;
+	}
+
+	Patch patch = { PATCH_TONE, 7, 0, 0, 0, 0, 0, 0, 0 };
+	std::vector<uint8_t> store = { 0xf0, SYSEX_ID, SYSEX_PATCH_STORE, PROGRAM_USER };
+	for (size_t i = 0; i < sizeof(patch); i++) {
+		uint8_t value = ((const uint8_t *) &patch)[i];
+		store.insert(store.end(), { (uint8_t) (value >> 4), (uint8_t) (value & 0x0f) });
+	}
+	store.push_back(0xf7);
+	push(store);
+	push({ 0x80 | channel, 60, 0, 0xc0 | channel, PROGRAM_USER, 0x90 | channel, 62, 127 });
+	pass(log, 5);
+	if (YMZ.getRegisterPsg0(0x07) != 0x38 || YMZ.getRegisterPsg0(0x08) != 7) {
+		error = "the stored patch played with mixer " + std::to_string(YMZ.getRegisterPsg0(0x07))
+				+ " and level " + std::to_string(YMZ.getRegisterPsg0(0x08));
+		return false;
+	}
+
+	push({ 0x80 | channel, 62, 0, 0xc0 | channel, PROGRAM_USER + 1 });
+	pass(log, 5);
+	from = log.writes.size();
+	push({ 0x90 | channel, 62, 127 });
+	pass(log, 5);
+	// of the patch's registers (0x06 up), only the mixer had changed
+	for (size_t i = from; i < log.writes.size(); i++) {
+		if (log.writes[i].reg >= 0x06 && log.writes[i].reg != 0x07) {
+			error = "playing the note again wrote register " + std::to_string(log.writes[i].reg);
+			return false;
+		}
+	}
+	if (YMZ.getRegisterPsg0(0x07) != 0x38) {
+		error = "playing the note again left mixer " + std::to_string(YMZ.getRegisterPsg0(0x07));
+		return false;
+	}
+	return true;
+}
+
+/**
+ * A C3 major chord on both chips, then C5 with portamento on at time 40:
+ * 40 * 40 / 4 ms, or 400 ms.
+ */
+static bool checkPortamento(std::string &error) {
+	const uint8_t channel = CHANNEL_MUSIC_STEREO - 1;
+	Log &log = *boot();
+	push({ 0xb0 | channel, CC_PORTAMENTO_TIME, 40, 0xb0 | channel, CC_PORTAMENTO, 127,
+			0x90 | channel, 48, 127 });
+	pass(log, 5);
+	size_t from = log.writes.size();
+	push({ 0x90 | channel, 72, 127 });
+	pass(log, 6000);
+
+	uint16_t tp = YMZ.getTonePeriod(0);
+	uint64_t start = 0, end = 0;
+	unsigned values = 0;
+	for (size_t i = from; i < log.writes.size(); i++) {
+		const Write &w = log.writes[i];
+		if (w.reg > 0x05) {
+			continue;
+		}
+		size_t writes = 0;
+		for (size_t j = i; j < log.writes.size() && log.writes[j].pass == w.pass; j++) {
+			writes += (log.writes[j].reg <= 0x05);
+		}
+		if (writes > GLIDE_WRITES) {
+			error = std::to_string(writes) + " tone writes in one loop() pass";
+			return false;
+		}
+		if (w.chip == 0 && w.reg == 0x00) {
+			start = start ? start : w.time;
+			end = w.time;
+			values++;
+		}
+	}
+	const uint8_t notes[] = { 72, 76, 79 };
+	for (uint8_t voice = 0; voice < 6; voice++) {
+		if (YMZ.getTonePeriod(voice) != YMZ.getTonePeriodMidi(notes[voice % 3])) {
+			error = "voice " + std::to_string(voice) + " ended on period "
+					+ std::to_string(YMZ.getTonePeriod(voice));
+			return false;
+		}
+	}
+	if (values < 100 || end - start < 380000 || end - start > 420000) {
+		error = "C5 (period " + std::to_string(tp) + ") came in " + std::to_string(values)
+				+ " steps over " + std::to_string(end - start) + " us, not over 400 ms";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Eight notes on PSG0 at irregular times off the cable, with loop()
+ * passes of 400 us run back to back, so each note's last byte lands at a
+ * different point of a pass. The statistics come back as 14-bit pairs,
+ * low first: events, forced, worst and mean lateness.
+ */
+static bool checkScheduleLatency(std::string &error) {
+	const uint8_t channel = CHANNEL_MUSIC_PSG0 - 1;
+	const unsigned count = 8;
+	Log &log = *boot();
+	std::vector<uint8_t> sent;
+	hostSerialSetSink(logTransmit, &sent);
+	std::vector<MidiEvent> events = { { 0, 0, { 0xf0, SYSEX_ID, SYSEX_SCHEDULE, 10, 0xf7 } } };
+	for (unsigned i = 0; i < count; i++) {
+		events.push_back({ 20000 + i * 30000 + i * 173, 0, { 0x90 | channel, (uint8_t) (48 + i), 127 } });
+	}
+	events.push_back({ 20000 + count * 30000, 0, { 0xf0, SYSEX_ID, SYSEX_SCHEDULE, 0xf7 } });
+	DeviceOptions options;
+	options.spin = true;
+	options.loopUs = 400;
+	uint64_t start = hostMicros();
+	devicePlay(events, start, 20000, options);
+
+	size_t from = 0;
+	for (unsigned i = 0; i < count; i++) {
+		uint64_t arrival = start + events[i + 1].time + 3 * MIDI_BYTE_US;
+		uint16_t tp = YMZ.getTonePeriodMidi(48 + i);
+		const Write *w = find(log, from, 0, 0x00, tp & 0xff);
+		if (!w) {
+			error = "note " + std::to_string(48 + i) + " was not written";
+			return false;
+		}
+		if (w->time < arrival + 10000 || w->time > arrival + 11000) {
+			error = "note " + std::to_string(48 + i) + " played "
+					+ std::to_string((int64_t) (w->time - arrival)) + " us after its last byte";
+			return false;
+		}
+		from = w - log.writes.data() + 1;
+	}
+
+	const size_t size = 13;
+	if (sent.size() < size || sent[sent.size() - size + 2] != SYSEX_SCHEDULE) {
+		error = "no statistics were sent back";
+		return false;
+	}
+	const uint8_t *reply = sent.data() + sent.size() - size + 4;
+	unsigned stats[4];
+	for (int i = 0; i < 4; i++) {
+		stats[i] = reply[2 * i] | (reply[2 * i + 1] << 7);
+	}
+	if (stats[0] != count || stats[1] || stats[2] >= 1000 || stats[3] > stats[2]) {
+		error = "statistics were " + std::to_string(stats[0]) + " events, " + std::to_string(stats[1])
+				+ " forced, " + std::to_string(stats[2]) + " us worst, " + std::to_string(stats[3])
+				+ " us mean";
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	const Check checks[] = {
+		{ "frames-commit", YMZ_REGSTREAM, checkFramesCommit },
+		{ "burst-order", YMZ_RAW && YMZ_MUSIC, checkBurstOrder },
+		{ "sample-step", YMZ_SAMPLES, checkSampleStep },
+		{ "buzzer-pitch", YMZ_MUSIC, checkBuzzerPitch },
+		{ "envelope-rate", HCYMZ_FLOAT, checkEnvelopeRate },
+		{ "player-delay", !!(HCYMZ_PLAYER_OPS & HCYMZ_OPS_TIMING), checkPlayerDelay },
+		{ "player-beat", !!(HCYMZ_PLAYER_OPS & HCYMZ_OPS_TIMING), checkPlayerBeat },
+		{ "chord-range", YMZ_MUSIC, checkChordRange },
+		{ "arp-shared", YMZ_MUSIC, checkArpShared },
+		{ "tuning-bulk", YMZ_TUNING && HCYMZ_TUNING, checkTuningBulk },
+		{ "sysex-order", YMZ_RAW && YMZ_MUSIC, checkSysexOrder },
+		{ "clock-order", YMZ_RAW && YMZ_MUSIC, checkClockOrder },
+		{ "slew-steps", YMZ_SMOOTH, checkSlewSteps },
+		{ "route-table", YMZ_MUSIC, checkRouteTable },
+		{ "dynamics-level", YMZ_MUSIC, checkDynamicsLevel },
+		{ "program-patch", YMZ_MUSIC, checkProgramPatch },
+		{ "portamento", YMZ_MUSIC, checkPortamento },
+		{ "schedule-latency", YMZ_SCHEDULE && YMZ_MUSIC, checkScheduleLatency },
+	};
+	unsigned failed = 0;
+	for (const Check &check : checks) {
+		std::string error;
+		if (!check.enabled) {
+			printf("%-16s skipped\n", check.name);
+		} else if (runIsolated(check, error)) {
+			printf("%-16s ok\n", check.name);
+		} else {
+			printf("%-16s FAILED: %s\n", check.name, error.c_str());
+			failed++;
+		}
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,322 @@
+/**
+ * ymzimport: convert AY/YM register logs for the shield.
+ *
+ *   ymzimport [-j jobs] [-c clock] [-t mid|ymzt] [-o out] input ...
+ *
+ * Reads YM, VGM and PSG files (see import.h), rescales their periods from
+ * the source chip's clock, or -c hz, to the YMZ284's, and writes either a
+ * MIDI file that plays them through the raw channels or a register trace
+ * for ymzsend. A single-chip log plays on both chips through the stereo
+ * channel; a dual-chip VGM puts its first chip on PSG0 (right) and its
+ * second on PSG1 (left). In the MIDI file the writes of each instant are
+ * wrapped in CC_LATCH so they land together.
+ *
+ * Directories are searched for .ym, .vgm and .psg files. With one input, -o
+ * names the output file; with several, -o names a directory and the files
+ * are converted in parallel.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "import.h"
+#include "pool.h"
+#include "smf.h"
+#include "trace.h"
+
+#define CHANNEL_RAW_STEREO 7
+#define CHANNEL_RAW_LEFT 8
+#define CHANNEL_RAW_RIGHT 9
+
+#define CC_CHANNEL_A_FREQ_MSB 20
+#define CC_CHANNEL_A_FREQ_LSB 52
+#define CC_NOISE_FREQ 23
+#define CC_MIXER 24
+#define CC_CHANNEL_A_LEVEL 25
+#define CC_ENVELOPE_FREQ_HIGH 28
+#define CC_ENVELOPE_FREQ_MED 29
+#define CC_ENVELOPE_FREQ_LOW 30
+#define CC_ENVELOPE_SHAPE 31
+#define CC_LATCH 80
+
+struct Options {
+	unsigned jobs = 0;
+	uint32_t clock = 0;
+	bool midi = true;
+	std::string out;
+};
+
+static void usage() {
+	fprintf(stderr, "usage: ymzimport [-j jobs] [-c clock] [-t mid|ymzt] [-o out] input ...\n");
+	exit(2);
+}
+
+static std::string baseName(const std::string &path) {
+	size_t slash = path.find_last_of('/');
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+static bool isLog(const std::string &name) {
+	size_t dot = name.find_last_of('.');
+	if (dot == std::string::npos) {
+		return false;
+	}
+	std::string extension = name.substr(dot + 1);
+	for (char &c : extension) {
+		c = tolower(c);
+	}
+	return extension == "ym" || extension == "vgm" || extension == "psg";
+}
+
+/**
+ * Add a file, or the logs in a directory. Returns true for a directory.
+ */
+static bool addInput(const std::string &path, std::vector<std::string> &inputs) {
+	struct stat info;
+	if (stat(path.c_str(), &info) || !S_ISDIR(info.st_mode)) {
+		inputs.push_back(path);
+		return false;
+	}
+	DIR *dir = opendir(path.c_str());
+	if (!dir) {
+		return true;
+	}
+	std::vector<std::string> found;
+	while (struct dirent *entry = readdir(dir)) {
+		if (isLog(entry->d_name)) {
+			found.push_back(path + "/" + entry->d_name);
+		}
+	}
+	closedir(dir);
+	std::sort(found.begin(), found.end());
+	inputs.insert(inputs.end(), found.begin(), found.end());
+	return true;
+}
+
+/**
+ * Turns register writes into raw channel CCs, sending only the parts of a
+ * period the controllers split it into that changed.
+ */
+class RawMidiEncoder {
+public:
+	RawMidiEncoder() {
+		memset(_image, 0, sizeof(_image));
+		memset(_known, 0, sizeof(_known));
+	}
+
+	void write(uint8_t chips, uint8_t reg, uint8_t value) {
+		uint8_t side = (chips == 2) ? 1 : 0;
+		_status[side] = 0xb0 | (((chips == 3) ? CHANNEL_RAW_STEREO
+				: (chips == 2) ? CHANNEL_RAW_LEFT : CHANNEL_RAW_RIGHT) - 1);
+		_pending[side][reg] = value;
+		_dirty[side] |= 1 << reg;
+	}
+
+	/**
+	 * Append the CCs for everything written since the last flush.
+	 */
+	void flush(uint64_t time, std::vector<MidiEvent> &events) {
+		std::vector<MidiEvent> group;
+		for (uint8_t side = 0; side < 2; side++) {
+			if (_dirty[side]) {
+				encode(side, time, group);
+			}
+			_dirty[side] = 0;
+		}
+		if (group.size() > 1) {
+			uint8_t status = group.front().bytes[0];
+			events.push_back({ time, 0, { status, CC_LATCH, 127 } });
+			events.insert(events.end(), group.begin(), group.end());
+			events.push_back({ time, 0, { status, CC_LATCH, 0 } });
+		} else {
+			events.insert(events.end(), group.begin(), group.end());
+		}
+	}
+
+private:
+	void control(uint8_t side, uint64_t time, uint8_t number, uint8_t value,
+			std::vector<MidiEvent> &group) {
+		group.push_back({ time, 0, { _status[side], number, (uint8_t) (value & 0x7f) } });
+	}
+
+	void encode(uint8_t side, uint64_t time, std::vector<MidiEvent> &group) {
+		const uint8_t *in = _pending[side];
+		uint16_t dirty = _dirty[side];
+		for (uint8_t voice = 0; voice < 3; voice++) {
+			if (!(dirty & (3 << (voice * 2)))) {
+				continue;
+			}
+			uint16_t was = period(side, voice * 2);
+			setImage(side, voice * 2, in[voice * 2], dirty);
+			setImage(side, voice * 2 + 1, in[voice * 2 + 1], dirty);
+			uint16_t now = period(side, voice * 2);
+			bool known = _known[side] & (3 << (voice * 2));
+			if (!known || (was >> 5) != (now >> 5)) {
+				control(side, time, CC_CHANNEL_A_FREQ_MSB + voice, now >> 5, group);
+			}
+			if (!known || (was & 0x1f) != (now & 0x1f)) {
+				control(side, time, CC_CHANNEL_A_FREQ_LSB + voice, (now & 0x1f) << 2, group);
+			}
+			_known[side] |= 3 << (voice * 2);
+		}
+		if (dirty & (1 << 6)) {
+			control(side, time, CC_NOISE_FREQ, in[6] << 2, group);
+		}
+		if (dirty & (1 << 7)) {
+			control(side, time, CC_MIXER, (in[7] & 0x3f) << 1, group);
+		}
+		for (uint8_t voice = 0; voice < 3; voice++) {
+			if (dirty & (1 << (8 + voice))) {
+				control(side, time, CC_CHANNEL_A_LEVEL + voice, (in[8 + voice] & 0x1f) << 2, group);
+			}
+		}
+		if (dirty & (3 << 11)) {
+			uint16_t was = period(side, 11);
+			setImage(side, 11, in[11], dirty);
+			setImage(side, 12, in[12], dirty);
+			uint16_t now = period(side, 11);
+			bool known = (_known[side] & (3 << 11)) == (3 << 11);
+			if (!known || (was >> 9) != (now >> 9)) {
+				control(side, time, CC_ENVELOPE_FREQ_HIGH, now >> 9, group);
+			}
+			if (!known || ((was >> 2) & 0x7f) != ((now >> 2) & 0x7f)) {
+				control(side, time, CC_ENVELOPE_FREQ_MED, now >> 2, group);
+			}
+			if (!known || (was & 3) != (now & 3)) {
+				control(side, time, CC_ENVELOPE_FREQ_LOW, (now & 3) << 5, group);
+			}
+			_known[side] |= 3 << 11;
+		}
+		if (dirty & (1 << 13)) {
+			control(side, time, CC_ENVELOPE_SHAPE, (in[13] & 0x0f) << 3, group);
+		}
+	}
+
+	void setImage(uint8_t side, uint8_t reg, uint8_t value, uint16_t dirty) {
+		if (dirty & (1 << reg)) {
+			_image[side][reg] = value;
+		}
+	}
+
+	uint16_t period(uint8_t side, uint8_t reg) const {
+		uint8_t mask = (reg == 11) ? 0xff : 0x0f;
+		return _image[side][reg] | ((_image[side][reg + 1] & mask) << 8);
+	}
+
+	uint8_t _status[2] = { 0, 0 };
+	uint8_t _image[2][16];
+	uint8_t _pending[2][16];
+	uint16_t _dirty[2] = { 0, 0 };
+	uint16_t _known[2];
+};
+
+static bool writeMidi(const std::string &out, const ImportResult &result, std::string &error) {
+	std::vector<MidiEvent> events;
+	RawMidiEncoder encoder;
+	const std::vector<RegisterWrite> &writes = result.writes;
+	for (size_t i = 0; i < writes.size();) {
+		uint64_t time = writes[i].time;
+		for (; i < writes.size() && writes[i].time == time; i++) {
+			encoder.write(writes[i].chips, writes[i].reg, writes[i].value);
+		}
+		encoder.flush(time, events);
+	}
+	return writeSmf(out, events, error);
+}
+
+static bool writeTrace(const std::string &out, const ImportResult &result, std::string &error) {
+	TraceWriter trace;
+	if (!trace.open(out)) {
+		error = "cannot write " + out;
+		return false;
+	}
+	for (const RegisterWrite &write : result.writes) {
+		trace.write(write.time, write.chips, write.reg, write.value);
+	}
+	if (!trace.close()) {
+		error = "cannot write " + out;
+		return false;
+	}
+	return true;
+}
+
+static bool convert(const std::string &in, const std::string &out, const Options &options) {
+	ImportResult result;
+	std::string error;
+	if (!importRegisterLog(in, options.clock, result, error)
+			|| !(options.midi ? writeMidi(out, result, error) : writeTrace(out, result, error))) {
+		fprintf(stderr, "%s: %s\n", in.c_str(), error.c_str());
+		return false;
+	}
+	double seconds = result.writes.empty() ? 0 : result.writes.back().time / 1e6;
+	printf("%s: %s, %u chip%s at %u Hz, %.1f s, %zu writes, %u clamped, worst tone %.1f cents\n",
+			in.c_str(), result.format.c_str(), result.sourceChips, (result.sourceChips > 1) ? "s" : "",
+			result.sourceClock, seconds, result.writes.size(), result.clamped, result.maxCents);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:c:t:o:")) != -1) {
+		switch (opt) {
+		case 'j':
+			options.jobs = atoi(optarg);
+			break;
+		case 'c':
+			options.clock = atoi(optarg);
+			break;
+		case 't':
+			if (strcmp(optarg, "mid") && strcmp(optarg, "ymzt")) {
+				usage();
+			}
+			options.midi = !strcmp(optarg, "mid");
+			break;
+		case 'o':
+			options.out = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind == argc) {
+		usage();
+	}
+	std::vector<std::string> inputs;
+	bool batch = argc - optind > 1;
+	for (int i = optind; i < argc; i++) {
+		batch |= addInput(argv[i], inputs);
+	}
+	std::string extension = options.midi ? ".mid" : ".ymzt";
+
+	if (!batch) {
+		std::string out = options.out.empty() ? baseName(inputs[0]) + extension : options.out;
+		return convert(inputs[0], out, options) ? 0 : 1;
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	std::string dir = options.out.empty() ? "." : options.out;
+	std::atomic<unsigned> failed(0);
+	WorkPool pool(options.jobs);
+	pool.run(inputs.size(), [&](size_t job, unsigned worker) {
+		if (!convert(inputs[job], dir + "/" + baseName(inputs[job]) + extension, options)) {
+			failed++;
+		}
+	});
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	printf("%zu files, %u failed, %.3f s on %u workers\n", inputs.size(), failed.load(), elapsed,
+			pool.workers());
+	return failed ? 1 : 0;
+}
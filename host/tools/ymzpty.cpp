@@ -0,0 +1,199 @@
+/**
+ * ymzpty: the firmware on a pseudo-terminal, in real time.
+ *
+ *   ymzpty [-d seconds] [-L loop_us] [-W shift_ns,strobe_ns] [-T] [-o out.wav]
+ *
+ * Prints the path of the pty's slave side, which takes the place of the
+ * board's serial port for anything that talks MIDI or register frames to
+ * it (ymzsend, a tracker, a MIDI bridge). Bytes written to it reach the
+ * firmware's UART spaced at whatever baud rate the firmware has the UART
+ * set to, and the virtual clock is held to the wall clock. What the
+ * firmware transmits comes back out of the pty.
+ *
+ * Runs until -d seconds have passed or it is interrupted, then writes the
+ * audio to a WAV file and, with -T, the register trace next to it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <deque>
+#include <string>
+
+#include "Arduino.h"
+#include "device.h"
+#include "host.h"
+#include "render.h"
+#include "trace.h"
+#include "wav.h"
+
+#define PTY_IDLE_US 1000
+
+extern "C" void loop();
+
+struct Options {
+	double seconds = 0;
+	uint32_t loopUs = 0;
+	uint32_t shiftNs = 0;
+	uint32_t strobeNs = 0;
+	bool trace = false;
+	std::string out = "ymzpty.wav";
+};
+
+struct Arrival {
+	uint64_t time;
+	uint8_t value;
+};
+
+static volatile sig_atomic_t stopping;
+
+static void stop(int) {
+	stopping = 1;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: ymzpty [-d seconds] [-L loop_us] [-W shift_ns,strobe_ns] [-T] [-o out.wav]\n");
+	exit(2);
+}
+
+static void transmit(void *context, uint8_t value) {
+	int master = *(int *) context;
+	while (write(master, &value, 1) < 0 && errno == EINTR) {
+	}
+}
+
+/**
+ * Microseconds one byte takes on the wire at the UART's current rate.
+ */
+static uint64_t byteUs() {
+	unsigned long baud = Serial.baud();
+	return baud ? (10000000 + baud - 1) / baud : MIDI_BYTE_US;
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	int opt;
+	while ((opt = getopt(argc, argv, "d:L:W:To:")) != -1) {
+		switch (opt) {
+		case 'd':
+			options.seconds = atof(optarg);
+			break;
+		case 'L':
+			options.loopUs = atoi(optarg);
+			break;
+		case 'W':
+			if (sscanf(optarg, "%u,%u", &options.shiftNs, &options.strobeNs) != 2) {
+				usage();
+			}
+			break;
+		case 'T':
+			options.trace = true;
+			break;
+		case 'o':
+			options.out = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) || unlockpt(master)) {
+		fprintf(stderr, "ymzpty: cannot open a pty: %s\n", strerror(errno));
+		return 1;
+	}
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+	// keep the slave open ourselves so the master sees no hangup between
+	// clients
+	const char *slave = ptsname(master);
+	int hold = open(slave, O_RDWR | O_NOCTTY);
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	uint64_t start = deviceBoot();
+	hostBusSetCost(options.shiftNs, options.strobeNs);
+	StereoRenderer renderer;
+	hostBusSetSink(&StereoRenderer::busSink, &renderer);
+	hostSerialSetSink(transmit, &master);
+	TraceWriter trace;
+	std::string tracePath = options.out.substr(0, options.out.find_last_of('.')) + ".ymzt";
+	if (options.trace) {
+		if (!trace.open(tracePath)) {
+			fprintf(stderr, "ymzpty: cannot write %s\n", tracePath.c_str());
+			return 1;
+		}
+		trace.attach(start);
+	}
+	printf("%s\n", slave);
+	fflush(stdout);
+
+	auto wall = std::chrono::steady_clock::now();
+	std::deque<Arrival> arrivals;
+	uint64_t wire = start;
+	uint32_t received = 0;
+	while (!stopping) {
+		uint64_t now = start + std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - wall).count();
+		if (options.seconds && now - start >= options.seconds * 1e6) {
+			break;
+		}
+
+		// lay what the client wrote out on the wire behind what is there
+		uint8_t buffer[256];
+		ssize_t n;
+		while ((n = read(master, buffer, sizeof(buffer))) > 0) {
+			for (ssize_t i = 0; i < n; i++) {
+				wire = ((wire > hostMicros()) ? wire : hostMicros()) + byteUs();
+				arrivals.push_back({ wire, buffer[i] });
+			}
+			received += n;
+		}
+
+		// catch the firmware up to the wall clock
+		while (hostMicros() < now) {
+			while (!arrivals.empty() && arrivals.front().time <= hostMicros()) {
+				hostSerialPush(arrivals.front().value);
+				arrivals.pop_front();
+			}
+			if (!hostSerialPending()) {
+				uint64_t step = hostMicros() + PTY_IDLE_US;
+				if (!arrivals.empty() && arrivals.front().time < step) {
+					step = arrivals.front().time;
+				}
+				hostAdvanceTo((step < now) ? step : now);
+			}
+			loop();
+			hostAdvance(options.loopUs);
+		}
+
+		struct pollfd fds = { master, POLLIN, 0 };
+		poll(&fds, 1, arrivals.empty() ? 1 : 0);
+	}
+
+	uint64_t end = hostMicros();
+	renderer.renderTo(end);
+	hostBusSetSink(0, 0);
+	hostSerialSetSink(0, 0);
+	close(hold);
+	close(master);
+	if (options.trace && !trace.close()) {
+		fprintf(stderr, "ymzpty: cannot write %s\n", tracePath.c_str());
+		return 1;
+	}
+	if (!writeWav(options.out, renderer.samples(), renderer.rate(), 2)) {
+		fprintf(stderr, "ymzpty: cannot write %s\n", options.out.c_str());
+		return 1;
+	}
+	fprintf(stderr, "ymzpty: %.1f s, %u bytes received, %u lost to a full receive buffer\n",
+			(end - start) / 1e6, received, hostSerialDropped());
+	return 0;
+}
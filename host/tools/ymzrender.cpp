@@ -0,0 +1,213 @@
+/**
+ * ymzrender: render MIDI files to WAV through the real firmware.
+ *
+ *   ymzrender [-j jobs] [-r rate] [-t tail_ms] [-b] [-T] [-n] [-o out] song.mid ...
+ *
+ * ymz_synth.cpp and hcYmzShield run unmodified on the virtual clock and
+ * their bus writes drive two emulated YMZ284s. With one input, -o names the
+ * WAV file; with several, -o names a directory and the songs are spread
+ * over a work-stealing pool. The firmware keeps its state in globals, so
+ * each song of a batch renders in its own child process. -T also records
+ * each song's register trace next to its WAV (see trace.h). -b renders
+ * through the band-limited renderer (blep.h) instead of stepping the
+ * chips tick by tick. -n skips the audio and keeps only the trace, for
+ * checking what the firmware does and when; with nothing to synthesize a
+ * five-minute song takes a few tens of milliseconds, and the same song
+ * always gives the same trace.
+ *
+ * A batch costs what the synthesis costs, not its child processes: a child
+ * boots and plays its song in a few milliseconds. Stepping the chips runs
+ * at about 150x realtime per worker and -b at about 700x, so hundreds of
+ * songs with audio take minutes. -n is the fast path, at several thousand
+ * times realtime: hundreds of songs take seconds, and ymztrace render makes
+ * the audio for the traces worth listening to.
+ */
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "blep.h"
+#include "device.h"
+#include "host.h"
+#include "pool.h"
+#include "render.h"
+#include "smf.h"
+#include "trace.h"
+#include "wav.h"
+
+extern char **environ;
+
+struct Options {
+	unsigned jobs = 0;
+	uint32_t rate = 44100;
+	uint32_t tailMs = 1000;
+	bool blep = false;
+	bool trace = false;
+	bool audio = true;
+	std::string out;
+};
+
+static void usage() {
+	fprintf(stderr, "usage: ymzrender [-j jobs] [-r rate] [-t tail_ms] [-b] [-T] [-n] [-o out] song.mid ...\n");
+	exit(2);
+}
+
+static std::string baseName(const std::string &path) {
+	size_t slash = path.find_last_of('/');
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+/**
+ * Render one song in this process. Returns seconds of audio, or a negative
+ * value on failure.
+ */
+static double renderSong(const std::string &in, const std::string &out, const Options &options) {
+	std::vector<MidiEvent> events;
+	std::string error;
+	if (!readSmf(in, events, error)) {
+		fprintf(stderr, "%s: %s\n", in.c_str(), error.c_str());
+		return -1;
+	}
+
+	uint64_t start = deviceBoot();
+	StereoRenderer renderer(options.rate);
+	BlepRenderer blep(options.rate);
+	if (options.audio) {
+		if (options.blep) {
+			hostBusSetSink(&BlepRenderer::busSink, &blep);
+		} else {
+			hostBusSetSink(&StereoRenderer::busSink, &renderer);
+		}
+	}
+	TraceWriter trace;
+	std::string tracePath = out.substr(0, out.find_last_of('.')) + ".ymzt";
+	if (options.trace) {
+		if (!trace.open(tracePath)) {
+			fprintf(stderr, "%s: cannot write %s\n", in.c_str(), tracePath.c_str());
+			return -1;
+		}
+		trace.attach(start);
+	}
+	uint64_t end = devicePlay(events, start, (uint64_t) options.tailMs * 1000);
+	if (options.audio) {
+		if (options.blep) {
+			blep.finish(end);
+		} else {
+			renderer.renderTo(end);
+		}
+	}
+	hostBusSetSink(0, 0);
+	if (options.trace && !trace.close()) {
+		fprintf(stderr, "%s: cannot write %s\n", in.c_str(), tracePath.c_str());
+		return -1;
+	}
+
+	if (options.audio && !writeWav(out, options.blep ? blep.samples() : renderer.samples(),
+			options.rate, 2)) {
+		fprintf(stderr, "%s: cannot write %s\n", in.c_str(), out.c_str());
+		return -1;
+	}
+	return (end - start) / 1e6;
+}
+
+static int spawnSong(const std::string &in, const std::string &out, const Options &options) {
+	std::string rate = std::to_string(options.rate);
+	std::string tail = std::to_string(options.tailMs);
+	std::vector<const char *> argv = { "ymzrender", "-r", rate.c_str(), "-t", tail.c_str(), "-o",
+			out.c_str() };
+	if (options.blep) {
+		argv.push_back("-b");
+	}
+	if (options.trace) {
+		argv.push_back("-T");
+	}
+	if (!options.audio) {
+		argv.push_back("-n");
+	}
+	argv.push_back(in.c_str());
+	argv.push_back(0);
+	pid_t pid;
+	int status = posix_spawn(&pid, "/proc/self/exe", 0, 0, (char **) argv.data(), environ);
+	if (status) {
+		fprintf(stderr, "%s: cannot spawn renderer: %s\n", in.c_str(), strerror(status));
+		return -1;
+	}
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:r:t:o:bTn")) != -1) {
+		switch (opt) {
+		case 'j':
+			options.jobs = atoi(optarg);
+			break;
+		case 'r':
+			options.rate = atoi(optarg);
+			break;
+		case 't':
+			options.tailMs = atoi(optarg);
+			break;
+		case 'o':
+			options.out = optarg;
+			break;
+		case 'b':
+			options.blep = true;
+			break;
+		case 'T':
+			options.trace = true;
+			break;
+		case 'n':
+			options.audio = false;
+			options.trace = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	std::vector<std::string> inputs(argv + optind, argv + argc);
+	if (inputs.empty() || !options.rate) {
+		usage();
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	if (inputs.size() == 1) {
+		std::string out = options.out.empty() ? baseName(inputs[0]) + ".wav" : options.out;
+		double seconds = renderSong(inputs[0], out, options);
+		if (seconds < 0) {
+			return 1;
+		}
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		printf("%s: %.1f s in %.3f s (%.0fx realtime)\n", inputs[0].c_str(), seconds, elapsed,
+				seconds / elapsed);
+		return 0;
+	}
+
+	std::string dir = options.out.empty() ? "." : options.out;
+	std::atomic<unsigned> failed(0);
+	WorkPool pool(options.jobs);
+	pool.run(inputs.size(), [&](size_t job, unsigned worker) {
+		if (spawnSong(inputs[job], dir + "/" + baseName(inputs[job]) + ".wav", options)) {
+			failed++;
+		}
+	});
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	printf("%zu songs, %u failed, %.3f s on %u workers\n", inputs.size(), failed.load(), elapsed,
+			pool.workers());
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * ymzsend: stream register writes to the board as register frames.
+ *
+ *   ymzsend [-b rate] [-f hz] port trace.ymzt
+ *
+ * Switches the firmware's UART from MIDI to register frames with
+ * SYSEX_SERIAL at rate index -b (see regstream.cpp: 0 = 115200 .. 3 =
+ * 1000000 baud, default 3), then plays the trace in real time. Writes are
+ * batched into ticks of -f hz (default 50, as trackers play; 0 keeps the
+ * trace's own timing) and each tick lands on the chips as one commit.
+ * Afterwards the UART goes back to MIDI and the firmware's count of good
+ * and rejected frames is printed.
+ *
+ * port is the board's serial device, the pty ymzpty prints, or a plain
+ * file to capture the frame stream without a device.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "regstream.h"
+#include "serial.h"
+#include "trace.h"
+
+#define SYSEX_ID 0x7d
+#define SYSEX_SERIAL 0x07
+#define ACK_TIMEOUT_MS 1000
+
+struct Options {
+	uint8_t rate = 3;
+	double hz = 50;
+};
+
+static void usage() {
+	fprintf(stderr, "usage: ymzsend [-b rate] [-f hz] port trace.ymzt\n");
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:f:")) != -1) {
+		switch (opt) {
+		case 'b':
+			options.rate = atoi(optarg);
+			break;
+		case 'f':
+			options.hz = atof(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 2 || !regStreamBaud(options.rate) || options.hz < 0) {
+		usage();
+	}
+	std::string path = argv[optind];
+	std::string error;
+	TraceFile trace;
+	if (!trace.open(argv[optind + 1], error)) {
+		fprintf(stderr, "%s: %s\n", argv[optind + 1], error.c_str());
+		return 1;
+	}
+	SerialPort port;
+	if (!port.open(path, error)) {
+		fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+		return 1;
+	}
+
+	// switch over: the firmware answers at the old rate, then changes
+	uint32_t baud = regStreamBaud(options.rate);
+	std::vector<uint8_t> message = { 0xf0, SYSEX_ID, SYSEX_SERIAL, options.rate, 0xf7 };
+	port.write(message);
+	if (port.isTty() && !port.readSysEx(SYSEX_SERIAL, message, ACK_TIMEOUT_MS)) {
+		fprintf(stderr, "%s: no answer to SYSEX_SERIAL\n", path.c_str());
+		return 1;
+	}
+	if (!port.setBaud(baud, error)) {
+		fprintf(stderr, "%s: cannot set %u baud: %s\n", path.c_str(), baud, error.c_str());
+		return 1;
+	}
+
+	// one batch per tick, sent when the tick comes due
+	FrameEncoder encoder;
+	uint64_t tickUs = options.hz ? (uint64_t) (1e6 / options.hz) : 0;
+	uint64_t bytes = 0;
+	uint64_t frames = 0;
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<uint8_t> out;
+	for (size_t i = 0; i < trace.size();) {
+		uint64_t tick = tickUs ? trace[i].time / tickUs * tickUs : trace[i].time;
+		for (; i < trace.size() && (tickUs ? trace[i].time / tickUs * tickUs : trace[i].time) == tick; i++) {
+			encoder.write(trace[i].chips, trace[i].reg, trace[i].value);
+		}
+		out.clear();
+		frames += encoder.flush(out);
+		if (out.empty()) {
+			continue;
+		}
+		if (port.isTty()) {
+			std::this_thread::sleep_until(begin + std::chrono::microseconds(tick));
+		}
+		if (!port.write(out)) {
+			fprintf(stderr, "%s: write failed\n", path.c_str());
+			return 1;
+		}
+		bytes += out.size();
+	}
+	out.clear();
+	FrameEncoder::end(out);
+	port.write(out);
+	port.drain();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	printf("%llu frames, %llu bytes in %.1f s at %u baud\n", (unsigned long long) frames,
+			(unsigned long long) bytes, seconds, baud);
+
+	// the report comes back over MIDI
+	if (!port.isTty()) {
+		return 0;
+	}
+	if (!port.setBaud(MIDI_BAUD, error)) {
+		fprintf(stderr, "%s: cannot set %u baud: %s\n", path.c_str(), MIDI_BAUD, error.c_str());
+		return 1;
+	}
+	if (!port.readSysEx(SYSEX_SERIAL, message, ACK_TIMEOUT_MS) || message.size() != 8) {
+		fprintf(stderr, "%s: no report from the firmware\n", path.c_str());
+		return 1;
+	}
+	unsigned good = message[3] | (message[4] << 7);
+	unsigned rejected = message[5] | (message[6] << 7);
+	printf("firmware: %u frames accepted, %u rejected\n", good, rejected);
+	return rejected ? 1 : 0;
+}
@@ -0,0 +1,779 @@
+/**
+ * ymzshrink: make a Hardchord Music block smaller without changing how it
+ * plays.
+ *
+ *   ymzshrink [-n states] [-o out] block
+ *
+ * Decodes the block that playBlock() and hcYmzPlayer read, follows what
+ * each command does to the chips' registers and the shield's own state
+ * (channel volumes, the tone mask, tempo and articulation), and drops the
+ * commands that make no difference:
+ *
+ *   - writes that leave everything as the block itself already set it,
+ *     such as a setVolume() to the level a channel is at
+ *   - writes that a later command overwrites before any time passes, such
+ *     as a setTone() that is switched back in the same instant
+ *   - commands playBlock() does not know, and anything after the end
+ *
+ * Adjacent delays are fused where the single delay ends at exactly the
+ * same time: beats (0xa0) when one beat lands on the same 1/256 tick, and
+ * millisecond delays (0xa1) whenever the sum fits, since the player chains
+ * a run of them without drift.
+ * Nothing is assumed about the state the block starts in, and commands
+ * with a timed effect (envelope restarts, set note and set channels with
+ * their articulation gaps) are kept. The block is taken to have the chips
+ * to itself while it plays.
+ *
+ * The result is then proved against the original: both are played through
+ * the real hcYmzPlayer on the host, from power-on and from -n - 1
+ * (default 7) random starting states, and the register traces must match.
+ * A trace here is what the chips hold at each instant, plus every envelope
+ * restart, so writes that change nothing do not count. The smaller block
+ * is written to -o only when every run matches.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "hcYmzPlayer.h"
+#include "host.h"
+
+#define HC_HEADER 3
+#define SEGMENT_US 1000 // how far the clock moves while the player waits
+#define PLAY_LIMIT_US (3600ULL * 1000000) // a block still playing after this is stuck
+
+// Beat length in 1/256 ticks per dot / beat, as hcYmzPlayer counts it
+#define BEAT_SPAN ((uint32_t) (4 * PPQN * 256 / 8))
+
+struct Options {
+	unsigned states = 8;
+	std::string out;
+};
+
+static void usage() {
+	fprintf(stderr, "usage: ymzshrink [-n states] [-o out] block\n");
+	exit(2);
+}
+
+/**
+ * Block decoding
+ */
+struct Command {
+	uint8_t op;
+	uint8_t args[6];
+};
+
+// Argument bytes for each command, as hcYmzPlayer reads them
+static uint8_t commandLength(uint8_t op) {
+	switch (op) {
+	case 0x51: case 0x61: case 0x62: case 0x63: case 0x73: case 0x81:
+	case 0x82: case 0xa0: case 0xa1:
+		return 2;
+	case 0x50: case 0x52: case 0x53: case 0x70: case 0x90:
+		return 1;
+	case 0x80:
+		return 3;
+	case 0x83:
+		return 6;
+	}
+	return 0;
+}
+
+static bool decodeBlock(const std::vector<uint8_t> &data, std::vector<Command> &commands,
+		std::string &error) {
+	if (data.size() < HC_HEADER || data[0] != 'H' || data[1] != 'C' || data[2] >= 2) {
+		error = "not a Hardchord Music block";
+		return false;
+	}
+	for (size_t at = HC_HEADER; at < data.size();) {
+		Command command = { data[at++] };
+		if (!command.op) {
+			return true;
+		}
+		uint8_t length = commandLength(command.op);
+		if (at + length > data.size()) {
+			break;
+		}
+		memcpy(command.args, &data[at], length);
+		at += length;
+		commands.push_back(command);
+	}
+	error = "block does not end";
+	return false;
+}
+
+static std::vector<uint8_t> encodeBlock(uint8_t revision, const std::vector<Command> &commands) {
+	std::vector<uint8_t> data = { 'H', 'C', revision };
+	for (const Command &command : commands) {
+		data.push_back(command.op);
+		data.insert(data.end(), command.args, command.args + commandLength(command.op));
+	}
+	data.push_back(0);
+	return data;
+}
+
+/**
+ * State model
+ *
+ * Everything a command can change is a slot of bits, each known or not:
+ * the registers (chip * 16 + reg) and then the shield's own state.
+ */
+enum {
+	SLOT_VOLUME = 32, // _volume[6]
+	SLOT_TONE = 38,   // _tone
+	SLOT_ARTICULATION,
+	SLOT_TEMPO,
+	SLOT_COUNT
+};
+
+#define SLOT_REG(chip, reg) ((chip) * 16 + (reg))
+
+struct Access {
+	uint8_t slot;
+	uint8_t bits;
+};
+
+// What running one command did, as far as the model can tell
+struct Step {
+	bool changed = false; // may have left some slot different
+	bool keep = false;    // has an effect the slots do not capture
+	bool barrier = false; // lets time pass, so everything is heard
+	std::vector<Access> writes;
+	std::vector<Access> reads;
+};
+
+class BlockModel {
+public:
+	BlockModel() {
+		forget();
+	}
+
+	void forget() {
+		memset(_value, 0, sizeof(_value));
+		memset(_known, 0, sizeof(_known));
+		memset(_toneNote, 0xff, sizeof(_toneNote));
+	}
+
+	/**
+	 * Run a command on the model, noting what it touched.
+	 */
+	Step run(const Command &c) {
+		Step step;
+		_step = &step;
+		const uint8_t *a = c.args;
+		switch (c.op) {
+		case 0x50:
+			for (uint8_t ch = 0; ch < 6; ch++) {
+				volume(ch, a[0], false);
+			}
+			break;
+		case 0x51:
+			if (!channel(a[0])) {
+				break;
+			}
+			volume(a[0], a[1], false);
+			break;
+		case 0x52:
+			// restarts Timer1's fractional count even at the same tempo
+			assign(SLOT_TEMPO, 0xff, a[0] < 10 ? 10 : a[0], 0xff);
+			step.changed = true;
+			break;
+		case 0x53:
+			assign(SLOT_ARTICULATION, 0xff, a[0], 0xff);
+			break;
+		case 0x60:
+			assign(SLOT_TONE, 0xff, 0x3f, 0xff);
+			assign(SLOT_REG(0, 0x07), 0xff, 0x3f, 0xff);
+			assign(SLOT_REG(1, 0x07), 0xff, 0x3f, 0xff);
+			break;
+		case 0x61:
+		case 0x62:
+			if (!channel(a[0])) {
+				break;
+			}
+			mixer(a[0], (c.op == 0x62) ? 3 : 0, a[1]);
+			break;
+		case 0x63:
+			if (!channel(a[0])) {
+				break;
+			}
+			// setEnvelope() works on channel A's register of the chip
+			assign(SLOT_REG(a[0] / 3, 0x08), 0xf0, a[1] ? 0x10 : 0, 0xf0);
+			break;
+		case 0x70:
+			assign(SLOT_REG(0, 0x0d), 0xff, a[0] & 0x0f, 0xff);
+			assign(SLOT_REG(1, 0x0d), 0xff, a[0] & 0x0f, 0xff);
+			step.keep = true;
+			break;
+		case 0x71:
+			// rewrites PSG0's shape, as sanitized, to both chips
+			copy(SLOT_REG(1, 0x0d), 0x0f, SLOT_REG(0, 0x0d));
+			assign(SLOT_REG(0, 0x0d), 0xf0, 0, 0xff);
+			assign(SLOT_REG(1, 0x0d), 0xf0, 0, 0xff);
+			step.keep = true;
+			break;
+		case 0x73:
+			for (uint8_t chip = 0; chip < 2; chip++) {
+				assign(SLOT_REG(chip, 0x0b), 0xff, a[1], 0xff);
+				assign(SLOT_REG(chip, 0x0c), 0xff, a[0], 0xff);
+			}
+			break;
+		case 0x80: {
+			if (!channel(a[0])) {
+				break;
+			}
+			uint16_t tp = ((a[1] << 8) + a[2]) & 0x0fff;
+			uint8_t reg = SLOT_REG(a[0] / 3, (a[0] % 3) * 2);
+			assign(reg, 0xff, tp & 0xff, 0xff);
+			assign(reg + 1, 0xff, tp >> 8, 0xff);
+			break;
+		}
+		case 0x81:
+			if (!channel(a[0])) {
+				break;
+			}
+			toneMidi(a[0], a[1]);
+			break;
+		case 0x82:
+			if (!channel(a[0])) {
+				break;
+			}
+			mixer(a[0], 0, 0);
+			if (a[1] != OFF) {
+				toneMidi(a[0], a[1]);
+				read(SLOT_ARTICULATION, 0xff);
+				mixer(a[0], 0, 1);
+				step.keep = step.barrier = true;
+			}
+			break;
+		case 0x83:
+			channels(a);
+			step.keep = step.barrier = true;
+			break;
+		case 0x90:
+			assign(SLOT_REG(0, 0x06), 0xff, a[0] & 0x1f, 0xff);
+			assign(SLOT_REG(1, 0x06), 0xff, a[0] & 0x1f, 0xff);
+			break;
+		case 0xa0:
+			read(SLOT_TEMPO, 0xff);
+			step.keep = step.barrier = true;
+			break;
+		case 0xa1:
+			step.keep = step.barrier = true;
+			break;
+		}
+		_step = 0;
+		return step;
+	}
+
+private:
+	/**
+	 * A channel a command can name. Others reach past the register files
+	 * or the shield's arrays, so all bets are off.
+	 */
+	bool channel(uint8_t ch) {
+		if (ch < 6) {
+			return true;
+		}
+		forget();
+		_step->changed = _step->keep = _step->barrier = true;
+		return false;
+	}
+
+	void read(uint8_t slot, uint8_t bits) {
+		_step->reads.push_back({ slot, bits });
+	}
+
+	/**
+	 * Give the bits in mask new values, known where known says so.
+	 */
+	void assign(uint8_t slot, uint8_t mask, uint8_t value, uint8_t known) {
+		known &= mask;
+		if ((mask & ~known) || (mask & known & ~_known[slot])
+				|| (mask & known & (_value[slot] ^ value))) {
+			_step->changed = true;
+		}
+		_value[slot] = (_value[slot] & ~mask) | (value & known);
+		_known[slot] = (_known[slot] & ~mask) | known;
+		if (slot < SLOT_VOLUME && (slot & 0x0f) < 6) {
+			_toneNote[(slot >> 4) * 3 + (slot & 0x0f) / 2] = -1;
+		}
+		_step->writes.push_back({ slot, mask });
+	}
+
+	/**
+	 * Set the bits in mask to the same bits of another slot.
+	 */
+	void copy(uint8_t slot, uint8_t mask, uint8_t from) {
+		if (slot == from) {
+			return;
+		}
+		read(from, mask);
+		assign(slot, mask, _value[from], _known[from]);
+	}
+
+	void volume(uint8_t ch, uint8_t level, bool fakeMute) {
+		uint8_t chip = ch / 3;
+		level &= 0x0f;
+		if (!fakeMute) {
+			assign(SLOT_VOLUME + ch, 0xff, level, 0xff);
+		}
+		// the envelope bit comes from channel A's register, whichever
+		// channel this is
+		uint8_t reg = SLOT_REG(chip, 0x08 + ch % 3);
+		assign(reg, 0xef, level, 0xef);
+		copy(reg, 0x10, SLOT_REG(chip, 0x08));
+	}
+
+	void mixer(uint8_t ch, uint8_t shift, bool enable) {
+		uint8_t bit = 1 << (ch % 3 + shift);
+		assign(SLOT_REG(ch / 3, 0x07), bit | 0xc0, enable ? 0 : bit, 0xff);
+	}
+
+	void toneMidi(uint8_t ch, uint8_t note) {
+		bool same = _toneNote[ch] == note;
+		uint8_t reg = SLOT_REG(ch / 3, (ch % 3) * 2);
+		bool changed = _step->changed;
+		assign(reg, 0xff, 0, 0);
+		assign(reg + 1, 0xff, 0, 0);
+		_toneNote[ch] = note;
+		if (same) {
+			_step->changed = changed;
+		}
+	}
+
+	void channels(const uint8_t *c) {
+		uint8_t state = 0;
+		for (uint8_t i = 0; i < 6; i++) {
+			if (c[i] != SKIP) {
+				state |= 1 << i;
+			}
+			if (c[i] == OFF) {
+				assign(SLOT_TONE, 1 << i, 1 << i, 0xff);
+				volume(i, 0, true);
+			} else if (c[i] < 128) {
+				assign(SLOT_TONE, 1 << i, 0, 0xff);
+			}
+		}
+		assign(SLOT_REG(0, 0x07), 0x07, state, 0xff);
+		assign(SLOT_REG(1, 0x07), 0x07, state >> 3, 0xff);
+
+		// after the gap
+		for (uint8_t i = 0; i < 6; i++) {
+			if (c[i] != OFF && c[i] != SKIP) {
+				toneMidi(i, c[i]);
+				read(SLOT_VOLUME + i, 0xff);
+				volume(i, _value[SLOT_VOLUME + i], true);
+				if (!_known[SLOT_VOLUME + i]) {
+					assign(SLOT_REG(i / 3, 0x08 + i % 3), 0x0f, 0, 0);
+				}
+			}
+		}
+		read(SLOT_TONE, 0x3f);
+		assign(SLOT_REG(0, 0x07), 0x07, _value[SLOT_TONE], _known[SLOT_TONE]);
+		assign(SLOT_REG(1, 0x07), 0x07, _value[SLOT_TONE] >> 3, _known[SLOT_TONE] >> 3);
+	}
+
+	uint8_t _value[SLOT_COUNT];
+	uint8_t _known[SLOT_COUNT];
+	int16_t _toneNote[6]; // note whose period a channel holds, or -1
+	Step *_step = 0;
+};
+
+/**
+ * Delay fusion
+ */
+
+static bool fuseDelays(Command &first, const Command &second) {
+	if (first.op == 0xa1) {
+		uint32_t a = (first.args[0] << 8) + first.args[1];
+		uint32_t b = (second.args[0] << 8) + second.args[1];
+		if (a + b > 0xffff) {
+			return false;
+		}
+		first.args[0] = (a + b) >> 8;
+		first.args[1] = (a + b) & 0xff;
+		return true;
+	}
+	if (!first.args[0] || !second.args[0]) {
+		return false;
+	}
+	uint32_t span = BEAT_SPAN * first.args[1] / first.args[0]
+			+ BEAT_SPAN * second.args[1] / second.args[0];
+	for (uint32_t beat = 1; beat < 256; beat++) {
+		uint32_t dot = (span * beat + BEAT_SPAN - 1) / BEAT_SPAN;
+		if (dot < 256 && BEAT_SPAN * dot / beat == span) {
+			first.args[0] = beat;
+			first.args[1] = dot;
+			return true;
+		}
+	}
+	return false;
+}
+
+struct ShrinkStats {
+	unsigned unknown = 0;
+	unsigned unchanged = 0;
+	unsigned overwritten = 0;
+	unsigned fused = 0;
+};
+
+static std::vector<Command> shrink(const std::vector<Command> &commands, ShrinkStats &stats) {
+	// forward: drop what leaves the state as it was
+	BlockModel model;
+	std::vector<Command> kept;
+	std::vector<Step> steps;
+	for (const Command &command : commands) {
+		if (!commandLength(command.op) && command.op != 0x60 && command.op != 0x71) {
+			stats.unknown++;
+			continue;
+		}
+		Step step = model.run(command);
+		if (!step.changed && !step.keep && !step.barrier) {
+			stats.unchanged++;
+			continue;
+		}
+		kept.push_back(command);
+		steps.push_back(step);
+	}
+
+	// backward: drop what is overwritten before anything hears it
+	std::vector<bool> dead(kept.size(), false);
+	uint8_t live[SLOT_COUNT];
+	memset(live, 0xff, sizeof(live));
+	for (size_t i = kept.size(); i-- > 0;) {
+		const Step &step = steps[i];
+		if (step.barrier) {
+			memset(live, 0xff, sizeof(live));
+			continue;
+		}
+		bool heard = step.keep;
+		for (const Access &write : step.writes) {
+			heard |= (write.bits & live[write.slot]) != 0;
+		}
+		if (!heard) {
+			dead[i] = true;
+			stats.overwritten++;
+			continue;
+		}
+		for (const Access &write : step.writes) {
+			live[write.slot] &= ~write.bits;
+		}
+		for (const Access &read : step.reads) {
+			live[read.slot] |= read.bits;
+		}
+	}
+
+	std::vector<Command> result;
+	for (size_t i = 0; i < kept.size(); i++) {
+		if (dead[i]) {
+			continue;
+		}
+		const Command &command = kept[i];
+		if (!result.empty() && (command.op == 0xa0 || command.op == 0xa1)
+				&& result.back().op == command.op && fuseDelays(result.back(), command)) {
+			stats.fused++;
+			continue;
+		}
+		result.push_back(command);
+	}
+	return result;
+}
+
+/**
+ * Verification
+ */
+struct TraceEvent {
+	uint32_t time;
+	uint8_t chip;
+	uint8_t reg;
+	uint8_t value;
+
+	bool operator!=(const TraceEvent &other) const {
+		return time != other.time || chip != other.chip || reg != other.reg || value != other.value;
+	}
+};
+
+struct Write {
+	uint64_t time;
+	uint8_t chip;
+	uint8_t reg;
+	uint8_t value;
+};
+
+static std::vector<Write> captured;
+
+static void captureWrite(uint8_t chips, uint8_t reg, uint8_t value) {
+	for (uint8_t chip = 0; chip < 2; chip++) {
+		if (chips & (1 << chip)) {
+			captured.push_back({ hostMicros(), chip, reg, value });
+		}
+	}
+}
+
+// Counts what the player has read, to tell a player that is waiting
+class CountingSource : public hcYmzSource {
+public:
+	CountingSource(const std::vector<uint8_t> &data) : _data(data) {}
+	int available() {
+		return (_at < _data.size()) ? (int) (_data.size() - _at) : -1;
+	}
+	uint8_t read() {
+		return _data[_at++];
+	}
+	size_t position() const {
+		return _at;
+	}
+private:
+	const std::vector<uint8_t> &_data;
+	size_t _at = 0;
+};
+
+/**
+ * Play a block to its end on an instantly fast board: the clock only moves
+ * on, a segment at a time, while the player waits for a beat or a gap.
+ */
+static void playToEnd(const std::vector<uint8_t> &block) {
+	CountingSource source(block);
+	hcYmzPlayer player;
+	player.play(source);
+	while (player.isPlaying()) {
+		size_t position = source.position();
+		uint32_t writes = hostBusWrites();
+		player.poll();
+		if (source.position() == position && hostBusWrites() == writes) {
+			if (hostMicros() > PLAY_LIMIT_US) {
+				_exit(1);
+			}
+			hostAdvance(SEGMENT_US);
+		}
+	}
+}
+
+/**
+ * Put the shield in a random state through the player: notes, volumes,
+ * mixer, envelope, tempo and articulation, then raw register values over
+ * the top.
+ */
+static void randomState(unsigned seed) {
+	std::mt19937 random(seed);
+	std::vector<uint8_t> prelude = { 'H', 'C', 1, 0x52, (uint8_t) (10 + random() % 246),
+		0x53, (uint8_t) (random() % 40), 0x83 };
+	for (uint8_t i = 0; i < 6; i++) {
+		uint8_t pick = random() % 4;
+		prelude.push_back(pick == 0 ? OFF : pick == 1 ? SKIP : (uint8_t) (random() % 128));
+	}
+	for (uint8_t ch = 0; ch < 6; ch++) {
+		prelude.insert(prelude.end(), { 0x51, ch, (uint8_t) (random() % 16) });
+	}
+	prelude.push_back(0);
+	playToEnd(prelude);
+	for (uint8_t reg = 0; reg < 0x0d; reg++) {
+		if (random() % 2) {
+			YMZ.setRegisterPsg0(reg, random());
+		}
+		if (random() % 2) {
+			YMZ.setRegisterPsg1(reg, random());
+		}
+	}
+	hostAdvance(random() % 50000);
+}
+
+/**
+ * Reduce raw writes to what the chips hold at the end of each instant,
+ * plus every envelope restart.
+ */
+static std::vector<TraceEvent> heardTrace(const uint8_t start[2][PSG_REGISTERS],
+		const std::vector<Write> &writes, uint64_t origin) {
+	std::vector<TraceEvent> trace;
+	uint8_t regs[2][PSG_REGISTERS];
+	memcpy(regs, start, sizeof(regs));
+	for (size_t i = 0; i < writes.size();) {
+		uint8_t before[2][PSG_REGISTERS];
+		memcpy(before, regs, sizeof(regs));
+		uint32_t time = writes[i].time - origin;
+		for (uint64_t now = writes[i].time; i < writes.size() && writes[i].time == now; i++) {
+			const Write &w = writes[i];
+			if (w.reg >= PSG_REGISTERS) {
+				continue;
+			}
+			regs[w.chip][w.reg] = w.value;
+			if (w.reg == 0x0d) {
+				trace.push_back({ time, w.chip, w.reg, w.value });
+			}
+		}
+		for (uint8_t chip = 0; chip < 2; chip++) {
+			for (uint8_t reg = 0; reg < 0x0d; reg++) {
+				if (regs[chip][reg] != before[chip][reg]) {
+					trace.push_back({ time, chip, reg, regs[chip][reg] });
+				}
+			}
+		}
+	}
+	return trace;
+}
+
+/**
+ * Play a block from starting state seed (0 for power-on) in a child
+ * process, which hands its trace back through a pipe.
+ */
+static bool traceBlock(const std::vector<uint8_t> &block, unsigned seed,
+		std::vector<TraceEvent> &trace) {
+	int pipes[2];
+	if (pipe(pipes)) {
+		return false;
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(pipes[0]);
+		hostReset();
+		YMZ.setTempo(MODERATO);
+		if (seed) {
+			randomState(seed);
+		}
+		uint8_t start[2][PSG_REGISTERS];
+		for (uint8_t reg = 0; reg < PSG_REGISTERS; reg++) {
+			start[0][reg] = YMZ.getRegisterPsg0(reg);
+			start[1][reg] = YMZ.getRegisterPsg1(reg);
+		}
+		uint64_t origin = hostMicros();
+		YMZ.setTrace(captureWrite);
+		playToEnd(block);
+		YMZ.setTrace();
+		std::vector<TraceEvent> heard = heardTrace(start, captured, origin);
+		size_t bytes = heard.size() * sizeof(TraceEvent);
+		const char *at = (const char *) heard.data();
+		while (bytes) {
+			ssize_t written = write(pipes[1], at, bytes);
+			if (written <= 0) {
+				_exit(1);
+			}
+			at += written;
+			bytes -= written;
+		}
+		_exit(0);
+	}
+	close(pipes[1]);
+	trace.clear();
+	TraceEvent event;
+	while (pid > 0 && read(pipes[0], &event, sizeof(event)) == sizeof(event)) {
+		trace.push_back(event);
+	}
+	close(pipes[0]);
+	int status = 0;
+	if (pid > 0) {
+		waitpid(pid, &status, 0);
+	}
+	return pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Compare the two blocks from every starting state, printing the first
+ * difference found.
+ */
+static bool verify(const std::vector<uint8_t> &original, const std::vector<uint8_t> &shrunk,
+		unsigned states, size_t &events) {
+	events = 0;
+	for (unsigned seed = 0; seed < states; seed++) {
+		std::vector<TraceEvent> a, b;
+		if (!traceBlock(original, seed, a) || !traceBlock(shrunk, seed, b)) {
+			fprintf(stderr, "state %u: player run failed\n", seed);
+			return false;
+		}
+		for (size_t i = 0; i < a.size() || i < b.size(); i++) {
+			if (i == a.size() || i == b.size() || a[i] != b[i]) {
+				const TraceEvent &e = (i < a.size()) ? a[i] : b[i];
+				fprintf(stderr, "state %u: traces part at event %zu (%u us, PSG%u %02x)\n",
+						seed, i, e.time, e.chip, e.reg);
+				return false;
+			}
+		}
+		events += a.size();
+	}
+	return true;
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+	uint8_t buffer[4096];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + got);
+	}
+	bool ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
+
+static bool writeFile(const std::string &path, const std::vector<uint8_t> &data) {
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return (fclose(file) == 0) && ok;
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+		switch (opt) {
+		case 'n':
+			options.states = atoi(optarg);
+			break;
+		case 'o':
+			options.out = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || !options.states) {
+		usage();
+	}
+	const char *in = argv[optind];
+
+	std::vector<uint8_t> original;
+	std::vector<Command> commands;
+	std::string error;
+	if (!readFile(in, original)) {
+		fprintf(stderr, "cannot read %s\n", in);
+		return 1;
+	}
+	if (!decodeBlock(original, commands, error)) {
+		fprintf(stderr, "%s: %s\n", in, error.c_str());
+		return 1;
+	}
+
+	ShrinkStats stats;
+	std::vector<Command> shrunk = shrink(commands, stats);
+	std::vector<uint8_t> block = encodeBlock(original[2], shrunk);
+	printf("%s: %zu -> %zu bytes, %zu -> %zu commands (%u unchanged, %u overwritten, "
+			"%u unknown, %u delays fused)\n", in, original.size(), block.size(),
+			commands.size(), shrunk.size(), stats.unchanged, stats.overwritten,
+			stats.unknown, stats.fused);
+
+	size_t events;
+	if (!verify(original, block, options.states, events)) {
+		fprintf(stderr, "%s: the smaller block does not play the same; nothing written\n", in);
+		return 1;
+	}
+	printf("%s: same trace from %u starting states (%zu events)\n", in, options.states, events);
+	if (!options.out.empty() && !writeFile(options.out, block)) {
+		fprintf(stderr, "cannot write %s\n", options.out.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,597 @@
+/**
+ * ymzstress: find the MIDI event rate the firmware can sustain.
+ *
+ *   ymzstress [-w workload] [-d seconds] [-b baud] [-B burst] [-L loop_us]
+ *             [-W shift_ns,strobe_ns] [-s seed] [-r]
+ *   ymzstress -F [-n runs] [-s seed] [-d seconds]
+ *   ymzstress -R stream.bin
+ *   ymzstress -J latency_ms [-d seconds] [-L loop_us] [-W shift_ns,strobe_ns] [-s seed]
+ *
+ * Each workload is played through the real handlers at increasing rates
+ * with UART arrival times for the given baud rate and modeled costs for a
+ * loop() pass and each bus write. The search reports the highest rate with
+ * no receive buffer overrun and where the first byte was lost one step
+ * above it. Bursts (-B) send that many events back to back and then wait,
+ * keeping the same average rate; -r uses running status.
+ *
+ * Workloads:
+ *   cc-sweep     dense CC_CHANNEL_*_FREQ_MSB/LSB sweeps on the raw channels
+ *   note-flood   note on/off on the music channels
+ *   latch        raw CCs with CC_LATCH toggling (each release commits the staged writes)
+ *   mixed        all of the above plus program changes
+ *
+ * -F fuzzes instead: random byte streams (valid and garbage) are fed
+ * through the firmware at wire speed, each run in a fresh child process.
+ * Build with 'make host-asan' so out-of-bounds accesses (such as past the
+ * end of a register file) abort the run; the offending stream is saved as
+ * fuzz-<seed>.bin for -R to replay.
+ *
+ * -J measures latency and jitter: how long after its last byte arrives a
+ * raw CC reaches the bus. The probes are level changes on the left raw
+ * channel, mixed in with notes and period sweeps on the right that keep
+ * loop() busy. The run is made once with messages handled as they are
+ * read and once with SYSEX_SCHEDULE set to the given latency, and the
+ * firmware's own statistics for the scheduled run are shown beside the
+ * measured ones.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "device.h"
+#include "host.h"
+
+#define CHANNEL_STEREO 1
+#define CHANNEL_RIGHT 3
+#define CHANNEL_RAW_STEREO 7
+#define CHANNEL_RAW_LEFT 8
+#define CHANNEL_RAW_RIGHT 9
+#define CC_CHANNEL_A_LEVEL 25
+#define CC_LATCH 80
+#define SYSEX_SCHEDULE 0x09
+
+struct Options {
+	std::string workload;
+	double seconds = 5;
+	uint32_t baud = 31250;
+	uint32_t burst = 1;
+	uint32_t loopUs = 30;
+	uint32_t shiftNs = 2000;
+	uint32_t strobeNs = 500;
+	uint32_t seed = 1;
+	uint32_t runs = 100;
+	bool runningStatus = false;
+};
+
+struct Trial {
+	bool ok;
+	DeviceStats stats;
+	uint32_t bytes;
+};
+
+static void usage() {
+	fprintf(stderr,
+			"usage: ymzstress [-w workload] [-d seconds] [-b baud] [-B burst] [-L loop_us]\n"
+			"                 [-W shift_ns,strobe_ns] [-s seed] [-r]\n"
+			"       ymzstress -F [-n runs] [-s seed] [-d seconds]\n"
+			"       ymzstress -R stream.bin\n"
+			"       ymzstress -J latency_ms [-d seconds] [-L loop_us] [-W shift_ns,strobe_ns] [-s seed]\n");
+	exit(2);
+}
+
+/**
+ * Random MIDI messages for one workload. Times are filled in later.
+ */
+class Generator {
+public:
+	Generator(const std::string &workload, uint32_t seed, bool runningStatus) :
+			_workload(workload), _random(seed), _runningStatus(runningStatus), _status(0),
+			_sweep(0), _latched(false) {
+		memset(_notes, 0xff, sizeof(_notes));
+	}
+
+	std::vector<uint8_t> next() {
+		std::string kind = _workload;
+		if (kind == "mixed") {
+			const char *kinds[] = { "cc-sweep", "note-flood", "latch", "program" };
+			kind = kinds[pick(4)];
+		}
+		if (kind == "cc-sweep") {
+			return ccSweep();
+		} else if (kind == "note-flood") {
+			return noteFlood();
+		} else if (kind == "latch") {
+			return latch();
+		}
+		return message(0xc0 | (CHANNEL_STEREO - 1 + pick(3)), pick(10), -1);
+	}
+
+private:
+	uint32_t pick(uint32_t n) {
+		return std::uniform_int_distribution<uint32_t>(0, n - 1)(_random);
+	}
+
+	std::vector<uint8_t> message(uint8_t status, int data1, int data2) {
+		std::vector<uint8_t> bytes;
+		if (!_runningStatus || status != _status) {
+			bytes.push_back(status);
+		}
+		_status = status;
+		bytes.push_back(data1 & 0x7f);
+		if (data2 >= 0) {
+			bytes.push_back(data2 & 0x7f);
+		}
+		return bytes;
+	}
+
+	std::vector<uint8_t> ccSweep() {
+		const uint8_t numbers[] = { 20, 52, 21, 53, 22, 54 };
+		uint8_t channel = CHANNEL_RAW_STEREO - 1 + pick(3);
+		_sweep++;
+		return message(0xb0 | channel, numbers[_sweep % 6], (_sweep / 6) & 0x7f);
+	}
+
+	std::vector<uint8_t> noteFlood() {
+		uint8_t channel = pick(3);
+		if (_notes[channel] != 0xff && pick(2)) {
+			uint8_t note = _notes[channel];
+			_notes[channel] = 0xff;
+			return message(0x80 | channel, note, 0);
+		}
+		_notes[channel] = 36 + pick(48);
+		return message(0x90 | channel, _notes[channel], 1 + pick(127));
+	}
+
+	std::vector<uint8_t> latch() {
+		uint8_t channel = CHANNEL_RAW_STEREO - 1 + pick(3);
+		if (!pick(4)) {
+			_latched = !_latched;
+			return message(0xb0 | channel, CC_LATCH, _latched ? 127 : 0);
+		}
+		return message(0xb0 | channel, 20 + pick(12), pick(128));
+	}
+
+	std::string _workload;
+	std::mt19937 _random;
+	bool _runningStatus;
+	uint8_t _status;
+	uint32_t _sweep;
+	bool _latched;
+	uint8_t _notes[3];
+};
+
+static std::vector<MidiEvent> workloadEvents(const Options &options, double rate, uint32_t &bytes) {
+	Generator generator(options.workload, options.seed, options.runningStatus);
+	std::vector<MidiEvent> events;
+	uint32_t count = (uint32_t) (rate * options.seconds);
+	double period = 1e6 / rate;
+	bytes = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		// a burst starts where its events would have started one by one
+		uint64_t time = (uint64_t) ((i - i % options.burst) * period);
+		events.push_back({ time, 0, generator.next() });
+		bytes += events.back().bytes.size();
+	}
+	return events;
+}
+
+/**
+ * Run events on a freshly booted firmware in a child process, so every
+ * trial starts from power-on.
+ */
+static bool runIsolated(const std::vector<MidiEvent> &events, const Options &options,
+		DeviceStats &stats) {
+	int pipes[2];
+	if (pipe(pipes)) {
+		return false;
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(pipes[0]);
+		DeviceOptions device;
+		device.byteUs = 10000000 / options.baud;
+		device.loopUs = options.loopUs;
+		uint64_t start = deviceBoot();
+		hostBusSetCost(options.shiftNs, options.strobeNs);
+		DeviceStats result;
+		devicePlay(events, start, 100000, device, &result);
+		ssize_t written = write(pipes[1], &result, sizeof(result));
+		_exit(written == sizeof(result) ? 0 : 1);
+	}
+	close(pipes[1]);
+	ssize_t got = (pid > 0) ? read(pipes[0], &stats, sizeof(stats)) : -1;
+	close(pipes[0]);
+	int status = 0;
+	if (pid > 0) {
+		waitpid(pid, &status, 0);
+	}
+	return got == sizeof(stats) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static Trial trial(const Options &options, double rate) {
+	Trial t;
+	std::vector<MidiEvent> events = workloadEvents(options, rate, t.bytes);
+	t.ok = runIsolated(events, options, t.stats);
+	if (!t.ok) {
+		fprintf(stderr, "%s: firmware run failed at %.0f events/s\n", options.workload.c_str(), rate);
+		exit(1);
+	}
+	t.ok = !t.stats.dropped;
+	return t;
+}
+
+/**
+ * Binary search for the highest clean rate, up to what the wire can carry.
+ */
+static void search(const Options &options) {
+	uint32_t bytes;
+	workloadEvents(options, 1000, bytes);
+	double bytesPerEvent = bytes / (1000 * options.seconds);
+	double wire = options.baud / 10.0 / bytesPerEvent;
+
+	Trial top = trial(options, wire);
+	if (top.ok) {
+		printf("%-11s %9.0f %9.0f  100%%  none, wire-limited (buffer peak %u)\n",
+				options.workload.c_str(), wire, wire * bytesPerEvent, top.stats.maxPending);
+		return;
+	}
+
+	double lo = 0, hi = wire;
+	Trial failing = top;
+	double failingRate = wire;
+	for (int i = 0; i < 16 && hi - lo > 1; i++) {
+		double mid = (lo + hi) / 2;
+		Trial t = trial(options, mid);
+		if (t.ok) {
+			lo = mid;
+		} else {
+			hi = mid;
+			failing = t;
+			failingRate = mid;
+		}
+	}
+	printf("%-11s %9.0f %9.0f %4.0f%%  at %.0f ev/s: event %zu, %.3f s, %u bytes lost\n",
+			options.workload.c_str(), lo, lo * bytesPerEvent, 100 * lo / wire, failingRate,
+			failing.stats.firstDropEvent, failing.stats.firstDrop / 1e6, failing.stats.dropped);
+}
+
+/**
+ * One fuzz stream: mostly plausible messages aimed at the synth's channels
+ * and controllers, salted with arbitrary bytes.
+ */
+static std::vector<uint8_t> fuzzStream(uint32_t seed, size_t length) {
+	std::mt19937 random(seed);
+	auto pick = [&](uint32_t n) {
+		return std::uniform_int_distribution<uint32_t>(0, n - 1)(random);
+	};
+	std::vector<uint8_t> bytes;
+	while (bytes.size() < length) {
+		switch (pick(6)) {
+		case 0:
+			bytes.push_back(pick(256));
+			break;
+		case 1:
+			bytes.push_back(0xf0);
+			bytes.push_back(0x7d);
+			for (uint32_t n = pick(24); n; n--) {
+				bytes.push_back(pick(128));
+			}
+			bytes.push_back(0xf7);
+			break;
+		default:
+			bytes.push_back((0x80 + 0x10 * pick(7)) | pick(16));
+			bytes.push_back(pick(2) ? pick(128) : 20 + pick(12));
+			bytes.push_back(pick(128));
+			break;
+		}
+	}
+	return bytes;
+}
+
+static std::vector<MidiEvent> streamEvents(const std::vector<uint8_t> &bytes) {
+	std::vector<MidiEvent> events;
+	for (uint8_t value : bytes) {
+		events.push_back({ 0, 0, { value } });
+	}
+	return events;
+}
+
+static int fuzz(const Options &options) {
+	size_t length = (size_t) (options.seconds * options.baud / 10);
+	for (uint32_t run = 0; run < options.runs; run++) {
+		uint32_t seed = options.seed + run;
+		std::vector<uint8_t> bytes = fuzzStream(seed, length);
+		DeviceStats stats;
+		if (runIsolated(streamEvents(bytes), options, stats)) {
+			continue;
+		}
+		std::string path = "fuzz-" + std::to_string(seed) + ".bin";
+		FILE *file = fopen(path.c_str(), "wb");
+		if (file) {
+			fwrite(bytes.data(), 1, bytes.size(), file);
+			fclose(file);
+		}
+		printf("seed %u failed; stream saved to %s\n", seed, path.c_str());
+		return 1;
+	}
+	printf("%u runs of %zu bytes clean\n", options.runs, length);
+	return 0;
+}
+
+static int replay(const char *path, const Options &options) {
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "cannot open %s\n", path);
+		return 1;
+	}
+	std::vector<uint8_t> bytes;
+	int c;
+	while ((c = fgetc(file)) != EOF) {
+		bytes.push_back(c);
+	}
+	fclose(file);
+	DeviceOptions device;
+	device.byteUs = 10000000 / options.baud;
+	uint64_t start = deviceBoot();
+	DeviceStats stats;
+	devicePlay(streamEvents(bytes), start, 100000, device, &stats);
+	printf("%zu bytes replayed, %u lost\n", bytes.size(), stats.dropped);
+	return 0;
+}
+
+struct JitterResult {
+	uint32_t probes;
+	uint32_t landed;
+	double minUs;
+	double meanUs;
+	double maxUs;
+	bool reported;        // the firmware answered the statistics request
+	uint16_t firmware[4]; // events, forced, worst and mean lateness in us
+};
+
+/**
+ * Probes and load for -J, with the latency set first and the firmware's
+ * statistics asked for at the end. The wire end of each probe, relative to
+ * the start, is returned alongside.
+ */
+static std::vector<MidiEvent> jitterEvents(const Options &options, uint8_t latency,
+		uint32_t byteUs, std::vector<uint64_t> &probeEnds) {
+	std::mt19937 random(options.seed);
+	auto pick = [&](uint32_t n) {
+		return std::uniform_int_distribution<uint32_t>(0, n - 1)(random);
+	};
+	std::vector<MidiEvent> events;
+	events.push_back({ 0, 0, { 0xf0, 0x7d, SYSEX_SCHEDULE, latency, 0xf7 } });
+	uint64_t time = 10000;
+	uint64_t end = 10000 + (uint64_t) (options.seconds * 1e6);
+	uint8_t note = 0xff;
+	bool high = false;
+	while (time < end) {
+		switch (pick(4)) {
+		case 0:
+			high = !high;
+			events.push_back({ time, 0, { 0xb0 | (CHANNEL_RAW_LEFT - 1), CC_CHANNEL_A_LEVEL,
+					(uint8_t) (high ? 60 : 4) } });
+			break;
+		case 1:
+			if (note != 0xff) {
+				events.push_back({ time, 0, { 0x80 | (CHANNEL_RIGHT - 1), note, 0 } });
+				note = 0xff;
+				break;
+			}
+			note = 36 + pick(48);
+			events.push_back({ time, 0, { 0x90 | (CHANNEL_RIGHT - 1), note, (uint8_t) (1 + pick(127)) } });
+			break;
+		default:
+			events.push_back({ time, 0, { 0xb0 | (CHANNEL_RAW_RIGHT - 1), (uint8_t) (20 + pick(3)),
+					(uint8_t) pick(128) } });
+			break;
+		}
+		// bursts of back-to-back messages between quiet gaps
+		time += pick(3) ? 0 : 2000 + pick(8000);
+	}
+	events.push_back({ end + 100000, 0, { 0xf0, 0x7d, SYSEX_SCHEDULE, 0xf7 } });
+
+	uint64_t wire = 0;
+	for (const MidiEvent &event : events) {
+		wire = (event.time > wire) ? event.time : wire;
+		wire += event.bytes.size() * byteUs;
+		if (event.bytes[0] == (0xb0 | (CHANNEL_RAW_LEFT - 1))) {
+			probeEnds.push_back(wire);
+		}
+	}
+	return events;
+}
+
+struct JitterCapture {
+	std::vector<uint64_t> writes; // PSG1 channel A level writes
+	std::vector<uint8_t> sent;
+};
+
+static void jitterBus(void *context, uint64_t time, uint8_t chip, uint8_t reg, uint8_t value) {
+	if (chip == 1 && reg == 0x08) {
+		((JitterCapture *) context)->writes.push_back(time);
+	}
+}
+
+static void jitterSerial(void *context, uint8_t value) {
+	((JitterCapture *) context)->sent.push_back(value);
+}
+
+/**
+ * One -J run in a child process, so it starts from power-on.
+ */
+static bool runJitter(const Options &options, uint8_t latency, JitterResult &result) {
+	int pipes[2];
+	if (pipe(pipes)) {
+		return false;
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(pipes[0]);
+		DeviceOptions device;
+		device.byteUs = 10000000 / options.baud;
+		device.loopUs = options.loopUs ? options.loopUs : 1;
+		device.spin = true;
+		std::vector<uint64_t> probeEnds;
+		std::vector<MidiEvent> events = jitterEvents(options, latency, device.byteUs, probeEnds);
+		uint64_t start = deviceBoot();
+		hostBusSetCost(options.shiftNs, options.strobeNs);
+		JitterCapture capture;
+		hostBusSetSink(jitterBus, &capture);
+		hostSerialSetSink(jitterSerial, &capture);
+		devicePlay(events, start, 100000, device);
+
+		JitterResult r = {};
+		r.probes = probeEnds.size();
+		r.landed = std::min(probeEnds.size(), capture.writes.size());
+		r.minUs = 1e30;
+		for (uint32_t i = 0; i < r.landed; i++) {
+			double us = (double) (capture.writes[i] - start) - probeEnds[i];
+			r.minUs = std::min(r.minUs, us);
+			r.maxUs = std::max(r.maxUs, us);
+			r.meanUs += us / r.landed;
+		}
+		const std::vector<uint8_t> &sent = capture.sent;
+		for (size_t i = 0; i + 13 <= sent.size(); i++) {
+			if (sent[i] == 0xf0 && sent[i + 1] == 0x7d && sent[i + 2] == SYSEX_SCHEDULE
+					&& sent[i + 12] == 0xf7) {
+				r.reported = true;
+				for (int v = 0; v < 4; v++) {
+					r.firmware[v] = sent[i + 4 + 2 * v] | (sent[i + 5 + 2 * v] << 7);
+				}
+			}
+		}
+		ssize_t written = write(pipes[1], &r, sizeof(r));
+		_exit(written == sizeof(r) ? 0 : 1);
+	}
+	close(pipes[1]);
+	ssize_t got = (pid > 0) ? read(pipes[0], &result, sizeof(result)) : -1;
+	close(pipes[0]);
+	int status = 0;
+	if (pid > 0) {
+		waitpid(pid, &status, 0);
+	}
+	return got == sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int jitter(const Options &options, int latency) {
+	printf("%u baud, loop %u us, bus write %u ns, %.1f s\n\n", options.baud, options.loopUs,
+			2 * (options.shiftNs + options.strobeNs), options.seconds);
+	printf("latency  probes   min us  mean us   max us  jitter us   firmware: events forced worst mean\n");
+	const int latencies[2] = { 0, latency };
+	for (int i = 0; i < 2; i++) {
+		JitterResult r;
+		if (!runJitter(options, latencies[i], r)) {
+			fprintf(stderr, "firmware run failed at %d ms\n", latencies[i]);
+			return 1;
+		}
+		if (r.landed != r.probes) {
+			printf("warning: %u of %u probes reached the bus\n", r.landed, r.probes);
+		}
+		printf("%4d ms %8u %8.0f %8.0f %8.0f %10.0f", latencies[i], r.probes, r.minUs, r.meanUs,
+				r.maxUs, r.maxUs - r.minUs);
+		if (latencies[i] && r.reported) {
+			printf("   %16u %6u %5u %4u", r.firmware[0], r.firmware[1], r.firmware[2], r.firmware[3]);
+		}
+		printf("\n");
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	bool fuzzing = false;
+	const char *replayPath = 0;
+	int latency = -1;
+	int opt;
+	while ((opt = getopt(argc, argv, "w:d:b:B:L:W:s:n:rFR:J:")) != -1) {
+		switch (opt) {
+		case 'w':
+			options.workload = optarg;
+			break;
+		case 'd':
+			options.seconds = atof(optarg);
+			break;
+		case 'b':
+			options.baud = atoi(optarg);
+			break;
+		case 'B':
+			options.burst = atoi(optarg);
+			break;
+		case 'L':
+			options.loopUs = atoi(optarg);
+			break;
+		case 'W':
+			if (sscanf(optarg, "%u,%u", &options.shiftNs, &options.strobeNs) != 2) {
+				usage();
+			}
+			break;
+		case 's':
+			options.seed = atoi(optarg);
+			break;
+		case 'n':
+			options.runs = atoi(optarg);
+			break;
+		case 'r':
+			options.runningStatus = true;
+			break;
+		case 'F':
+			fuzzing = true;
+			break;
+		case 'R':
+			replayPath = optarg;
+			break;
+		case 'J':
+			latency = atoi(optarg);
+			if (latency < 1 || latency > 127) {
+				usage();
+			}
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || !options.baud || !options.burst || options.seconds <= 0) {
+		usage();
+	}
+	if (replayPath) {
+		return replay(replayPath, options);
+	}
+	if (fuzzing) {
+		return fuzz(options);
+	}
+	if (latency > 0) {
+		return jitter(options, latency);
+	}
+
+	std::vector<std::string> workloads;
+	if (options.workload.empty()) {
+		workloads = { "cc-sweep", "note-flood", "latch", "mixed" };
+	} else {
+		workloads = { options.workload };
+	}
+	printf("%u baud, burst %u, loop %u us, bus write %u ns, %.1f s per trial\n\n", options.baud,
+			options.burst, options.loopUs, 2 * (options.shiftNs + options.strobeNs), options.seconds);
+	printf("workload    sustained   bytes/s  wire  first drop above it\n");
+	for (const std::string &workload : workloads) {
+		if (workload != "cc-sweep" && workload != "note-flood" && workload != "latch"
+				&& workload != "mixed") {
+			fprintf(stderr, "unknown workload %s\n", workload.c_str());
+			return 2;
+		}
+		options.workload = workload;
+		search(options);
+	}
+	return 0;
+}
@@ -0,0 +1,426 @@
+/**
+ * ymztrace: inspect and compare register traces.
+ *
+ *   ymztrace dump trace.ymzt
+ *   ymztrace stats trace.ymzt
+ *   ymztrace diff [-t tolerance_us] [-n max] [-x] a.ymzt b.ymzt
+ *   ymztrace import capture.syx trace.ymzt
+ *   ymztrace render [-j jobs] [-r rate] [-t tail_ms] [-o out] trace.ymzt ...
+ *
+ * diff replays both traces and compares the register state the chips end
+ * up in rather than the transactions, so an optimization that drops
+ * redundant writes compares equal as long as every register holds the same
+ * value at the same time. Differences shorter than the tolerance are
+ * ignored; registers neither trace has written yet are not compared. -x
+ * compares transactions one for one instead. The exit status is 1 when the
+ * traces differ.
+ *
+ * render plays traces through the band-limited renderer (blep.h) to WAV,
+ * with tail_ms (default 1000) after the last write. With one trace, -o
+ * names the WAV file; with several, -o names a directory and the traces
+ * render in parallel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "blep.h"
+#include "pool.h"
+#include "trace.h"
+#include "wav.h"
+
+#define UNKNOWN 0x100
+#define REGISTERS 16
+
+static void usage() {
+	fprintf(stderr,
+			"usage: ymztrace dump trace.ymzt\n"
+			"       ymztrace stats trace.ymzt\n"
+			"       ymztrace diff [-t tolerance_us] [-n max] [-x] a.ymzt b.ymzt\n"
+			"       ymztrace import capture.syx trace.ymzt\n"
+			"       ymztrace render [-j jobs] [-r rate] [-t tail_ms] [-o out] trace.ymzt ...\n");
+	exit(2);
+}
+
+static bool openTrace(TraceFile &trace, const char *path) {
+	std::string error;
+	if (!trace.open(path, error)) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return false;
+	}
+	return true;
+}
+
+static const char *chipName(uint8_t chips) {
+	switch (chips) {
+	case 1:
+		return "PSG0";
+	case 2:
+		return "PSG1";
+	default:
+		return "both";
+	}
+}
+
+static int dump(int argc, char **argv) {
+	if (argc != 2) {
+		usage();
+	}
+	TraceFile trace;
+	if (!openTrace(trace, argv[1])) {
+		return 1;
+	}
+	for (const TraceRecord &r : trace) {
+		printf("%10u %s %02x=%02x\n", r.time, chipName(r.chips), r.reg, r.value);
+	}
+	return 0;
+}
+
+/**
+ * Write counts and rates per register and chip, plus the busiest
+ * millisecond on the bus.
+ */
+static int stats(int argc, char **argv) {
+	if (argc != 2) {
+		usage();
+	}
+	TraceFile trace;
+	if (!openTrace(trace, argv[1])) {
+		return 1;
+	}
+	uint64_t counts[2][REGISTERS] = { { 0 } };
+	uint64_t both = 0;
+	size_t peak = 0;
+	uint32_t peakTime = 0;
+	size_t window = 0;
+	for (size_t i = 0; i < trace.size(); i++) {
+		const TraceRecord &r = trace[i];
+		for (int chip = 0; chip < 2; chip++) {
+			if (r.chips & (1 << chip)) {
+				counts[chip][r.reg & 0x0f]++;
+			}
+		}
+		both += (r.chips == 3);
+		while (trace[window].time + 1000 <= r.time) {
+			window++;
+		}
+		if (i + 1 - window > peak) {
+			peak = i + 1 - window;
+			peakTime = trace[window].time;
+		}
+	}
+
+	double seconds = trace.size() ? (trace[trace.size() - 1].time - trace[0].time) / 1e6 : 0;
+	if (seconds <= 0) {
+		seconds = 1e-6;
+	}
+	printf("%zu transactions (%llu to both chips) over %.3f s, %.1f/s\n", trace.size(),
+			(unsigned long long) both, seconds, trace.size() / seconds);
+	printf("peak %zu transactions in 1 ms at %.3f s\n\n", peak, peakTime / 1e6);
+	printf("reg       PSG0     /s       PSG1     /s\n");
+	for (int reg = 0; reg < REGISTERS; reg++) {
+		if (!counts[0][reg] && !counts[1][reg]) {
+			continue;
+		}
+		printf("0x%02x %10llu %6.1f %10llu %6.1f\n", reg, (unsigned long long) counts[0][reg],
+				counts[0][reg] / seconds, (unsigned long long) counts[1][reg], counts[1][reg] / seconds);
+	}
+	return 0;
+}
+
+struct Divergence {
+	uint32_t since;
+	bool open;
+};
+
+static int diff(int argc, char **argv) {
+	uint32_t tolerance = 0;
+	size_t max = 20;
+	bool exact = false;
+	int opt;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "t:n:x")) != -1) {
+		switch (opt) {
+		case 't':
+			tolerance = atoi(optarg);
+			break;
+		case 'n':
+			max = atoi(optarg);
+			break;
+		case 'x':
+			exact = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 2) {
+		usage();
+	}
+	TraceFile a, b;
+	if (!openTrace(a, argv[optind]) || !openTrace(b, argv[optind + 1])) {
+		return 1;
+	}
+	printf("%zu vs %zu transactions (%+.1f%%)\n", a.size(), b.size(),
+			a.size() ? 100.0 * ((double) b.size() - a.size()) / a.size() : 0.0);
+
+	if (exact) {
+		size_t n = (a.size() < b.size()) ? a.size() : b.size();
+		for (size_t i = 0; i < n; i++) {
+			if (memcmp(&a[i], &b[i], sizeof(TraceRecord))) {
+				printf("first difference at transaction %zu: %u %s %02x=%02x vs %u %s %02x=%02x\n", i,
+						a[i].time, chipName(a[i].chips), a[i].reg, a[i].value, b[i].time,
+						chipName(b[i].chips), b[i].reg, b[i].value);
+				return 1;
+			}
+		}
+		if (a.size() != b.size()) {
+			printf("identical for %zu transactions, then one trace ends\n", n);
+			return 1;
+		}
+		printf("identical\n");
+		return 0;
+	}
+
+	uint16_t state[2][2][REGISTERS];
+	Divergence divergence[2][REGISTERS];
+	for (int i = 0; i < 2; i++) {
+		for (int reg = 0; reg < REGISTERS; reg++) {
+			state[0][i][reg] = state[1][i][reg] = UNKNOWN;
+			divergence[i][reg].open = false;
+		}
+	}
+
+	size_t reported = 0;
+	size_t total = 0;
+	auto report = [&](int chip, int reg, uint32_t since, uint32_t until, bool ended) {
+		total++;
+		if (reported++ < max) {
+			printf("PSG%d %02x differs from %.6f s %s%.6f s\n", chip, reg, since / 1e6,
+					ended ? "to the end, " : "for ", (until - since) / 1e6);
+		}
+	};
+
+	size_t i = 0, j = 0;
+	while (i < a.size() || j < b.size()) {
+		uint32_t time = (j >= b.size() || (i < a.size() && a[i].time <= b[j].time)) ? a[i].time : b[j].time;
+		uint16_t touched[2] = { 0, 0 };
+		for (; i < a.size() && a[i].time == time; i++) {
+			for (int chip = 0; chip < 2; chip++) {
+				if (a[i].chips & (1 << chip)) {
+					state[0][chip][a[i].reg & 0x0f] = a[i].value;
+					touched[chip] |= 1 << (a[i].reg & 0x0f);
+				}
+			}
+		}
+		for (; j < b.size() && b[j].time == time; j++) {
+			for (int chip = 0; chip < 2; chip++) {
+				if (b[j].chips & (1 << chip)) {
+					state[1][chip][b[j].reg & 0x0f] = b[j].value;
+					touched[chip] |= 1 << (b[j].reg & 0x0f);
+				}
+			}
+		}
+		for (int chip = 0; chip < 2; chip++) {
+			for (int reg = 0; touched[chip] >> reg; reg++) {
+				if (!(touched[chip] & (1 << reg))) {
+					continue;
+				}
+				uint16_t va = state[0][chip][reg];
+				uint16_t vb = state[1][chip][reg];
+				bool differs = (va != vb) && va != UNKNOWN && vb != UNKNOWN;
+				Divergence &d = divergence[chip][reg];
+				if (differs && !d.open) {
+					d.open = true;
+					d.since = time;
+				} else if (!differs && d.open) {
+					d.open = false;
+					if (time - d.since > tolerance) {
+						report(chip, reg, d.since, time, false);
+					}
+				}
+			}
+		}
+	}
+	uint32_t end = 0;
+	if (a.size()) {
+		end = a[a.size() - 1].time;
+	}
+	if (b.size() && b[b.size() - 1].time > end) {
+		end = b[b.size() - 1].time;
+	}
+	for (int chip = 0; chip < 2; chip++) {
+		for (int reg = 0; reg < REGISTERS; reg++) {
+			if (divergence[chip][reg].open) {
+				report(chip, reg, divergence[chip][reg].since, end, true);
+			}
+		}
+	}
+
+	if (!total) {
+		printf("register state identical\n");
+		return 0;
+	}
+	if (total > max) {
+		printf("... %zu more\n", total - max);
+	}
+	return 1;
+}
+
+static int import(int argc, char **argv) {
+	if (argc != 3) {
+		usage();
+	}
+	FILE *file = fopen(argv[1], "rb");
+	if (!file) {
+		fprintf(stderr, "cannot open %s\n", argv[1]);
+		return 1;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[65536];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + count);
+	}
+	fclose(file);
+
+	std::vector<TraceRecord> records;
+	uint32_t dropped = decodeTraceFrames(data.data(), data.size(), records);
+	TraceWriter writer;
+	if (!writer.open(argv[2])) {
+		fprintf(stderr, "cannot write %s\n", argv[2]);
+		return 1;
+	}
+	for (const TraceRecord &r : records) {
+		writer.write(r.time, r.chips, r.reg, r.value);
+	}
+	if (!writer.close()) {
+		fprintf(stderr, "cannot write %s\n", argv[2]);
+		return 1;
+	}
+	printf("%zu transactions, %u dropped on the device\n", records.size(), dropped);
+	return 0;
+}
+
+static std::string baseName(const std::string &path) {
+	size_t slash = path.find_last_of('/');
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+/**
+ * Render one trace to a WAV file. Returns seconds of audio, or a negative
+ * value on failure.
+ */
+static double renderTrace(const std::string &in, const std::string &out, uint32_t rate,
+		uint32_t tailMs) {
+	TraceFile trace;
+	if (!openTrace(trace, in.c_str())) {
+		return -1;
+	}
+	BlepRenderer renderer(rate);
+	for (const TraceRecord &r : trace) {
+		for (uint8_t chip = 0; chip < 2; chip++) {
+			if (r.chips & (1 << chip)) {
+				renderer.write(r.time, chip, r.reg, r.value);
+			}
+		}
+	}
+	uint64_t end = (trace.size() ? trace[trace.size() - 1].time : 0) + (uint64_t) tailMs * 1000;
+	renderer.finish(end);
+	if (!writeWav(out, renderer.samples(), rate, 2)) {
+		fprintf(stderr, "cannot write %s\n", out.c_str());
+		return -1;
+	}
+	return end / 1e6;
+}
+
+static int render(int argc, char **argv) {
+	unsigned jobs = 0;
+	uint32_t rate = 44100;
+	uint32_t tailMs = 1000;
+	std::string out;
+	int opt;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "j:r:t:o:")) != -1) {
+		switch (opt) {
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 't':
+			tailMs = atoi(optarg);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	std::vector<std::string> inputs(argv + optind, argv + argc);
+	if (inputs.empty() || !rate) {
+		usage();
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	if (inputs.size() == 1) {
+		double seconds = renderTrace(inputs[0], out.empty() ? baseName(inputs[0]) + ".wav" : out,
+				rate, tailMs);
+		if (seconds < 0) {
+			return 1;
+		}
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		printf("%s: %.1f s in %.4f s (%.0fx realtime)\n", inputs[0].c_str(), seconds, elapsed,
+				seconds / elapsed);
+		return 0;
+	}
+
+	std::string dir = out.empty() ? "." : out;
+	std::atomic<unsigned> failed(0);
+	std::vector<double> seconds(inputs.size(), 0);
+	WorkPool pool(jobs);
+	pool.run(inputs.size(), [&](size_t job, unsigned worker) {
+		seconds[job] = renderTrace(inputs[job], dir + "/" + baseName(inputs[job]) + ".wav", rate, tailMs);
+		if (seconds[job] < 0) {
+			failed++;
+		}
+	});
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	double total = 0;
+	for (double s : seconds) {
+		total += (s > 0) ? s : 0;
+	}
+	printf("%zu traces, %u failed, %.1f s of audio in %.3f s on %u workers (%.0fx realtime)\n",
+			inputs.size(), failed.load(), total, elapsed, pool.workers(), total / elapsed);
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		usage();
+	}
+	std::string command = argv[1];
+	if (command == "dump") {
+		return dump(argc - 1, argv + 1);
+	} else if (command == "stats") {
+		return stats(argc - 1, argv + 1);
+	} else if (command == "diff") {
+		return diff(argc - 1, argv + 1);
+	} else if (command == "import") {
+		return import(argc - 1, argv + 1);
+	} else if (command == "render") {
+		return render(argc - 1, argv + 1);
+	}
+	usage();
+}
@@ -0,0 +1,425 @@
+/**
+ * Hardchord YMZ Shield 1.0 (hcYmzPlayer.cpp)
+ * Derrick Sobodash <derrick@sobodash.com>
+ * Version 0.4.3
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ */
+
+#include "hcYmzPlayer.h"
+
+// Player states
+#define PLAYER_IDLE     0
+#define PLAYER_HEADER   1 // waiting for "HC" and the revision
+#define PLAYER_COMMAND  2 // waiting for a command byte
+#define PLAYER_ARGS     3 // waiting for the current command's arguments
+#define PLAYER_BEAT     4 // waiting for getClockFine() to reach _scheduled
+#define PLAYER_NOTE     5 // articulation gap inside a set note
+#define PLAYER_CHANNELS 6 // articulation gap inside a set channels
+#define PLAYER_DELAY    7 // waiting for millis() to reach _delayEnd
+
+// A run of delays more than this many milliseconds behind starts over
+#define PLAYER_DELAY_SLACK 100
+
+
+/**
+ * Byte Sources
+ */
+hcYmzProgmemSource::hcYmzProgmemSource(const uint8_t *data) {
+  _data = data;
+}
+
+int hcYmzProgmemSource::available() {
+  // The block's end command stops the player before it reads any further
+  return(0x7fff);
+}
+
+uint8_t hcYmzProgmemSource::read() {
+  return(pgm_read_byte(_data++));
+}
+
+hcYmzRamSource::hcYmzRamSource(const uint8_t *data, uint16_t size) {
+  _data = data;
+  _size = size;
+}
+
+int hcYmzRamSource::available() {
+  return(_size ? (_size > 0x7fff ? 0x7fff : _size) : -1);
+}
+
+uint8_t hcYmzRamSource::read() {
+  _size--;
+  return(*_data++);
+}
+
+hcYmzStreamSource::hcYmzStreamSource() {
+  reset();
+}
+
+int hcYmzStreamSource::available() {
+  uint8_t count = (STREAM_SIZE + _head - _tail) % STREAM_SIZE;
+  return((!count && _finished) ? -1 : count);
+}
+
+uint8_t hcYmzStreamSource::read() {
+  uint8_t value = _buffer[_tail];
+  _tail = (_tail + 1) % STREAM_SIZE;
+  return(value);
+}
+
+/**
+ * public hcYmzStreamSource::write()
+ * 
+ * Appends a byte to the stream. Returns false if the buffer is full; keep
+ * the sender within space().
+ */
+bool hcYmzStreamSource::write(uint8_t value) {
+  uint8_t next = (_head + 1) % STREAM_SIZE;
+  if(next == _tail)
+    return(false);
+  _buffer[_head] = value;
+  _head = next;
+  return(true);
+}
+
+/**
+ * public hcYmzStreamSource::space()
+ * 
+ * Returns how many bytes write() will take right now.
+ */
+uint8_t hcYmzStreamSource::space() {
+  return(STREAM_SIZE - 1 - (STREAM_SIZE + _head - _tail) % STREAM_SIZE);
+}
+
+/**
+ * public hcYmzStreamSource::finish()
+ * 
+ * Marks the end of the stream; the player stops once it has drained.
+ */
+void hcYmzStreamSource::finish() {
+  _finished = true;
+}
+
+/**
+ * public hcYmzStreamSource::reset()
+ * 
+ * Empties the buffer for a new stream.
+ */
+void hcYmzStreamSource::reset() {
+  _head = _tail = 0;
+  _finished = false;
+}
+
+
+/**
+ * Player
+ */
+
+// Argument bytes for each command; anything not listed takes none and is
+// skipped, as playBlock() always has
+static uint8_t commandLength(uint8_t command) {
+  switch(command) {
+    case 0x51: case 0x61: case 0x62: case 0x63: case 0x73: case 0x81:
+    case 0x82: case 0xa0: case 0xa1:
+      return(2);
+    case 0x50: case 0x52: case 0x53: case 0x70: case 0x90:
+      return(1);
+    case 0x80:
+      return(3);
+    case 0x83:
+      return(6);
+  }
+  return(0);
+}
+
+hcYmzPlayer::hcYmzPlayer() {
+  _source = 0;
+  _state = PLAYER_IDLE;
+  _delayEnd = 0;
+}
+
+
+/**
+ * public hcYmzPlayer::play()
+ * 
+ * Starts playing a block from the source. The source must outlive the
+ * playback.
+ */
+void hcYmzPlayer::play(hcYmzSource &source) {
+  _source = &source;
+  _state = PLAYER_HEADER;
+  _scheduled = YMZ.getClockFine();
+  _delayEnd = millis();
+}
+
+
+/**
+ * public hcYmzPlayer::stop()
+ * 
+ * Stops reading the block. Notes already playing keep sounding.
+ */
+void hcYmzPlayer::stop() {
+  _source = 0;
+  _state = PLAYER_IDLE;
+}
+
+
+/**
+ * public hcYmzPlayer::isPlaying()
+ */
+bool hcYmzPlayer::isPlaying() {
+  return(_state != PLAYER_IDLE);
+}
+
+
+/**
+ * public hcYmzPlayer::poll()
+ * 
+ * Call from loop(). Runs the commands that are due, up to PLAYER_BURST at a
+ * time, and returns right away when the next one has to wait for a beat,
+ * an articulation gap or more streamed data. Returns false once the block
+ * has ended.
+ */
+bool hcYmzPlayer::poll() {
+  for(uint8_t i = 0; i < PLAYER_BURST; i++) {
+    if(!_run())
+      break;
+  }
+  return(isPlaying());
+}
+
+
+/**
+ * private hcYmzPlayer::_run()
+ * 
+ * Takes one step. Returns false when the player has to wait.
+ */
+bool hcYmzPlayer::_run() {
+  int available;
+  switch(_state) {
+    case PLAYER_IDLE:
+      return(false);
+
+    case PLAYER_HEADER:
+      available = _source->available();
+      if(available < 0) {
+        stop();
+        return(false);
+      }
+      if(available < 3)
+        return(false);
+      // Support <= Revision 1
+      if(_source->read() != 0x48 || _source->read() != 0x43 || _source->read() >= 2) {
+        stop();
+        return(false);
+      }
+      _state = PLAYER_COMMAND;
+      return(true);
+
+    case PLAYER_COMMAND:
+      available = _source->available();
+      if(available <= 0) {
+        if(available < 0)
+          stop();
+        return(false);
+      }
+      _command = _source->read();
+      if(!_command) {
+        stop();
+        return(false);
+      }
+      _state = PLAYER_ARGS;
+      // fall through
+
+    case PLAYER_ARGS: {
+      uint8_t length = commandLength(_command);
+      available = _source->available();
+      if(available < length) {
+        if(available < 0)
+          stop();
+        return(false);
+      }
+      for(uint8_t i = 0; i < length; i++)
+        _args[i] = _source->read();
+      _state = PLAYER_COMMAND;
+      break;
+    }
+
+    case PLAYER_BEAT:
+      if((int32_t)(YMZ.getClockFine() - _scheduled) < 0)
+        return(false);
+      _delayEnd = millis();
+      _state = PLAYER_COMMAND;
+      return(true);
+
+    case PLAYER_DELAY:
+      if((long)(millis() - _delayEnd) < 0)
+        return(false);
+      _scheduled = YMZ.getClockFine();
+      _state = PLAYER_COMMAND;
+      return(true);
+
+    case PLAYER_NOTE:
+    case PLAYER_CHANNELS:
+      if((long)(millis() - _gapEnd) < 0)
+        return(false);
+      _finishNotes();
+      _state = PLAYER_COMMAND;
+      return(true);
+  }
+
+  switch(_command) {
+    #if HCYMZ_PLAYER_OPS & HCYMZ_OPS_LEVELS
+    // Set volume on all channels
+    case 0x50:
+      YMZ.setVolume(_args[0]);
+      break;
+    // Set volume on one channel
+    case 0x51:
+      YMZ.setVolume(_args[0], _args[1]);
+      break;
+    // Set tempo
+    case 0x52:
+      YMZ.setTempo(_args[0]);
+      break;
+    // Set articulation
+    case 0x53:
+      YMZ.setArticulation(_args[0]);
+      break;
+    #endif
+
+    #if HCYMZ_PLAYER_OPS & HCYMZ_OPS_MIXER
+    // Mute all channels
+    case 0x60:
+      YMZ.mute();
+      break;
+    // Toggle tone on channel
+    case 0x61:
+      YMZ.setTone(_args[0], !!_args[1]);
+      break;
+    // Toggle noise on channel
+    case 0x62:
+      YMZ.setNoise(_args[0], !!_args[1]);
+      break;
+    // Toggle envelope on channel
+    case 0x63:
+      YMZ.setEnvelope(_args[0], !!_args[1]);
+      break;
+    #endif
+
+    #if HCYMZ_PLAYER_OPS & HCYMZ_OPS_ENVELOPE
+    // Start envelope generator with ADSR envelope
+    case 0x70:
+      YMZ.startEnvelope(_args[0]);
+      break;
+    // Restart current ADSR envelope
+    case 0x71:
+      YMZ.restartEnvelope();
+      break;
+    // Set envelope period
+    case 0x73:
+      YMZ.setEnvelopePeriod((_args[0] << 8) + _args[1]);
+      break;
+    #endif
+
+    #if HCYMZ_PLAYER_OPS & HCYMZ_OPS_TONE
+    // Set tone period
+    case 0x80:
+      YMZ.setTonePeriod(_args[0], (_args[1] << 8) + _args[2]);
+      break;
+    // Set tone MIDI
+    case 0x81:
+      YMZ.setToneMidi(_args[0], _args[1]);
+      break;
+    // Set note: as setNote(), with the articulation gap left to later polls
+    case 0x82:
+      YMZ.setTone(_args[0], false);
+      if(_args[1] != OFF) {
+        YMZ.setToneMidi(_args[0], _args[1]);
+        _gapEnd = millis() + YMZ._articulation;
+        _state = PLAYER_NOTE;
+      }
+      break;
+    // Set channels, likewise
+    case 0x83:
+      YMZ._setChannelsOff(_args);
+      _gapEnd = millis() + YMZ._articulation;
+      _state = PLAYER_CHANNELS;
+      break;
+    #endif
+
+    #if HCYMZ_PLAYER_OPS & HCYMZ_OPS_NOISE
+    // Set noise period
+    case 0x90:
+      YMZ.setNoisePeriod(_args[0]);
+      break;
+    #endif
+
+    #if HCYMZ_PLAYER_OPS & HCYMZ_OPS_TIMING
+    // Pause for a beat, as beat() counts it; a beat of 0 from a corrupt or
+    // hand-made block has no length and is skipped
+    case 0xa0:
+      if (_args[0]) {
+        _schedule(((uint32_t)(4 * PPQN * 256 / 8) * _args[1]) / _args[0]);
+      }
+      break;
+    // Delay, in milliseconds of real time whatever the tempo clock does
+    case 0xa1:
+      _delay(((uint16_t)_args[0] << 8) + _args[1]);
+      break;
+    #endif
+  }
+  return(_state == PLAYER_COMMAND);
+}
+
+
+/**
+ * private hcYmzPlayer::_schedule()
+ * 
+ * Moves the schedule on by a span in 1/256 ticks and waits for it. Like
+ * beat(), a player more than a quarter note behind starts over from now.
+ */
+void hcYmzPlayer::_schedule(uint32_t length) {
+  uint32_t now = YMZ.getClockFine();
+  if((int32_t)(now - _scheduled) > (int32_t)(PPQN << 8))
+    _scheduled = now;
+  _scheduled += length;
+  _state = PLAYER_BEAT;
+}
+
+
+/**
+ * private hcYmzPlayer::_delay()
+ * 
+ * Waits for a number of milliseconds after the last delay ended, so a run
+ * of delays adds up exactly. A beat or a player more than
+ * PLAYER_DELAY_SLACK behind starts the run over from now. The beats after
+ * it count from where it ends.
+ */
+void hcYmzPlayer::_delay(uint16_t ms) {
+  unsigned long now = millis();
+  if((long)(now - _delayEnd) > PLAYER_DELAY_SLACK)
+    _delayEnd = now;
+  _delayEnd += ms;
+  _state = PLAYER_DELAY;
+}
+
+
+/**
+ * private hcYmzPlayer::_finishNotes()
+ * 
+ * The second half of a set note or set channels, after the gap.
+ */
+void hcYmzPlayer::_finishNotes() {
+  if(_state == PLAYER_NOTE)
+    YMZ.setTone(_args[0]);
+  else
+    YMZ._setChannelsOn(_args);
+}
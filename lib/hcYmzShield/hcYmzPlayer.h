@@ -0,0 +1,102 @@
+/**
+ * Hardchord YMZ Shield 1.0 (hcYmzPlayer.h)
+ * Derrick Sobodash <derrick@sobodash.com>
+ * Version 0.4.3
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ */
+
+#ifndef __HCYMZPLAYER_H
+#define __HCYMZPLAYER_H
+
+#include "hcYmzShield.h"
+
+// Commands the player runs per poll() before giving loop() back
+#define PLAYER_BURST 8
+
+// Prefetch buffer for streamed songs
+#define STREAM_SIZE 32
+
+/**
+ * Where a player reads its Hardchord Music block from. available() is the
+ * number of bytes read() can return right now, or -1 once the source has
+ * run out for good.
+ */
+class hcYmzSource {
+  public:
+    virtual int available() = 0;
+    virtual uint8_t read() = 0;
+};
+
+// A block in flash, as playBlock() has always read it; ends at command 0
+class hcYmzProgmemSource : public hcYmzSource {
+  public:
+    hcYmzProgmemSource(const uint8_t*);
+    int available();
+    uint8_t read();
+  private:
+    const uint8_t *_data;
+};
+
+// A block in RAM of known size
+class hcYmzRamSource : public hcYmzSource {
+  public:
+    hcYmzRamSource(const uint8_t*, uint16_t);
+    int available();
+    uint8_t read();
+  private:
+    const uint8_t *_data;
+    uint16_t _size;
+};
+
+// A block fed a few bytes at a time, e.g. from SysEx, through a ring buffer
+class hcYmzStreamSource : public hcYmzSource {
+  public:
+    hcYmzStreamSource();
+    int available();
+    uint8_t read();
+    bool write(uint8_t);
+    uint8_t space();
+    void finish();
+    void reset();
+  private:
+    uint8_t _buffer[STREAM_SIZE];
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+    bool _finished;
+};
+
+/**
+ * Plays a block one poll() at a time, so the sketch's loop() keeps running
+ * between commands. Beats are scheduled against the shield's tempo clock,
+ * delays against millis().
+ */
+class hcYmzPlayer {
+  public:
+    hcYmzPlayer();
+    void play(hcYmzSource&);
+    void stop();
+    bool isPlaying();
+    bool poll();
+  private:
+    hcYmzSource *_source;
+    uint8_t _state;
+    uint8_t _command;
+    uint8_t _args[6];
+    uint32_t _scheduled;
+    unsigned long _gapEnd;
+    unsigned long _delayEnd;
+    bool _run();
+    void _schedule(uint32_t);
+    void _delay(uint16_t);
+    void _finishNotes();
+};
+
+#endif // __HCYMZPLAYER_H
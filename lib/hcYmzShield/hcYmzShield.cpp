@@ -14,6 +14,7 @@
  */
 
 #include "hcYmzShield.h"
+#include "hcYmzPlayer.h"
 
 
 // Create the handle to the shield.
@@ -22,7 +23,7 @@ hcYmzShield YMZ;
 
 // Base tone periods for the first 12 MIDI notes at 4MHz
 #ifdef __FAVOR_PRECISION
-static const uint16_t tpMidi[128] = {
+static constexpr uint16_t tpMidi[128] = {
       0,     0,     0,     0,     0,     0, // Octave -1
       0,     0,     0,     0,     0,     0,
       0,     0,     0,     0,     0,     0, // Octave 0
@@ -47,20 +48,86 @@ static const uint16_t tpMidi[128] = {
       0,     0
 };
 #else
-static const uint16_t tpMidi[12] = {
+static constexpr uint16_t tpMidi[12] = {
   15289, 14431, 13621, 12856, 12135, 11454,
   10811, 10204,  9631,  9091,  8581,  8099
 };
 #endif
 
 
+// Envelope periods whose sawtooth plays each MIDI note, derived from tpMidi
+// at compile time. A sawtooth repeats at fM / (512 * EP), as
+// setEnvelopeFrequency() has it, and a tone at fM / (32 * TP), so one
+// cycle is 16 tone periods long.
+#ifdef __FAVOR_PRECISION
+#define EP_MIDI(n) ((tpMidi[(n)] + 8) >> 4)
+#else
+#define EP_MIDI(n) ((tpMidi[(n) % 12] + (8 << ((n) / 12))) >> (4 + (n) / 12))
+#endif
+#define EP_MIDI_OCTAVE(o) \
+  EP_MIDI((o) * 12 + 0), EP_MIDI((o) * 12 + 1), EP_MIDI((o) * 12 + 2),  \
+  EP_MIDI((o) * 12 + 3), EP_MIDI((o) * 12 + 4), EP_MIDI((o) * 12 + 5),  \
+  EP_MIDI((o) * 12 + 6), EP_MIDI((o) * 12 + 7), EP_MIDI((o) * 12 + 8),  \
+  EP_MIDI((o) * 12 + 9), EP_MIDI((o) * 12 + 10), EP_MIDI((o) * 12 + 11)
+
+static const uint16_t epMidi[128] PROGMEM = {
+  EP_MIDI_OCTAVE(0), EP_MIDI_OCTAVE(1), EP_MIDI_OCTAVE(2), EP_MIDI_OCTAVE(3),
+  EP_MIDI_OCTAVE(4), EP_MIDI_OCTAVE(5), EP_MIDI_OCTAVE(6), EP_MIDI_OCTAVE(7),
+  EP_MIDI_OCTAVE(8), EP_MIDI_OCTAVE(9),
+  EP_MIDI(120), EP_MIDI(121), EP_MIDI(122), EP_MIDI(123),
+  EP_MIDI(124), EP_MIDI(125), EP_MIDI(126), EP_MIDI(127)
+};
+
+
+#if HCYMZ_TUNING
+// Tone periods of MIDI notes 0-11 in 8.8 fixed point, for tunings worked
+// out to a fraction of a period before the octave shift
+static const uint32_t tpMidiFine[12] PROGMEM = {
+  3913991, 3694315, 3486969, 3291261, 3106536, 2932180,
+  2767609, 2612275, 2465660, 2327273, 2196653, 2073364
+};
+
+// 2^(-i/192) in 1.15 fixed point: sixteenths of a semitone down
+static const uint16_t semitoneSixteenths[17] PROGMEM = {
+  32768, 32650, 32532, 32415, 32298, 32182, 32066, 31950, 31835,
+  31720, 31606, 31492, 31379, 31266, 31153, 31041, 30929
+};
+#endif
+
+
 /**
  * Helper Methods
  * 
  * These static methods control data exchange with the YMZ284 chips and the
  * board's 75HC595 serial shifter.
  */
-#if defined(__SPI_HACK)
+#if defined(YMZ_HOST)
+// Host builds drive the bus model in host.h. The strobes are swapped the
+// same way the pins are: _psg1Write() reaches the chip behind PSG0's
+// register file and vice versa.
+void hcYmzShield::_shiftOut(uint8_t value) {
+  hostBusShift(value);
+}
+void hcYmzShield::_busAddress() {
+  hostBusSelect(false);
+}
+void hcYmzShield::_busData() {
+  hostBusSelect(true);
+}
+void hcYmzShield::_psgWrite() {
+  hostBusStrobe(B00000011);
+}
+void hcYmzShield::_psg0Write() {
+  hostBusStrobe(B00000010);
+}
+void hcYmzShield::_psg1Write() {
+  hostBusStrobe(B00000001);
+}
+void hcYmzShield::_debugLightOn() {
+}
+void hcYmzShield::_debugLightOff() {
+}
+#elif defined(__SPI_HACK)
 void hcYmzShield::_shiftOut(uint8_t value) {
   PORTB &= ~B00000010;
   SPDR = value;
@@ -199,13 +266,70 @@ void hcYmzShield::_debugLightOff() {
 #endif
 
 
+/**
+ * Tempo Timer
+ * 
+ * Timer1 runs in CTC mode at F_CPU/64 and interrupts once per tick. A tick
+ * is rarely a whole number of timer counts, so the compare value alternates
+ * between the two nearest counts the way a Bresenham line does, keeping
+ * the long-run tempo exact to the crystal.
+ */
+#if defined(YMZ_HOST) || defined(__AVR__)
+#define TEMPO_COUNTS ((F_CPU / 64) * 60 / PPQN) // timer counts per tick at 1 BPM
+
+static volatile uint16_t tickCounts;
+static volatile uint8_t tickRemainder;
+static volatile uint8_t tickBpm;
+static volatile uint16_t tickError;
+
+ISR(TIMER1_COMPA_vect) {
+  uint16_t counts = tickCounts;
+  tickError += tickRemainder;
+  if(tickError >= tickBpm) {
+    tickError -= tickBpm;
+    counts++;
+  }
+  OCR1A = counts - 1;
+  YMZ.clock();
+}
+
+void hcYmzShield::_startTimer(uint8_t bpm) {
+  uint8_t sreg = SREG;
+  cli();
+  tickCounts = TEMPO_COUNTS / bpm;
+  tickRemainder = TEMPO_COUNTS % bpm;
+  tickBpm = bpm;
+  tickError = 0;
+  if(!(TIMSK1 & _BV(OCIE1A))) {
+    TCCR1A = 0;
+    TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+    TCNT1 = 0;
+    OCR1A = tickCounts - 1;
+    TIMSK1 |= _BV(OCIE1A);
+  }
+  SREG = sreg;
+}
+
+void hcYmzShield::_stopTimer() {
+  TIMSK1 &= ~_BV(OCIE1A);
+}
+#else
+void hcYmzShield::_startTimer(uint8_t bpm) {
+}
+void hcYmzShield::_stopTimer() {
+}
+#endif
+
+
 /**
  * public hcYmzShield()
  *
  * Initializes the shield as an object.
  */
 hcYmzShield::hcYmzShield() {
-  #if defined(__SPI_HACK)
+  #if defined(YMZ_HOST)
+  // Nothing to configure; the host bus is ready at static init
+  #elif defined(__SPI_HACK)
   DDRB  |= B00101111;
   DDRD  |= B00001100;
   PORTB &= ~B00101000;
@@ -234,15 +358,37 @@ hcYmzShield::hcYmzShield() {
   digitalWrite(PIN_CS2, HIGH);
   #endif
   
+  // No transaction or clock hook until one is installed
+  _trace = 0;
+  _clockHandler = 0;
+  
   // Initialize register backup to 0
-  memset(_psg0Registers, 0, 16);
-  memset(_psg1Registers, 0, 16);
+  memset(_psg0Registers, 0, sizeof(_psg0Registers));
+  memset(_psg1Registers, 0, sizeof(_psg1Registers));
+
+  // No address latched in either chip yet
+  _psg0Address = OFF;
+  _psg1Address = OFF;
+
+  #if HCYMZ_TUNING
+  resetTuning();
+  #endif
   
   // Set default tempo
   _bpm = MODERATO;
 
   // Set default articulation
   _articulation = 8;
+
+  // Free-run from the tempo; Timer1 starts with the first setTempo() call
+  // since the core's init() reprograms it after static construction
+  _clockSource = CLOCK_INTERNAL;
+  _clockRunning = true;
+  _ticks = 0;
+  _scheduled = 0;
+  _quarterStart = 0;
+  _quarterClocks = 0;
+  _tickTime = 0;
   
   // Make sure the speakers don't fart
   mute();
@@ -253,21 +399,21 @@ hcYmzShield::hcYmzShield() {
  * accessor for _getRegisterPsg
  */
 uint8_t hcYmzShield::getRegisterPsg(uint8_t reg) {
-	return _psg0Registers[reg];
+	return (reg < PSG_REGISTERS) ? _psg0Registers[reg] : 0;
 }
 
 /**
  * accessor for _getRegisterPsg0
  */
 uint8_t hcYmzShield::getRegisterPsg0(uint8_t reg) {
-	return _psg0Registers[reg];
+	return (reg < PSG_REGISTERS) ? _psg0Registers[reg] : 0;
 }
 
 /**
  * accessor for _getRegisterPsg0
  */
 uint8_t hcYmzShield::getRegisterPsg1(uint8_t reg) {
-	return _psg1Registers[reg];
+	return (reg < PSG_REGISTERS) ? _psg1Registers[reg] : 0;
 }
 
 /**
@@ -291,29 +437,122 @@ void hcYmzShield::setRegisterPsg1(uint8_t reg, uint8_t data) {
   _setRegisterPsg1(reg, data);
 }
 
+/**
+ * public hcYmzShield::streamRegisterPsg()
+ *
+ * Sets a byte in both YMZ284s like setRegisterPsg(), but when both chips
+ * still have the register's address latched from the last write only the
+ * data phase goes out. Meant for one register written over and over at
+ * audio rates, like a level register playing samples.
+ */
+void hcYmzShield::streamRegisterPsg(uint8_t reg, uint8_t data) {
+  uint8_t sreg = SREG;
+  cli();
+  if(reg != _psg0Address || reg != _psg1Address || reg >= PSG_REGISTERS) {
+    _setRegisterPsg(reg, data);
+    SREG = sreg;
+    return;
+  }
+  _busData();
+  _shiftOut(data);
+  _psgWrite();
+  _psg0Registers[reg] = data;
+  _psg1Registers[reg] = data;
+  if(_trace)
+    _trace(3, reg, data);
+  SREG = sreg;
+}
+
+/**
+ * public hcYmzShield::streamRegisterPsg0()
+ *
+ * Data-only write to PSG0 when it has reg latched, see streamRegisterPsg().
+ */
+void hcYmzShield::streamRegisterPsg0(uint8_t reg, uint8_t data) {
+  uint8_t sreg = SREG;
+  cli();
+  if(reg != _psg0Address || reg >= PSG_REGISTERS) {
+    _setRegisterPsg0(reg, data);
+    SREG = sreg;
+    return;
+  }
+  _busData();
+  _shiftOut(data);
+  _psg1Write();
+  _psg0Registers[reg] = data;
+  if(_trace)
+    _trace(1, reg, data);
+  SREG = sreg;
+}
+
+/**
+ * public hcYmzShield::streamRegisterPsg1()
+ *
+ * Data-only write to PSG1 when it has reg latched, see streamRegisterPsg().
+ */
+void hcYmzShield::streamRegisterPsg1(uint8_t reg, uint8_t data) {
+  uint8_t sreg = SREG;
+  cli();
+  if(reg != _psg1Address || reg >= PSG_REGISTERS) {
+    _setRegisterPsg1(reg, data);
+    SREG = sreg;
+    return;
+  }
+  _busData();
+  _shiftOut(data);
+  _psg0Write();
+  _psg1Registers[reg] = data;
+  if(_trace)
+    _trace(2, reg, data);
+  SREG = sreg;
+}
+
+/**
+ * public hcYmzShield::setTrace()
+ * 
+ * Installs a hook that sees every register transaction after it reaches
+ * the bus. Call it with no parameters to remove the hook.
+ */
+void hcYmzShield::setTrace(hcYmzTrace trace) {
+  _trace = trace;
+}
+
 /**
  * private hcYmzShield::_setRegisterPsg()
  * 
  * Set a byte in both YMZ284s' internal registers.
  */
 void hcYmzShield::_setRegisterPsg(uint8_t reg, uint8_t data) {
+  // A clock handler may write registers from an interrupt; keep the
+  // address and data phases together
+  uint8_t sreg = SREG;
+  cli();
   _debugLightOn();
 
   // Switch the bus to recieve a register address and shift it out
   _busAddress();
   _shiftOut(reg);
   _psgWrite();
+  _psg0Address = reg;
+  _psg1Address = reg;
   
   // Switch the bus to recieve data and shift it out
   _busData();
   _shiftOut(data);
   _psgWrite();
   
-  // Copy the byte to the internal register map
-  _psg0Registers[reg] = data;
-  _psg1Registers[reg] = data;
+  // Copy the byte to the internal register map; the chips ignore
+  // addresses past the last register, so there is nothing to keep
+  if(reg < PSG_REGISTERS) {
+    _psg0Registers[reg] = data;
+    _psg1Registers[reg] = data;
+  }
+
+  if(_trace)
+    _trace(3, reg, data);
 
   _debugLightOff();
+  SREG = sreg;
 }
 
 
@@ -323,12 +562,15 @@ void hcYmzShield::_setRegisterPsg(uint8_t reg, uint8_t data) {
  * Set a byte in PSG0's internal registers.
  */
 void hcYmzShield::_setRegisterPsg0(uint8_t reg, uint8_t data) {
+  uint8_t sreg = SREG;
+  cli();
   _debugLightOn();
 
   // Switch the bus to recieve a register address and shift it out
   _busAddress();
   _shiftOut(reg);
   _psg1Write();
+  _psg0Address = reg;
   
   // Switch the bus to recieve data and shift it out
   _busData();
@@ -336,9 +578,14 @@ void hcYmzShield::_setRegisterPsg0(uint8_t reg, uint8_t data) {
   _psg1Write();
   
   // Copy the byte to the internal register map
-  _psg0Registers[reg] = data;
+  if(reg < PSG_REGISTERS)
+    _psg0Registers[reg] = data;
+
+  if(_trace)
+    _trace(1, reg, data);
 
   _debugLightOff();
+  SREG = sreg;
 }
 
 
@@ -348,12 +595,15 @@ void hcYmzShield::_setRegisterPsg0(uint8_t reg, uint8_t data) {
  * Set a byte in PSG1's internal registers.
  */
 void hcYmzShield::_setRegisterPsg1(uint8_t reg, uint8_t data) {
+  uint8_t sreg = SREG;
+  cli();
   _debugLightOn();
 
   // Switch the bus to recieve a register address and shift it out
   _busAddress();
   _shiftOut(reg);  
   _psg0Write();
+  _psg1Address = reg;
   
   // Switch the bus to recieve data and shift it out
   _busData();
@@ -361,9 +611,14 @@ void hcYmzShield::_setRegisterPsg1(uint8_t reg, uint8_t data) {
   _psg0Write();
   
   // Copy the byte to the internal register map
-  _psg1Registers[reg] = data;
+  if(reg < PSG_REGISTERS)
+    _psg1Registers[reg] = data;
+
+  if(_trace)
+    _trace(2, reg, data);
 
   _debugLightOff();
+  SREG = sreg;
 }
 
 
@@ -408,6 +663,7 @@ uint16_t hcYmzShield::getTonePeriod(uint8_t channel) {
 }
 
 
+#if HCYMZ_FLOAT
 /**
  * public hcYmzShield::setToneFrequency()
  * 
@@ -425,6 +681,7 @@ void hcYmzShield::setToneFrequency(uint8_t channel, float hz) {
     _setRegisterPsg0((++channel), tp >> 8);
   }
 }
+#endif
 
 
 /**
@@ -433,11 +690,7 @@ void hcYmzShield::setToneFrequency(uint8_t channel, float hz) {
  * Sets the tone period of a channel to produce the given MIDI note.
  */
 void hcYmzShield::setToneMidi(uint8_t channel, uint16_t note) {
-  #ifdef __FAVOR_PRECISION
-  uint16_t tp = tpMidi[note];
-  #else
-  uint16_t tp = ((note > 12) ? (tpMidi[note%12] >> (note/12)) : tpMidi[note]);
-  #endif
+  uint16_t tp = getTonePeriodMidi(note);
   
   if(channel > 2) {
     _setRegisterPsg1(((channel -= 3) *= 2), tp & 0xff);
@@ -450,6 +703,70 @@ void hcYmzShield::setToneMidi(uint8_t channel, uint16_t note) {
 }
 
 
+/**
+ * public hcYmzShield::getTonePeriodMidi()
+ * 
+ * Returns the tone period that produces the given MIDI note.
+ */
+uint16_t hcYmzShield::getTonePeriodMidi(uint8_t note) {
+  #if HCYMZ_TUNING
+  return(_tonePeriods[note & 0x7f]);
+  #elif defined(__FAVOR_PRECISION)
+  return(tpMidi[note & 0x7f]);
+  #else
+  return((note >= 12) ? (tpMidi[note%12] >> (note/12)) : tpMidi[note]);
+  #endif
+}
+
+
+#if HCYMZ_TUNING
+/**
+ * public hcYmzShield::setNoteTuning()
+ * 
+ * Retunes a MIDI note to a pitch given the way the MIDI Tuning Standard
+ * gives it: an equal-tempered semitone and a 14-bit fraction of the way
+ * to the next. The period is worked out here, in integer math, so that
+ * setToneMidi() stays a table lookup. Like the equal-tempered periods,
+ * those below the chip's range are kept whole for getEnvelopePeriodMidi().
+ */
+void hcYmzShield::setNoteTuning(uint8_t note, uint8_t semitone, uint16_t fraction) {
+  uint8_t octave = semitone / 12;
+  uint32_t base = pgm_read_dword(&tpMidiFine[semitone % 12]);
+
+  // a sixteenth of a semitone from the table, the rest interpolated
+  uint8_t step = (fraction >> 10) & 0x0f;
+  uint16_t high = pgm_read_word(&semitoneSixteenths[step]);
+  uint16_t low = pgm_read_word(&semitoneSixteenths[step + 1]);
+  uint16_t scale = high - (((uint32_t)(high - low) * (fraction & 0x3ff)) >> 10);
+
+  // 8.8 period times 1.15 scale, kept as 17.15
+  uint32_t fine = (base >> 8) * scale + (((base & 0xff) * scale) >> 8);
+  uint32_t tp = (fine + (1UL << (14 + octave))) >> (15 + octave);
+
+  note &= 0x7f;
+  _tonePeriods[note] = tp ? tp : 1;
+  _retuned[note >> 3] |= (1 << (note & 7));
+}
+
+
+/**
+ * public hcYmzShield::resetTuning()
+ * 
+ * Puts every note back to equal temperament.
+ */
+void hcYmzShield::resetTuning() {
+  for(uint8_t note = 0; note < 128; note++) {
+    #ifdef __FAVOR_PRECISION
+    _tonePeriods[note] = tpMidi[note];
+    #else
+    _tonePeriods[note] = (note >= 12) ? (tpMidi[note%12] >> (note/12)) : tpMidi[note];
+    #endif
+  }
+  memset(_retuned, 0, sizeof(_retuned));
+}
+#endif
+
+
 /**
  * public hcYmzShield::setNoisePeriod()
  * 
@@ -473,6 +790,7 @@ uint8_t hcYmzShield::getNoisePeriod() {
 }
 
 
+#if HCYMZ_FLOAT
 /**
  * public hcYmzShield::setNoiseFrequency()
  * 
@@ -483,6 +801,7 @@ void hcYmzShield::setNoiseFrequency(float hz) {
   
   _setRegisterPsg(0x06, np & B00011111); // Sanitize and write
 }
+#endif
 
 
 /**
@@ -509,6 +828,7 @@ uint16_t hcYmzShield::getEnvelopePeriod() {
 }
 
 
+#if HCYMZ_FLOAT
 /**
  * public hcYmzShield::setEnvelopeFrequency()
  * 
@@ -520,6 +840,38 @@ void hcYmzShield::setEnvelopeFrequency(float hz) {
   _setRegisterPsg(0x0b, ep & 0xff);
   _setRegisterPsg(0x0c, ep >> 8);
 }
+#endif
+
+
+/**
+ * public hcYmzShield::getEnvelopePeriodMidi()
+ * 
+ * Returns the envelope period that makes a repeating sawtooth envelope
+ * sound the given MIDI note. Triangle shapes take twice as long per cycle,
+ * so halve the period for those.
+ */
+uint16_t hcYmzShield::getEnvelopePeriodMidi(uint8_t note) {
+  note &= 0x7f;
+  #if HCYMZ_TUNING
+  if(_retuned[note >> 3] & (1 << (note & 7)))
+    return((_tonePeriods[note] + 8) >> 4);
+  #endif
+  return(pgm_read_word(&epMidi[note]));
+}
+
+
+/**
+ * public hcYmzShield::setEnvelopeMidi()
+ * 
+ * Sets the envelope period so that a repeating sawtooth envelope plays the
+ * given MIDI note.
+ */
+void hcYmzShield::setEnvelopeMidi(uint8_t note) {
+  uint16_t ep = getEnvelopePeriodMidi(note);
+  
+  _setRegisterPsg(0x0b, ep & 0xff);
+  _setRegisterPsg(0x0c, ep >> 8);
+}
 
 
 /**
@@ -696,9 +1048,27 @@ bool hcYmzShield::isEnvelope(uint8_t channel) {
  */
 void hcYmzShield::setChannels(uint8_t c0, uint8_t c1, uint8_t c2, uint8_t c3, uint8_t c4, uint8_t c5) {
   uint8_t channel[6] = {c0, c1, c2, c3, c4, c5};
-  uint8_t i, state = 0;
 
   // First turn off any notes we will change
+  _setChannelsOff(channel);
+  
+  // Pause for articulation
+  delay(_articulation);
+  
+  // Now set the new notes
+  _setChannelsOn(channel);
+}
+
+
+/**
+ * private hcYmzShield::_setChannelsOff()
+ * 
+ * The first half of setChannels(): silences every channel that is not
+ * SKIP.
+ */
+void hcYmzShield::_setChannelsOff(const uint8_t *channel) {
+  uint8_t i, state = 0;
+
   for(i = 0; i < 6; i++) {
     if(channel[i] != SKIP)
       state |= (1 << i);
@@ -712,12 +1082,16 @@ void hcYmzShield::setChannels(uint8_t c0, uint8_t c1, uint8_t c2, uint8_t c3, ui
   
   _setRegisterPsg0(0x07, (_psg0Registers[0x07] & ~B00000111) | (state & B00000111));
   _setRegisterPsg1(0x07, (_psg1Registers[0x07] & ~B00000111) | (state >> 3));
-  
-  // Pause for articulation
-  delay(_articulation);
-  
-  // Now set the new notes
-  for(i = 0; i < 6; i++) {
+}
+
+
+/**
+ * private hcYmzShield::_setChannelsOn()
+ * 
+ * The second half of setChannels(): sets and sounds the new notes.
+ */
+void hcYmzShield::_setChannelsOn(const uint8_t *channel) {
+  for(uint8_t i = 0; i < 6; i++) {
     if(channel[i] != OFF && channel[i] != SKIP) {
       setToneMidi(i, channel[i]);
       setVolume(i, _volume[i]);
@@ -756,10 +1130,16 @@ void hcYmzShield::setNote(uint8_t channel, uint8_t note) {
 /**
  * public hcYmzShield::setTempo()
  * 
- * Sets the current tempo in beats per minute (BPM).
+ * Sets the current tempo in beats per minute (BPM). Tempos below 10 BPM are
+ * raised to 10, the slowest one Timer1 can count a tick of. While following
+ * an external clock the tempo is measured from it instead.
  */
 void hcYmzShield::setTempo(uint8_t bpm) {
+  if(bpm < 10)
+    bpm = 10;
   _bpm = bpm;
+  if(_clockSource == CLOCK_INTERNAL)
+    _startTimer(bpm);
 }
 
 
@@ -787,18 +1167,217 @@ void hcYmzShield::setArticulation(uint8_t tonguing) {
 /**
  * public hcYmzShield::beat()
  * 
- * Delays the number of milliseconds relative to 1/beat at the current tempo.
- * For example, at the default tempo of MODERATO, beat(4) would delay for
- * 666 milliseconds, or one quarter note.
+ * Waits for 1/beat of a whole note at the current tempo. For example, at the
+ * default tempo of MODERATO, beat(4) waits for one quarter note (24 ticks,
+ * 666 milliseconds).
  * 
  * For dotted notes, you can pass DOT, DOUBLEDOT or TRIPLEDOT as the second
  * parameter to extend the length.
  *
- * There are 60,000 milliseconds per minute.
+ * Each beat ends a fixed number of ticks after the previous one, so time
+ * spent on articulation and register writes in between does not add up.
+ * A beat of 0 has no length and returns right away.
  */
 void hcYmzShield::beat(uint8_t beat, uint8_t dot) {
-  // Subtract articulation to keep beat count
-  delay((((60000/_bpm) * 4)/beat) * (float(dot)/8) - _articulation);
+  if (!beat) {
+    return;
+  }
+  // A whole note is 4 * PPQN ticks; count in 1/256 ticks so that short and
+  // dotted values stay exact, and wait on getClockFine() so they end on
+  // time rather than on the next tick
+  _wait(((uint32_t)(4 * PPQN * 256 / 8) * dot) / beat);
+}
+
+
+/**
+ * private hcYmzShield::_wait()
+ * 
+ * Waits until the clock reaches the end of the next span of the given
+ * length in 1/256 ticks. A schedule that has fallen more than a quarter
+ * note behind, as when beat() has not been called for a while, starts
+ * over from now instead of rushing to catch up.
+ */
+void hcYmzShield::_wait(uint32_t length) {
+  uint32_t now = getClockFine();
+  if((int32_t)(now - _scheduled) > (int32_t)(PPQN << 8))
+    _scheduled = now;
+  _scheduled += length;
+  while((int32_t)(getClockFine() - _scheduled) < 0)
+    yield();
+}
+
+
+/**
+ * public hcYmzShield::setClockSource()
+ * 
+ * Selects what drives the tempo engine: CLOCK_INTERNAL free-runs Timer1 at
+ * the tempo from setTempo(), CLOCK_EXTERNAL counts the ticks passed to
+ * clock(), one per MIDI Clock message. An external clock waits for
+ * startClock() or continueClock() before it counts.
+ */
+void hcYmzShield::setClockSource(uint8_t source) {
+  if(source == _clockSource)
+    return;
+  _clockSource = source;
+  if(source == CLOCK_EXTERNAL) {
+    _stopTimer();
+    _clockRunning = false;
+  }
+  else {
+    _clockRunning = true;
+    setTempo(_bpm);
+  }
+}
+
+
+/**
+ * public hcYmzShield::getClockSource()
+ * 
+ * Returns CLOCK_INTERNAL or CLOCK_EXTERNAL.
+ */
+uint8_t hcYmzShield::getClockSource() {
+  return(_clockSource);
+}
+
+
+/**
+ * public hcYmzShield::startClock()
+ * 
+ * Rewinds the clock to tick 0 and runs it (MIDI Start).
+ */
+void hcYmzShield::startClock() {
+  uint8_t sreg = SREG;
+  cli();
+  _ticks = 0;
+  _tickTime = micros();
+  _clockRunning = true;
+  SREG = sreg;
+  _scheduled = 0;
+}
+
+
+/**
+ * public hcYmzShield::stopClock()
+ * 
+ * Holds the clock where it is (MIDI Stop). Anything waiting on a beat
+ * waits until the clock runs again.
+ */
+void hcYmzShield::stopClock() {
+  _clockRunning = false;
+}
+
+
+/**
+ * public hcYmzShield::continueClock()
+ * 
+ * Runs the clock again from where it stopped (MIDI Continue).
+ */
+void hcYmzShield::continueClock() {
+  _tickTime = micros();
+  _clockRunning = true;
+}
+
+
+/**
+ * public hcYmzShield::isClockRunning()
+ */
+bool hcYmzShield::isClockRunning() {
+  return(_clockRunning);
+}
+
+
+/**
+ * public hcYmzShield::clock()
+ * 
+ * Advances the clock by one tick. Timer1 calls this when free-running; when
+ * following an external clock, call it for every MIDI Clock message. The
+ * external tempo is measured once per quarter note so getTempo() follows
+ * it.
+ *
+ * The clock handler runs from here, so from Timer1's interrupt when
+ * free-running.
+ */
+void hcYmzShield::clock() {
+  if(_clockRunning) {
+    _ticks++;
+    _tickTime = micros();
+    if(_clockHandler)
+      _clockHandler(_ticks);
+  }
+
+  if(_clockSource == CLOCK_EXTERNAL && ++_quarterClocks == PPQN) {
+    _quarterClocks = 0;
+    uint32_t now = micros();
+    uint32_t quarter = now - _quarterStart;
+    _quarterStart = now;
+    if(quarter)
+      _bpm = constrain(60000000UL / quarter, 10, 255);
+  }
+}
+
+
+/**
+ * public hcYmzShield::setClockHandler()
+ * 
+ * Installs a function to run on every tick while the clock runs. It may
+ * be called from an interrupt, so keep it short; register writes are safe
+ * from there. Call it with no parameters to remove the handler.
+ */
+void hcYmzShield::setClockHandler(hcYmzClock handler) {
+  uint8_t sreg = SREG;
+  cli();
+  _clockHandler = handler;
+  SREG = sreg;
+}
+
+
+/**
+ * public hcYmzShield::getClock()
+ * 
+ * Returns the number of ticks (PPQN per quarter note) since the clock was
+ * last started.
+ */
+uint32_t hcYmzShield::getClock() {
+  #if !defined(YMZ_HOST) && !defined(__AVR__)
+  // No Timer1: catch up on the ticks that have elapsed since the last call
+  if(_clockSource == CLOCK_INTERNAL) {
+    uint32_t period = 60000000UL / PPQN / _bpm;
+    while(micros() - _tickTime >= period) {
+      uint32_t next = _tickTime + period;
+      clock();
+      _tickTime = next;
+    }
+  }
+  #endif
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t ticks = _ticks;
+  SREG = sreg;
+  return(ticks);
+}
+
+
+/**
+ * public hcYmzShield::getClockFine()
+ * 
+ * Returns the clock in 1/256 ticks: getClock() plus how far the current
+ * tick has got, from the time since it began and the tempo. The part
+ * tick stops short of the next one, so an external clock that runs late
+ * or stops holds the count instead of running past it.
+ */
+uint32_t hcYmzShield::getClockFine() {
+  getClock(); // catches up a board without Timer1
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t ticks = _ticks;
+  uint32_t start = _tickTime;
+  bool running = _clockRunning;
+  SREG = sreg;
+  if(!running)
+    return(ticks << 8);
+  uint32_t elapsed = micros() - start;
+  uint32_t tick = 60000000UL / PPQN / _bpm;
+  return((ticks << 8) + ((elapsed < tick) ? (elapsed << 8) / tick : 255));
 }
 
 
@@ -817,113 +1396,14 @@ void hcYmzShield::beat(uint8_t beat, uint8_t dot) {
  * 
  * You should carefully weigh the benefits of using this function in any
  * programs that have severe space constraints.
+ *
+ * playBlock() returns when the block ends. To keep loop() running while a
+ * song plays, or to play from RAM or a stream, use hcYmzPlayer instead.
  */
 void hcYmzShield::playBlock(const uint8_t *song) {
-  uint32_t i;
-  uint8_t command;
-  if(pgm_read_byte(song) == 0x48 && pgm_read_byte(song + 1) == 0x43) {
-    if(song[2] < 2) { // Support <= Revision 1
-      command = pgm_read_byte(song + 3);
-      i = 4;
-      while(command != 0) {
-        switch(command) {
-          // Set volume on all channels
-          case 0x50:
-            setVolume(pgm_read_byte(song + i));
-            i++;
-            break;
-          // Set volume on one channel
-          case 0x51:
-            setVolume(pgm_read_byte(song + i), pgm_read_byte(song + i + 1));
-            i += 2;
-            break;
-          // Set tempo
-          case 0x52:
-            setTempo(pgm_read_byte(song + i));
-            i++;
-            break;
-          // Set articulation
-          case 0x53:
-            setArticulation(pgm_read_byte(song + i));
-            i++;
-            break;
-          
-          // Mute all channels
-          case 0x60:
-            mute();
-            break;
-          // Toggle tone on channel
-          case 0x61:
-            setTone(pgm_read_byte(song + i), !!pgm_read_byte(song + i + 1));
-            i += 2;
-            break;
-          // Toggle noise on channel
-          case 0x62:
-            setNoise(pgm_read_byte(song + i), !!pgm_read_byte(song + i + 1));
-            i += 2;
-            break;
-          // Toggle envelope on channel
-          case 0x63:
-            setEnvelope(pgm_read_byte(song + i), !!pgm_read_byte(song + i + 1));
-            i += 2;
-            break;
-          
-          // Start envelope generator with ADSR envelope
-          case 0x70:
-            startEnvelope(pgm_read_byte(song + i));
-            i++;
-            break;
-          // Restart current ADSR envelope
-          case 0x71:
-            restartEnvelope();
-            break;
-          // Set envelope period
-          case 0x73:
-            setEnvelopePeriod((pgm_read_byte(song + i) << 8) + pgm_read_byte(song + i + 1));
-            i += 2;
-            break;
-          
-          // Set tone period
-          case 0x80:
-            setTonePeriod(pgm_read_byte(song + i), (pgm_read_byte(song + i + 1) << 8) + pgm_read_byte(song + i + 2));
-            i += 3;
-            break;
-          // Set tone MIDI
-          case 0x81:
-            setToneMidi(pgm_read_byte(song + i), pgm_read_byte(song + i + 1));
-            i += 2;
-            break;
-          // Set note
-          case 0x82:
-            setNote(pgm_read_byte(song + i), pgm_read_byte(song + i + 1));
-            i += 2;
-            break;
-          // Set channels
-          case 0x83:
-            setChannels(pgm_read_byte(song + i), pgm_read_byte(song + i + 1), pgm_read_byte(song + i + 2), pgm_read_byte(song + i + 3), pgm_read_byte(song + i + 4), pgm_read_byte(song + i + 5));
-            i += 6;
-            break;
-          
-          // Set noise period
-          case 0x90:
-            setNoisePeriod(pgm_read_byte(song + i));
-            i++;
-            break;
-          
-          // Pause for a beat
-          case 0xa0:
-            beat(pgm_read_byte(song + i), pgm_read_byte(song + i + 1));
-            i += 2;
-            break;
-          // Delay
-          case 0xa1:
-            delay((pgm_read_byte(song + i) << 8) + pgm_read_byte(song + i + 1));
-            i += 2;
-            break;
-        }
-        command = pgm_read_byte(song + i);
-        i++;
-      }
-    }
-  }
+  hcYmzProgmemSource source(song);
+  hcYmzPlayer player;
+  player.play(source);
+  while(player.poll())
+    yield();
 }
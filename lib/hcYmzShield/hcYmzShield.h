@@ -33,12 +33,45 @@
 // Pin 10 must be kept free. Setting Pin 10 LOW will kill all SPI devices.
 #define __SPI_HACK
 
+// Optional parts of the library, all on by default. Build with, say,
+// -DHCYMZ_FLOAT=0 to leave out what a sketch never calls.
+//
+// HCYMZ_FLOAT: setToneFrequency(), setNoiseFrequency() and
+// setEnvelopeFrequency(), which pull in the AVR float routines.
+#ifndef HCYMZ_FLOAT
+#define HCYMZ_FLOAT 1
+#endif
+
+// HCYMZ_PLAYER_OPS: the command groups hcYmzPlayer and playBlock() carry
+// out. Commands of the other groups are still read and skipped, so any
+// block plays; the effects they would have had are simply missing.
+#define HCYMZ_OPS_LEVELS   0x01 // 0x50-0x53 volume, tempo, articulation
+#define HCYMZ_OPS_MIXER    0x02 // 0x60-0x63 mute, tone, noise, envelope
+#define HCYMZ_OPS_ENVELOPE 0x04 // 0x70-0x73 envelope shape and period
+#define HCYMZ_OPS_TONE     0x08 // 0x80-0x83 tone periods, notes, channels
+#define HCYMZ_OPS_NOISE    0x10 // 0x90 noise period
+#define HCYMZ_OPS_TIMING   0x20 // 0xa0-0xa1 beats and delays
+#ifndef HCYMZ_PLAYER_OPS
+#define HCYMZ_PLAYER_OPS 0x3f
+#endif
+
+// HCYMZ_TUNING: tone periods for the MIDI notes kept in a RAM table (272
+// bytes) that setNoteTuning() can retune one note at a time, as the MIDI
+// Tuning Standard does, while setToneMidi() stays a lookup. Without it the
+// notes are fixed to equal temperament.
+#ifndef HCYMZ_TUNING
+#define HCYMZ_TUNING 1
+#endif
+
 // Envelope controls
 #define CONT B00001000
 #define ATT  B00000100
 #define ALT  B00000010
 #define HOLD B00000001
 
+// Registers 0x00-0x0d of a YMZ284
+#define PSG_REGISTERS 0x0e
+
 // YMZ Shield pinning masks for AVR
 #define MASK_SER  B00000100
 #define MASK_RCK  B00001000
@@ -91,22 +124,47 @@
 #define STACCATO 20
 #define LEGATO 0
 
+// Tempo engine
+#define PPQN 24
+#define CLOCK_INTERNAL 0
+#define CLOCK_EXTERNAL 1
+
 #endif // __HCINTERNALS
 
+// Register transaction hook: chips is 1 for PSG0, 2 for PSG1 and 3 for both
+typedef void (*hcYmzTrace)(uint8_t, uint8_t, uint8_t);
+
+// Clock hook: called with the new tick count on every tick while running
+typedef void (*hcYmzClock)(uint32_t);
+
 class hcYmzShield {
+  friend class hcYmzPlayer;
   public:
     hcYmzShield();
     void setTonePeriod(uint8_t, uint16_t);
     uint16_t getTonePeriod(uint8_t);
+    #if HCYMZ_FLOAT
     void setToneFrequency(uint8_t, float);
+    #endif
     void setToneMidi(uint8_t, uint16_t);
+    uint16_t getTonePeriodMidi(uint8_t);
+    #if HCYMZ_TUNING
+    void setNoteTuning(uint8_t, uint8_t, uint16_t);
+    void resetTuning();
+    #endif
     void setNoisePeriod(uint8_t);
     uint8_t getNoisePeriod();
+    #if HCYMZ_FLOAT
     void setNoiseFrequency(float);
+    #endif
     void mute();
     void setEnvelopePeriod(uint16_t);
     uint16_t getEnvelopePeriod();
+    #if HCYMZ_FLOAT
     void setEnvelopeFrequency(float);
+    #endif
+    uint16_t getEnvelopePeriodMidi(uint8_t);
+    void setEnvelopeMidi(uint8_t);
     void startEnvelope(uint8_t);
     void restartEnvelope();
     void setTone(uint8_t, bool = true);
@@ -125,23 +183,55 @@ class hcYmzShield {
     void setArticulation(uint8_t = 8);
     uint8_t getTempo();
     void beat(uint8_t, uint8_t = 8);
+    void setClockSource(uint8_t);
+    uint8_t getClockSource();
+    void startClock();
+    void stopClock();
+    void continueClock();
+    bool isClockRunning();
+    void clock();
+    uint32_t getClock();
+    uint32_t getClockFine();
+    void setClockHandler(hcYmzClock = 0);
     void playBlock(const uint8_t*);
     void setRegisterPsg(uint8_t, uint8_t);
     void setRegisterPsg0(uint8_t, uint8_t);
     void setRegisterPsg1(uint8_t, uint8_t);
+    void streamRegisterPsg(uint8_t, uint8_t);
+    void streamRegisterPsg0(uint8_t, uint8_t);
+    void streamRegisterPsg1(uint8_t, uint8_t);
     uint8_t getRegisterPsg(uint8_t);
     uint8_t getRegisterPsg0(uint8_t);
     uint8_t getRegisterPsg1(uint8_t);
+    void setTrace(hcYmzTrace = 0);
   private:
-    uint8_t _psg0Registers[0xd];
-    uint8_t _psg1Registers[0xd];
+    uint8_t _psg0Registers[PSG_REGISTERS];
+    uint8_t _psg1Registers[PSG_REGISTERS];
+    volatile uint8_t _psg0Address;
+    volatile uint8_t _psg1Address;
+    #if HCYMZ_TUNING
+    uint16_t _tonePeriods[128];
+    uint8_t _retuned[16]; // a bit per note moved off equal temperament
+    #endif
     uint8_t _volume[6];
     uint8_t _tone;
     uint8_t _bpm;
     uint8_t _articulation;
+    uint8_t _clockSource;
+    volatile bool _clockRunning;
+    volatile uint32_t _ticks;
+    uint32_t _scheduled;
+    uint32_t _quarterStart;
+    uint8_t _quarterClocks;
+    volatile uint32_t _tickTime; // micros() of the last tick
+    hcYmzTrace _trace;
+    hcYmzClock _clockHandler;
     void _setRegisterPsg(uint8_t, uint8_t);
     void _setRegisterPsg0(uint8_t, uint8_t);
     void _setRegisterPsg1(uint8_t, uint8_t);
+    void _wait(uint32_t);
+    void _setChannelsOff(const uint8_t*);
+    void _setChannelsOn(const uint8_t*);
     inline static void _shiftOut(uint8_t);
     inline static void _busAddress();
     inline static void _debugLightOn();
@@ -150,6 +240,8 @@ class hcYmzShield {
     inline static void _psgWrite();
     inline static void _psg0Write();
     inline static void _psg1Write();
+    static void _startTimer(uint8_t);
+    static void _stopTimer();
 };
 
 extern hcYmzShield YMZ;
@@ -0,0 +1,42 @@
+#include "chord.h"
+
+// chord shapes; the major triad first since it is what note-on always played
+const Chord romChords[CHORD_COUNT] PROGMEM = {
+	{ 3, { 0, 4, 7 } },              // major
+	{ 3, { 0, 3, 7 } },              // minor
+	{ 3, { 0, 2, 7 } },              // sus2
+	{ 3, { 0, 5, 7 } },              // sus4
+	{ 3, { 0, 3, 6 } },              // diminished
+	{ 3, { 0, 4, 8 } },              // augmented
+	{ 4, { 0, 4, 7, 10 } },          // dominant 7th
+	{ 4, { 0, 4, 7, 11 } },          // major 7th
+	{ 4, { 0, 3, 7, 10 } },          // minor 7th
+	{ 4, { 0, 4, 7, 14 } },          // add 9
+	{ 5, { 0, 4, 7, 11, 14 } },      // major 9th
+	{ 5, { 0, 3, 7, 10, 14 } },      // minor 9th
+	{ 6, { 0, 4, 7, 10, 14, 21 } },  // 13th
+	{ 3, { 0, 7, 12 } },             // power
+	{ 2, { 0, 12 } },                // octave
+	{ 1, { 0 } }                     // single note
+};
+
+// 1/4, 1/8, 1/8 triplet, 1/16, 1/16 triplet, 1/32, 1/32 triplet, 1/96
+const byte romArpRates[ARP_RATE_COUNT] PROGMEM = { 24, 12, 8, 6, 4, 3, 2, 1 };
+
+/**
+ * Read a chord shape from flash. Returns false if there is no such chord.
+ */
+bool loadChord(byte index, Chord &chord) {
+	if (index >= CHORD_COUNT) {
+		return false;
+	}
+	memcpy_P(&chord, &romChords[index], sizeof(Chord));
+	return true;
+}
+
+/**
+ * Clock ticks per arpeggio step for a rate setting.
+ */
+byte arpRateTicks(byte rate) {
+	return pgm_read_byte(&romArpRates[rate < ARP_RATE_COUNT ? rate : ARP_RATE_COUNT - 1]);
+}
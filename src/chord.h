@@ -0,0 +1,35 @@
+#ifndef _chord_h_
+#define _chord_h_
+#include "Arduino.h"
+
+// Chord shapes in flash, selected per music channel with CC_CHORD
+#define CHORD_COUNT 16
+#define CHORD_SIZE 6
+
+// Arpeggio patterns, selected with CC_ARP_PATTERN
+#define ARP_OFF 0
+#define ARP_UP 1
+#define ARP_DOWN 2
+#define ARP_UP_DOWN 3
+#define ARP_RANDOM 4
+#define ARP_PATTERN_COUNT 5
+
+// Arpeggio rates in 24 PPQN clock ticks per step, selected with CC_ARP_RATE
+#define ARP_RATE_COUNT 8
+#define ARP_OCTAVES 3
+
+// Longest arpeggio line: every chord note in every octave, up and back down
+#define ARP_SIZE (2 * CHORD_SIZE * ARP_OCTAVES)
+
+/**
+ * A chord as semitones above the played note, lowest first.
+ */
+struct Chord {
+	byte size;
+	byte notes[CHORD_SIZE];
+};
+
+bool loadChord(byte index, Chord &chord);
+byte arpRateTicks(byte rate);
+
+#endif /* _chord_h_ */
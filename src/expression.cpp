@@ -0,0 +1,22 @@
+#include "expression.h"
+
+// 20 log10(127 / value) / 1.5, rounded: a MIDI value as amplitude, in half
+// steps of the 4-bit level scale
+const byte romAttenuation[128] PROGMEM = {
+	32, 28, 24, 22, 20, 19, 18, 17, 16, 15, 15, 14, 14, 13, 13, 12,
+	12, 12, 11, 11, 11, 10, 10, 10, 10, 9, 9, 9, 9, 9, 8, 8,
+	8, 8, 8, 7, 7, 7, 7, 7, 7, 7, 6, 6, 6, 6, 6, 6,
+	6, 6, 5, 5, 5, 5, 5, 5, 5, 5, 5, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/**
+ * Attenuation for a 7-bit MIDI level (velocity, volume, expression or
+ * pressure). Products of levels become sums of attenuations.
+ */
+byte attenuation(byte value) {
+	return pgm_read_byte(&romAttenuation[value & 0x7f]);
+}
@@ -0,0 +1,11 @@
+#ifndef _expression_h_
+#define _expression_h_
+#include "Arduino.h"
+
+// Attenuation is counted in half level steps, about 1.5 dB each; a MIDI
+// value of 0 attenuates by at least a full level range
+#define ATTENUATION_SILENT 32
+
+byte attenuation(byte value);
+
+#endif /* _expression_h_ */
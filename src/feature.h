@@ -0,0 +1,73 @@
+/**
+ * Compile-time features of the synth.
+ *
+ * Each feature is on unless the build sets it to 0 (see the usb_uno_lean
+ * environment in platformio.ini). A feature that is off leaves no code and
+ * no RAM behind. Its state, SysEx commands and loop() work are compiled
+ * out. MIDI channels routed to a kind that is compiled out are ignored,
+ * the same as channels routed off.
+ */
+
+#ifndef _feature_h_
+#define _feature_h_
+
+// music channels: patches, software envelopes, chords, arpeggios and glides
+#ifndef YMZ_MUSIC
+#define YMZ_MUSIC 1
+#endif
+
+// raw register channels, CC_LATCH included
+#ifndef YMZ_RAW
+#define YMZ_RAW 1
+#endif
+
+// drum samples played from Timer2 (sample.h)
+#ifndef YMZ_SAMPLES
+#define YMZ_SAMPLES 1
+#endif
+
+// register trace frames over SysEx (SYSEX_TRACE)
+#ifndef YMZ_TRACE
+#define YMZ_TRACE 1
+#endif
+
+// Hardchord Music songs streamed over SysEx into hcYmzPlayer (SYSEX_STREAM)
+#ifndef YMZ_STREAM
+#define YMZ_STREAM 1
+#endif
+
+// register frames on the UART in place of MIDI (SYSEX_SERIAL, regstream.h)
+#ifndef YMZ_REGSTREAM
+#define YMZ_REGSTREAM 1
+#endif
+
+// constant-latency scheduling of channel messages (SYSEX_SCHEDULE, schedule.h)
+#ifndef YMZ_SCHEDULE
+#define YMZ_SCHEDULE 1
+#endif
+
+// MIDI Tuning Standard retuning of the notes (tuning.h), which needs the
+// note table HCYMZ_TUNING gives the shield library
+#ifndef YMZ_TUNING
+#define YMZ_TUNING 1
+#endif
+
+// slew limiting of raw channel levels and periods (CC_*_SLEW), which
+// needs raw channels
+#ifndef YMZ_SMOOTH
+#define YMZ_SMOOTH 1
+#endif
+#if !YMZ_RAW
+#undef YMZ_SMOOTH
+#define YMZ_SMOOTH 0
+#endif
+
+// debugMidi*() output on CC_DEBUG, for bring-up only
+#ifndef YMZ_DEBUG
+#define YMZ_DEBUG 0
+#endif
+
+// the staged register image behind CC_LATCH and register frames
+#define YMZ_STAGING (YMZ_RAW || YMZ_REGSTREAM)
+
+#endif /* _feature_h_ */
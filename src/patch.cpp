@@ -0,0 +1,99 @@
+#include "patch.h"
+
+#include <EEPROM.h>
+
+#include "hcYmzShield.h"
+
+// factory patches
+const Patch romPatches[PATCH_ROM_COUNT] PROGMEM = {
+	// mixer, level, noise, shape, period, attack, decay, sustain, release
+	{ PATCH_TONE, 10, 0, 0, 0, 0, 0, 0, 0 },                           // square
+	{ PATCH_TONE, 15, 0, 0, 0, 0, 20, 4, 10 },                         // pluck
+	{ PATCH_TONE, 12, 0, 0, 0, 30, 0, 0, 40 },                         // pad
+	{ PATCH_NOISE, 13, 8, 0, 0, 0, 10, 0, 0 },                         // snare
+	{ PATCH_TONE | PATCH_NOISE, 11, 2, 0, 0, 0, 15, 6, 15 },           // grit
+	{ PATCH_TONE, PATCH_LEVEL_ENVELOPE, 0, 0, 0x0800, 0, 0, 0, 0 },    // hardware decay
+	{ PATCH_TONE, PATCH_LEVEL_ENVELOPE, 0, CONT | ALT, 0x0100, 0, 0, 0, 0 }, // tremolo
+	{ PATCH_TONE, 14, 0, 0, 0, 15, 0, 0, 15 },                         // swell
+	{ PATCH_TONE | PATCH_BUZZER, 10, 0, CONT, 0, 0, 0, 0, 0 },         // buzz saw
+	{ PATCH_TONE | PATCH_BUZZER | PATCH_SYNC, 10, 0, CONT | ALT, 0, 0, 0, 0, 0 } // sync triangle
+};
+
+/**
+ * Read a patch from flash or EEPROM. Returns false if the program does not
+ * exist or the EEPROM slot has never been written.
+ */
+bool loadPatch(byte program, Patch &patch) {
+	if (program < PATCH_ROM_COUNT) {
+		memcpy_P(&patch, &romPatches[program], sizeof(Patch));
+		return true;
+	}
+	if (program >= PATCH_COUNT) {
+		return false;
+	}
+	EEPROM.get(PATCH_EEPROM_BASE + (program - PATCH_ROM_COUNT) * sizeof(Patch), patch);
+	return (patch.mixer != 0xff);
+}
+
+/**
+ * Write a user patch to EEPROM. Factory patches are read-only.
+ */
+bool storePatch(byte program, const Patch &patch) {
+	if (program < PATCH_ROM_COUNT || program >= PATCH_COUNT) {
+		return false;
+	}
+	EEPROM.put(PATCH_EEPROM_BASE + (program - PATCH_ROM_COUNT) * sizeof(Patch), patch);
+	return true;
+}
+
+/**
+ * Expand a patch into the register image written at note-on.
+ */
+void decodePatch(const Patch &patch, PatchImage &image) {
+	bool envelope = (patch.level >= PATCH_LEVEL_ENVELOPE);
+	byte level = envelope ? 0x10 : (patch.level & 0x0f);
+
+	// mixer bits are active low: tone on bits 0-2, noise on bits 3-5
+	byte mixer = B00111111;
+	if (patch.mixer & PATCH_TONE) {
+		mixer &= ~B00000111;
+	}
+	if (patch.mixer & PATCH_NOISE) {
+		mixer &= ~B00111000;
+	}
+
+	// the software envelope starts from silence when there is an attack
+	byte initial = (!envelope && patch.attack) ? 0 : level;
+
+	image.regs[0x06 - PATCH_IMAGE_BASE] = patch.noise & B00011111;
+	image.regs[0x07 - PATCH_IMAGE_BASE] = mixer;
+	image.regs[0x08 - PATCH_IMAGE_BASE] = initial;
+	image.regs[0x09 - PATCH_IMAGE_BASE] = initial;
+	image.regs[0x0a - PATCH_IMAGE_BASE] = initial;
+	image.regs[0x0b - PATCH_IMAGE_BASE] = patch.envPeriod & 0xff;
+	image.regs[0x0c - PATCH_IMAGE_BASE] = patch.envPeriod >> 8;
+	image.regs[0x0d - PATCH_IMAGE_BASE] = patch.envShape & 0x0f;
+
+	image.mask = B00011110; // mixer and levels
+	if (patch.mixer & PATCH_NOISE) {
+		image.mask |= B00000001;
+	}
+	if (envelope) {
+		image.mask |= B11100000;
+	}
+
+	// the buzzer restarts its waveform at note-on; the period follows the note
+	image.buzzer = patch.mixer & (PATCH_BUZZER | PATCH_SYNC);
+	if (image.buzzer & PATCH_BUZZER) {
+		image.mask |= B10000000;
+		if ((patch.envShape & (ALT | HOLD)) == ALT) {
+			image.buzzer |= BUZZER_TRIANGLE;
+		}
+	}
+
+	image.level = level;
+	image.attack = envelope ? 0 : patch.attack;
+	image.decay = envelope ? 0 : patch.decay;
+	image.sustain = patch.sustain & 0x0f;
+	image.release = envelope ? 0 : patch.release;
+}
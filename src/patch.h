@@ -0,0 +1,64 @@
+#ifndef _patch_h_
+#define _patch_h_
+#include "Arduino.h"
+
+// Programs 0..PATCH_ROM_COUNT-1 are factory patches in flash; the rest are
+// user patches stored in EEPROM starting at PATCH_EEPROM_BASE.
+#define PATCH_ROM_COUNT 10
+#define PATCH_EEPROM_COUNT 16
+#define PATCH_COUNT (PATCH_ROM_COUNT + PATCH_EEPROM_COUNT)
+#define PATCH_EEPROM_BASE 0x000
+
+// Patch mixer bits
+#define PATCH_TONE B00000001
+#define PATCH_NOISE B00000010
+#define PATCH_BUZZER B00000100 // one channel per chip plays the envelope as its oscillator
+#define PATCH_SYNC B00001000   // lock the buzzer channel's tone to the envelope period
+
+// Patch level that routes the channel through the hardware envelope
+#define PATCH_LEVEL_ENVELOPE 16
+
+// Buzzer waveform takes two envelope ramps per cycle
+#define BUZZER_TRIANGLE B10000000
+
+// Registers covered by a decoded patch image (noise period .. envelope shape)
+#define PATCH_IMAGE_BASE 0x06
+#define PATCH_IMAGE_SIZE 8
+
+/**
+ * An instrument as stored in flash and EEPROM.
+ */
+struct Patch {
+	byte mixer;         // PATCH_TONE | PATCH_NOISE | PATCH_BUZZER | PATCH_SYNC
+	byte level;         // 0-15, or PATCH_LEVEL_ENVELOPE
+	byte noise;         // noise period, 5 bits
+	byte envShape;      // hardware envelope shape, 4 bits; the waveform for PATCH_BUZZER
+	uint16_t envPeriod; // hardware envelope period
+	byte attack;        // software envelope: ms per level step up (0 = instant)
+	byte decay;         // ms per level step down to sustain (0 = hold level)
+	byte sustain;       // level held after decay
+	byte release;       // ms per level step down after note off (0 = instant)
+};
+
+/**
+ * A patch decoded for note-on. regs[] is the image of one chip's registers
+ * 0x06-0x0d with all three channels playing the patch; mask marks the
+ * registers the patch owns. The envelope shape register is only owned when
+ * the hardware envelope is in use, and writing it restarts the envelope.
+ */
+struct PatchImage {
+	byte regs[PATCH_IMAGE_SIZE];
+	byte mask;
+	byte level;
+	byte buzzer; // PATCH_BUZZER | PATCH_SYNC, plus BUZZER_TRIANGLE
+	byte attack;
+	byte decay;
+	byte sustain;
+	byte release;
+};
+
+bool loadPatch(byte program, Patch &patch);
+bool storePatch(byte program, const Patch &patch);
+void decodePatch(const Patch &patch, PatchImage &image);
+
+#endif /* _patch_h_ */
@@ -0,0 +1,27 @@
+#include "regstream.h"
+
+// 1 Mbaud and 500 kbaud are exact from a 16 MHz clock with double speed on
+const uint32_t romRegStreamRates[REGSTREAM_RATE_COUNT] PROGMEM = {
+	115200, 250000, 500000, 1000000
+};
+
+/**
+ * Fold one byte into a CRC-8 with polynomial 0x07, MSB first.
+ */
+byte regStreamCrc(byte crc, byte value) {
+	crc ^= value;
+	for (byte i = 0; i < 8; i++) {
+		crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+	}
+	return crc;
+}
+
+/**
+ * Baud rate for a SYSEX_SERIAL rate index, or 0 if there is no such rate.
+ */
+uint32_t regStreamBaud(byte rate) {
+	if (rate >= REGSTREAM_RATE_COUNT) {
+		return 0;
+	}
+	return pgm_read_dword(&romRegStreamRates[rate]);
+}
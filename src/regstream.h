@@ -0,0 +1,29 @@
+#ifndef _regstream_h_
+#define _regstream_h_
+#include "Arduino.h"
+
+#include "hcYmzShield.h"
+
+// Register frames on the UART, once SYSEX_SERIAL has switched it over:
+//   REGSTREAM_SYNC <chips> <dirty low> <dirty high> <values> <crc>
+// chips is a mask of the PSGs the values go to (bit 0 = PSG0, bit 1 =
+// PSG1), and dirty has a bit per register 0x00-0x0d with one value byte for
+// each set bit, lowest register first. The CRC-8 (polynomial 0x07) covers
+// everything after the sync byte. A frame is applied as one commit unless
+// REGSTREAM_MORE asks for it to wait for the next one. An empty frame
+// (chips and dirty 0) hands the UART back to MIDI.
+#define REGSTREAM_SYNC 0xa5
+#define REGSTREAM_CHIPS B00000011
+#define REGSTREAM_MORE B10000000
+#define REGSTREAM_MAX (4 + PSG_REGISTERS + 1)
+
+// Rates SYSEX_SERIAL can switch to, by index
+#define REGSTREAM_RATE_COUNT 4
+
+// The UART goes back to MIDI when no good frame has come for this long
+#define REGSTREAM_IDLE_MS 2000
+
+byte regStreamCrc(byte crc, byte value);
+uint32_t regStreamBaud(byte rate);
+
+#endif /* _regstream_h_ */
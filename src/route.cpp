@@ -0,0 +1,47 @@
+#include "route.h"
+
+#include <EEPROM.h>
+
+// channels 1-3 play music, 4-6 noise and 7-9 raw registers, each on both
+// chips, then left, then right; 10 plays drum samples, as General MIDI
+// has it, and 11-16 are not routed
+const byte romRoutes[ROUTE_CHANNELS] PROGMEM = {
+	ROUTE(ROUTE_MUSIC, ROUTE_BOTH), ROUTE(ROUTE_MUSIC, ROUTE_PSG1), ROUTE(ROUTE_MUSIC, ROUTE_PSG0),
+	ROUTE(ROUTE_NOISE, ROUTE_BOTH), ROUTE(ROUTE_NOISE, ROUTE_PSG1), ROUTE(ROUTE_NOISE, ROUTE_PSG0),
+	ROUTE(ROUTE_RAW, ROUTE_BOTH), ROUTE(ROUTE_RAW, ROUTE_PSG1), ROUTE(ROUTE_RAW, ROUTE_PSG0),
+	ROUTE(ROUTE_SAMPLE, ROUTE_BOTH),
+	ROUTE_OFF, ROUTE_OFF, ROUTE_OFF, ROUTE_OFF, ROUTE_OFF, ROUTE_OFF
+};
+
+/**
+ * Is a packed route one the dispatcher can take?
+ */
+static bool isRoute(byte route) {
+	return routeKind(route) < ROUTE_KIND_COUNT && !(route & B00001100)
+			&& (routeKind(route) == ROUTE_OFF || routeChips(route));
+}
+
+/**
+ * Read the routing table from EEPROM, falling back to the default for any
+ * channel whose entry was never written.
+ */
+void loadRoutes(byte *routes) {
+	for (byte i = 0; i < ROUTE_CHANNELS; i++) {
+		byte route = EEPROM.read(ROUTE_EEPROM_BASE + i);
+		routes[i] = isRoute(route) ? route : pgm_read_byte(&romRoutes[i]);
+	}
+}
+
+/**
+ * Route a MIDI channel (0-15) and keep it across power cycles. Returns
+ * false for a route that does not exist.
+ */
+bool storeRoute(byte *routes, byte channel, byte kind, byte chips) {
+	byte route = (kind == ROUTE_OFF) ? ROUTE_OFF : ROUTE(kind, chips);
+	if (channel >= ROUTE_CHANNELS || !isRoute(route)) {
+		return false;
+	}
+	routes[channel] = route;
+	EEPROM.update(ROUTE_EEPROM_BASE + channel, route);
+	return true;
+}
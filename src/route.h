@@ -0,0 +1,33 @@
+#ifndef _route_h_
+#define _route_h_
+#include "Arduino.h"
+
+#include "patch.h"
+
+// Each MIDI channel is routed to a handler kind and the chips it plays on,
+// packed in one byte as kind << 4 | chips. The table lives in EEPROM after
+// the user patches; an erased entry takes the channel's default.
+#define ROUTE_CHANNELS 16
+#define ROUTE_EEPROM_BASE (PATCH_EEPROM_BASE + PATCH_EEPROM_COUNT * sizeof(Patch))
+
+// Handler kinds
+#define ROUTE_OFF 0
+#define ROUTE_MUSIC 1
+#define ROUTE_NOISE 2 // reserved: the channels are routed but nothing plays yet
+#define ROUTE_RAW 3
+#define ROUTE_SAMPLE 4 // drum samples on channel C of each chip (sample.h)
+#define ROUTE_KIND_COUNT 5
+
+// Target chips, numbered as the shield's transaction hook numbers them
+#define ROUTE_PSG0 1 // right
+#define ROUTE_PSG1 2 // left
+#define ROUTE_BOTH 3
+
+#define ROUTE(kind, chips) (((kind) << 4) | (chips))
+#define routeKind(route) ((route) >> 4)
+#define routeChips(route) ((route) & ROUTE_BOTH)
+
+void loadRoutes(byte *routes);
+bool storeRoute(byte *routes, byte channel, byte kind, byte chips);
+
+#endif /* _route_h_ */
@@ -0,0 +1,189 @@
+#include "sample.h"
+
+// Synthesized at 8 kHz and mapped to the nearest level on the chip's 3 dB
+// scale with error feedback. Each decays to level 0 so a hit ends without
+// a step in the output.
+
+// kick, 1424 samples
+const byte kickSample[] PROGMEM = {
+	0xde, 0xee, 0xee, 0xfe, 0xff, 0xff, 0xff, 0xff, 0xfe, 0xfe, 0xee, 0xee, 0xdd, 0xdd, 0xcc, 0xbb,
+	0xaa, 0x98, 0x76, 0x42, 0x00, 0x02, 0x46, 0x78, 0x99, 0xab, 0xbc, 0xcc, 0xdd, 0xdd, 0xee, 0xee,
+	0xee, 0xef, 0xef, 0xef, 0xef, 0xef, 0xee, 0xee, 0xee, 0xed, 0xdd, 0xdd, 0xcc, 0xcb, 0xba, 0xaa,
+	0x98, 0x76, 0x54, 0x20, 0x00, 0x11, 0x45, 0x67, 0x89, 0x9a, 0xab, 0xbb, 0xcc, 0xcd, 0xcd, 0xdd,
+	0xde, 0xde, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xde, 0xdd, 0xdd, 0xdd, 0xcc, 0xcc,
+	0xcb, 0xbb, 0xaa, 0x99, 0x88, 0x76, 0x64, 0x31, 0x10, 0x00, 0x11, 0x35, 0x56, 0x78, 0x89, 0x9a,
+	0xaa, 0xbb, 0xbc, 0xbc, 0xcc, 0xdc, 0xdd, 0xdd, 0xdd, 0xde, 0xde, 0xde, 0xde, 0xde, 0xde, 0xde,
+	0xdd, 0xed, 0xdd, 0xdd, 0xdd, 0xcd, 0xcc, 0xcc, 0xbb, 0xbb, 0xba, 0xaa, 0x99, 0x98, 0x87, 0x66,
+	0x54, 0x32, 0x10, 0x00, 0x00, 0x11, 0x34, 0x55, 0x67, 0x78, 0x89, 0x99, 0xaa, 0xaa, 0xbb, 0xbb,
+	0xbc, 0xcc, 0xcc, 0xcc, 0xdc, 0xdc, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdc,
+	0xdc, 0xdc, 0xcc, 0xcc, 0xcc, 0xcb, 0xcb, 0xbb, 0xba, 0xba, 0xaa, 0x99, 0x98, 0x88, 0x77, 0x76,
+	0x55, 0x43, 0x31, 0x10, 0x00, 0x00, 0x01, 0x11, 0x34, 0x45, 0x66, 0x67, 0x78, 0x88, 0x99, 0x99,
+	0xaa, 0xaa, 0xab, 0xab, 0xbb, 0xbb, 0xcb, 0xcb, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcd,
+	0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcb, 0xcb, 0xcb, 0xbb, 0xbb, 0xbb, 0xab, 0xaa, 0xaa,
+	0x9a, 0x99, 0x98, 0x88, 0x87, 0x77, 0x66, 0x55, 0x54, 0x32, 0x21, 0x10, 0x00, 0x00, 0x00, 0x01,
+	0x11, 0x23, 0x44, 0x55, 0x66, 0x67, 0x77, 0x88, 0x88, 0x99, 0x99, 0x9a, 0x9a, 0xaa, 0xaa, 0xab,
+	0xab, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb, 0xbc, 0xbb, 0xcb, 0xcb, 0xcb, 0xcb, 0xcb, 0xcb, 0xcb, 0xbc,
+	0xbb, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb, 0xab, 0xaa, 0xaa, 0xaa, 0xaa, 0x9a, 0x99, 0x99, 0x98, 0x88,
+	0x88, 0x77, 0x77, 0x66, 0x65, 0x55, 0x44, 0x32, 0x21, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x11,
+	0x11, 0x23, 0x34, 0x45, 0x55, 0x66, 0x67, 0x67, 0x77, 0x88, 0x88, 0x89, 0x89, 0x99, 0x99, 0x9a,
+	0x9a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xba, 0xab, 0xab, 0xab, 0xab, 0xab, 0xba, 0xbb, 0xab, 0xab,
+	0xab, 0xab, 0xab, 0xaa, 0xba, 0xaa, 0xaa, 0xaa, 0xaa, 0xa9, 0xa9, 0xa9, 0x99, 0x99, 0x98, 0x98,
+	0x88, 0x88, 0x78, 0x77, 0x77, 0x66, 0x66, 0x55, 0x55, 0x44, 0x33, 0x32, 0x11, 0x10, 0x10, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x10, 0x11, 0x12, 0x23, 0x34, 0x44, 0x55, 0x55, 0x66, 0x66, 0x67, 0x77,
+	0x77, 0x87, 0x88, 0x88, 0x88, 0x98, 0x98, 0x99, 0x99, 0x99, 0x99, 0x9a, 0x99, 0xa9, 0xa9, 0xa9,
+	0xaa, 0x9a, 0xa9, 0xaa, 0xa9, 0xaa, 0x9a, 0xa9, 0xa9, 0xa9, 0xa9, 0xa9, 0x99, 0x99, 0x99, 0x99,
+	0x99, 0x98, 0x98, 0x98, 0x88, 0x88, 0x88, 0x78, 0x77, 0x77, 0x76, 0x76, 0x66, 0x65, 0x55, 0x54,
+	0x44, 0x43, 0x33, 0x22, 0x11, 0x11, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x11,
+	0x11, 0x22, 0x33, 0x34, 0x44, 0x45, 0x55, 0x56, 0x56, 0x66, 0x67, 0x67, 0x77, 0x77, 0x77, 0x87,
+	0x88, 0x88, 0x88, 0x88, 0x88, 0x89, 0x88, 0x98, 0x98, 0x98, 0x99, 0x89, 0x99, 0x89, 0x99, 0x98,
+	0x99, 0x98, 0x99, 0x89, 0x89, 0x89, 0x89, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x78, 0x77, 0x87,
+	0x77, 0x77, 0x67, 0x66, 0x66, 0x66, 0x55, 0x55, 0x55, 0x44, 0x44, 0x33, 0x33, 0x22, 0x21, 0x11,
+	0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x10, 0x11, 0x11, 0x22, 0x23,
+	0x33, 0x34, 0x44, 0x44, 0x55, 0x55, 0x55, 0x65, 0x66, 0x66, 0x66, 0x76, 0x76, 0x77, 0x77, 0x77,
+	0x77, 0x77, 0x87, 0x78, 0x78, 0x78, 0x78, 0x87, 0x88, 0x87, 0x88, 0x88, 0x78, 0x88, 0x78, 0x87,
+	0x87, 0x87, 0x87, 0x87, 0x78, 0x77, 0x77, 0x77, 0x77, 0x77, 0x67, 0x67, 0x66, 0x66, 0x66, 0x65,
+	0x65, 0x55, 0x55, 0x45, 0x44, 0x44, 0x33, 0x33, 0x22, 0x22, 0x11, 0x11, 0x10, 0x10, 0x10, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x10, 0x11, 0x11, 0x11, 0x12, 0x22,
+	0x22, 0x32, 0x33, 0x33, 0x43, 0x44, 0x44, 0x44, 0x44, 0x54, 0x54, 0x55, 0x55, 0x55, 0x55, 0x55,
+	0x55, 0x55, 0x55, 0x56, 0x55, 0x56, 0x55, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+	0x55, 0x45, 0x45, 0x45, 0x44, 0x44, 0x44, 0x44, 0x34, 0x34, 0x33, 0x33, 0x33, 0x23, 0x22, 0x22,
+	0x21, 0x11, 0x11, 0x11, 0x11, 0x01, 0x01, 0x01, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01,
+	0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+	0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x00, 0x10
+};
+
+// snare, 1192 samples
+const byte snareSample[] PROGMEM = {
+	0xbc, 0xcd, 0xfe, 0xed, 0xdf, 0xce, 0xde, 0xed, 0xee, 0xde, 0xdd, 0xee, 0xbb, 0xd6, 0xcd, 0xcb,
+	0xaa, 0xc7, 0xdc, 0xbb, 0xbe, 0xdd, 0xec, 0xee, 0xce, 0xdd, 0xee, 0xde, 0xee, 0xcd, 0xcb, 0xed,
+	0xbc, 0xde, 0x9c, 0xab, 0xd9, 0x9a, 0xdc, 0xdb, 0xdc, 0xdd, 0xde, 0xed, 0xcd, 0xdc, 0xed, 0xee,
+	0xee, 0xcd, 0xed, 0xdd, 0xdd, 0xcd, 0xdb, 0xca, 0xbc, 0xbd, 0xb9, 0xab, 0xdc, 0xda, 0xda, 0xbd,
+	0xcb, 0xdd, 0xdc, 0xcc, 0xec, 0xdc, 0xdd, 0xcd, 0xed, 0xdd, 0xdd, 0xdd, 0xbc, 0xbd, 0xdb, 0xbc,
+	0xca, 0xba, 0xac, 0xcd, 0xbb, 0xbb, 0xcd, 0xdb, 0xdc, 0xcd, 0xcc, 0xdc, 0xcc, 0xcc, 0xcc, 0xdc,
+	0xdb, 0xcc, 0xbc, 0xcb, 0xbd, 0xbb, 0xcb, 0xab, 0xcc, 0xbc, 0xbb, 0xcc, 0xdc, 0xcb, 0xcb, 0xcd,
+	0xbd, 0xcd, 0xcd, 0xdc, 0xcd, 0xbd, 0xcc, 0xbb, 0xbb, 0xbc, 0xca, 0xbc, 0xbb, 0xcc, 0xbb, 0xbb,
+	0xac, 0xbb, 0xbb, 0xdc, 0xcd, 0xbb, 0xdc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcb, 0xcb, 0xbc, 0xbc, 0xbc,
+	0xbb, 0xac, 0xcb, 0xca, 0xbb, 0xcb, 0xbb, 0xbb, 0xbb, 0xcc, 0xcc, 0xbc, 0xbc, 0xbb, 0xcb, 0xbc,
+	0xbc, 0xbb, 0xbc, 0xca, 0xab, 0xbc, 0xac, 0xab, 0xbb, 0xbb, 0xbb, 0xab, 0xbc, 0xbb, 0xbc, 0xbb,
+	0xbc, 0xcc, 0xbb, 0xbc, 0xbb, 0xcb, 0xbb, 0xcb, 0xba, 0xba, 0xba, 0xbb, 0xbb, 0xba, 0xbc, 0xbb,
+	0xba, 0xbb, 0xcb, 0xbb, 0xbb, 0xbc, 0xbc, 0xbb, 0xca, 0xbb, 0xbb, 0xbb, 0xba, 0xba, 0xbb, 0xbb,
+	0xbb, 0xba, 0xbb, 0xab, 0xbb, 0xbb, 0xab, 0xbb, 0xbb, 0xab, 0xab, 0xbb, 0xbb, 0xbb, 0xba, 0xbb,
+	0xbb, 0xbb, 0xbb, 0xab, 0xba, 0xba, 0xab, 0xba, 0xba, 0xbb, 0xba, 0xba, 0xbb, 0xab, 0xab, 0xab,
+	0xaa, 0xbb, 0xaa, 0xba, 0xba, 0xbb, 0xba, 0xba, 0xba, 0xab, 0xba, 0xaa, 0xab, 0xaa, 0xba, 0xba,
+	0xaa, 0xba, 0xab, 0xaa, 0xab, 0xaa, 0xab, 0xbb, 0xaa, 0xaa, 0xba, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+	0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xba, 0xaa,
+	0xaa, 0xba, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x9a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+	0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xa9, 0xaa, 0xa9, 0xaa, 0x9a, 0x99, 0xaa,
+	0xa9, 0xaa, 0x9a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x9a, 0x9a, 0x9a, 0xa9, 0xaa, 0x99, 0xa9, 0xaa,
+	0x9a, 0x9a, 0x9a, 0x9a, 0x99, 0x9a, 0x9a, 0x9a, 0x9a, 0x99, 0xa9, 0xa9, 0xa9, 0x9a, 0x99, 0xa9,
+	0xa9, 0xa9, 0x99, 0x9a, 0x99, 0x99, 0x9a, 0x99, 0x9a, 0x99, 0xa9, 0x9a, 0x99, 0x99, 0x99, 0x9a,
+	0x99, 0xa9, 0x9a, 0x99, 0x99, 0x99, 0x9a, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99,
+	0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99,
+	0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x89, 0x98, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99,
+	0x89, 0x99, 0x99, 0x89, 0x99, 0x99, 0x99, 0x98, 0x98, 0x99, 0x98, 0x98, 0x98, 0x99, 0x89, 0x98,
+	0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x89, 0x89, 0x88,
+	0x89, 0x88, 0x98, 0x98, 0x98, 0x89, 0x89, 0x89, 0x88, 0x89, 0x88, 0x98, 0x89, 0x88, 0x98, 0x88,
+	0x89, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
+	0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x78, 0x87, 0x88, 0x78, 0x87, 0x87,
+	0x87, 0x87, 0x78, 0x78, 0x78, 0x77, 0x87, 0x77, 0x87, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77,
+	0x77, 0x77, 0x77, 0x67, 0x76, 0x77, 0x67, 0x67, 0x67, 0x67, 0x66, 0x76, 0x67, 0x66, 0x66, 0x66,
+	0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x65, 0x65, 0x65, 0x65, 0x65, 0x65, 0x65, 0x55,
+	0x65, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x45, 0x54, 0x54, 0x54, 0x54, 0x45, 0x44, 0x44,
+	0x44, 0x44, 0x44, 0x44, 0x44, 0x34, 0x34, 0x34, 0x33, 0x43, 0x33, 0x33, 0x33, 0x33, 0x32, 0x32,
+	0x32, 0x23, 0x22, 0x22, 0x22, 0x21, 0x21, 0x21, 0x11, 0x11, 0x11, 0x11, 0x11, 0x10, 0x11, 0x01,
+	0x01, 0x01, 0x00, 0x10
+};
+
+// clap, 954 samples
+const byte clapSample[] PROGMEM = {
+	0xce, 0xf8, 0xdc, 0xdd, 0xee, 0xce, 0xba, 0xe8, 0xcb, 0xdc, 0xaa, 0x9c, 0xec, 0xc9, 0xad, 0xbe,
+	0x9b, 0xbd, 0x68, 0xa9, 0xbd, 0xcb, 0x6a, 0xbc, 0xbb, 0xcc, 0xbb, 0xbc, 0x7c, 0xba, 0x5a, 0xbc,
+	0xac, 0x8a, 0x82, 0x4b, 0xc9, 0x87, 0xb9, 0xb8, 0x78, 0x78, 0x81, 0x8a, 0xce, 0xaf, 0xd4, 0xee,
+	0xee, 0xce, 0xed, 0xce, 0xdc, 0xed, 0xde, 0xbd, 0xce, 0xdb, 0xea, 0xda, 0xbd, 0x9a, 0xcc, 0xcb,
+	0x8c, 0x7a, 0xcc, 0xc7, 0x89, 0xcd, 0x9a, 0x9c, 0xcc, 0x61, 0x77, 0xac, 0xbb, 0xca, 0xc0, 0xb5,
+	0xa9, 0xbc, 0xa3, 0xb9, 0x97, 0xa1, 0x9a, 0x9a, 0x9c, 0xae, 0xbf, 0xeb, 0xce, 0xdc, 0xdf, 0xa5,
+	0xcd, 0xac, 0xce, 0xef, 0xde, 0xbe, 0xee, 0x7c, 0xcd, 0xce, 0xe9, 0xdd, 0xce, 0xbd, 0xda, 0xee,
+	0x9e, 0x8d, 0xbe, 0xca, 0xde, 0xdd, 0xcd, 0xca, 0xee, 0xeb, 0xcc, 0xbd, 0xee, 0x8d, 0xd9, 0xca,
+	0x9e, 0x7a, 0xbd, 0x5d, 0xd8, 0xce, 0xd9, 0xac, 0xec, 0xbb, 0xcd, 0xbe, 0xde, 0xce, 0x7b, 0xbd,
+	0x7d, 0xdc, 0x5c, 0xbc, 0xce, 0xc7, 0x7a, 0xb7, 0x79, 0xdc, 0xdd, 0xdc, 0xca, 0xd8, 0xcd, 0xdb,
+	0xcd, 0xbd, 0xed, 0xbb, 0xdc, 0x8b, 0xdd, 0xcc, 0xc8, 0xcc, 0x9a, 0x5d, 0xbc, 0xba, 0x9c, 0x58,
+	0xcc, 0xdc, 0xcd, 0xcb, 0xdd, 0xca, 0xc0, 0xcc, 0xdd, 0x9d, 0xcd, 0xaa, 0x7c, 0xcd, 0x81, 0xd7,
+	0x8c, 0x0c, 0xbb, 0xd9, 0xdc, 0xbc, 0x4a, 0xc8, 0xca, 0xa5, 0xbc, 0x8d, 0xcb, 0xab, 0x5c, 0xca,
+	0xcc, 0xaa, 0x9c, 0xcc, 0x76, 0xc9, 0xcb, 0x5b, 0x7b, 0xc9, 0x78, 0xcb, 0xca, 0x3a, 0xc9, 0x6b,
+	0xbb, 0xc9, 0x71, 0x0c, 0x2c, 0xc4, 0xac, 0xca, 0xc9, 0xcb, 0xcb, 0xb8, 0xcc, 0xb3, 0x77, 0x88,
+	0xaa, 0xa7, 0x85, 0xab, 0xbc, 0xb4, 0x7c, 0x9a, 0xab, 0x99, 0xcb, 0x1b, 0x97, 0xaa, 0xcb, 0xb6,
+	0x73, 0x72, 0xaa, 0x61, 0xbb, 0x5b, 0xc5, 0x69, 0x0b, 0xaa, 0xbc, 0x8c, 0x87, 0x3a, 0x07, 0xbb,
+	0xb5, 0xa5, 0x86, 0xba, 0xbb, 0xb9, 0xba, 0xba, 0x6b, 0xb3, 0x77, 0x99, 0x8b, 0x29, 0xa8, 0x9b,
+	0x9a, 0x57, 0x8a, 0xaa, 0x46, 0xbb, 0x18, 0x8b, 0xb7, 0xa4, 0xaa, 0xba, 0xa8, 0xa5, 0xb9, 0xb1,
+	0x59, 0x99, 0xa7, 0x58, 0xa8, 0xb9, 0x77, 0x18, 0xaa, 0x47, 0x78, 0xaa, 0xa0, 0x8a, 0x87, 0x59,
+	0xa8, 0x92, 0xa9, 0x87, 0x8a, 0x7a, 0x5a, 0xaa, 0xb5, 0xa7, 0x88, 0x5a, 0x8a, 0x39, 0x54, 0x4a,
+	0xa4, 0xaa, 0xa7, 0x66, 0x08, 0x89, 0x93, 0xaa, 0xa9, 0x97, 0x77, 0x71, 0x84, 0xa9, 0x8a, 0x96,
+	0x39, 0x57, 0x29, 0xa7, 0x59, 0x0a, 0xa9, 0x7a, 0x78, 0xaa, 0x99, 0x67, 0x85, 0x82, 0x98, 0x94,
+	0x99, 0x89, 0x36, 0x97, 0x75, 0x97, 0xa9, 0x8a, 0x89, 0x93, 0x51, 0x96, 0x58, 0x98, 0x88, 0x41,
+	0x96, 0x67, 0x09, 0x69, 0x08, 0x78, 0x67, 0x90, 0x17, 0x50, 0x31, 0x88, 0x88, 0x15, 0x88, 0x17,
+	0x86, 0x72, 0x77, 0x86, 0x78, 0x58, 0x77, 0x68, 0x78, 0x78, 0x81, 0x78, 0x85, 0x77, 0x01, 0x57,
+	0x71, 0x64, 0x67, 0x14, 0x50, 0x54, 0x01, 0x74, 0x77, 0x70, 0x76, 0x26, 0x61, 0x10, 0x23, 0x50,
+	0x35, 0x06, 0x05, 0x25, 0x56, 0x66, 0x66, 0x16, 0x52, 0x06, 0x65, 0x36, 0x50, 0x53, 0x05, 0x54,
+	0x52, 0x44, 0x33, 0x23, 0x14, 0x42, 0x34, 0x41, 0x20, 0x24, 0x40, 0x32, 0x00, 0x33, 0x11, 0x12,
+	0x31, 0x22, 0x00, 0x22, 0x02, 0x01, 0x11, 0x11, 0x01, 0x00, 0x10, 0x00, 0x10
+};
+
+// hat, 390 samples
+const byte hatSample[] PROGMEM = {
+	0xde, 0xce, 0xcc, 0xdd, 0xbe, 0xdd, 0xda, 0xce, 0xad, 0xdb, 0xcc, 0xeb, 0xdb, 0xdb, 0xdd, 0xbd,
+	0xbd, 0x8e, 0x8e, 0xab, 0xdc, 0xbb, 0xcd, 0xcb, 0xad, 0xd0, 0xdb, 0xac, 0xcb, 0xbd, 0xba, 0xac,
+	0xcc, 0x9d, 0x8d, 0x6d, 0xba, 0xab, 0xbb, 0xda, 0xaa, 0xbc, 0x9c, 0x9b, 0xca, 0xbb, 0xab, 0x99,
+	0xba, 0xac, 0x9c, 0x9b, 0x8a, 0xbb, 0x8a, 0xab, 0x8b, 0x8b, 0xba, 0xba, 0x98, 0xba, 0xa7, 0xba,
+	0xa9, 0xa9, 0xaa, 0x7a, 0xaa, 0xa6, 0x9a, 0x9b, 0x88, 0xaa, 0xa8, 0x9a, 0x7a, 0x6a, 0xa6, 0x9a,
+	0x6a, 0x8a, 0xa5, 0x99, 0x98, 0x99, 0xa6, 0x97, 0x8a, 0x78, 0x99, 0x6a, 0x88, 0x48, 0x99, 0x98,
+	0x59, 0x98, 0x68, 0x88, 0x95, 0x87, 0x98, 0x58, 0x78, 0x78, 0x89, 0x76, 0x96, 0x76, 0x86, 0x94,
+	0x79, 0x78, 0x67, 0x78, 0x57, 0x87, 0x74, 0x94, 0x76, 0x90, 0x77, 0x76, 0x87, 0x75, 0x66, 0x85,
+	0x67, 0x76, 0x57, 0x66, 0x83, 0x76, 0x74, 0x67, 0x67, 0x66, 0x26, 0x68, 0x16, 0x57, 0x46, 0x65,
+	0x66, 0x57, 0x65, 0x65, 0x44, 0x76, 0x16, 0x64, 0x56, 0x46, 0x66, 0x54, 0x46, 0x46, 0x55, 0x55,
+	0x34, 0x63, 0x46, 0x44, 0x55, 0x33, 0x55, 0x15, 0x42, 0x54, 0x24, 0x41, 0x24, 0x35, 0x12, 0x24,
+	0x21, 0x32, 0x32, 0x22, 0x12, 0x13, 0x11, 0x13, 0x02, 0x01, 0x21, 0x02, 0x10, 0x11, 0x10, 0x10,
+	0x10, 0x00, 0x10
+};
+
+const Sample romSamples[SAMPLE_COUNT] PROGMEM = {
+	{ kickSample, sizeof(kickSample) * 2 },
+	{ snareSample, sizeof(snareSample) * 2 },
+	{ clapSample, sizeof(clapSample) * 2 },
+	{ hatSample, sizeof(hatSample) * 2 }
+};
+
+#define KICK 0
+#define SNARE 1
+#define CLAP 2
+#define HAT 3
+
+// sample and step for each kit note; toms are the kick pitched up
+const byte romKits[SAMPLE_KIT_COUNT][SAMPLE_KIT_SIZE][2] PROGMEM = {
+	{
+		{ KICK, 14 }, { KICK, 16 }, { SNARE, 28 }, { SNARE, 16 }, // 35-38
+		{ CLAP, 16 }, { SNARE, 18 }, { KICK, 22 }, { HAT, 16 },   // 39-42
+		{ KICK, 26 }, { HAT, 14 }, { KICK, 30 }, { HAT, 11 }      // 43-46
+	},
+	{
+		// the same hits an octave lower, for a heavier kit
+		{ KICK, 7 }, { KICK, 8 }, { SNARE, 14 }, { SNARE, 8 },
+		{ CLAP, 8 }, { SNARE, 9 }, { KICK, 11 }, { HAT, 8 },
+		{ KICK, 13 }, { HAT, 7 }, { KICK, 15 }, { HAT, 6 }
+	}
+};
+
+/**
+ * Look up the sample a kit plays for a note and the step to play it at.
+ * Returns false for a note the kit does not cover.
+ */
+bool loadSample(byte kit, byte note, Sample &sample, byte &step) {
+	if (kit >= SAMPLE_KIT_COUNT || note < SAMPLE_KIT_BASE
+			|| note >= SAMPLE_KIT_BASE + SAMPLE_KIT_SIZE) {
+		return false;
+	}
+	const byte *key = romKits[kit][note - SAMPLE_KIT_BASE];
+	memcpy_P(&sample, &romSamples[pgm_read_byte(&key[0])], sizeof(Sample));
+	step = pgm_read_byte(&key[1]);
+	return true;
+}
@@ -0,0 +1,40 @@
+#ifndef _sample_h_
+#define _sample_h_
+#include "Arduino.h"
+
+// 4-bit drum samples in flash, played by rewriting a level register with
+// tone and noise closed in the mixer. Samples are recorded at
+// SAMPLE_SOURCE_RATE and written out from Timer2 at SAMPLE_RATE; a lower
+// rate costs less CPU and keeps the pitch.
+#define SAMPLE_SOURCE_RATE 8000
+#define SAMPLE_RATE 8000
+#define SAMPLE_COUNT 4
+
+// Timer2 runs in CTC mode; its compare value is 8 bits
+#if F_CPU / 8 / SAMPLE_RATE <= 256
+#define SAMPLE_TIMER_PRESCALE 8
+#define SAMPLE_TIMER_CLOCK _BV(CS21)
+#else
+#define SAMPLE_TIMER_PRESCALE 32
+#define SAMPLE_TIMER_CLOCK (_BV(CS21) | _BV(CS20))
+#endif
+#define SAMPLE_TIMER_COUNTS (F_CPU / SAMPLE_TIMER_PRESCALE / SAMPLE_RATE)
+
+// Kits map the General MIDI percussion notes SAMPLE_KIT_BASE onwards to a
+// sample and a playback step, selected per kit with program change
+#define SAMPLE_KIT_COUNT 2
+#define SAMPLE_KIT_BASE 35 // acoustic bass drum
+#define SAMPLE_KIT_SIZE 12 // up to open hi-hat
+#define SAMPLE_STEP_UNITY 16 // steps are in 1/16 samples
+
+/**
+ * A sample as two 4-bit levels per byte, high nibble first.
+ */
+struct Sample {
+	const byte *data;
+	uint16_t length; // in levels, at most 4095
+};
+
+bool loadSample(byte kit, byte note, Sample &sample, byte &step);
+
+#endif /* _sample_h_ */
@@ -0,0 +1,167 @@
+#include "schedule.h"
+
+struct Scheduled {
+	uint16_t due;
+	byte status;
+	byte data1;
+	byte data2;
+};
+
+static byte offset = 0; // ms, 0 when messages run as they are read
+static scheduleHandler dispatch;
+static bool dispatching = false;
+static ScheduleStats stats;
+
+// arrival times of the oldest unread bytes in the receive buffer
+static uint16_t stamps[SCHEDULE_STAMPS];
+static byte stampHead = 0;
+static byte stampCount = 0;
+static uint16_t lastNoticed;
+static uint16_t stamp; // arrival of the byte MIDI.read() is parsing
+
+static Scheduled queue[SCHEDULE_QUEUE];
+static byte queueHead = 0;
+static byte queueCount = 0;
+
+/**
+ * Set the function that runs messages once their time comes.
+ */
+void beginSchedule(scheduleHandler handler) {
+	dispatch = handler;
+}
+
+/**
+ * Set the latency in ms, 0 to run messages as they are read, and start
+ * the statistics over. Messages already waiting run straight away.
+ */
+void setScheduleOffset(byte ms) {
+	flushSchedule();
+	offset = (ms > SCHEDULE_MAX_MS) ? SCHEDULE_MAX_MS : ms;
+	memset(&stats, 0, sizeof(stats));
+	restartStamps();
+}
+
+byte scheduleOffset() {
+	return offset;
+}
+
+const ScheduleStats &scheduleStats() {
+	return stats;
+}
+
+/**
+ * Forget every stamp, for when the UART has changed hands. Bytes still
+ * unread are dated from the next noticeMidi().
+ */
+void restartStamps() {
+	stampHead = 0;
+	stampCount = 0;
+	lastNoticed = micros();
+}
+
+/**
+ * Stamp the bytes that reached the receive buffer since the last call.
+ * None of them can be older than that call, and each is at least a byte
+ * time older than the one after it. Bytes beyond SCHEDULE_STAMPS are left
+ * to a later call and dated then.
+ */
+void noticeMidi() {
+	if (!offset) {
+		return;
+	}
+	uint16_t now = micros();
+	int available = Serial.available();
+	byte fresh = (available > stampCount) ? available - stampCount : 0;
+	for (byte i = 0; i < fresh && stampCount < SCHEDULE_STAMPS; i++) {
+		uint16_t back = (uint16_t) (fresh - 1 - i) * SCHEDULE_BYTE_US;
+		uint16_t time = now - back;
+		if ((int16_t) (time - lastNoticed) < 0) {
+			time = lastNoticed;
+		}
+		stamps[(stampHead + stampCount++) % SCHEDULE_STAMPS] = time;
+	}
+	lastNoticed = now;
+}
+
+/**
+ * Take the stamp of the next byte in the receive buffer, which MIDI.read()
+ * is about to parse. A byte that was not stamped counts as arriving now.
+ */
+void takeStamp() {
+	if (!offset || !Serial.available()) {
+		return;
+	}
+	if (!stampCount) {
+		stamp = micros();
+		return;
+	}
+	stamp = stamps[stampHead];
+	stampHead = (stampHead + 1) % SCHEDULE_STAMPS;
+	stampCount--;
+}
+
+/**
+ * Run the oldest waiting message, noting how late it is.
+ */
+static void runNext(bool forced) {
+	Scheduled &next = queue[queueHead];
+	queueHead = (queueHead + 1) % SCHEDULE_QUEUE;
+	queueCount--;
+	if (forced) {
+		stats.forced++;
+	} else {
+		int16_t late = (uint16_t) micros() - next.due;
+		if (late < 0) {
+			late = 0;
+		}
+		if (stats.events < 0xffff) {
+			stats.events++;
+			stats.totalLate += late;
+		}
+		if ((uint16_t) late > stats.worstLate) {
+			stats.worstLate = late;
+		}
+	}
+	dispatching = true;
+	dispatch(next.status, next.data1, next.data2);
+	dispatching = false;
+}
+
+/**
+ * Hold a channel message until its stamp plus the offset. Returns false
+ * when the message should run now: scheduling is off or the message is
+ * one coming off the queue. A full queue lets its oldest message go early.
+ */
+bool deferMessage(byte status, byte data1, byte data2) {
+	if (!offset || dispatching) {
+		return false;
+	}
+	if (queueCount == SCHEDULE_QUEUE) {
+		runNext(true);
+	}
+	Scheduled &slot = queue[(queueHead + queueCount++) % SCHEDULE_QUEUE];
+	slot.due = stamp + (uint16_t) offset * 1000;
+	slot.status = status;
+	slot.data1 = data1;
+	slot.data2 = data2;
+	return true;
+}
+
+/**
+ * Run the messages that are due.
+ */
+void runSchedule() {
+	while (queueCount && (int16_t) ((uint16_t) micros() - queue[queueHead].due) >= 0) {
+		runNext(false);
+	}
+}
+
+/**
+ * Run everything waiting straight away, counted as forced, ahead of a
+ * change to how messages arrive.
+ */
+void flushSchedule() {
+	while (queueCount) {
+		runNext(true);
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef _schedule_h_
+#define _schedule_h_
+#include "Arduino.h"
+
+// Constant-latency scheduling of MIDI channel messages. When an offset is
+// set (SYSEX_SCHEDULE), a message is stamped with the time its last byte
+// arrived, and its handler runs at that stamp plus the offset instead of
+// whenever loop() gets to it. Where in loop() the bytes landed and how
+// many registers the messages before them wrote stop showing in the
+// latency, as long as the offset covers them. SysEx and real-time messages
+// still run as they are read.
+//
+// The Arduino core owns the UART receive interrupt, so bytes are stamped
+// by noticeMidi() when loop() first finds them in the receive buffer. When
+// several bytes are new, each one except the newest is dated one byte time
+// before the byte that followed it, since bytes on the cable are at least
+// that far apart.
+//
+// Times are the low 16 bits of micros(), which is plenty for offsets of up
+// to SCHEDULE_MAX_MS.
+#define SCHEDULE_STAMPS 16  // unread bytes that can hold a stamp
+#define SCHEDULE_QUEUE 16   // messages waiting for their time
+#define SCHEDULE_MAX_MS 25
+#define SCHEDULE_BYTE_US 320 // one byte at 31,250 baud
+
+// How dispatched messages kept time since the offset was last set. Late
+// is how far after its due time a message's handler started. A message
+// forced out early by a full queue is counted apart and does not add to
+// the lateness figures.
+struct ScheduleStats {
+	uint16_t events;
+	uint16_t forced;
+	uint16_t worstLate; // us
+	uint32_t totalLate; // us, for the mean
+};
+
+// Runs a message taken off the queue: status with channel, then its data
+typedef void (*scheduleHandler)(byte, byte, byte);
+
+void beginSchedule(scheduleHandler handler);
+void setScheduleOffset(byte ms);
+byte scheduleOffset();
+const ScheduleStats &scheduleStats();
+void restartStamps();
+void noticeMidi();
+void takeStamp();
+bool deferMessage(byte status, byte data1, byte data2);
+void runSchedule();
+void flushSchedule();
+
+#endif /* _schedule_h_ */
@@ -0,0 +1,96 @@
+#include "tuning.h"
+
+#if HCYMZ_TUNING
+// bulk dump being taken in: the index of the next byte in it, counting
+// from F0, and the first two bytes of the note it is in
+static uint16_t bulkIndex = 0; // 0 when no dump is coming in
+static byte bulkFrequency[2];
+
+/**
+ * Retune one note from its three MTS bytes, unless they say to leave it.
+ */
+static void tuneNote(byte note, const byte *frequency) {
+	if (frequency[0] == 0x7f && frequency[1] == 0x7f && frequency[2] == 0x7f) {
+		return;
+	}
+	YMZ.setNoteTuning(note, frequency[0], ((uint16_t) frequency[1] << 7) | frequency[2]);
+}
+
+/**
+ * Retune the notes listed in a single-note change, as many as the message
+ * really holds. Only those notes are worked out again.
+ */
+static void tuneNotes(const byte *data, unsigned size, unsigned count) {
+	const byte *end = data + size - 1;
+	for (; count && data + 4 <= end; count--, data += 4) {
+		tuneNote(data[0] & 0x7f, data + 1);
+	}
+}
+#endif
+
+/**
+ * Is a SysEx message (F0 and F7 included) one of the MTS changes the note
+ * table takes?
+ */
+bool isTuningMessage(const byte *data, unsigned size) {
+	return size >= 6 && (data[1] == TUNING_NON_REALTIME || data[1] == TUNING_REALTIME)
+			&& data[3] == TUNING_SUB_ID;
+}
+
+/**
+ * Apply an MTS single-note change, real-time or not. Other tuning
+ * messages, requests for a dump among them, are ignored; bulk dumps are
+ * taken by takeTuningByte() instead, as they arrive.
+ */
+void applyTuning(const byte *data, unsigned size) {
+#if HCYMZ_TUNING
+	switch (data[4]) {
+	case TUNING_NOTE:
+		if (size > 7) {
+			tuneNotes(data + 7, size - 7, data[6]);
+		}
+		break;
+	case TUNING_BANK_NOTE:
+		if (size > 8) {
+			tuneNotes(data + 8, size - 8, data[7]);
+		}
+		break;
+	}
+#endif
+}
+
+/**
+ * Follow the MIDI input a byte at a time, ahead of MIDI.read(), for bulk
+ * dumps, retuning each note as soon as its three bytes are in. The dump's
+ * checksum is not checked, as the standard lets a receiver do. Real-time
+ * bytes may come in the middle; any other status byte ends the dump.
+ */
+void takeTuningByte(byte value) {
+#if HCYMZ_TUNING
+	if (value >= 0xf8) {
+		return;
+	}
+	if (value == 0xf0) {
+		bulkIndex = 1;
+		return;
+	}
+	if (!bulkIndex || (value & 0x80) || bulkIndex >= TUNING_BULK_SIZE - 1
+			|| (bulkIndex == 1 && value != TUNING_NON_REALTIME && value != TUNING_REALTIME)
+			|| (bulkIndex == 3 && value != TUNING_SUB_ID)
+			|| (bulkIndex == 4 && value != TUNING_BULK_DUMP)) {
+		bulkIndex = 0;
+		return;
+	}
+	if (bulkIndex >= 22 && bulkIndex < 22 + 3 * 128) {
+		byte note = (bulkIndex - 22) / 3;
+		byte part = (bulkIndex - 22) % 3;
+		if (part < 2) {
+			bulkFrequency[part] = value;
+		} else {
+			byte frequency[3] = { bulkFrequency[0], bulkFrequency[1], value };
+			tuneNote(note, frequency);
+		}
+	}
+	bulkIndex++;
+#endif
+}
@@ -0,0 +1,33 @@
+#ifndef _tuning_h_
+#define _tuning_h_
+#include "Arduino.h"
+
+#include "hcYmzShield.h"
+
+// MIDI Tuning Standard messages, which retune the shield's note table one
+// note at a time (hcYmzShield::setNoteTuning). All arrive as Universal
+// SysEx, real-time (7F) or not (7E), for any device ID:
+//   F0 7E <dev> 08 01 <program> <name x16> (<xx> <yy> <zz>) x128 <sum> F7
+//   F0 7F <dev> 08 02 <program> <count> (<note> <xx> <yy> <zz>) x count F7
+//   F0 7E <dev> 08 07 <bank> <program> <count> (<note> <xx> <yy> <zz>) ... F7
+// xx is the equal-tempered semitone at or below the pitch and yy zz the
+// 14-bit fraction of the way up to the next, MSB first; 7F 7F 7F leaves a
+// note as it is. There is one table, so every tuning program and bank is
+// taken as the current one, and notes already sounding keep their pitch
+// until they are played again. The bulk dump is 408 bytes, more than the
+// MIDI library's SysEx buffer holds, so it is read a byte at a time as it
+// arrives (takeTuningByte) and each note retuned once its three bytes are
+// in; a dump cut short leaves the notes it got to retuned.
+#define TUNING_NON_REALTIME 0x7e
+#define TUNING_REALTIME 0x7f
+#define TUNING_SUB_ID 0x08
+#define TUNING_BULK_DUMP 0x01
+#define TUNING_NOTE 0x02
+#define TUNING_BANK_NOTE 0x07
+#define TUNING_BULK_SIZE 408
+
+bool isTuningMessage(const byte *data, unsigned size);
+void applyTuning(const byte *data, unsigned size);
+void takeTuningByte(byte value);
+
+#endif /* _tuning_h_ */
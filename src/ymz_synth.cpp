@@ -7,20 +7,8 @@
 
 #define LED_COUNT 4
 
-// MIDI channels - standard
-#define CHANNEL_STEREO 1
-#define CHANNEL_LEFT 2
-#define CHANNEL_RIGHT 3
-
-// MIDI channels - noise
-#define CHANNEL_NOISE_STEREO 4
-#define CHANNEL_NOISE_LEFT 5
-#define CHANNEL_NOISE_RIGHT 6
-
-// MIDI channels - raw
-#define CHANNEL_RAW_STEREO 7
-#define CHANNEL_RAW_LEFT 8
-#define CHANNEL_RAW_RIGHT 9
+// MIDI channels are routed to music, noise or raw register handlers by
+// the table in route.h; channels 1-3, 4-6 and 7-9 by default
 
 // CC #s
 #define CC_CHANNEL_A_FREQ_MSB 20
@@ -39,19 +27,232 @@
 #define CC_ENVELOPE_FREQ_LOW 30  // low 2 bits
 #define CC_ENVELOPE_SHAPE 31
 #define CC_LATCH 80
+#define CC_FREQ_SLEW 81  // time of a full-scale move in SLEW_UNIT_MS, 0 = off
+#define CC_NOISE_SLEW 82
+#define CC_LEVEL_SLEW 83
 #define CC_DEBUG 119
 
+// music channel controllers
+#define CC_PORTAMENTO_TIME 5
+#define CC_VOLUME 7
+#define CC_EXPRESSION 11
+#define CC_CHORD 14       // chord shape, 0 to CHORD_COUNT - 1
+#define CC_ARP_PATTERN 15 // ARP_OFF, ARP_UP, ARP_DOWN, ARP_UP_DOWN or ARP_RANDOM
+#define CC_ARP_RATE 16    // 0 (quarter notes) to ARP_RATE_COUNT - 1 (fastest)
+#define CC_ARP_OCTAVES 17 // 1 to ARP_OCTAVES
+#define CC_PORTAMENTO 65
+
+// SysEx messages: F0 SYSEX_ID <command> ... F7
+#define SYSEX_ID 0x7d // non-commercial manufacturer ID
+#define SYSEX_PATCH_STORE 0x01 // <program> <patch bytes as high/low nibbles>
+#define SYSEX_TRACE 0x02       // <0 = off, 1 = on>
+#define SYSEX_TRACE_FRAME 0x03 // sent: <sequence> <dropped> <4-byte records>
+#define SYSEX_STREAM 0x04       // <song bytes as high/low nibbles>, none to start
+#define SYSEX_STREAM_END 0x05   // no more song bytes
+#define SYSEX_STREAM_CREDIT 0x06 // sent: <bytes the sender may send>
+#define SYSEX_SERIAL 0x07        // <rate>: register frames on the UART (regstream.h)
+                                 // sent: <rate> before switching, then <frames> <errors>
+                                 // as 14-bit pairs, low first, when back on MIDI
+#define SYSEX_ROUTE 0x08         // <channel 0-15> <kind> <chips> to route, none to ask
+                                 // sent: the 16 packed routes (route.h)
+#define SYSEX_SCHEDULE 0x09      // <latency ms, 0 = off> to set (schedule.h), none to ask
+                                 // sent: <latency> <events> <forced> <worst late us>
+                                 // <mean late us>, counts as 14-bit pairs, low first
+
+// register trace ring, in records; each record is four 7-bit bytes:
+//   0Vcc rrrr / 0vvv vvvv / 0ttt tttt / 0ttt tttt
+// cc = chips as passed to the shield's hook, V = value bit 7, t = 14-bit
+// delta. Chips 0 is a time extension carrying a 21-bit delta in the last
+// three bytes. Deltas are in 4us units.
+#define TRACE_SIZE 32
+#define TRACE_FRAME 8
+#define TRACE_IDLE_MS 10
+
+// software envelope stages
+#define ENV_IDLE 0
+#define ENV_ATTACK 1
+#define ENV_DECAY 2
+#define ENV_SUSTAIN 3
+#define ENV_RELEASE 4
+
+#define VOICE_COUNT 6
+
+// portamento: ramps step every GLIDE_TICK_MS and each step writes at most
+// GLIDE_WRITES tone period bytes, spread over the gliding voices
+#define GLIDE_TICK_MS 2
+#define GLIDE_WRITES 4
+
+// raw CC smoothing: moving parameters step every SMOOTH_TICK_MS and each
+// step writes at most SMOOTH_WRITES registers, however fast CCs come in
+#define SMOOTH_TICK_MS 2
+#define SMOOTH_WRITES 4
+#define SMOOTH_PARAMS 7 // tone periods A-C, noise period, levels A-C
+#define SLEW_FREQ 0
+#define SLEW_NOISE 1
+#define SLEW_LEVEL 2
+#define SLEW_KINDS 3
+#define SLEW_UNIT_MS 8
+
+// an arpeggio plays on the first channel of each chip; the others rest
+#define ARP_SILENT_SLOTS B00000110
+
+#if YMZ_DEBUG
 const byte hex[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B',
 		'C', 'D', 'E', 'F' };
+#endif
 
 MIDI_CREATE_DEFAULT_INSTANCE();
 
 // define an array of LEDs so we can do patterns (left to right)
 const int LEDS[LED_COUNT] = { RED_LED, GREEN_LED, PINK_LED, WHITE_LED };
-volatile unsigned long decay[LED_COUNT] = { 0, 0, 0, 0 };
-volatile uint8_t rawRegisters0[0xd];
-volatile uint8_t rawRegisters1[0xd];
-volatile bool latched = false;
+uint16_t decay[LED_COUNT]; // millis() at which each lit LED goes out
+byte litLeds = 0;
+
+#if YMZ_STAGING
+// raw channel writes held back while CC_LATCH is down or a burst of
+// messages is being read, by chip; only the dirty registers hold anything,
+// the shield's register file has the rest
+uint8_t staged[2][PSG_REGISTERS];
+uint16_t stagedDirty[2];
+bool latched = false;
+#endif
+#if YMZ_RAW
+bool latchHeld = false; // CC_LATCH is down
+bool bursting = false;  // loop() is running messages with raw writes staged
+#endif
+
+#if YMZ_SMOOTH
+// raw channel parameters slewing toward what their CCs last set, by chip.
+// Targets are kept as register bytes, so the CC handlers read and modify
+// them as they would the chip's; positions are in register units with 4
+// fraction bits.
+uint8_t smoothTargets[2][PSG_REGISTERS];
+uint16_t smoothPositions[2][SMOOTH_PARAMS];
+byte smoothing[2];                 // parameters still moving
+uint16_t slewRates[2][SLEW_KINDS]; // position change per step, 0 to jump
+byte smoothNext = 0; // parameter (chip * SMOOTH_PARAMS + n) writing first
+unsigned long smoothTime = 0;
+#endif
+
+// handler kind and target chips for each MIDI channel
+byte routes[ROUTE_CHANNELS];
+
+#if YMZ_MUSIC
+// software envelope state for each YMZ channel
+struct Voice {
+	byte image; // music channel whose patch the voice is playing
+	byte stage;
+	byte level;
+	uint16_t next; // millis() of the next step; steps are at most 255 ms apart
+};
+Voice voices[VOICE_COUNT];
+
+// selected program and its decoded register image for each music channel
+byte programs[3];
+PatchImage images[3];
+
+// YMZ channel playing each chip's envelope generator as a buzzer, or OFF
+byte envelopeVoice[2] = { OFF, OFF };
+
+// the note each music channel's voices are playing, so a note-off for a
+// note already replaced by a legato note-on leaves the new one sounding
+byte heldNotes[3] = { OFF, OFF, OFF };
+
+// portamento switch (CC65) and time (CC5) for each music channel
+bool portamento[3];
+byte portamentoTime[3];
+
+// dynamics for each music channel, as MIDI levels; the note's velocity
+// and pressure, then channel volume (CC7) and expression (CC11)
+byte velocities[3];
+byte pressures[3];
+byte volumes[3] = { 127, 127, 127 };
+byte expressions[3] = { 127, 127, 127 };
+
+// combined attenuation for each music channel, in whole level steps
+byte attenuations[3];
+
+// chord and arpeggio settings for each music channel
+byte chords[3];
+byte arpPatterns[3];
+byte arpRates[3];
+byte arpOctaves[3] = { 1, 1, 1 };
+
+// running arpeggio, stepped from the tempo clock: its line of tone periods
+// is worked out at note-on so a step is nothing but register writes. There
+// is one for the whole synth, so a music channel starting an arpeggio takes
+// it over from any other; notes without one only stop it on shared chips.
+uint16_t arpLine[ARP_SIZE];
+volatile byte arpLength = 0; // 0 when no arpeggio runs
+byte arpIndex;
+volatile byte arpChips; // chips the arpeggio plays on
+byte arpTicks;
+byte arpCountdown;
+bool arpRandom;
+volatile bool arpPending = false; // a step held back by a burst
+uint16_t arpPendingPeriod;
+uint16_t arpSeed = 0xace1;
+
+// tone period glide for each YMZ channel, periods in 16.16 fixed point
+struct Glide {
+	uint32_t period;
+	int32_t step;
+	uint16_t steps;
+	uint16_t target;
+};
+Glide glides[VOICE_COUNT];
+byte glideDirty = 0; // channels whose registers may lag their period
+byte glideNext = 0;  // channel the next step's write budget starts at
+unsigned long glideTime = 0;
+#endif
+
+#if YMZ_SAMPLES
+// drum sample playing on channel C of each chip, positions in 12.4 fixed
+// point; the Timer2 interrupt owns these while data is set
+struct SamplePlayer {
+	const byte *data;
+	uint16_t position;
+	uint16_t end;
+	byte step;
+	byte attenuation;
+};
+SamplePlayer samplePlayers[2];
+volatile byte sampleVoices = 0; // YMZ channels held by a sample (2 and 5)
+byte sampleKit = 0;
+#endif
+
+#if YMZ_TRACE
+// register trace state
+bool tracing = false;
+byte traceRing[TRACE_SIZE][4];
+volatile byte traceHead = 0;
+byte traceTail = 0;
+byte traceDropped = 0;
+byte traceSequence = 0;
+unsigned long traceTime = 0;
+unsigned long traceFlushed = 0;
+#endif
+
+#if YMZ_STREAM
+// song streamed over SysEx into the player; the sender may have at most
+// streamCredit bytes on the way, so the prefetch buffer never overflows
+hcYmzPlayer player;
+hcYmzStreamSource stream;
+bool streaming = false;
+byte streamCredit = 0;
+#endif
+
+#if YMZ_REGSTREAM
+// register frames on the UART in place of MIDI, see regstream.h
+byte serialRequest = OFF; // rate asked for by SYSEX_SERIAL, until loop() switches
+bool serialStreaming = false;
+byte frame[REGSTREAM_MAX];
+byte frameLength = 0;
+byte frameSize;
+unsigned long frameTime;
+uint16_t frameCount;
+uint16_t frameErrors;
+#endif
 
 // wrapper functions to allow pointer to functions
 
@@ -67,10 +268,6 @@ void setRegisterPsg1(byte reg, byte value) {
 	YMZ.setRegisterPsg1(reg, value);
 }
 
-byte getRegisterPsg(byte reg) {
-	return YMZ.getRegisterPsg(reg);
-}
-
 byte getRegisterPsg0(byte reg) {
 	return YMZ.getRegisterPsg0(reg);
 }
@@ -79,174 +276,1469 @@ byte getRegisterPsg1(byte reg) {
 	return YMZ.getRegisterPsg1(reg);
 }
 
-// array of getter/setter pairs for the PSG registers -- used to allow per-MIDI channel mapping
+// array of setters for the PSG registers by route target chips
+
+#if YMZ_RAW
+const regSet setters[4] =
+		{ 0, &setRegisterPsg0, &setRegisterPsg1, &setRegisterPsg };
+#endif
+
+// getter/setter pairs by chip, as used by YMZ channels 0-2 (PSG0) and 3-5 (PSG1)
+const regSet chipSetters[2] = { &setRegisterPsg0, &setRegisterPsg1 };
+const regGet chipGetters[2] = { &getRegisterPsg0, &getRegisterPsg1 };
+
+#if YMZ_SMOOTH
+/**
+ * The smoothed parameter a register is part of, or OFF.
+ */
+byte smoothParam(byte reg) {
+	if (reg < 0x06) {
+		return reg >> 1;
+	}
+	if (reg == 0x06) {
+		return 3;
+	}
+	return (reg >= 0x08 && reg <= 0x0a) ? reg - 4 : OFF;
+}
+
+byte paramRegister(byte param) {
+	return (param < 3) ? param << 1 : (param == 3) ? 0x06 : param + 4;
+}
+
+byte slewKind(byte param) {
+	return (param < 3) ? SLEW_FREQ : (param == 3) ? SLEW_NOISE : SLEW_LEVEL;
+}
+
+/**
+ * A parameter's value as the chip holds it, or as its target has it.
+ */
+uint16_t paramValue(byte chip, byte param, bool target) {
+	byte reg = paramRegister(param);
+	byte low = target ? smoothTargets[chip][reg] : chipGetters[chip](reg);
+	if (param < 3) {
+		byte high = target ? smoothTargets[chip][reg + 1] : chipGetters[chip](reg + 1);
+		return ((high & 0x0f) << 8) | low;
+	}
+	return low & ((param == 3) ? 0x1f : 0x0f);
+}
+
+/**
+ * Move a write to a slewing parameter's target, starting the move from
+ * where the chip is if it was not already under way. Returns false for a
+ * write to go straight through, which also ends any move: the parameter's
+ * kind does not slew on this chip, or the level is switching to or from
+ * the envelope.
+ */
+bool smoothRegister(byte chip, byte reg, byte value) {
+	byte param = smoothParam(reg);
+	if (param == OFF) {
+		return false;
+	}
+	byte bit = (1 << param);
+	if (!slewRates[chip][slewKind(param)]
+			|| (param > 3 && ((value | chipGetters[chip](reg)) & 0x10))) {
+		smoothing[chip] &= ~bit;
+		return false;
+	}
+	if (!(smoothing[chip] & bit)) {
+		byte first = paramRegister(param);
+		byte last = (param < 3) ? first + 1 : first;
+		for (byte r = first; r <= last; r++) {
+			smoothTargets[chip][r] = chipGetters[chip](r);
+		}
+		smoothPositions[chip][param] = paramValue(chip, param, false) << 4;
+		if (!smoothing[0] && !smoothing[1]) {
+			smoothTime = millis();
+		}
+		smoothing[chip] |= bit;
+	}
+	smoothTargets[chip][reg] = value;
+	return true;
+}
+
+/**
+ * Put the moving parameters of a kind, or of every kind for SLEW_KINDS,
+ * on their targets now.
+ */
+void settleSmoothing(byte chip, byte kind) {
+	for (byte param = 0; param < SMOOTH_PARAMS; param++) {
+		byte bit = (1 << param);
+		if (!(smoothing[chip] & bit) || (kind != SLEW_KINDS && slewKind(param) != kind)) {
+			continue;
+		}
+		byte first = paramRegister(param);
+		byte last = (param < 3) ? first + 1 : first;
+		for (byte r = first; r <= last; r++) {
+			if (chipGetters[chip](r) != smoothTargets[chip][r]) {
+				chipSetters[chip](r, smoothTargets[chip][r]);
+			}
+		}
+		smoothing[chip] &= ~bit;
+	}
+}
+
+/**
+ * Set how long a full-scale move of a kind of parameter takes on a raw
+ * channel's chips, in SLEW_UNIT_MS, or 0 for CCs to write straight
+ * through. The one division happens here.
+ */
+void setSlew(byte chips, byte kind, byte value) {
+	uint16_t scale = (kind == SLEW_FREQ) ? 0x0fff : (kind == SLEW_NOISE) ? 0x1f : 0x0f;
+	uint16_t rate = 0;
+	if (value) {
+		rate = ((uint32_t) scale << 4) * SMOOTH_TICK_MS / ((uint16_t) value * SLEW_UNIT_MS);
+		if (!rate) {
+			rate = 1;
+		}
+	}
+	for (byte chip = 0; chip < 2; chip++) {
+		if (chips & (1 << chip)) {
+			slewRates[chip][kind] = rate;
+			if (!rate) {
+				settleSmoothing(chip, kind);
+			}
+		}
+	}
+}
+
+/**
+ * Step every moving parameter toward its target, then bring the registers
+ * up to date round-robin, writing only those that differ from what the
+ * chip has and never more than SMOOTH_WRITES of them. A tone period whose
+ * bytes do not both fit in what is left waits for the next step, as a
+ * glide does.
+ */
+void updateSmoothing() {
+	if (!(smoothing[0] | smoothing[1]) || (long) (millis() - smoothTime) < SMOOTH_TICK_MS) {
+		return;
+	}
+	smoothTime += SMOOTH_TICK_MS;
+
+	for (byte chip = 0; chip < 2; chip++) {
+		for (byte param = 0; param < SMOOTH_PARAMS; param++) {
+			if (!(smoothing[chip] & (1 << param))) {
+				continue;
+			}
+			uint16_t &position = smoothPositions[chip][param];
+			uint16_t target = paramValue(chip, param, true) << 4;
+			uint16_t rate = slewRates[chip][slewKind(param)];
+			if (position < target) {
+				position = (target - position > rate) ? position + rate : target;
+			} else {
+				position = (position - target > rate) ? position - rate : target;
+			}
+		}
+	}
+
+	byte budget = SMOOTH_WRITES;
+	for (byte n = 0; n < 2 * SMOOTH_PARAMS; n++) {
+		byte chip = smoothNext / SMOOTH_PARAMS;
+		byte param = smoothNext % SMOOTH_PARAMS;
+		byte bit = (1 << param);
+		if (smoothing[chip] & bit) {
+			uint16_t position = smoothPositions[chip][param];
+			uint16_t value = (position + 8) >> 4;
+			byte reg = paramRegister(param);
+			byte low = (param < 3) ? value & 0xff : value;
+			bool writeLow = (chipGetters[chip](reg) != low);
+			bool writeHigh = (param < 3) && (chipGetters[chip](reg + 1) != (value >> 8));
+			if (writeLow + writeHigh > budget) {
+				return;
+			}
+			if (writeLow) {
+				chipSetters[chip](reg, low);
+			}
+			if (writeHigh) {
+				chipSetters[chip](reg + 1, value >> 8);
+			}
+			budget -= writeLow + writeHigh;
+			if (position == (paramValue(chip, param, true) << 4)) {
+				smoothing[chip] &= ~bit;
+			}
+		}
+		if (++smoothNext == 2 * SMOOTH_PARAMS) {
+			smoothNext = 0;
+		}
+	}
+}
+#endif
+
+/**
+ * Music channel state is kept per target: both chips, left, then right.
+ * MIDI channels routed to the same target share it.
+ */
+byte inline musicImage(byte chips) {
+	return (chips == ROUTE_BOTH) ? 0 : (chips == ROUTE_PSG1) ? 1 : 2;
+}
+
+/**
+ * The YMZ channels (bit n = channel n) of the chips in a route target.
+ */
+byte inline chipVoices(byte chips) {
+	return ((chips & ROUTE_PSG0) ? B00000111 : 0) | ((chips & ROUTE_PSG1) ? B00111000 : 0);
+}
+
+/**
+ * The YMZ channels a drum sample holds, which music leaves alone.
+ */
+byte inline sampleChannels() {
+#if YMZ_SAMPLES
+	return sampleVoices;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Pulse the red LED when MIDI activity is generated.
+ */
+void midiActivity(int led) {
+	digitalWrite(led, HIGH);
+	for (int i = 0; i < LED_COUNT; i++) {
+		if (LEDS[i] == led) {
+			decay[i] = (uint16_t) millis() + 10;
+			litLeds |= (1 << i);
+		}
+	}
+}
+
+/**
+ * Pulse the LED of each side a route target plays on.
+ */
+void routeActivity(byte chips, int left, int right) {
+	if (chips & ROUTE_PSG1) {
+		midiActivity(left);
+	}
+	if (chips & ROUTE_PSG0) {
+		midiActivity(right);
+	}
+}
+
+/**
+ * Decay the LEDs
+ */
+void decayLeds() {
+	uint16_t time = millis();
+	for (int i = 0; i < LED_COUNT; i++) {
+		if ((litLeds & (1 << i)) && (int16_t) (time - decay[i]) >= 0) {
+			litLeds &= ~(1 << i);
+			digitalWrite(LEDS[i], LOW);
+		}
+	}
+}
+
+#if YMZ_DEBUG
+void debugMidi(byte value) {
+	MIDI.sendControlChange(CC_DEBUG, value & 0x7f, 1);
+}
+
+void debugMidiBinary(byte value) {
+	for (int i = 7; i >= 0; i--) {
+		byte send = (value >> i) & 0x01;
+		MIDI.sendControlChange(CC_DEBUG, (send == 0) ? '0' : '1', 1);
+		if (i == 4) {
+			MIDI.sendControlChange(CC_DEBUG, ' ', 1);
+		}
+	}
+}
+
+void debugMidiHex(byte value) {
+	byte high = (value & B11110000) >> 4;
+	byte low = (value & B00001111);
+	MIDI.sendControlChange(CC_DEBUG, hex[high], 1);
+	MIDI.sendControlChange(CC_DEBUG, hex[low], 1);
+}
+
+void debugMidiStr(char * value) {
+	for (int i = 0; i < strlen(value); i++) {
+		MIDI.sendControlChange(CC_DEBUG, value[i], 1);
+	}
+}
+#endif
+
+#if YMZ_TRACE
+/**
+ * Queue one record in the trace ring. Returns false if the ring is full.
+ */
+bool traceRecord(byte b0, byte b1, byte b2, byte b3) {
+	byte next = (traceHead + 1) % TRACE_SIZE;
+	if (next == traceTail) {
+		return false;
+	}
+	traceRing[traceHead][0] = b0;
+	traceRing[traceHead][1] = b1;
+	traceRing[traceHead][2] = b2;
+	traceRing[traceHead][3] = b3;
+	traceHead = next;
+	return true;
+}
 
-const regSet setters[3] =
-		{ &setRegisterPsg, &setRegisterPsg1, &setRegisterPsg0 };
-const regGet getters[3] =
-		{ &getRegisterPsg, &getRegisterPsg1, &getRegisterPsg0 };
+/**
+ * Shield transaction hook: record the write with the time since the last
+ * recorded one. Dropped writes leave the time base alone so the next delta
+ * still covers the gap.
+ */
+void traceWrite(uint8_t chips, uint8_t reg, uint8_t data) {
+	unsigned long delta = (micros() - traceTime) >> 2;
+	while (delta >= 0x4000) {
+		unsigned long step = (delta > 0x1fffff) ? 0x1fffff : delta;
+		if (!traceRecord(0, (step >> 14) & 0x7f, (step >> 7) & 0x7f, step & 0x7f)) {
+			traceDropped++;
+			return;
+		}
+		traceTime += step << 2;
+		delta -= step;
+	}
+	if (!traceRecord((chips << 4) | (reg & 0x0f) | ((data & 0x80) >> 1) , data & 0x7f,
+			(delta >> 7) & 0x7f, delta & 0x7f)) {
+		traceDropped++;
+		return;
+	}
+	traceTime += delta << 2;
+}
 
 /**
- * Is the given MIDI channel used for normal music output?
+ * Send a trace frame once a full frame is queued, or whatever is queued
+ * once writes have gone quiet.
  */
-bool inline isMusicMode(byte channel) {
-	return (channel == CHANNEL_STEREO || channel == CHANNEL_LEFT
-			|| channel == CHANNEL_RIGHT);
+void flushTrace() {
+	byte pending = (TRACE_SIZE + traceHead - traceTail) % TRACE_SIZE;
+	if (!pending) {
+		traceFlushed = millis();
+		return;
+	}
+	if (pending < TRACE_FRAME && millis() - traceFlushed < TRACE_IDLE_MS) {
+		return;
+	}
+	if (pending > TRACE_FRAME) {
+		pending = TRACE_FRAME;
+	}
+
+	byte frame[4 + 4 * TRACE_FRAME];
+	frame[0] = SYSEX_ID;
+	frame[1] = SYSEX_TRACE_FRAME;
+	frame[2] = traceSequence++ & 0x7f;
+	frame[3] = (traceDropped > 0x7f) ? 0x7f : traceDropped;
+	traceDropped = 0;
+	for (byte i = 0; i < pending; i++) {
+		memcpy(frame + 4 + 4 * i, traceRing[traceTail], 4);
+		traceTail = (traceTail + 1) % TRACE_SIZE;
+	}
+	MIDI.sendSysEx(4 + 4 * pending, frame);
+	traceFlushed = millis();
+}
+
+/**
+ * Start or stop streaming register trace frames.
+ */
+void sysexTrace(byte * data, unsigned size) {
+	if (size != 5) {
+		return;
+	}
+	tracing = data[3];
+	traceHead = traceTail = 0;
+	traceDropped = 0;
+	traceTime = micros();
+	YMZ.setTrace(tracing ? traceWrite : 0);
+}
+#endif
+
+#if YMZ_MUSIC
+/**
+ * Scale a 4-bit level by a music channel's attenuation. Levels routed
+ * through the hardware envelope are left alone.
+ */
+byte scaleLevel(byte image, byte level) {
+	if (level & 0x10) {
+		return level;
+	}
+	byte steps = attenuations[image];
+	return (level > steps) ? level - steps : 0;
+}
+
+/**
+ * Bring one chip in line with a decoded patch image, writing only the
+ * registers that differ. The envelope shape is always written when owned
+ * since that is what restarts the hardware envelope.
+ *
+ * For buzzer patches, channel slot (0-2) of the chip plays note through
+ * the envelope generator; pass OFF for a chip without a buzzer channel.
+ * Slots set in silent (bit n = slot n) are left closed in the mixer, as
+ * are channels playing a sample.
+ */
+void applyPatchImage(byte chip, byte index, byte slot, byte note, byte silent) {
+	const PatchImage &image = images[index];
+	byte regs[PATCH_IMAGE_SIZE];
+	byte mask = image.mask;
+	memcpy(regs, image.regs, PATCH_IMAGE_SIZE);
+
+	// a channel playing a sample keeps its level and stays closed
+	byte reserved = (sampleChannels() >> (chip * 3)) & B00000111;
+	silent |= reserved;
+	mask &= ~(reserved << (0x08 - PATCH_IMAGE_BASE));
+	regs[0x07 - PATCH_IMAGE_BASE] |= silent | (silent << 3);
+	for (byte i = 0x08; i <= 0x0a; i++) {
+		regs[i - PATCH_IMAGE_BASE] = scaleLevel(index, regs[i - PATCH_IMAGE_BASE]);
+	}
+	if (slot != OFF) {
+		uint16_t ep = YMZ.getEnvelopePeriodMidi(note);
+		if (image.buzzer & BUZZER_TRIANGLE) {
+			ep = (ep + 1) >> 1;
+		}
+		regs[0x0b - PATCH_IMAGE_BASE] = ep & 0xff;
+		regs[0x0c - PATCH_IMAGE_BASE] = ep >> 8;
+		regs[0x08 + slot - PATCH_IMAGE_BASE] = 0x10;
+		if (!(image.buzzer & PATCH_SYNC)) {
+			regs[0x07 - PATCH_IMAGE_BASE] |= (1 << slot);
+		}
+		mask |= B01100000;
+	}
+	for (byte i = 0; i < PATCH_IMAGE_SIZE; i++) {
+		if (!(mask & (1 << i))) {
+			continue;
+		}
+		byte reg = PATCH_IMAGE_BASE + i;
+		if (reg == 0x0d || chipGetters[chip](reg) != regs[i]) {
+			chipSetters[chip](reg, regs[i]);
+		}
+	}
 }
 
 /**
- * Is the given MIDI channel used for noise output?
+ * Lock a buzzer channel's tone to its envelope: the tone period is a whole
+ * number of envelope steps, raised by octaves until it fits in 12 bits.
  */
-bool inline isNoiseMode(byte channel) {
-	return (channel == CHANNEL_NOISE_STEREO || channel == CHANNEL_NOISE_LEFT
-			|| channel == CHANNEL_NOISE_RIGHT);
+void syncBuzzerTone(byte voice, const PatchImage &image, byte note) {
+	uint16_t tp = YMZ.getEnvelopePeriodMidi(note);
+	if (image.buzzer & BUZZER_TRIANGLE) {
+		tp = ((tp + 1) >> 1) << 5;
+	} else {
+		tp <<= 4;
+	}
+	while (tp > 0x0fff) {
+		tp >>= 1;
+	}
+	YMZ.setTonePeriod(voice, tp);
+}
+
+/**
+ * Set the output level of a single YMZ channel from its envelope level,
+ * scaled by the dynamics of the music channel it plays. Nothing is
+ * written when the scaled level is already in the register.
+ */
+void setVoiceLevel(byte voice, byte level) {
+	byte chip = voice / 3;
+	byte reg = 0x08 + (voice % 3);
+	byte output = scaleLevel(voices[voice].image, level);
+	if (chipGetters[chip](reg) != output) {
+		chipSetters[chip](reg, output);
+	}
+}
+
+/**
+ * Combine a music channel's velocity, pressure, volume and expression into
+ * its attenuation in level steps. Pressure swells a note above its
+ * velocity but never below it.
+ */
+byte channelAttenuation(byte image) {
+	byte dynamics = (pressures[image] > velocities[image]) ? pressures[image] : velocities[image];
+	byte half = attenuation(dynamics) + attenuation(volumes[image])
+			+ attenuation(expressions[image]);
+	return half >> 1;
+}
+
+/**
+ * Recompute a music channel's attenuation and bring the level of each
+ * voice it plays up to date.
+ */
+void updateDynamics(byte image) {
+	byte steps = channelAttenuation(image);
+	if (steps == attenuations[image]) {
+		return;
+	}
+	attenuations[image] = steps;
+	for (byte i = 0; i < VOICE_COUNT; i++) {
+		if (voices[i].image == image && voices[i].stage != ENV_IDLE
+				&& envelopeVoice[i / 3] != i) {
+			setVoiceLevel(i, voices[i].level);
+		}
+	}
+}
+
+/**
+ * Turn off tone and noise for every YMZ channel in mask (bit n = channel n),
+ * with at most one mixer write per chip.
+ */
+void muteVoices(byte mask) {
+	for (byte chip = 0; chip < 2; chip++) {
+		byte bits = (mask >> (chip * 3)) & B00000111;
+		if (!bits) {
+			continue;
+		}
+		byte mixer = chipGetters[chip](0x07) | bits | (bits << 3);
+		if (mixer != chipGetters[chip](0x07)) {
+			chipSetters[chip](0x07, mixer);
+		}
+	}
+	for (byte i = 0; i < VOICE_COUNT; i++) {
+		if (mask & (1 << i)) {
+			voices[i].stage = ENV_IDLE;
+		}
+	}
+	for (byte chip = 0; chip < 2; chip++) {
+		if (envelopeVoice[chip] != OFF && (mask & (1 << envelopeVoice[chip]))) {
+			envelopeVoice[chip] = OFF;
+		}
+	}
+}
+
+/**
+ * Start the software envelope of a voice at note-on. The level register
+ * itself is written by the patch image.
+ */
+void startVoice(byte voice, byte image) {
+	const PatchImage &patch = images[image];
+	Voice &v = voices[voice];
+	v.image = image;
+	v.next = millis();
+	if (patch.attack) {
+		v.stage = ENV_ATTACK;
+		v.level = 0;
+		v.next += patch.attack;
+	} else if (patch.decay && patch.sustain < patch.level) {
+		v.stage = ENV_DECAY;
+		v.level = patch.level;
+		v.next += patch.decay;
+	} else {
+		v.stage = ENV_SUSTAIN;
+		v.level = patch.level;
+	}
+}
+
+/**
+ * Release a voice at note-off, either into its release stage or straight
+ * to silence. Returns true if the voice should be muted now.
+ */
+bool releaseVoice(byte voice) {
+	const PatchImage &patch = images[voices[voice].image];
+	Voice &v = voices[voice];
+	if (patch.release && v.level && v.stage != ENV_IDLE) {
+		v.stage = ENV_RELEASE;
+		v.next = millis() + patch.release;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Step the software envelopes, one level per step.
+ */
+void updateEnvelopes() {
+	uint16_t time = millis();
+	byte mute = 0;
+	for (byte i = 0; i < VOICE_COUNT; i++) {
+		Voice &v = voices[i];
+		if (v.stage == ENV_IDLE || v.stage == ENV_SUSTAIN || (int16_t) (time - v.next) < 0) {
+			continue;
+		}
+		const PatchImage &patch = images[v.image];
+		switch (v.stage) {
+		case ENV_ATTACK:
+			v.level++;
+			v.next += patch.attack;
+			if (v.level >= patch.level) {
+				v.level = patch.level;
+				v.stage = (patch.decay && patch.sustain < patch.level) ? ENV_DECAY : ENV_SUSTAIN;
+				v.next = time + patch.decay;
+			}
+			break;
+		case ENV_DECAY:
+			v.level--;
+			v.next += patch.decay;
+			if (v.level <= patch.sustain) {
+				v.stage = ENV_SUSTAIN;
+			}
+			break;
+		case ENV_RELEASE:
+			v.level--;
+			v.next += patch.release;
+			if (!v.level) {
+				mute |= (1 << i);
+			}
+			break;
+		}
+		setVoiceLevel(i, v.level);
+	}
+	if (mute) {
+		muteVoices(mute);
+	}
+}
+
+/**
+ * Glide length in steps for a music channel, 0 when portamento is off. The
+ * time control is squared for finer short glides: 0 to about 4 seconds.
+ */
+uint16_t glideSteps(byte image) {
+	if (!portamento[image]) {
+		return 0;
+	}
+	uint16_t time = portamentoTime[image];
+	return ((time * time) >> 2) / GLIDE_TICK_MS;
+}
+
+/**
+ * Set the tone of a YMZ channel to a MIDI note, gliding there over the
+ * given number of steps from wherever the channel is now. The one division
+ * happens here; each step is then a single add.
+ */
+void setVoiceTone(byte voice, byte note, uint16_t steps) {
+	Glide &g = glides[voice];
+	uint16_t tp = YMZ.getTonePeriodMidi(note);
+	g.target = tp;
+	if (!steps) {
+		g.steps = 0;
+		g.period = (uint32_t) tp << 16;
+		glideDirty &= ~(1 << voice);
+		YMZ.setTonePeriod(voice, tp);
+		return;
+	}
+	if (!g.steps) {
+		g.period = (uint32_t) YMZ.getTonePeriod(voice) << 16;
+	}
+	g.step = (((int32_t) tp << 16) - (int32_t) g.period) / (int32_t) steps;
+	g.steps = steps;
+	if (!glideDirty) {
+		glideTime = millis();
+	}
+	glideDirty |= (1 << voice);
+}
+
+/**
+ * Stop any glide on a YMZ channel whose tone is about to be set directly.
+ */
+void stopGlide(byte voice) {
+	glides[voice].steps = 0;
+	glideDirty &= ~(1 << voice);
+}
+
+/**
+ * Advance every glide by a step, then bring the tone registers up to date
+ * round-robin, writing only bytes that differ from what the chip has and
+ * never more than GLIDE_WRITES of them. A channel whose bytes do not all
+ * fit in what is left of the budget waits for the next step rather than
+ * sounding half-written.
+ */
+void updateGlides() {
+	if (!glideDirty || (long) (millis() - glideTime) < GLIDE_TICK_MS) {
+		return;
+	}
+	glideTime += GLIDE_TICK_MS;
+
+	for (byte i = 0; i < VOICE_COUNT; i++) {
+		Glide &g = glides[i];
+		if (!g.steps) {
+			continue;
+		}
+		g.period += g.step;
+		if (!--g.steps) {
+			g.period = (uint32_t) g.target << 16;
+		}
+	}
+
+	byte budget = GLIDE_WRITES;
+	for (byte n = 0; n < VOICE_COUNT; n++) {
+		byte i = glideNext;
+		byte bit = (1 << i);
+		if (!(glideDirty & bit)) {
+			if (++glideNext == VOICE_COUNT) {
+				glideNext = 0;
+			}
+			continue;
+		}
+		if (voices[i].stage == ENV_IDLE) {
+			stopGlide(i);
+			continue;
+		}
+
+		byte chip = (i >= 3);
+		byte reg = (i - 3 * chip) << 1;
+		uint16_t tp = glides[i].period >> 16;
+		byte low = tp & 0xff;
+		byte high = tp >> 8;
+		bool writeLow = (chipGetters[chip](reg) != low);
+		bool writeHigh = (chipGetters[chip](reg + 1) != high);
+		if (writeLow + writeHigh > budget) {
+			return;
+		}
+		if (writeLow) {
+			chipSetters[chip](reg, low);
+		}
+		if (writeHigh) {
+			chipSetters[chip](reg + 1, high);
+		}
+		budget -= writeLow + writeHigh;
+		if (!glides[i].steps) {
+			glideDirty &= ~bit;
+		}
+		if (++glideNext == VOICE_COUNT) {
+			glideNext = 0;
+		}
+	}
+}
+
+/**
+ * Play an arpeggio step on the first channel of each of its chips, writing
+ * only the bytes of the period that change.
+ */
+void writeArpStep(uint16_t tp) {
+	byte low = tp & 0xff;
+	byte high = tp >> 8;
+	for (byte chip = 0; chip < 2; chip++) {
+		if (!(arpChips & (1 << chip)) || voices[chip * 3].stage == ENV_IDLE) {
+			continue;
+		}
+		if (chipGetters[chip](0x00) != low) {
+			chipSetters[chip](0x00, low);
+		}
+		if (chipGetters[chip](0x01) != high) {
+			chipSetters[chip](0x01, high);
+		}
+	}
+}
+
+/**
+ * Tempo clock handler. It runs from the Timer1 interrupt, or from
+ * MIDI.read() when following an external clock, so it only counts down
+ * and plays the next precomputed step.
+ */
+void arpClock(uint32_t tick) {
+	if (!arpLength || --arpCountdown) {
+		return;
+	}
+	arpCountdown = arpTicks;
+	byte step;
+	if (arpRandom) {
+		// 16-bit Galois LFSR, scaled to the line without a division
+		arpSeed = (arpSeed >> 1) ^ (-(arpSeed & 1) & 0xb400);
+		step = ((arpSeed & 0xff) * arpLength) >> 8;
+	} else {
+		step = arpIndex;
+		if (++arpIndex == arpLength) {
+			arpIndex = 0;
+		}
+	}
+#if YMZ_RAW
+	// raw writes staged by a burst came before this step, so it waits for
+	// them to be committed (playPendingArp())
+	if (bursting) {
+		arpPending = true;
+		arpPendingPeriod = arpLine[step];
+		return;
+	}
+#endif
+	writeArpStep(arpLine[step]);
+}
+
+/**
+ * Play the arpeggio step a burst held back, if there is one.
+ */
+void playPendingArp() {
+	uint8_t sreg = SREG;
+	cli();
+	if (arpPending) {
+		arpPending = false;
+		writeArpStep(arpPendingPeriod);
+	}
+	SREG = sreg;
+}
+
+/**
+ * Lay out a music channel's arpeggio over the chord on pitch, across its
+ * octaves and in its pattern, then hand it to the clock and play the
+ * first step. Lines can be longer than there are channels to play them.
+ */
+void startArp(byte image, byte chips, byte pitch, const Chord &chord) {
+	uint16_t line[ARP_SIZE];
+	byte length = 0;
+	for (byte octave = 0; octave < arpOctaves[image]; octave++) {
+		for (byte i = 0; i < chord.size; i++) {
+			byte note = pitch + chord.notes[i] + 12 * octave;
+			if (note < 128) {
+				line[length++] = YMZ.getTonePeriodMidi(note);
+			}
+		}
+	}
+	if (arpPatterns[image] == ARP_DOWN) {
+		for (byte i = 0; i < length / 2; i++) {
+			uint16_t tp = line[i];
+			line[i] = line[length - 1 - i];
+			line[length - 1 - i] = tp;
+		}
+	} else if (arpPatterns[image] == ARP_UP_DOWN) {
+		for (byte i = length - 1; i-- > 1;) {
+			line[length + (length - 2 - i)] = line[i];
+		}
+		if (length > 2) {
+			length += length - 2;
+		}
+	}
+
+	uint8_t sreg = SREG;
+	cli();
+	memcpy(arpLine, line, length * sizeof(uint16_t));
+	arpLength = length;
+	arpIndex = (length > 1) ? 1 : 0;
+	arpTicks = arpRateTicks(arpRates[image]);
+	arpCountdown = arpTicks;
+	arpRandom = (arpPatterns[image] == ARP_RANDOM);
+	arpChips = chips;
+	arpPending = false;
+	writeArpStep(line[0]);
+	SREG = sreg;
+}
+
+/**
+ * Select the patch a music channel plays. Unknown or empty programs leave
+ * the current patch in place.
+ */
+void selectProgram(byte image, byte program) {
+	Patch patch;
+	if (!loadPatch(program, patch)) {
+		return;
+	}
+	programs[image] = program;
+	decodePatch(patch, images[image]);
+}
+
+/**
+ * Program change on a music channel.
+ */
+void musicProgramChange(byte chips, byte number) {
+	routeActivity(chips, RED_LED, GREEN_LED);
+	selectProgram(musicImage(chips), number);
+}
+
+/**
+ * Store a user patch sent as F0 SYSEX_ID SYSEX_PATCH_STORE <program>
+ * <nibbles> F7, each patch byte sent high nibble first.
+ */
+void sysexPatchStore(byte * data, unsigned size) {
+	if (size != 4 + 2 * sizeof(Patch) + 1) {
+		return;
+	}
+	Patch patch;
+	byte * raw = (byte *) &patch;
+	for (byte i = 0; i < sizeof(Patch); i++) {
+		raw[i] = ((data[4 + 2 * i] & 0x0f) << 4) | (data[5 + 2 * i] & 0x0f);
+	}
+	if (!storePatch(data[3], patch)) {
+		return;
+	}
+
+	// pick up the new contents on channels already playing the program
+	for (byte i = 0; i < 3; i++) {
+		if (programs[i] == data[3]) {
+			decodePatch(patch, images[i]);
+		}
+	}
+}
+#endif
+
+#if YMZ_STREAM
+/**
+ * Play a Hardchord Music block streamed as F0 SYSEX_ID SYSEX_STREAM F7 to
+ * start, then SYSEX_STREAM messages carrying song bytes as nibble pairs
+ * and SYSEX_STREAM_END. The sender waits for SYSEX_STREAM_CREDIT before
+ * sending and never has more bytes outstanding than it was granted.
+ */
+void sysexStream(byte * data, unsigned size) {
+	if (size == 4) {
+		stream.reset();
+		player.play(stream);
+		streaming = true;
+		streamCredit = 0;
+		return;
+	}
+	if (!streaming) {
+		return;
+	}
+	for (unsigned i = 3; i + 2 < size; i += 2) {
+		stream.write(((data[i] & 0x0f) << 4) | (data[i + 1] & 0x0f));
+		if (streamCredit) {
+			streamCredit--;
+		}
+	}
+}
+
+void sysexStreamEnd() {
+	stream.finish();
+	streaming = false;
+}
+
+/**
+ * Grant the stream sender the buffer space freed up since the last grant,
+ * a quarter of the buffer at a time.
+ */
+void grantStream() {
+	if (!player.isPlaying()) {
+		streaming = false;
+		return;
+	}
+	byte grant = stream.space() - streamCredit;
+	if (grant < STREAM_SIZE / 4) {
+		return;
+	}
+	byte message[3] = { SYSEX_ID, SYSEX_STREAM_CREDIT, grant };
+	MIDI.sendSysEx(3, message);
+	streamCredit += grant;
+}
+#endif
+
+/**
+ * Route a MIDI channel with F0 SYSEX_ID SYSEX_ROUTE <channel> <kind>
+ * <chips> F7, stored in EEPROM. A music channel moved elsewhere lets go of
+ * its voices first. Either way, and for an empty message, the whole table
+ * is sent back.
+ */
+void sysexRoute(byte * data, unsigned size) {
+	if (size == 7 && data[3] < ROUTE_CHANNELS) {
+		byte old = routes[data[3]];
+		if (storeRoute(routes, data[3], data[4], data[5]) && routes[data[3]] != old
+				&& routeKind(old) == ROUTE_MUSIC) {
+#if YMZ_MUSIC
+			byte image = musicImage(routeChips(old));
+			byte mute = 0;
+			for (byte i = 0; i < VOICE_COUNT; i++) {
+				if (voices[i].image == image && voices[i].stage != ENV_IDLE) {
+					mute |= (1 << i);
+				}
+			}
+			muteVoices(mute);
+			heldNotes[image] = OFF;
+#endif
+		}
+#if YMZ_SMOOTH
+		// moves a raw channel left under way land now, not on a new owner
+		if (routes[data[3]] != old && routeKind(old) == ROUTE_RAW) {
+			for (byte chip = 0; chip < 2; chip++) {
+				if (routeChips(old) & (1 << chip)) {
+					settleSmoothing(chip, SLEW_KINDS);
+				}
+			}
+		}
+#endif
+	} else if (size != 4) {
+		return;
+	}
+	byte message[2 + ROUTE_CHANNELS] = { SYSEX_ID, SYSEX_ROUTE };
+	memcpy(message + 2, routes, ROUTE_CHANNELS);
+	MIDI.sendSysEx(sizeof(message), message);
+}
+
+#if YMZ_SCHEDULE
+/**
+ * Set the scheduling latency with F0 SYSEX_ID SYSEX_SCHEDULE <ms> F7, which
+ * starts the statistics over, or send them back for an empty message.
+ */
+void sysexSchedule(byte * data, unsigned size) {
+	if (size == 5) {
+		setScheduleOffset(data[3]);
+		return;
+	}
+	if (size != 4) {
+		return;
+	}
+	const ScheduleStats &stats = scheduleStats();
+	uint16_t values[4] = { stats.events, stats.forced, stats.worstLate,
+			(uint16_t) (stats.events ? stats.totalLate / stats.events : 0) };
+	byte message[3 + 2 * 4] = { SYSEX_ID, SYSEX_SCHEDULE, scheduleOffset() };
+	for (byte i = 0; i < 4; i++) {
+		uint16_t value = (values[i] > 0x3fff) ? 0x3fff : values[i];
+		message[3 + 2 * i] = value & 0x7f;
+		message[4 + 2 * i] = value >> 7;
+	}
+	MIDI.sendSysEx(sizeof(message), message);
+}
+#endif
+
+#if YMZ_MUSIC
+/**
+ * Note-on on a music channel: the chord on the voices of its chips.
+ */
+void musicNoteOn(byte chips, byte pitch, byte velocity) {
+	routeActivity(chips, RED_LED, GREEN_LED);
+
+	// TODO handle polyphony within a channel.
+	byte image = musicImage(chips);
+	byte mask = chipVoices(chips) & ~sampleChannels();
+	const PatchImage &patch = images[image];
+	Chord chord;
+	loadChord(chords[image], chord);
+
+	// voices are not sounding yet, so only the attenuation changes here
+	velocities[image] = velocity;
+	pressures[image] = 0;
+	attenuations[image] = channelAttenuation(image);
+
+	// a buzzer patch gives each chip's envelope generator to the chord root
+	bool buzzer = (patch.buzzer & PATCH_BUZZER);
+	for (byte chip = 0; chip < 2; chip++) {
+		if (chips & (1 << chip)) {
+			envelopeVoice[chip] = buzzer ? chip * 3 : OFF;
+		}
+	}
+
+	// buzzer notes are envelope periods, which the arpeggio does not step
+	bool arp = (arpPatterns[image] != ARP_OFF && !buzzer);
+	if (arpChips & chips) {
+		arpLength = 0;
+		arpPending = false;
+	}
+
+	uint16_t steps = glideSteps(image);
+	heldNotes[image] = pitch;
+	byte skipped = 0;
+	for (byte i = 0; i < VOICE_COUNT; i++) {
+		if (!(mask & (1 << i))) {
+			continue;
+		}
+		byte note = pitch + chord.notes[i % chord.size];
+		bool sounding = (voices[i].stage != ENV_IDLE);
+		if (note > 127 && !arp && envelopeVoice[i / 3] != i) {
+			// as in the arpeggio, chord notes above the MIDI range are left out
+			stopGlide(i);
+			voices[i].stage = ENV_IDLE;
+			skipped |= (1 << i);
+			continue;
+		}
+		if (arp) {
+			stopGlide(i);
+			if (ARP_SILENT_SLOTS & (1 << (i % 3))) {
+				voices[i].stage = ENV_IDLE;
+			} else {
+				startVoice(i, image);
+			}
+			continue;
+		}
+		startVoice(i, image);
+		if (envelopeVoice[i / 3] != i) {
+			// only a sounding channel has a pitch to glide from
+			setVoiceTone(i, note, sounding ? steps : 0);
+			continue;
+		}
+		stopGlide(i);
+
+		// the envelope sets the level; tone only sounds when synced to it
+		voices[i].stage = ENV_SUSTAIN;
+		voices[i].level = 0;
+		if (patch.buzzer & PATCH_SYNC) {
+			syncBuzzerTone(i, patch, pitch);
+		}
+	}
+	if (arp) {
+		startArp(image, chips, pitch, chord);
+	}
+
+	// patch registers last so the mixer opens on the new pitches
+	for (byte chip = 0; chip < 2; chip++) {
+		if (!(chips & (1 << chip))) {
+			continue;
+		}
+		byte slot = envelopeVoice[chip];
+		applyPatchImage(chip, image, (slot == OFF) ? OFF : slot % 3, pitch,
+				(arp ? ARP_SILENT_SLOTS : 0) | ((skipped >> (chip * 3)) & B00000111));
+	}
+}
+
+/**
+ * Channel pressure on a music channel swells the held note.
+ */
+void musicAfterTouch(byte chips, byte pressure) {
+	byte image = musicImage(chips);
+	pressures[image] = pressure;
+	updateDynamics(image);
+}
+
+/**
+ * Key pressure counts as channel pressure when it is for the held note.
+ */
+void musicAfterTouchPoly(byte chips, byte pitch, byte pressure) {
+	if (pitch == heldNotes[musicImage(chips)]) {
+		musicAfterTouch(chips, pressure);
+	}
+}
+
+/**
+ * Note-off on a music channel releases the voices still playing its note.
+ */
+void musicNoteOff(byte chips, byte pitch, byte velocity) {
+	routeActivity(chips, RED_LED, GREEN_LED);
+
+	byte image = musicImage(chips);
+	if (pitch != heldNotes[image]) {
+		return;
+	}
+	heldNotes[image] = OFF;
+	byte mask = chipVoices(chips);
+	byte mute = 0;
+	for (byte i = 0; i < VOICE_COUNT; i++) {
+		if ((mask & (1 << i)) && voices[i].image == image && releaseVoice(i)) {
+			mute |= (1 << i);
+		}
+	}
+	muteVoices(mute);
+}
+#endif
+
+#if YMZ_SAMPLES
+/**
+ * The next level of a chip's sample, or OFF when it has ended.
+ */
+byte inline sampleLevel(SamplePlayer &player) {
+	if (player.position >= player.end) {
+		return OFF;
+	}
+	byte pair = pgm_read_byte(&player.data[player.position >> 5]);
+	byte level = (player.position & 0x10) ? (pair & 0x0f) : (pair >> 4);
+	player.position += player.step;
+	return (level > player.attenuation) ? level - player.attenuation : 0;
+}
+
+/**
+ * Write the next level of each playing sample. Channel C's level register
+ * stays latched between interrupts, so most writes are the data phase
+ * alone, and a level both chips share goes out once. A chip whose sample
+ * has ended is left at level 0 with its channel given back to music.
+ */
+ISR(TIMER2_COMPA_vect) {
+	byte levels[2];
+	for (byte chip = 0; chip < 2; chip++) {
+		SamplePlayer &player = samplePlayers[chip];
+		if (!player.data) {
+			levels[chip] = OFF;
+			continue;
+		}
+		levels[chip] = sampleLevel(player);
+		if (levels[chip] == OFF) {
+			player.data = 0;
+			sampleVoices &= ~(1 << (chip * 3 + 2));
+			levels[chip] = 0;
+		}
+	}
+	if (levels[0] == levels[1] && levels[0] != OFF) {
+		if (levels[0] != YMZ.getRegisterPsg0(0x0a) || levels[1] != YMZ.getRegisterPsg1(0x0a)) {
+			YMZ.streamRegisterPsg(0x0a, levels[0]);
+		}
+	} else {
+		if (levels[0] != OFF && levels[0] != YMZ.getRegisterPsg0(0x0a)) {
+			YMZ.streamRegisterPsg0(0x0a, levels[0]);
+		}
+		if (levels[1] != OFF && levels[1] != YMZ.getRegisterPsg1(0x0a)) {
+			YMZ.streamRegisterPsg1(0x0a, levels[1]);
+		}
+	}
+	if (!sampleVoices) {
+		TIMSK2 &= ~_BV(OCIE2A);
+	}
+}
+
+/**
+ * Note-on on a sample channel: a one-shot hit from the selected kit on
+ * channel C of its chips, taken from music until the sample ends.
+ */
+void sampleNoteOn(byte chips, byte pitch, byte velocity) {
+	Sample sample;
+	byte step;
+	if (!velocity || !loadSample(sampleKit, pitch, sample, step)) {
+		return;
+	}
+	routeActivity(chips, RED_LED, GREEN_LED);
+	// in 32 bits: with the AVR's 16-bit int, any step above 8 would wrap
+	step = (uint32_t) step * SAMPLE_SOURCE_RATE / SAMPLE_RATE;
+	byte steps = attenuation(velocity) >> 1;
+	for (byte chip = 0; chip < 2; chip++) {
+		if (!(chips & (1 << chip))) {
+			continue;
+		}
+		byte voice = chip * 3 + 2;
+#if YMZ_MUSIC
+		stopGlide(voice);
+		voices[voice].stage = ENV_IDLE;
+		if (envelopeVoice[chip] == voice) {
+			envelopeVoice[chip] = OFF;
+		}
+#endif
+		byte mixer = chipGetters[chip](0x07) | B00100100;
+		if (mixer != chipGetters[chip](0x07)) {
+			chipSetters[chip](0x07, mixer);
+		}
+		SamplePlayer &player = samplePlayers[chip];
+		uint8_t sreg = SREG;
+		cli();
+		player.data = sample.data;
+		player.position = 0;
+		player.end = sample.length << 4;
+		player.step = step;
+		player.attenuation = steps;
+		sampleVoices |= (1 << voice);
+		SREG = sreg;
+	}
+
+	// CTC mode, started or restarted with the next level due a period on
+	TCCR2A = _BV(WGM21);
+	TCCR2B = SAMPLE_TIMER_CLOCK;
+	TCNT2 = 0;
+	OCR2A = SAMPLE_TIMER_COUNTS - 1;
+	TIMSK2 |= _BV(OCIE2A);
+}
+
+/**
+ * Program change on a sample channel selects the kit.
+ */
+void sampleProgramChange(byte chips, byte number) {
+	if (number < SAMPLE_KIT_COUNT) {
+		sampleKit = number;
+	}
+}
+#endif
+
+#if YMZ_RAW
+/**
+ * Read a raw channel's register: the staged value if one is waiting,
+ * otherwise the chip's. Both chips read PSG0, which mirrors PSG1 unless a
+ * one-sided channel has written it since.
+ */
+byte getRegister(byte chips, byte reg) {
+	byte chip = (chips == ROUTE_PSG1) ? 1 : 0;
+#if YMZ_SMOOTH
+	byte param = smoothParam(reg);
+	if (param != OFF && (smoothing[chip] & (1 << param))) {
+		return smoothTargets[chip][reg];
+	}
+#endif
+	if (stagedDirty[chip] & (1 << reg)) {
+		return staged[chip][reg];
+	}
+	return chipGetters[chip](reg);
+}
+
+/**
+ * Write a raw channel's register, or stage it while latched. On a chip
+ * where it slews, the value becomes its target instead, latched or not.
+ */
+void setRegister(byte chips, byte reg, byte value) {
+#if YMZ_SMOOTH
+	for (byte chip = 0; chip < 2; chip++) {
+		if ((chips & (1 << chip)) && smoothRegister(chip, reg, value)) {
+			chips &= ~(1 << chip);
+		}
+	}
+	if (!chips) {
+		return;
+	}
+#endif
+	if (!latched) {
+		setters[chips](reg, value);
+		return;
+	}
+	for (byte chip = 0; chip < 2; chip++) {
+		if (chips & (1 << chip)) {
+			staged[chip][reg] = value;
+			stagedDirty[chip] |= (1 << reg);
+		}
+	}
 }
+#endif
 
+#if YMZ_STAGING
 /**
- * Is the given MIDI channel used for raw register output?
+ * Start staging raw writes. Nothing is copied: a register reads from the
+ * chips until something is staged for it.
  */
-bool inline isRawMode(byte channel) {
-	return (channel == CHANNEL_RAW_STEREO || channel == CHANNEL_RAW_LEFT
-			|| channel == CHANNEL_RAW_RIGHT);
+void latchRegisters() {
+	stagedDirty[0] = 0;
+	stagedDirty[1] = 0;
+	latched = true;
 }
 
 /**
- * Pulse the red LED when MIDI activity is generated.
+ * Write the staged registers that changed. A register staged to the same
+ * value on both chips goes out as one stereo write; the envelope shape is
+ * always written since that restarts the envelope.
  */
-void midiActivity(int led) {
-	digitalWrite(led, HIGH);
-	for (int i = 0; i < LED_COUNT; i++) {
-		if (LEDS[i] == led) {
-			decay[i] = millis() + 10L;
+void commitRegisters() {
+	latched = false;
+	for (byte reg = 0; reg < PSG_REGISTERS; reg++) {
+		uint16_t bit = (1 << reg);
+		bool write[2];
+		for (byte chip = 0; chip < 2; chip++) {
+			write[chip] = (stagedDirty[chip] & bit)
+					&& (reg == 0x0d || chipGetters[chip](reg) != staged[chip][reg]);
+		}
+		if (write[0] && write[1] && staged[0][reg] == staged[1][reg]) {
+			YMZ.setRegisterPsg(reg, staged[0][reg]);
+			continue;
+		}
+		for (byte chip = 0; chip < 2; chip++) {
+			if (write[chip]) {
+				chipSetters[chip](reg, staged[chip][reg]);
+			}
 		}
 	}
+	stagedDirty[0] = 0;
+	stagedDirty[1] = 0;
 }
+#endif
 
 /**
- * Decay the LEDs
+ * Listen to MIDI on the UART.
  */
-void decayLeds() {
-	unsigned long time = millis();
-	for (int i = 0; i < LED_COUNT; i++) {
-		if (decay[i] < time || decay[i] > (time + 30000L)) {
-			decay[i] = 0L;
-			digitalWrite(LEDS[i], LOW);
-		}
-	}
-}
-
-void debugMidi(byte value) {
-	MIDI.sendControlChange(CC_DEBUG, value & 0x7f, 1);
+void beginMidi() {
+	MIDI.begin(MIDI_CHANNEL_OMNI);
+	MIDI.turnThruOff();
+#if YMZ_SCHEDULE
+	restartStamps();
+#endif
 }
 
-void debugMidiBinary(byte value) {
-	for (int i = 7; i >= 0; i--) {
-		byte send = (value >> i) & 0x01;
-		MIDI.sendControlChange(CC_DEBUG, (send == 0) ? '0' : '1', 1);
-		if (i == 4) {
-			MIDI.sendControlChange(CC_DEBUG, ' ', 1);
-		}
+#if YMZ_REGSTREAM
+/**
+ * Acknowledge SYSEX_SERIAL over MIDI, then hand the UART to register
+ * frames at the requested rate.
+ */
+void beginSerialStream(byte rate) {
+#if YMZ_SCHEDULE
+	flushSchedule();
+#endif
+#if YMZ_SMOOTH
+	settleSmoothing(0, SLEW_KINDS);
+	settleSmoothing(1, SLEW_KINDS);
+#endif
+	if (latched) {
+		commitRegisters();
 	}
+	byte message[3] = { SYSEX_ID, SYSEX_SERIAL, rate };
+	MIDI.sendSysEx(3, message);
+	Serial.flush();
+	Serial.begin(regStreamBaud(rate));
+	serialStreaming = true;
+	frameLength = 0;
+	frameTime = millis();
+	frameCount = 0;
+	frameErrors = 0;
 }
 
-void debugMidiHex(byte value) {
-	byte high = (value & B11110000) >> 4;
-	byte low = (value & B00001111);
-	MIDI.sendControlChange(CC_DEBUG, hex[high], 1);
-	MIDI.sendControlChange(CC_DEBUG, hex[low], 1);
-}
-
-void debugMidiStr(char * value) {
-	for (int i = 0; i < strlen(value); i++) {
-		MIDI.sendControlChange(CC_DEBUG, value[i], 1);
+/**
+ * Go back to MIDI and report how the stream went.
+ */
+void endSerialStream() {
+	if (latched) {
+		commitRegisters();
 	}
+	serialStreaming = false;
+	Serial.flush();
+	beginMidi();
+	byte message[6] = { SYSEX_ID, SYSEX_SERIAL, (byte) (frameCount & 0x7f),
+			(byte) ((frameCount >> 7) & 0x7f), (byte) (frameErrors & 0x7f),
+			(byte) ((frameErrors >> 7) & 0x7f) };
+	MIDI.sendSysEx(6, message);
 }
 
 /**
- * Process MIDI NOTE ON messages.
+ * Stage a checked frame, committing it unless more are to follow.
  */
-void handleNoteOn(byte channel, byte pitch, byte velocity) {
-	if (!isMusicMode(channel)) {
+void applyFrame() {
+	byte chips = frame[1] & REGSTREAM_CHIPS;
+	uint16_t dirty = frame[2] | (frame[3] << 8);
+	if (!chips && !dirty) {
+		endSerialStream();
 		return;
 	}
-	switch (channel) {
-	case CHANNEL_STEREO:
-		midiActivity(RED_LED);
-		midiActivity(GREEN_LED);
-		break;
-	case CHANNEL_LEFT:
-		midiActivity(RED_LED);
-		break;
-	case CHANNEL_RIGHT:
-		midiActivity(GREEN_LED);
-		break;
+	frameCount++;
+	if (!latched) {
+		latchRegisters();
 	}
-
-	// TODO handle multiple channels (stereo/left/right) as well as polyphony.
-	YMZ.setNote(0, pitch);
-	YMZ.setNote(1, pitch + 4);
-	YMZ.setNote(2, pitch + 7);
-	YMZ.setNote(3, pitch);
-	YMZ.setNote(4, pitch + 4);
-	YMZ.setNote(5, pitch + 7);
-	uint16_t period = YMZ.getTonePeriod(0);
-}
-
-void handleNoteOff(byte channel, byte pitch, byte velocity) {
-	if (!isMusicMode(channel)) {
-		return;
+	byte *value = frame + 4;
+	for (byte reg = 0; reg < PSG_REGISTERS; reg++) {
+		if (!(dirty & (1 << reg))) {
+			continue;
+		}
+		for (byte chip = 0; chip < 2; chip++) {
+			if (chips & (1 << chip)) {
+				staged[chip][reg] = *value;
+				stagedDirty[chip] |= (1 << reg);
+			}
+		}
+		value++;
 	}
-	switch (channel) {
-	case CHANNEL_STEREO:
-		midiActivity(RED_LED);
-		midiActivity(GREEN_LED);
-		break;
-	case CHANNEL_LEFT:
-		midiActivity(RED_LED);
-		break;
-	case CHANNEL_RIGHT:
-		midiActivity(GREEN_LED);
-		break;
+	if (!(frame[1] & REGSTREAM_MORE)) {
+		commitRegisters();
 	}
+}
 
-	// TODO handle multiple channels (stereo/left/right) as well as polyphony.
-
-	YMZ.setNote(0, OFF);
-	YMZ.setNote(1, OFF);
-	YMZ.setNote(2, OFF);
-	YMZ.setNote(3, OFF);
-	YMZ.setNote(4, OFF);
-	YMZ.setNote(5, OFF);
+/**
+ * Drop a bad frame, along with anything it was to be committed with, and
+ * look for the next sync byte.
+ */
+void rejectFrame() {
+	frameErrors++;
+	frameLength = 0;
+	latched = false;
+	stagedDirty[0] = 0;
+	stagedDirty[1] = 0;
 }
 
-void writeAllRegisters(byte channel) {
-	if (!isRawMode(channel)) {
-		return;
-	}
-	for (int i = 0; i < 14; i++) {
-		switch (channel) {
-		case CHANNEL_RAW_STEREO:
-			setRegisterPsg1(i, rawRegisters1[i]);
-			setRegisterPsg0(i, rawRegisters0[i]);
-			break;
-		case CHANNEL_RAW_LEFT:
-			setRegisterPsg1(i, rawRegisters1[i]);
-			break;
-		case CHANNEL_RAW_RIGHT:
-			setRegisterPsg0(i, rawRegisters0[i]);
-			break;
+/**
+ * Take in what the UART has of register frames. Nothing touches the chips
+ * until a whole frame has passed its CRC.
+ */
+void pollRegisterStream() {
+	while (Serial.available()) {
+		byte value = Serial.read();
+		if (!frameLength && value != REGSTREAM_SYNC) {
+			continue;
+		}
+		frame[frameLength++] = value;
+		if (frameLength == 4) {
+			uint16_t dirty = frame[2] | (frame[3] << 8);
+			if (dirty >> PSG_REGISTERS || (frame[1] & ~(REGSTREAM_CHIPS | REGSTREAM_MORE))) {
+				rejectFrame();
+				continue;
+			}
+			frameSize = 5;
+			for (; dirty; dirty &= dirty - 1) {
+				frameSize++;
+			}
+		}
+		if (frameLength < 4 || frameLength < frameSize) {
+			continue;
+		}
+		byte crc = 0;
+		for (byte i = 1; i < frameSize - 1; i++) {
+			crc = regStreamCrc(crc, frame[i]);
+		}
+		if (crc != frame[frameSize - 1]) {
+			rejectFrame();
+			continue;
+		}
+		frameLength = 0;
+		frameTime = millis();
+		applyFrame();
+		if (!serialStreaming) {
+			return;
 		}
 	}
-}
-
-void setChannelFreqMsb(byte channel, byte reg, byte value) {
-	if (!isRawMode(channel)) {
-		return;
+	if (millis() - frameTime > REGSTREAM_IDLE_MS) {
+		endSerialStream();
 	}
+}
+#endif
 
+#if YMZ_RAW
+void setChannelFreqMsb(byte chips, byte reg, byte value) {
 	// get current value
-	uint8_t oldFine = getters[channel - CHANNEL_RAW_STEREO](reg);
-	uint8_t oldRough = getters[channel - CHANNEL_RAW_STEREO](reg + 1);
+	uint8_t oldFine = getRegister(chips, reg);
+	uint8_t oldRough = getRegister(chips, reg + 1);
 
 	// shift lower 4 bits of oldRough measurement up 8 bits and add oldFine; giving 12-bit number [0..4095]
 	uint16_t buf = (uint16_t) (oldRough & B00001111);
@@ -267,36 +1759,14 @@ void setChannelFreqMsb(byte channel, byte reg, byte value) {
 	uint8_t newRough = ((uint8_t) (buf >> 8)) & B00001111; // upper 4 bits
 
 	// update
-	switch (channel) {
-	case CHANNEL_RAW_STEREO:
-		rawRegisters0[reg] = newFine;
-		rawRegisters0[reg + 1] = newRough;
-		rawRegisters1[reg] = newFine;
-		rawRegisters1[reg + 1] = newRough;
-		break;
-	case CHANNEL_RAW_LEFT:
-		rawRegisters1[reg] = newFine;
-		rawRegisters1[reg + 1] = newRough;
-		break;
-	case CHANNEL_RAW_RIGHT:
-		rawRegisters0[reg] = newFine;
-		rawRegisters0[reg + 1] = newRough;
-		break;
-	}
-	if (!latched) {
-		setters[channel - CHANNEL_RAW_STEREO](reg, newFine);
-		setters[channel - CHANNEL_RAW_STEREO](reg + 1, newRough);
-	}
+	setRegister(chips, reg, newFine);
+	setRegister(chips, reg + 1, newRough);
 }
 
-void setChannelFreqLsb(byte channel, byte reg, byte value) {
-	if (!isRawMode(channel)) {
-		return;
-	}
-
+void setChannelFreqLsb(byte chips, byte reg, byte value) {
 	// get current value
-	uint8_t oldFine = getters[channel - CHANNEL_RAW_STEREO](reg);
-	uint8_t oldRough = getters[channel - CHANNEL_RAW_STEREO](reg + 1);
+	uint8_t oldFine = getRegister(chips, reg);
+	uint8_t oldRough = getRegister(chips, reg + 1);
 
 	// shift lower 4 bits of oldRough measurement up 8 bits and add oldFine; giving 12-bit number [0..4095]
 	uint16_t buf = (uint16_t) (oldRough & B00001111);
@@ -317,36 +1787,14 @@ void setChannelFreqLsb(byte channel, byte reg, byte value) {
 	uint8_t newRough = ((uint8_t) (buf >> 8)) & B00001111; // upper 4 bits
 
 	// update
-	switch (channel) {
-	case CHANNEL_RAW_STEREO:
-		rawRegisters0[reg] = newFine;
-		rawRegisters0[reg + 1] = newRough;
-		rawRegisters1[reg] = newFine;
-		rawRegisters1[reg + 1] = newRough;
-		break;
-	case CHANNEL_RAW_LEFT:
-		rawRegisters1[reg] = newFine;
-		rawRegisters1[reg + 1] = newRough;
-		break;
-	case CHANNEL_RAW_RIGHT:
-		rawRegisters0[reg] = newFine;
-		rawRegisters0[reg + 1] = newRough;
-		break;
-	}
-	if (!latched) {
-		setters[channel - CHANNEL_RAW_STEREO](reg, newFine);
-		setters[channel - CHANNEL_RAW_STEREO](reg + 1, newRough);
-	}
+	setRegister(chips, reg, newFine);
+	setRegister(chips, reg + 1, newRough);
 }
 
-void setEnvelopeFreqHigh(byte channel, byte value) {
-	if (!isRawMode(channel)) {
-		return;
-	}
-
+void setEnvelopeFreqHigh(byte chips, byte value) {
 	// get current value
-	uint8_t oldFine = getters[channel - CHANNEL_RAW_STEREO](0x0b);
-	uint8_t oldRough = getters[channel - CHANNEL_RAW_STEREO](0x0c);
+	uint8_t oldFine = getRegister(chips, 0x0b);
+	uint8_t oldRough = getRegister(chips, 0x0c);
 
 	// shift lower 8 bits of oldRough measurement up 8 bits and add oldFine; giving 16-bit number
 	uint16_t buf = oldRough;
@@ -368,36 +1816,14 @@ void setEnvelopeFreqHigh(byte channel, byte value) {
 	uint8_t newRough = ((uint8_t) (buf >> 8)); // upper 8 bits
 
 	// update
-	switch (channel) {
-	case CHANNEL_RAW_STEREO:
-		rawRegisters0[0xb] = newFine;
-		rawRegisters0[0xc] = newRough;
-		rawRegisters1[0xb] = newFine;
-		rawRegisters1[0xc] = newRough;
-		break;
-	case CHANNEL_RAW_LEFT:
-		rawRegisters1[0xb] = newFine;
-		rawRegisters1[0x6] = newRough;
-		break;
-	case CHANNEL_RAW_RIGHT:
-		rawRegisters0[0xb] = newFine;
-		rawRegisters0[0x6] = newRough;
-		break;
-	}
-	if (!latched) {
-		setters[channel - CHANNEL_RAW_STEREO](0xb, newFine);
-		setters[channel - CHANNEL_RAW_STEREO](0xc, newRough);
-	}
+	setRegister(chips, 0x0b, newFine);
+	setRegister(chips, 0x0c, newRough);
 }
 
-void setEnvelopeFreqMed(byte channel, byte value) {
-	if (!isRawMode(channel)) {
-		return;
-	}
-
+void setEnvelopeFreqMed(byte chips, byte value) {
 	// get current value
-	uint8_t oldFine = getters[channel - CHANNEL_RAW_STEREO](0x0b);
-	uint8_t oldRough = getters[channel - CHANNEL_RAW_STEREO](0x0c);
+	uint8_t oldFine = getRegister(chips, 0x0b);
+	uint8_t oldRough = getRegister(chips, 0x0c);
 
 	// shift lower 8 bits of oldRough measurement up 8 bits and add oldFine; giving 16-bit number
 	uint16_t buf = oldRough;
@@ -419,36 +1845,14 @@ void setEnvelopeFreqMed(byte channel, byte value) {
 	uint8_t newRough = ((uint8_t) (buf >> 8)); // upper 8 bits
 
 	// update
-	switch (channel) {
-	case CHANNEL_RAW_STEREO:
-		rawRegisters0[0xb] = newFine;
-		rawRegisters0[0xc] = newRough;
-		rawRegisters1[0xb] = newFine;
-		rawRegisters1[0xc] = newRough;
-		break;
-	case CHANNEL_RAW_LEFT:
-		rawRegisters1[0xb] = newFine;
-		rawRegisters1[0x6] = newRough;
-		break;
-	case CHANNEL_RAW_RIGHT:
-		rawRegisters0[0xb] = newFine;
-		rawRegisters0[0x6] = newRough;
-		break;
-	}
-	if (!latched) {
-		setters[channel - CHANNEL_RAW_STEREO](0xb, newFine);
-		setters[channel - CHANNEL_RAW_STEREO](0xc, newRough);
-	}
+	setRegister(chips, 0x0b, newFine);
+	setRegister(chips, 0x0c, newRough);
 }
 
-void setEnvelopeFreqLow(byte channel, byte value) {
-	if (!isRawMode(channel)) {
-		return;
-	}
-
+void setEnvelopeFreqLow(byte chips, byte value) {
 	// get current value
-	uint8_t oldFine = getters[channel - CHANNEL_RAW_STEREO](0x0b);
-	uint8_t oldRough = getters[channel - CHANNEL_RAW_STEREO](0x0c);
+	uint8_t oldFine = getRegister(chips, 0x0b);
+	uint8_t oldRough = getRegister(chips, 0x0c);
 
 	// shift lower 8 bits of oldRough measurement up 8 bits and add oldFine; giving 16-bit number
 	uint16_t buf = oldRough;
@@ -470,127 +1874,422 @@ void setEnvelopeFreqLow(byte channel, byte value) {
 	uint8_t newRough = ((uint8_t) (buf >> 8)); // upper 8 bits
 
 	// update
-	switch (channel) {
-	case CHANNEL_RAW_STEREO:
-		rawRegisters0[0xb] = newFine;
-		rawRegisters0[0xc] = newRough;
-		rawRegisters1[0xb] = newFine;
-		rawRegisters1[0xc] = newRough;
-		break;
-	case CHANNEL_RAW_LEFT:
-		rawRegisters1[0xb] = newFine;
-		rawRegisters1[0x6] = newRough;
-		break;
-	case CHANNEL_RAW_RIGHT:
-		rawRegisters0[0xb] = newFine;
-		rawRegisters0[0x6] = newRough;
-		break;
-	}
-	if (!latched) {
-		setters[channel - CHANNEL_RAW_STEREO](0xb, newFine);
-		setters[channel - CHANNEL_RAW_STEREO](0xc, newRough);
-	}
+	setRegister(chips, 0x0b, newFine);
+	setRegister(chips, 0x0c, newRough);
 }
+#endif
 
-void setRegister(byte channel, byte reg, byte value) {
-	switch (channel) {
-	case CHANNEL_RAW_STEREO:
-		rawRegisters0[reg] = value;
-		rawRegisters1[reg] = value;
-		if (!latched) {
-			YMZ.setRegisterPsg(reg, value);
-		}
+#if YMZ_MUSIC
+/**
+ * Controllers on the music channels.
+ */
+void musicControlChange(byte chips, byte number, byte value) {
+	byte image = musicImage(chips);
+	switch (number) {
+	case CC_PORTAMENTO_TIME:
+		portamentoTime[image] = value;
+		break;
+	case CC_VOLUME:
+		volumes[image] = value;
+		updateDynamics(image);
 		break;
-	case CHANNEL_RAW_LEFT:
-		rawRegisters1[reg] = value;
-		if (!latched) {
-			YMZ.setRegisterPsg1(reg, value);
+	case CC_EXPRESSION:
+		expressions[image] = value;
+		updateDynamics(image);
+		break;
+	case CC_CHORD:
+		if (value < CHORD_COUNT) {
+			chords[image] = value;
 		}
 		break;
-	case CHANNEL_RAW_RIGHT:
-		rawRegisters0[reg] = value;
-		if (!latched) {
-			YMZ.setRegisterPsg0(reg, value);
+	case CC_ARP_PATTERN:
+		if (value < ARP_PATTERN_COUNT) {
+			arpPatterns[image] = value;
 		}
 		break;
-	default:
-		return;
-	}
-}
-
-void handleControlChange(byte channel, byte number, byte value) {
-	if (!isRawMode(channel)) {
-		return;
-	}
-	switch (channel) {
-	case CHANNEL_RAW_STEREO:
-		midiActivity(PINK_LED);
-		midiActivity(WHITE_LED);
+	case CC_ARP_RATE:
+		arpRates[image] = (value < ARP_RATE_COUNT) ? value : ARP_RATE_COUNT - 1;
 		break;
-	case CHANNEL_RAW_LEFT:
-		midiActivity(PINK_LED);
+	case CC_ARP_OCTAVES:
+		arpOctaves[image] = constrain(value, 1, ARP_OCTAVES);
 		break;
-	case CHANNEL_RAW_RIGHT:
-		midiActivity(WHITE_LED);
+	case CC_PORTAMENTO:
+		portamento[image] = (value > 63);
 		break;
 	}
+}
+#endif
+
+#if YMZ_RAW
+/**
+ * Controllers on the raw channels, each a register or part of a period.
+ */
+void rawControlChange(byte chips, byte number, byte value) {
+	routeActivity(chips, PINK_LED, WHITE_LED);
 
 	value &= B01111111; // make 7-bit clean
 
 	switch (number) {
 	case CC_CHANNEL_A_FREQ_MSB:
-		setChannelFreqMsb(channel, 0x00, value);
+		setChannelFreqMsb(chips, 0x00, value);
 		break;
 	case CC_CHANNEL_B_FREQ_MSB:
-		setChannelFreqMsb(channel, 0x02, value);
+		setChannelFreqMsb(chips, 0x02, value);
 		break;
 	case CC_CHANNEL_C_FREQ_MSB:
-		setChannelFreqMsb(channel, 0x04, value);
+		setChannelFreqMsb(chips, 0x04, value);
 		break;
 	case CC_CHANNEL_A_FREQ_LSB:
-		setChannelFreqLsb(channel, 0x00, value);
+		setChannelFreqLsb(chips, 0x00, value);
 		break;
 	case CC_CHANNEL_B_FREQ_LSB:
-		setChannelFreqLsb(channel, 0x02, value);
+		setChannelFreqLsb(chips, 0x02, value);
 		break;
 	case CC_CHANNEL_C_FREQ_LSB:
-		setChannelFreqLsb(channel, 0x04, value);
+		setChannelFreqLsb(chips, 0x04, value);
 		break;
 	case CC_NOISE_FREQ: // 5 bits
-		setRegister(channel, 0x06, (value >> 2) & B00011111); // 7 -> 5 bits
+		setRegister(chips, 0x06, (value >> 2) & B00011111); // 7 -> 5 bits
 		break;
 	case CC_MIXER:
-		setRegister(channel, 0x07, (value >> 1) & B00111111); // 7 -> 6 bits
+		setRegister(chips, 0x07, (value >> 1) & B00111111); // 7 -> 6 bits
 		break;
 	case CC_CHANNEL_A_LEVEL:
-		setRegister(channel, 0x08, (value >> 2) & B00011111); // 7 -> 5 bits
+		setRegister(chips, 0x08, (value >> 2) & B00011111); // 7 -> 5 bits
 		break;
 	case CC_CHANNEL_B_LEVEL:
-		setRegister(channel, 0x09, (value >> 2) & B00011111); // 7 -> 5 bits
+		setRegister(chips, 0x09, (value >> 2) & B00011111); // 7 -> 5 bits
 		break;
 	case CC_CHANNEL_C_LEVEL:
-		setRegister(channel, 0x0a, (value >> 2) & B00011111); // 7 -> 5 bits
+		setRegister(chips, 0x0a, (value >> 2) & B00011111); // 7 -> 5 bits
 		break;
 	case CC_ENVELOPE_FREQ_HIGH:
-		setEnvelopeFreqHigh(channel, value);
+		setEnvelopeFreqHigh(chips, value);
 		break;
 	case CC_ENVELOPE_FREQ_MED:
-		setEnvelopeFreqMed(channel, value);
+		setEnvelopeFreqMed(chips, value);
 		break;
 	case CC_ENVELOPE_FREQ_LOW:
-		setEnvelopeFreqLow(channel, value);
+		setEnvelopeFreqLow(chips, value);
 		break;
 	case CC_ENVELOPE_SHAPE:
-		setRegister(channel, 0x0d, (value >> 3) & B00001111); // 7 -> 4 bits
+		setRegister(chips, 0x0d, (value >> 3) & B00001111); // 7 -> 4 bits
 		break;
 	case CC_LATCH:
-		latched = (value > 64);
-		if (!latched) {
-			writeAllRegisters(channel);
+		// every message is read inside a burst, whose end commits once
+		// the latch is up
+		latchHeld = (value > 64);
+		if (latchHeld && !latched) {
+			latchRegisters();
+		}
+		break;
+#if YMZ_SMOOTH
+	case CC_FREQ_SLEW:
+		setSlew(chips, SLEW_FREQ, value);
+		break;
+	case CC_NOISE_SLEW:
+		setSlew(chips, SLEW_NOISE, value);
+		break;
+	case CC_LEVEL_SLEW:
+		setSlew(chips, SLEW_LEVEL, value);
+		break;
+#endif
+	}
+}
+
+/**
+ * Stage raw writes for the messages about to run, so that a burst of
+ * controllers, such as the MSB and LSB of a frequency, reaches the chips
+ * as one commit instead of a read-modify-write and its writes for each.
+ * Writes still land in the order they came: anything else that writes the
+ * chips during the burst commits what is staged first (see flushBurst()),
+ * and arpeggio steps clocked during it wait for the commit.
+ * While the UART carries register frames, frames chained with
+ * REGSTREAM_MORE own the staged image and there is no burst.
+ */
+void beginBurst() {
+#if YMZ_REGSTREAM
+	if (serialStreaming) {
+		return;
+	}
+#endif
+	bursting = true;
+	if (!latched) {
+		latchRegisters();
+	}
+}
+
+/**
+ * Write what the burst has staged so far, ahead of a message that writes
+ * the chips some other way, and go on staging. Writes held by CC_LATCH
+ * stay held and land on its release, as they always have.
+ */
+void flushBurst() {
+	if (bursting && !latchHeld && (stagedDirty[0] | stagedDirty[1])) {
+		commitRegisters();
+		latchRegisters();
+	}
+#if YMZ_MUSIC
+	playPendingArp();
+#endif
+}
+
+/**
+ * Commit what the burst staged, unless CC_LATCH is holding it, then any
+ * arpeggio step that came during the burst.
+ */
+void endBurst() {
+	if (!bursting) {
+		return;
+	}
+	if (latched && !latchHeld) {
+		if (stagedDirty[0] | stagedDirty[1]) {
+			commitRegisters();
+		} else {
+			latched = false;
+		}
+	}
+	bursting = false;
+#if YMZ_MUSIC
+	playPendingArp();
+#endif
+}
+#endif
+
+void ignoreNote(byte chips, byte pitch, byte velocity) {
+}
+
+void ignoreControl(byte chips, byte number, byte value) {
+}
+
+void ignoreValue(byte chips, byte value) {
+}
+
+// a route kind compiled out (feature.h) is ignored like a channel routed off
+#if !YMZ_MUSIC
+#define musicNoteOn ignoreNote
+#define musicNoteOff ignoreNote
+#define musicAfterTouchPoly ignoreNote
+#define musicControlChange ignoreControl
+#define musicProgramChange ignoreValue
+#define musicAfterTouch ignoreValue
+#endif
+#if !YMZ_RAW
+#define rawControlChange ignoreControl
+#endif
+#if !YMZ_SAMPLES
+#define sampleNoteOn ignoreNote
+#define sampleProgramChange ignoreValue
+#endif
+
+// handlers for each route kind: off, music, noise, raw and sample; samples
+// are one-shots, so they ignore note-off
+const noteHandler noteOnHandlers[ROUTE_KIND_COUNT] =
+		{ &ignoreNote, &musicNoteOn, &ignoreNote, &ignoreNote, &sampleNoteOn };
+const noteHandler noteOffHandlers[ROUTE_KIND_COUNT] =
+		{ &ignoreNote, &musicNoteOff, &ignoreNote, &ignoreNote, &ignoreNote };
+const noteHandler polyPressureHandlers[ROUTE_KIND_COUNT] =
+		{ &ignoreNote, &musicAfterTouchPoly, &ignoreNote, &ignoreNote, &ignoreNote };
+const controlHandler controlHandlers[ROUTE_KIND_COUNT] =
+		{ &ignoreControl, &musicControlChange, &ignoreControl, &rawControlChange, &ignoreControl };
+const valueHandler programHandlers[ROUTE_KIND_COUNT] =
+		{ &ignoreValue, &musicProgramChange, &ignoreValue, &ignoreValue, &sampleProgramChange };
+const valueHandler pressureHandlers[ROUTE_KIND_COUNT] =
+		{ &ignoreValue, &musicAfterTouch, &ignoreValue, &ignoreValue, &ignoreValue };
+
+/**
+ * Commit staged raw writes before a message for any other kind of channel
+ * runs, so the chips see writes in the order they arrived.
+ */
+void inline keepOrder(byte route) {
+#if YMZ_RAW
+	if (routeKind(route) != ROUTE_RAW) {
+		flushBurst();
+	}
+#endif
+}
+
+/**
+ * Hold a channel message back for its time, when scheduling is on.
+ */
+bool inline deferred(byte type, byte channel, byte data1, byte data2) {
+#if YMZ_SCHEDULE
+	return deferMessage(type | (channel - 1), data1, data2);
+#else
+	return false;
+#endif
+}
+
+/**
+ * MIDI channel messages go to the handler their channel is routed to.
+ */
+void handleNoteOn(byte channel, byte pitch, byte velocity) {
+	if (deferred(midi::NoteOn, channel, pitch, velocity)) {
+		return;
+	}
+	byte route = routes[channel - 1];
+	keepOrder(route);
+	noteOnHandlers[routeKind(route)](routeChips(route), pitch, velocity);
+}
+
+void handleNoteOff(byte channel, byte pitch, byte velocity) {
+	if (deferred(midi::NoteOff, channel, pitch, velocity)) {
+		return;
+	}
+	byte route = routes[channel - 1];
+	keepOrder(route);
+	noteOffHandlers[routeKind(route)](routeChips(route), pitch, velocity);
+}
+
+void handleAfterTouchPoly(byte channel, byte pitch, byte pressure) {
+	if (deferred(midi::AfterTouchPoly, channel, pitch, pressure)) {
+		return;
+	}
+	byte route = routes[channel - 1];
+	keepOrder(route);
+	polyPressureHandlers[routeKind(route)](routeChips(route), pitch, pressure);
+}
+
+void handleControlChange(byte channel, byte number, byte value) {
+	if (deferred(midi::ControlChange, channel, number, value)) {
+		return;
+	}
+	byte route = routes[channel - 1];
+	keepOrder(route);
+	controlHandlers[routeKind(route)](routeChips(route), number, value);
+}
+
+void handleProgramChange(byte channel, byte number) {
+	if (deferred(midi::ProgramChange, channel, number, 0)) {
+		return;
+	}
+	byte route = routes[channel - 1];
+	keepOrder(route);
+	programHandlers[routeKind(route)](routeChips(route), number);
+}
+
+void handleAfterTouchChannel(byte channel, byte pressure) {
+	if (deferred(midi::AfterTouchChannel, channel, pressure, 0)) {
+		return;
+	}
+	byte route = routes[channel - 1];
+	keepOrder(route);
+	pressureHandlers[routeKind(route)](routeChips(route), pressure);
+}
+
+#if YMZ_SCHEDULE
+/**
+ * A channel message whose time has come, through its handler as if just
+ * read.
+ */
+void runMessage(byte status, byte data1, byte data2) {
+	byte channel = (status & 0x0f) + 1;
+	switch (status & 0xf0) {
+	case midi::NoteOn:
+		handleNoteOn(channel, data1, data2);
+		break;
+	case midi::NoteOff:
+		handleNoteOff(channel, data1, data2);
+		break;
+	case midi::AfterTouchPoly:
+		handleAfterTouchPoly(channel, data1, data2);
+		break;
+	case midi::ControlChange:
+		handleControlChange(channel, data1, data2);
+		break;
+	case midi::ProgramChange:
+		handleProgramChange(channel, data1);
+		break;
+	case midi::AfterTouchChannel:
+		handleAfterTouchChannel(channel, data1);
+		break;
+	}
+}
+#endif
+
+/**
+ * Process SysEx messages. The array includes the F0 and F7 boundaries.
+ */
+void handleSystemExclusive(byte * data, unsigned size) {
+#if YMZ_RAW
+	// the handlers write the chips themselves, after what came before
+	flushBurst();
+#endif
+#if YMZ_TUNING
+	if (isTuningMessage(data, size)) {
+		applyTuning(data, size);
+		return;
+	}
+#endif
+	if (size < 4 || data[1] != SYSEX_ID) {
+		return;
+	}
+	switch (data[2]) {
+#if YMZ_MUSIC
+	case SYSEX_PATCH_STORE:
+		sysexPatchStore(data, size);
+		break;
+#endif
+#if YMZ_TRACE
+	case SYSEX_TRACE:
+		sysexTrace(data, size);
+		break;
+#endif
+#if YMZ_STREAM
+	case SYSEX_STREAM:
+		sysexStream(data, size);
+		break;
+	case SYSEX_STREAM_END:
+		sysexStreamEnd();
+		break;
+#endif
+#if YMZ_REGSTREAM
+	case SYSEX_SERIAL:
+		// the UART changes over between MIDI messages, from loop()
+		if (size == 5 && regStreamBaud(data[3])) {
+			serialRequest = data[3];
 		}
+		break;
+#endif
+	case SYSEX_ROUTE:
+		sysexRoute(data, size);
+		break;
+#if YMZ_SCHEDULE
+	case SYSEX_SCHEDULE:
+		sysexSchedule(data, size);
+		break;
+#endif
 	}
 }
 
+/**
+ * MIDI real-time messages. Start or Continue hands the tempo engine over to
+ * the sender's clock; it stays external until the next reset.
+ */
+void handleClock() {
+	if (YMZ.getClockSource() == CLOCK_EXTERNAL) {
+		YMZ.clock();
+#if YMZ_RAW
+		// an arpeggio step the tick played goes out after the staged writes
+		flushBurst();
+#endif
+	}
+}
+
+void handleStart() {
+	YMZ.setClockSource(CLOCK_EXTERNAL);
+	YMZ.startClock();
+}
+
+void handleContinue() {
+	YMZ.setClockSource(CLOCK_EXTERNAL);
+	YMZ.continueClock();
+}
+
+void handleStop() {
+	YMZ.stopClock();
+}
+
 void setup() {
 	for (int i = 0; i < LED_COUNT; i++) {
 		pinMode(LEDS[i], OUTPUT);
@@ -613,14 +2312,36 @@ void setup() {
 	MIDI.setHandleNoteOn(handleNoteOn);
 	MIDI.setHandleNoteOff(handleNoteOff);
 	MIDI.setHandleControlChange(handleControlChange);
-
-	// listen to all channels
-	MIDI.begin(MIDI_CHANNEL_OMNI);
-	MIDI.turnThruOff();
-
-	// default volume for music
+	MIDI.setHandleProgramChange(handleProgramChange);
+	MIDI.setHandleAfterTouchChannel(handleAfterTouchChannel);
+	MIDI.setHandleAfterTouchPoly(handleAfterTouchPoly);
+	MIDI.setHandleSystemExclusive(handleSystemExclusive);
+	MIDI.setHandleClock(handleClock);
+	MIDI.setHandleStart(handleStart);
+	MIDI.setHandleContinue(handleContinue);
+	MIDI.setHandleStop(handleStop);
+#if YMZ_SCHEDULE
+	beginSchedule(runMessage);
+#endif
+#if YMZ_MUSIC
+	YMZ.setClockHandler(arpClock);
+#endif
+
+	// listen to all channels, through the stored routes
+	loadRoutes(routes);
+	beginMidi();
+
+	// default volume for songs from the player; music channels scale
+	// patch levels by their own dynamics
 	YMZ.setVolume(10);
 
+#if YMZ_MUSIC
+	// every music channel starts on the first factory patch
+	for (byte image = 0; image < 3; image++) {
+		selectProgram(image, 0);
+	}
+#endif
+
 	// let the user know we're ready to go by flashing all the lights
 	for (int i = 0; i < LED_COUNT; i++) {
 		digitalWrite(LEDS[i], HIGH);
@@ -631,7 +2352,71 @@ void setup() {
 }
 
 void loop() {
+#if YMZ_SCHEDULE
+	noticeMidi();
+#if YMZ_RAW
+	beginBurst();
+	runSchedule();
+	endBurst();
+#else
+	runSchedule();
+#endif
+#endif
 	decayLeds();
-	MIDI.read();
+#if YMZ_MUSIC
+	updateEnvelopes();
+	updateGlides();
+#endif
+#if YMZ_SMOOTH
+	updateSmoothing();
+#endif
+#if YMZ_REGSTREAM
+	if (serialStreaming) {
+		pollRegisterStream();
+#if YMZ_STREAM
+		player.poll();
+#endif
+		return;
+	}
+#endif
+	// everything received is read now, with raw writes staged and
+	// committed once at the end, so a burst of controllers costs one write
+	// per register it changes and no intermediate values reach the chips
+#if YMZ_RAW
+	beginBurst();
+#endif
+	do {
+#if YMZ_SCHEDULE
+		noticeMidi();
+		takeStamp();
+#endif
+#if YMZ_TUNING
+		if (Serial.available()) {
+			takeTuningByte(Serial.peek());
+		}
+#endif
+		MIDI.read();
+	} while (Serial.available());
+#if YMZ_RAW
+	endBurst();
+#endif
+#if YMZ_REGSTREAM
+	if (serialRequest != OFF) {
+		beginSerialStream(serialRequest);
+		serialRequest = OFF;
+		return;
+	}
+#endif
+#if YMZ_TRACE
+	if (tracing) {
+		flushTrace();
+	}
+#endif
+#if YMZ_STREAM
+	player.poll();
+	if (streaming) {
+		grantStream();
+	}
+#endif
 }
 
@@ -5,10 +5,25 @@
 #include "MIDI.h"
 #include "MIDI.hpp"
 #include "hcYmzShield.h"
+#include "hcYmzPlayer.h"
+#include "chord.h"
+#include "expression.h"
+#include "feature.h"
+#include "patch.h"
+#include "regstream.h"
+#include "route.h"
+#include "sample.h"
+#include "schedule.h"
+#include "tuning.h"
 
 typedef void (*regSet)(byte, byte);
 typedef byte (*regGet)(byte);
 
+// MIDI channel message handlers, called with the route's target chips
+typedef void (*noteHandler)(byte, byte, byte);
+typedef void (*controlHandler)(byte, byte, byte);
+typedef void (*valueHandler)(byte, byte);
+
 #ifdef __cplusplus
 extern "C" {
 #endif